@@ -19,11 +19,38 @@
 * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+/* For CPU_SET () and pthread_setaffinity_np () */
+#define _GNU_SOURCE
+
 // must be the first include
 #include "fdsetsize.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <sched.h>
+
 #include "batch.h"
 
+/* 
+   Inter-arrival times are precomputed for a minute of the request rate,
+   but not less than ARRIVAL_IA_NUM_MIN and not more than ARRIVAL_IA_NUM_MAX.
+*/
+#define ARRIVAL_IA_SECONDS 60
+#define ARRIVAL_IA_NUM_MIN 1024
+#define ARRIVAL_IA_NUM_MAX (1 << 20)
+
+static int arrival_trace_load (batch_context* bctx);
+static void arrival_poisson_fill (batch_context* bctx, unsigned short xsubi[3]);
+static void arrival_mmpp_fill (batch_context* bctx, unsigned short xsubi[3]);
+
+static batch_share* share_create (int share_data);
+static void share_lock_func (CURL* handle, curl_lock_data data, 
+                             curl_lock_access access, void* userptr);
+static void share_unlock_func (CURL* handle, curl_lock_data data, void* userptr);
+
 int is_batch_group_leader (batch_context* bctx)
 {
   return !bctx->batch_id;
@@ -47,3 +74,519 @@ size_t next_ipv6_shared_index (batch_context* bctx)
 
   return to_return;
 }
+
+/****************************************************************************************
+* Function name - batch_cpu_affinity_online
+*
+* Description - Fills the batch list of CPUs for threads affinity by all CPUs, 
+*               which the process is allowed to run on.
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - On success - number of CPUs, on error - (-1)
+****************************************************************************************/
+int batch_cpu_affinity_online (batch_context* bctx)
+{
+  cpu_set_t cpus;
+  int cpu, cpus_num = 0;
+
+  CPU_ZERO (&cpus);
+
+  if (sched_getaffinity (0, sizeof (cpus), &cpus) == -1)
+    {
+      fprintf (stderr, "%s - error: sched_getaffinity () failed.\n", __func__);
+      return -1;
+    }
+
+  free (bctx->cpu_affinity);
+
+  if (! (bctx->cpu_affinity = calloc (CPU_COUNT (&cpus), sizeof (int))))
+    {
+      fprintf (stderr, "%s - error: calloc () failed.\n", __func__);
+      return -1;
+    }
+
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+      if (CPU_ISSET (cpu, &cpus))
+        {
+          bctx->cpu_affinity[cpus_num++] = cpu;
+        }
+    }
+
+  return (bctx->cpu_affinity_num = cpus_num);
+}
+
+/****************************************************************************************
+* Function name - batch_cpu_affinity_set
+*
+* Description - Pins the calling thread to the CPU of the batch, taken from the batch 
+*               list of CPUs by the batch id. Memory allocated by the thread afterwards
+*               is first-touched and, thus, placed at the local NUMA node.
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - On success - 0, on error - (-1)
+****************************************************************************************/
+int batch_cpu_affinity_set (batch_context* bctx)
+{
+  cpu_set_t cpus;
+  int cpu;
+
+  if (! bctx->cpu_affinity_num)
+    return 0;
+
+  cpu = bctx->cpu_affinity[bctx->batch_id % bctx->cpu_affinity_num];
+
+  CPU_ZERO (&cpus);
+  CPU_SET (cpu, &cpus);
+
+  if (pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus))
+    {
+      fprintf (stderr, "%s - error: failed to pin batch \"%s\" to CPU %d.\n", 
+               __func__, bctx->batch_name, cpu);
+      return -1;
+    }
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - batch_arrival_init
+*
+* Description - Precomputes inter-arrival times of the fixed rate requests in usec
+*               by the batch arrival process. Random processes use the same seed
+*               for a batch in every run, thus the runs are comparable.
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - On success - 0, on error - (-1)
+****************************************************************************************/
+int batch_arrival_init (batch_context* bctx)
+{
+  unsigned short xsubi[3] = {0x330E, 0, 0};
+  size_t ia_num = 0;
+
+  free (bctx->arrival_ia);
+  bctx->arrival_ia = 0;
+  bctx->arrival_ia_num = 0;
+  bctx->arrival_offset = 0;
+
+  if (bctx->arrival_process == ARRIVAL_UNIFORM || !bctx->req_rate)
+    return 0;
+
+  if (bctx->arrival_process == ARRIVAL_TRACE)
+    return arrival_trace_load (bctx);
+
+  if (bctx->arrival_process == ARRIVAL_MMPP &&
+      bctx->arrival_burst_ratio * bctx->arrival_burst_msec > 
+      (double) (bctx->arrival_burst_msec + bctx->arrival_idle_msec))
+    {
+      fprintf (stderr, "%s - error: MMPP burst ratio %.2f is above the maximum %.2f "
+               "for the burst and idle durations.\n", __func__, 
+               bctx->arrival_burst_ratio, 
+               (double) (bctx->arrival_burst_msec + bctx->arrival_idle_msec) / 
+               bctx->arrival_burst_msec);
+      return -1;
+    }
+
+  ia_num = (size_t) bctx->req_rate * ARRIVAL_IA_SECONDS;
+  if (ia_num < ARRIVAL_IA_NUM_MIN)
+    ia_num = ARRIVAL_IA_NUM_MIN;
+  else if (ia_num > ARRIVAL_IA_NUM_MAX)
+    ia_num = ARRIVAL_IA_NUM_MAX;
+
+  if (! (bctx->arrival_ia = calloc (ia_num, sizeof (unsigned long))))
+    {
+      fprintf (stderr, "%s - error: calloc () failed.\n", __func__);
+      return -1;
+    }
+  bctx->arrival_ia_num = ia_num;
+
+  xsubi[1] = (unsigned short) bctx->batch_id;
+
+  if (bctx->arrival_process == ARRIVAL_POISSON)
+    arrival_poisson_fill (bctx, xsubi);
+  else
+    arrival_mmpp_fill (bctx, xsubi);
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - batch_arrival_split
+*
+* Description - Takes a share of the inter-arrival times of a batch for a sub-batch
+*               (thread): sub-batch <index> of <num> starts each <num>-th request
+*               of the schedule, which is repeated <num> times, beginning with
+*               request <index>. Its first request comes after the sum of the
+*               <index> first inter-arrival times, thus the sub-batches, started
+*               together, keep the arrival process of the batch.
+*
+* Input -       *bctx  - pointer to the sub-batch context
+*               *ia    - inter-arrival times of the batch, usec
+*               ia_num - number of the inter-arrival times
+*               index  - index of the sub-batch
+*               num    - number of the sub-batches
+* Return Code/Output - On success - 0, on error - (-1)
+****************************************************************************************/
+int batch_arrival_split (batch_context* bctx, 
+                         const unsigned long* ia, 
+                         size_t ia_num, 
+                         int index, 
+                         int num)
+{
+  size_t i;
+  int k;
+
+  bctx->arrival_ia = 0;
+  bctx->arrival_ia_num = 0;
+  bctx->arrival_offset = 0;
+
+  if (! ia_num)
+    return 0;
+
+  if (! (bctx->arrival_ia = calloc (ia_num, sizeof (unsigned long))))
+    {
+      fprintf (stderr, "%s - error: calloc () failed.\n", __func__);
+      return -1;
+    }
+  bctx->arrival_ia_num = ia_num;
+
+  /* The first own request is request <index> of the batch */
+  for (k = 0; k < index; k++)
+    bctx->arrival_offset += ia[k % ia_num];
+
+  /* Interval between the own requests is the sum of <num> intervals of the batch */
+  for (i = 0; i < ia_num; i++)
+    {
+      for (k = 0; k < num; k++)
+        bctx->arrival_ia[i] += ia[(index + i * num + k) % ia_num];
+    }
+
+  return 0;
+}
+
+/*
+  Returns an exponentially distributed random interval in usec 
+  for events with <rate> per second.
+*/
+static double arrival_exp_usec (unsigned short xsubi[3], double rate)
+{
+  /* 1 - U is in (0, 1] */
+  return -log (1.0 - erand48 (xsubi)) * 1000000.0 / rate;
+}
+
+/*
+  Keeps arrival times as double and rounds each of them to usec, 
+  so that the rounding errors of inter-arrival times are not accumulated.
+*/
+static void arrival_ia_put (batch_context* bctx, size_t i, 
+                            double time, unsigned long long* last)
+{
+  const unsigned long long usec = (unsigned long long) llround (time);
+
+  bctx->arrival_ia[i] = (unsigned long) (usec - *last);
+  *last = usec;
+}
+
+/****************************************************************************************
+* Function name - arrival_poisson_fill
+*
+* Description - Fills inter-arrival times of a Poisson process with the REQ_RATE
+*
+* Input -       *bctx - pointer to the batch context
+*               xsubi - state of the random numbers generator
+* Return Code/Output - None
+****************************************************************************************/
+static void arrival_poisson_fill (batch_context* bctx, unsigned short xsubi[3])
+{
+  unsigned long long last = 0;
+  double time = 0.0;
+  size_t i;
+
+  for (i = 0; i < bctx->arrival_ia_num; i++)
+    {
+      time += arrival_exp_usec (xsubi, bctx->req_rate);
+      arrival_ia_put (bctx, i, time, &last);
+    }
+}
+
+/****************************************************************************************
+* Function name - arrival_mmpp_fill
+*
+* Description - Fills inter-arrival times of a two-state Markov-modulated Poisson 
+*               process. The burst and idle states last exponentially distributed 
+*               times with the configured means. The burst state has the rate of 
+*               REQ_RATE multiplied by the burst ratio, the idle state has the rate 
+*               keeping the mean rate equal to REQ_RATE, which is zero for 
+*               on-off bursts.
+*
+* Input -       *bctx - pointer to the batch context
+*               xsubi - state of the random numbers generator
+* Return Code/Output - None
+****************************************************************************************/
+static void arrival_mmpp_fill (batch_context* bctx, unsigned short xsubi[3])
+{
+  const double burst_share = (double) bctx->arrival_burst_msec / 
+    (bctx->arrival_burst_msec + bctx->arrival_idle_msec);
+  const double burst_rate = bctx->req_rate * bctx->arrival_burst_ratio;
+  const double rate[2] = 
+    {
+      burst_rate,
+      (bctx->req_rate - burst_share * burst_rate) / (1.0 - burst_share)
+    };
+  const double mean_usec[2] = 
+    {
+      bctx->arrival_burst_msec * 1000.0, 
+      bctx->arrival_idle_msec * 1000.0
+    };
+  int state = 0;
+  double sojourn = arrival_exp_usec (xsubi, 1000000.0 / mean_usec[state]);
+  unsigned long long last = 0;
+  double time = 0.0, next = 0.0;
+  size_t i = 0;
+
+  while (i < bctx->arrival_ia_num)
+    {
+      /* Rate of the idle state is zero for on-off bursts */
+      if (rate[state] > 1e-9 && 
+          (next = arrival_exp_usec (xsubi, rate[state])) <= sojourn)
+        {
+          time += next;
+          sojourn -= next;
+          arrival_ia_put (bctx, i++, time, &last);
+        }
+      else
+        {
+          /* The process is memoryless, the next state draws a new interval */
+          time += sojourn;
+          state ^= 1;
+          sojourn = arrival_exp_usec (xsubi, 1000000.0 / mean_usec[state]);
+        }
+    }
+}
+
+/****************************************************************************************
+* Function name - arrival_trace_load
+*
+* Description - Loads inter-arrival times in usec from the trace file, one per line.
+*               Empty lines and lines starting from '#' are skipped.
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - On success - 0, on error - (-1)
+****************************************************************************************/
+static int arrival_trace_load (batch_context* bctx)
+{
+  FILE* fp = 0;
+  char line[128];
+  size_t ia_size = 0, i;
+  unsigned long* ia = 0;
+
+  if (! (fp = fopen (bctx->arrival_trace_file, "r")))
+    {
+      fprintf (stderr, "%s - error: failed to open trace file \"%s\".\n", 
+               __func__, bctx->arrival_trace_file);
+      return -1;
+    }
+
+  while (fgets (line, sizeof (line), fp))
+    {
+      char* ptr = line, *endptr = 0;
+      unsigned long usec;
+
+      while (isspace (*ptr))
+        ptr++;
+
+      if (!*ptr || *ptr == '#')
+        continue;
+
+      usec = strtoul (ptr, &endptr, 10);
+      if (endptr == ptr || (*endptr && !isspace (*endptr)))
+        {
+          fprintf (stderr, "%s - error: wrong inter-arrival time \"%s\" "
+                   "in trace file \"%s\".\n", __func__, ptr, bctx->arrival_trace_file);
+          goto error;
+        }
+
+      if (bctx->arrival_ia_num == ia_size)
+        {
+          ia_size = ia_size ? 2 * ia_size : ARRIVAL_IA_NUM_MIN;
+          if (! (ia = realloc (bctx->arrival_ia, ia_size * sizeof (unsigned long))))
+            {
+              fprintf (stderr, "%s - error: realloc () failed.\n", __func__);
+              goto error;
+            }
+          bctx->arrival_ia = ia;
+        }
+      bctx->arrival_ia[bctx->arrival_ia_num++] = usec;
+    }
+
+  fclose (fp);
+
+  /* Zero times only would start requests forever without advancing the schedule */
+  for (i = 0; i < bctx->arrival_ia_num; i++)
+    {
+      if (bctx->arrival_ia[i])
+        return 0;
+    }
+
+  fprintf (stderr, "%s - error: no positive inter-arrival times in trace file \"%s\".\n", 
+           __func__, bctx->arrival_trace_file);
+  free (bctx->arrival_ia);
+  bctx->arrival_ia = 0;
+  bctx->arrival_ia_num = 0;
+  return -1;
+
+ error:
+  fclose (fp);
+  free (bctx->arrival_ia);
+  bctx->arrival_ia = 0;
+  bctx->arrival_ia_num = 0;
+  return -1;
+}
+
+/****************************************************************************************
+* Function name - batch_share_init
+*
+* Description - Creates curl share objects of the batch thread for the combinations
+*               of TLS sessions, DNS cache and connections sharing used by urls.
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - On success - 0, on error - (-1)
+****************************************************************************************/
+int batch_share_init (batch_context* bctx)
+{
+  int i;
+
+  for (i = 0; i < bctx->urls_num; i++)
+    {
+      const int share_data = bctx->url_ctx_array[i].share_data;
+
+      if (! share_data || bctx->shares[share_data])
+        continue;
+
+      if (! (bctx->shares[share_data] = share_create (share_data)))
+        {
+          fprintf (stderr, "%s - error: share_create () failed for batch \"%s\".\n", 
+                   __func__, bctx->batch_name);
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - batch_share_release
+*
+* Description - Releases curl share objects of a batch. Should be called, when all 
+*               the threads are over, as handles of migrated clients, attached to 
+*               the objects, are cleaned up by the thread of their origin.
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - None
+****************************************************************************************/
+void batch_share_release (batch_context* bctx)
+{
+  int i, j;
+
+  for (i = 0; i <= URL_SHARE_MASK; i++)
+    {
+      batch_share* sh = bctx->shares[i];
+
+      if (! sh)
+        continue;
+
+      if (curl_share_cleanup (sh->share) != CURLSHE_OK)
+        {
+          fprintf (stderr, "%s - error: curl_share_cleanup () failed for batch \"%s\".\n", 
+                   __func__, bctx->batch_name);
+          continue;
+        }
+
+      for (j = 0; j < CURL_LOCK_DATA_LAST; j++)
+        pthread_mutex_destroy (&sh->locks[j]);
+
+      free (sh);
+      bctx->shares[i] = 0;
+    }
+}
+
+/****************************************************************************************
+* Function name - share_create
+*
+* Description - Allocates and initializes a curl share object with locks
+*
+* Input -       share_data - mask of URL_SHARE_* bits
+* Return Code/Output - On success - pointer to the object, on error - NULL
+****************************************************************************************/
+static batch_share* share_create (int share_data)
+{
+  batch_share* sh = 0;
+  int i;
+
+  if (! (sh = calloc (1, sizeof (batch_share))))
+    {
+      fprintf (stderr, "%s - error: calloc () failed.\n", __func__);
+      return 0;
+    }
+
+  if (! (sh->share = curl_share_init ()))
+    {
+      fprintf (stderr, "%s - error: curl_share_init () failed.\n", __func__);
+      free (sh);
+      return 0;
+    }
+
+  for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    pthread_mutex_init (&sh->locks[i], 0);
+
+  curl_share_setopt (sh->share, CURLSHOPT_LOCKFUNC, share_lock_func);
+  curl_share_setopt (sh->share, CURLSHOPT_UNLOCKFUNC, share_unlock_func);
+  curl_share_setopt (sh->share, CURLSHOPT_USERDATA, sh);
+
+  if ((share_data & URL_SHARE_TLS_SESSIONS && 
+       curl_share_setopt (sh->share, CURLSHOPT_SHARE, 
+                          CURL_LOCK_DATA_SSL_SESSION) != CURLSHE_OK) ||
+      (share_data & URL_SHARE_DNS && 
+       curl_share_setopt (sh->share, CURLSHOPT_SHARE, 
+                          CURL_LOCK_DATA_DNS) != CURLSHE_OK))
+    {
+      fprintf (stderr, "%s - error: curl_share_setopt () failed.\n", __func__);
+      goto error;
+    }
+
+  if (share_data & URL_SHARE_CONNECTIONS)
+    {
+#if LIBCURL_VERSION_NUM >= 0x073900
+      if (curl_share_setopt (sh->share, CURLSHOPT_SHARE, 
+                             CURL_LOCK_DATA_CONNECT) != CURLSHE_OK)
+#endif
+        {
+          fprintf (stderr, "%s - error: connections sharing is not supported "
+                   "by libcurl.\n", __func__);
+          goto error;
+        }
+    }
+
+  return sh;
+
+ error:
+  curl_share_cleanup (sh->share);
+  for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    pthread_mutex_destroy (&sh->locks[i]);
+  free (sh);
+  return 0;
+}
+
+static void share_lock_func (CURL* handle, curl_lock_data data, 
+                             curl_lock_access access, void* userptr)
+{
+  (void) handle;
+  (void) access;
+  pthread_mutex_lock (&((batch_share *) userptr)->locks[data]);
+}
+
+static void share_unlock_func (CURL* handle, curl_lock_data data, void* userptr)
+{
+  (void) handle;
+  pthread_mutex_unlock (&((batch_share *) userptr)->locks[data]);
+}
@@ -36,6 +36,13 @@
 #include "url.h"
 #include "statistics.h"
 
+struct sock_info;
+struct uring_ctx;
+struct stats_stream;
+struct log_ring;
+struct resp_capture;
+struct mpool;
+
 #define BATCH_NAME_SIZE 64
 #define BATCH_NAME_EXTRA_SIZE 12
 #define POST_BUFFER_SIZE 256
@@ -55,6 +62,26 @@ typedef enum form_usagetype
     FORM_USAGETYPE_END,
 } form_usagetype;
 
+/* Arrival processes of the fixed rate requests */
+typedef enum arrival_process_type
+{
+    ARRIVAL_UNIFORM = 0,
+    ARRIVAL_POISSON,
+    ARRIVAL_MMPP,
+    ARRIVAL_TRACE,
+} arrival_process_type;
+
+/*
+  Curl share object of a thread for a combination of the shared data.
+  Clients migrated to another thread keep their handles attached till the
+  next url, thus the share is locked.
+*/
+typedef struct batch_share
+{
+  CURLSH* share;
+  pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+} batch_share;
+
 struct client_context;
 struct event_base;
 struct event;
@@ -91,6 +118,9 @@ typedef struct batch_context
   /* Number of clients to start with */
   int client_num_start;
 
+  /* Index of the first client of a thread sub-batch among the clients of the batch */
+  int client_index_base;
+
 
 
   /* 
@@ -147,12 +177,48 @@ typedef struct batch_context
   */
   unsigned long run_time;
 
+  /*
+      List of CPUs to pin the batch threads to, by THREAD_AFFINITY tag or
+      -t auto command line option. A thread is pinned to the CPU at index
+      of its batch id modulo the list size. Empty list - no pinning.
+      Sub-batches share the list of the first batch.
+  */
+  int* cpu_affinity;
+  int cpu_affinity_num;
+
   /*
       Client fixed request rate per second.  Zero means send request after
       receiving reply.
   */
   int req_rate;
 
+  /*
+      Open-loop request rate. Each request has its intended start time by 
+      the rate schedule, and its latency is counted from that time. Requests, 
+      which could not be started due to lack of free clients, are kept as
+      backlog instead of being skipped.
+  */
+  int req_rate_open_loop;
+
+  /*
+      Arrival process of the fixed rate requests. ARRIVAL_UNIFORM spreads
+      the request rate evenly over the request rate timer invocations, 
+      other processes start each request at its own time by the precomputed
+      inter-arrival times.
+  */
+  int arrival_process;
+
+  /* 
+      MMPP arrival process: ratio of the burst request rate to the REQ_RATE,
+      mean durations (msec) of the burst and idle states.
+  */
+  double arrival_burst_ratio;
+  unsigned long arrival_burst_msec;
+  unsigned long arrival_idle_msec;
+
+  /* Trace arrival process: file with inter-arrival times in usec */
+  char arrival_trace_file[256];
+
    /* 
       User-agent string to appear in the HTTP 1/1 requests.
   */
@@ -226,6 +292,39 @@ typedef struct batch_context
   /* Request rate timer invocation sequence number within a second */
   int req_rate_timer_invocation;
 
+  /* Open-loop request rate: time (usec) of the first request by the schedule */
+  unsigned long long req_rate_start_time;
+
+  /* Open-loop request rate: number of requests, which have come due */
+  unsigned long req_rate_due_num;
+
+  /* Open-loop request rate: number of requests started */
+  unsigned long req_rate_dispatched_num;
+
+  /* 
+     Open-loop request rate: number of requests, which have not been started
+     at the timer invocation, when they came due (backlogged requests).
+  */
+  unsigned long req_rate_backlogged_num;
+
+  /* Precomputed inter-arrival times (usec) of requests, taken cyclically */
+  unsigned long* arrival_ia;
+  size_t arrival_ia_num;
+
+  /* 
+     Time (usec) of the first request after the start, by which a sub-batch
+     takes its place in the arrival process of the batch.
+  */
+  unsigned long arrival_offset;
+
+  /* Index in <arrival_ia> and time (usec) of the next request to come due */
+  size_t arrival_due_index;
+  unsigned long long arrival_due_time;
+
+  /* Index in <arrival_ia> and intended time (usec) of the next request to start */
+  size_t arrival_dispatch_index;
+  unsigned long long arrival_dispatch_time;
+
   /* Counter used mainly by smooth mode: active clients */
   int active_clients_count;
 
@@ -249,9 +348,6 @@ typedef struct batch_context
   /*  Waiting queue timeouts in smooth mode */
   timer_queue* waiting_queue;
 
-  /* The timer-node for timer testing the logfile size */
-  timer_node logfile_timer_node;
-
   /* The timer-node for timer to add more clients during ramp-up period. */
   timer_node clients_num_inc_timer_node;
 
@@ -261,6 +357,39 @@ typedef struct batch_context
   /* The timer-node for fixed request rate timer. */
   timer_node req_rate_timer_node;
 
+  /* The timer-node for timer rebalancing clients between threads. */
+  timer_node rebalance_timer_node;
+
+  /* 
+     Event loop lag: running average of timers dispatching lateness in msec.
+     Written by the batch thread, read by other threads.
+  */
+  int loop_lag;
+
+  /* 
+     Clients migrated to the batch by other threads, but still not taken to
+     the batch waiting queue. Protected by migrate_lock.
+  */
+  pthread_mutex_t migrate_lock;
+  struct client_context* migrate_head;
+  int migrate_num;
+
+  /* Indicates, that the batch is over and does not accept migrated clients */
+  int migrate_closed;
+
+  /* 
+     Clients woken up by their sleeping timers, which expired at the same
+     dispatching of the waiting queue, to be added to the multi-handle at once.
+  */
+  struct client_context* wake_head;
+  struct client_context* wake_tail;
+
+  /* 
+     Curl share objects of the thread, indexed by the url <share_data> mask.
+     Allocated for the masks used by urls.
+  */
+  batch_share* shares[URL_SHARE_MASK + 1];
+
   /* Event base from event_init () of libevent. */
   struct event_base* eb;
 
@@ -270,6 +399,27 @@ typedef struct batch_context
   /* Pointer to structure used by lebevent. */
   struct event* timer_next_load_event;
 
+  /* Hyper mode table of live sockets, indexed by socket descriptors. */
+  struct sock_info** sock_table;
+
+  /* Number of entries in sock_table. */
+  int sock_table_size;
+
+  /* Memory pool of sock_info objects for hyper mode. */
+  struct mpool* sock_pool;
+
+  /* epoll descriptor, used by smooth mode for socket events demultiplexing. */
+  int epoll_fd;
+
+  /* 
+     Timestamp (msec), when libcurl wishes its timeout to be served, as passed 
+     by CURLMOPT_TIMERFUNCTION in smooth mode. Zero means no timeout pending.
+  */
+  unsigned long curl_timeout_time;
+
+  /* io_uring of the batch, used by io_uring mode. */
+  struct uring_ctx* uring;
+
 
   /*--------------- STATISTICS  --------------------------------------------*/
 
@@ -282,14 +432,35 @@ typedef struct batch_context
   /* Dump operational statistics indicator, 0: no dump */
   int dump_opstats;
 
+  /* Binary statistics stream, written by the leader; NULL - no stream */
+  struct stats_stream* stream;
+
+  /* Ring of the client log records, drained by the log writer; NULL - no ring */
+  struct log_ring* log_ring;
+
+  /* 
+     Size in MB of the segment files, capturing logged responses, 
+     0: a file per client per cycle (LOG_RESP_SEGMENT_SIZE tag) 
+  */
+  long log_resp_segment_size;
+
+  /* Capture store of the logged responses; NULL - no segmented capture */
+  struct resp_capture* capture;
+
+  /* Number of the completed url fetches for 1-in-N trace sampling (-j) */
+  unsigned long trace_sample_count;
+
   /* Timestamp, when the loading started */
   unsigned long start_time; 
 
   /* The last timestamp */
   unsigned long last_measure;
 
-  /* HTTP counters since the last measurements */
-  stat_point http_delta;
+  /* 
+     HTTP counters since the last measurements. The counters, updated by the 
+     thread of the batch, start at a cache line of their own.
+  */
+  stat_point http_delta __attribute__ ((aligned (STAT_CACHE_LINE_SIZE)));
   /* HTTP counters since the loading started */
   stat_point http_total;
 
@@ -302,6 +473,9 @@ typedef struct batch_context
   op_stat_point op_delta;
   op_stat_point op_total;
 
+  /* Handoff of the delta counters of a thread sub-batch to the leader */
+  stat_handoff handoff;
+
   /* Count of response times dumped before new-line,
    used to limit line length */
   int ct_resps;
@@ -314,6 +488,19 @@ int is_batch_group_leader (batch_context* bctx);
 size_t next_ipv4_shared_index (batch_context* bctx);
 size_t next_ipv6_shared_index (batch_context* bctx);
 
+int batch_cpu_affinity_online (batch_context* bctx);
+int batch_cpu_affinity_set (batch_context* bctx);
+
+int batch_arrival_init (batch_context* bctx);
+int batch_arrival_split (batch_context* bctx, 
+                         const unsigned long* ia, 
+                         size_t ia_num, 
+                         int index, 
+                         int num);
+
+int batch_share_init (batch_context* bctx);
+void batch_share_release (batch_context* bctx);
+
 
 
 
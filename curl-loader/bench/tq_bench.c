@@ -0,0 +1,229 @@
+/*
+*     tq_bench.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+* Microbenchmark of the timer queue: binary heap vs. timing wheel.
+* Simulates clients of a loading thread, each with a sleeping timer and
+* an url-completion timer. An expired sleeping timer re-schedules itself
+* after a random think time, cancels the url-completion timer and
+* schedules it again, like a client completing an url and starting
+* the next one. The clock is simulated in 1 msec steps, so that both
+* queues get exactly the same sequence of operations.
+*
+* Build: make tq_bench
+* Usage: bench/tq_bench [-n clients] [-s simulated seconds] [-t max think msec]
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "timer_queue.h"
+#include "timer_node.h"
+#include "timer_tick.h"
+
+#define URL_COMPLETION_MSEC 30000
+
+typedef struct bench_client
+{
+  /* Must be the first, the client is found by it in the timer handler */
+  timer_node sleep_node;
+
+  timer_node url_completion_node;
+  long tid_url_completion;
+
+  /* Random seed of the client */
+  unsigned int seed;
+} bench_client;
+
+typedef struct bench_context
+{
+  timer_queue* tq;
+  unsigned long long now_time;
+  unsigned long think_max;
+  unsigned long long ops;
+  unsigned long long dispatched;
+} bench_context;
+
+static int handle_url_completion_timer (timer_node* tn, void* vp, unsigned long now)
+{
+  (void) tn; (void) vp; (void) now;
+  return 0;
+}
+
+static int handle_sleep_timer (timer_node* tn, void* vp, unsigned long now)
+{
+  bench_client* cl = (bench_client *) tn;
+  bench_context* bc = (bench_context *) vp;
+  (void) now;
+
+  /* Counted here, as the wheel may be called to dispatch with nothing expired */
+  bc->dispatched++;
+  bc->ops++;
+
+  if (cl->tid_url_completion >= 0)
+    {
+      tq_cancel_timer (bc->tq, cl->tid_url_completion);
+      bc->ops++;
+    }
+
+  cl->url_completion_node.next_timer =
+    bc->now_time + URL_COMPLETION_MSEC * TICK_USEC_PER_MSEC;
+  if ((cl->tid_url_completion =
+       tq_schedule_timer (bc->tq, &cl->url_completion_node)) == -1)
+    return -1;
+
+  cl->sleep_node.next_timer = bc->now_time +
+    1 + rand_r (&cl->seed) % (bc->think_max * TICK_USEC_PER_MSEC);
+
+  if (tq_schedule_timer (bc->tq, &cl->sleep_node) == -1)
+    return -1;
+
+  bc->ops += 2;
+  return 0;
+}
+
+static int run_bench (int type, size_t clients_num, unsigned long seconds,
+                      unsigned long think_max)
+{
+  bench_context bc;
+  bench_client* cl = 0;
+  unsigned long long start = 0, finish = 0, time_end = 0;
+  size_t i = 0;
+
+  bc.tq = 0;
+
+  if (! (cl = calloc (clients_num, sizeof (bench_client))) ||
+      ! (bc.tq = calloc (1, sizeof (timer_queue))))
+    {
+      fprintf (stderr, "%s - error: allocation failed.\n", __func__);
+      free (bc.tq);
+      free (cl);
+      return -1;
+    }
+
+  /* 
+     Start at a msec boundary before the wheel is initialized, so that both
+     queues see the same expired timers.
+  */
+  bc.now_time = get_tick_count_usec () / TICK_USEC_PER_MSEC * TICK_USEC_PER_MSEC;
+
+  if (tq_init (bc.tq, type, 2 * clients_num + 1, 10, 2 * clients_num + 1) == -1)
+    {
+      fprintf (stderr, "%s - error: tq_init () failed.\n", __func__);
+      free (bc.tq);
+      free (cl);
+      return -1;
+    }
+  bc.think_max = think_max;
+  bc.ops = 0;
+  bc.dispatched = 0;
+  time_end = bc.now_time + seconds * 1000 * TICK_USEC_PER_MSEC;
+
+  start = get_tick_count_usec ();
+
+  for (i = 0; i < clients_num; i++)
+    {
+      cl[i].seed = (unsigned int) i;
+      cl[i].tid_url_completion = -1;
+      cl[i].sleep_node.func_timer = handle_sleep_timer;
+      cl[i].url_completion_node.func_timer = handle_url_completion_timer;
+
+      cl[i].sleep_node.next_timer = bc.now_time +
+        1 + rand_r (&cl[i].seed) % (think_max * TICK_USEC_PER_MSEC);
+
+      tq_schedule_timer (bc.tq, &cl[i].sleep_node);
+      bc.ops++;
+    }
+
+  for (; bc.now_time < time_end; bc.now_time += TICK_USEC_PER_MSEC)
+    {
+      while (! tq_empty (bc.tq) &&
+             tq_time_to_nearest_timer (bc.tq) <= bc.now_time)
+        {
+          if (tq_dispatch_nearest_timer (bc.tq, &bc, bc.now_time) == -1)
+            {
+              fprintf (stderr, "%s - error: dispatching failed.\n", __func__);
+              return -1;
+            }
+        }
+    }
+
+  finish = get_tick_count_usec ();
+
+  fprintf (stderr, "%-6s clients:%zu dispatched:%llu ops:%llu time:%llu.%03llu ms ns/op:%.1f\n",
+           type == TQ_TYPE_WHEEL ? "wheel" : "heap",
+           clients_num, bc.dispatched, bc.ops,
+           (finish - start) / 1000, (finish - start) % 1000,
+           bc.ops ? 1000.0 * (finish - start) / bc.ops : 0.0);
+
+  for (i = 0; i < clients_num; i++)
+    {
+      if (cl[i].sleep_node.timer_id >= 0)
+        tq_cancel_timer (bc.tq, cl[i].sleep_node.timer_id);
+      if (cl[i].tid_url_completion >= 0)
+        tq_cancel_timer (bc.tq, cl[i].tid_url_completion);
+    }
+
+  tq_release (bc.tq);
+  free (bc.tq);
+  free (cl);
+
+  return 0;
+}
+
+int main (int argc, char *argv [])
+{
+  size_t clients_num = 100000;
+  unsigned long seconds = 10;
+  unsigned long think_max = 10000;
+  int rget_opt = 0;
+
+  while ((rget_opt = getopt (argc, argv, "n:s:t:")) != EOF)
+    {
+      switch (rget_opt)
+        {
+        case 'n':
+          clients_num = strtoul (optarg, 0, 10);
+          break;
+        case 's':
+          seconds = strtoul (optarg, 0, 10);
+          break;
+        case 't':
+          think_max = strtoul (optarg, 0, 10);
+          break;
+        default:
+          fprintf (stderr, "usage: %s [-n clients] [-s simulated seconds] "
+                   "[-t max think msec]\n", argv[0]);
+          return 1;
+        }
+    }
+
+  if (!clients_num || !seconds || !think_max)
+    {
+      fprintf (stderr, "%s - error: options should be positive numbers.\n", __func__);
+      return 1;
+    }
+
+  if (run_bench (TQ_TYPE_HEAP, clients_num, seconds, think_max) == -1 ||
+      run_bench (TQ_TYPE_WHEEL, clients_num, seconds, think_max) == -1)
+    return 1;
+
+  return 0;
+}
@@ -187,40 +187,51 @@ void stat_5xx_inc (client_context* cctx)
     cctx->bctx->http_delta.resp_5xx++;
 }
 
-void stat_appl_delay_add (client_context* cctx, unsigned long resp_timestamp)
+void stat_appl_delay_add (client_context* cctx, unsigned long long resp_timestamp)
 {
+  stat_point* sp = cctx->is_https ? &cctx->bctx->https_delta : 
+    &cctx->bctx->http_delta;
+
   if (resp_timestamp > cctx->req_sent_timestamp)
     {
-      if (cctx->is_https)
-        {
-          cctx->bctx->https_delta.appl_delay = 
-            (cctx->bctx->https_delta.appl_delay * cctx->bctx->https_delta.appl_delay_points +
-             resp_timestamp - cctx->req_sent_timestamp) / ++cctx->bctx->https_delta.appl_delay_points;
-        }
-      else
-        {
-          cctx->bctx->http_delta.appl_delay = 
-            (cctx->bctx->http_delta.appl_delay * cctx->bctx->http_delta.appl_delay_points +
-             resp_timestamp - cctx->req_sent_timestamp) / ++cctx->bctx->http_delta.appl_delay_points;
-        }
+      const unsigned long long delay = resp_timestamp - cctx->req_sent_timestamp;
+
+      sp->appl_delay_points++;
+      sp->appl_delay_sum += delay;
+      if (sp->appl_delay_hist)
+        hdr_hist_record (sp->appl_delay_hist, delay);
     }
 }
-void stat_appl_delay_2xx_add (client_context* cctx, unsigned long resp_timestamp)
+void stat_appl_delay_2xx_add (client_context* cctx, unsigned long long resp_timestamp)
 {
-    if (resp_timestamp > cctx->req_sent_timestamp)
+  stat_point* sp = cctx->is_https ? &cctx->bctx->https_delta : 
+    &cctx->bctx->http_delta;
+
+  if (resp_timestamp > cctx->req_sent_timestamp)
+    {
+      const unsigned long long delay = resp_timestamp - cctx->req_sent_timestamp;
+
+      sp->appl_delay_2xx_points++;
+      sp->appl_delay_2xx_sum += delay;
+      if (sp->appl_delay_2xx_hist)
+        hdr_hist_record (sp->appl_delay_2xx_hist, delay);
+    }
+}
+
+void stat_phases_add (client_context* cctx, const unsigned long* phases)
+{
+  stat_point* sp = cctx->is_https ? &cctx->bctx->https_delta : 
+    &cctx->bctx->http_delta;
+  int i;
+
+  sp->phase_points++;
+  for (i = 0; i < PHASE_NUM; i++)
     {
-      if (cctx->is_https)
-        {
-          cctx->bctx->https_delta.appl_delay_2xx = 
-            (cctx->bctx->https_delta.appl_delay_2xx * cctx->bctx->https_delta.appl_delay_2xx_points +
-             resp_timestamp - cctx->req_sent_timestamp) / ++cctx->bctx->https_delta.appl_delay_2xx_points;
-        }
-      else
-        {
-          cctx->bctx->http_delta.appl_delay_2xx = 
-            (cctx->bctx->http_delta.appl_delay_2xx * cctx->bctx->http_delta.appl_delay_2xx_points +
-             resp_timestamp - cctx->req_sent_timestamp) / ++cctx->bctx->http_delta.appl_delay_2xx_points;
-        }
+      sp->phase_sum[i] += phases[i];
+      if (phases[i] > sp->phase_max[i])
+        sp->phase_max[i] = phases[i];
+      if (sp->phase_hist)
+        hdr_hist_record (&sp->phase_hist[i], phases[i]);
     }
 }
 
@@ -123,9 +123,28 @@ typedef struct client_context
 */
   struct batch_context* bctx;
 
+  /* Next client in the list of clients migrated to another batch (thread) */
+  struct client_context* migrate_next;
+
+  /* Next client in the list of clients woken up by expired timers */
+  struct client_context* wake_next;
+
+  /* 
+     Url, whose handle plan has been applied to the CURL handle, or NULL, when
+     the handle is new or has been reset, or options of a URL_USE_CURRENT url
+     have been set outside of the plan. 
+  */
+  struct url_context* handle_plan_url;
+
   /* Index of the client within its batch. */
   size_t client_index;
 
+  /* 
+     Index of the client among the clients of all the thread sub-batches of
+     the batch, kept, when the client is migrated to another sub-batch.
+  */
+  size_t batch_client_index;
+
   /* Index of the currently used url. */
   size_t url_curr_index;
 
@@ -180,22 +199,29 @@ typedef struct client_context
   int first_hdr_4xx;
   int first_hdr_5xx;
 
+  /*
+     Whether statistics of the current url fetch are collected at its completion
+     (fast statistics), and not by the libcurl tracing function.
+  */
+  int stats_at_completion;
+
   /* 
-     Timestamp of a request sent. Used to calculate server 
+     Timestamp (usec) of a request sent. Used to calculate server 
      application response delay. 
   */
-  unsigned long req_sent_timestamp;
+  unsigned long long req_sent_timestamp;
+
+  /* 
+     Intended start time (usec) of an open-loop fixed rate request. When 
+     set, it is taken as the request sent timestamp. 
+  */
+  unsigned long long req_intended_timestamp;
 
   /*
     Client-based statistics. Parallel to updating batch statistics, 
     client-based statistics is also updated.
   */
   stat_point st;
-
-  /*
-     Pointer to socket data used by hyper-mode
-   */
-  void * ext_data;
   
   
    /*
@@ -205,6 +231,15 @@ typedef struct client_context
     */
   curl_infotype previous_type;
 
+  /*
+    Trace of the current url fetch, kept for the tail-based sampling (-j)
+    and logged only for a slow, failed or sampled fetch.
+  */
+  char* trace_buf;
+  size_t trace_len;
+  size_t trace_size;
+  int trace_truncated;
+
 
 } client_context;
 
@@ -245,14 +280,26 @@ void stat_3xx_inc (client_context* cctx);
 void stat_4xx_inc (client_context* cctx);
 void stat_5xx_inc (client_context* cctx);
 
-void stat_appl_delay_add (client_context* cctx, unsigned long resp_timestamp);
-void stat_appl_delay_2xx_add (client_context* cctx, unsigned long resp_timestamp);
+void stat_appl_delay_add (client_context* cctx, unsigned long long resp_timestamp);
+void stat_appl_delay_2xx_add (client_context* cctx, unsigned long long resp_timestamp);
+void stat_phases_add (client_context* cctx, const unsigned long* phases);
 
 void dump_client (FILE* file, client_context* cctx);
 
 /* Currently, in smooth mode */
 int pending_active_and_waiting_clients_num (struct batch_context* bctx);
 
+/****************************************************************************************
+ * Function name - rebalance_close
+ *
+ * Description -  Closes the batch for clients migration from other threads, unless 
+ *                some migrated clients are still to be taken.
+ *
+ * Input -       *bctx - pointer to the batch context
+ * Return Code/Output - 0, when closed, -1, when migrated clients are to be loaded
+ ****************************************************************************************/
+int rebalance_close (struct batch_context* bctx);
+
 /*
   Flag used to indicate, that no more loading is necessary.
   Time to dump the final statistics, clients table and exit.
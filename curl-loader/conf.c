@@ -29,6 +29,9 @@
 #include <string.h>
 
 #include "conf.h"
+#include "timer_queue.h"
+#include "stats_stream.h"
+#include "log_rotate.h"
 
 /*
   Command line configuration options. Setting defaults here.
@@ -42,15 +45,33 @@ int verbose_logging = 0;
 /* Flag, whether to run batches as batch per thread. */
 int threads_subbatches_num = 0;
 
+/* Flag, whether to run a thread per CPU. */
+int threads_subbatches_auto = 0;
+
 /* 
    Time in seconds between snapshot statistics printouts to
    screen as well as to the statistics file
 */
 long snapshot_statistics_timeout = 3; /* Seconds */
+
+/* 
+   Time in msec between records of the binary statistics stream; 
+   0 - no stream 
+*/
+long stats_stream_interval = 0;
+
+/* 
+   Address <host:port> of the metrics exporter; empty - no exporter
+*/
+char metrics_address[METRICS_ADDRESS_SIZE];
+
 /*  
-    Rewind logfile, if above the size above MB 
+    Rotate logfile, if above the size in MB or older than the period in seconds,
+    and keep the number of the rotated logfiles 
 */
-long logfile_rewind_size = 1024;
+long logfile_rotate_size = 1024;
+long logfile_rotate_period = 0;
+long logfile_rotate_keep = LOG_ROTATE_KEEP_DEFAULT;
 
 /* Whether to stdout the downloaded file body */
 int output_to_stdout = 0;
@@ -61,12 +82,30 @@ int stderr_print_client_msg = 0;
 /* Storming or smooth loading */
 int loading_mode = LOAD_MODE_DEFAULT;
 
+/* Binary heap or hierarchical timing wheel */
+int timer_queue_type = TQ_TYPE_DEFAULT;
+
  /* Whether to include url to all log outputs. */
 int url_logging = 0;
 
 /* Output to logfile the details of request/response. */
 int detailed_logging = 0;
 
+/* 
+   Tail-based sampling of the traces of url fetches: only the traces of
+   fetches slower than the threshold in msec (0 - none), failed or each
+   1-in-N fetch (0 - none) are logged.
+*/
+int trace_sampling = 0;
+long trace_sample_slow = 0;
+long trace_sample_rate = 0;
+
+/* 
+   Collect statistics at url completion from libcurl infos, not by the
+   verbose tracing of each header and data chunk.
+*/
+int fast_statistics = 0;
+
 int warnings_skip = 0;
 
 /* Name of the configuration file */
@@ -87,10 +126,24 @@ int parse_command_line (int argc, char *argv [])
 {
   int rget_opt = 0;
 
-    while ((rget_opt = getopt (argc, argv, "c:dehf:i:l:m:op:rst:vuwx:")) != EOF) 
+    while ((rget_opt = getopt (argc, argv, "ab:c:dehf:g:i:j:k:l:m:op:q:rst:vuwx:")) != EOF) 
     {
       switch (rget_opt) 
         {
+        case 'a': /* Fast statistics, collected at url completion */
+          fast_statistics = 1;
+          break;
+
+        case 'b': /* Binary statistics stream */
+          if (!optarg || 
+              (stats_stream_interval = atol (optarg)) < STATS_STREAM_INTERVAL_MIN)
+            {
+              fprintf (stderr, "%s error: -b option should be followed by a number "
+                       "of msec >= %d.\n", __func__, STATS_STREAM_INTERVAL_MIN);
+              return -1;
+            }
+          break;
+
         case 'c': /* Connection establishment timeout */
           if (!optarg || (connect_timeout = atoi (optarg)) <= 0)
             {
@@ -121,6 +174,17 @@ int parse_command_line (int argc, char *argv [])
             }
           break;
 
+        case 'g': /* Metrics exporter */
+          if (!optarg || !strchr (optarg, ':') || 
+              strlen (optarg) >= METRICS_ADDRESS_SIZE)
+            {
+              fprintf (stderr, "%s error: -g option should be followed by "
+                       "<host:port> to listen on.\n", __func__);
+              return -1;
+            }
+          strcpy (metrics_address, optarg);
+          break;
+
           case 'i': /* Statistics snapshot timeout */
           if (!optarg ||
               (snapshot_statistics_timeout = atoi (optarg)) < 1)
@@ -131,24 +195,58 @@ int parse_command_line (int argc, char *argv [])
             }
           break;
             
-        case 'l': /* Number of cycles before a logfile rewinds. */
+        case 'j': /* Just slow, failed and 1-in-N sampled fetches are logged */
+          {
+            char* end = 0;
+
+            if (!optarg || 
+                (trace_sample_slow = strtol (optarg, &end, 10)) < 0 ||
+                (*end == ',' && (trace_sample_rate = strtol (end + 1, &end, 10)) < 1) ||
+                *end)
+              {
+                fprintf (stderr, "%s: error: -j option should be followed by a number of msec >= 0 "
+                         "and optionally by a comma and a sampling rate 1-in-N >= 1.\n", __func__);
+                return -1;
+              }
+            trace_sampling = 1;
+          }
+          break;
+
+        case 'k': /* Number of the rotated logfiles kept */
           if (!optarg || 
-              (logfile_rewind_size = atol (optarg)) < 2)
+              (logfile_rotate_keep = atol (optarg)) < 1)
             {
-              fprintf (stderr, "%s: error: -l option should be followed by a number >= 2.\n",
+              fprintf (stderr, "%s: error: -k option should be followed by a number >= 1.\n",
                   __func__);
               return -1;
             }
           break;
 
-        case 'm': /* Modes of loading: SMOOTH and STORMING */
+        case 'l': /* Size in MB and period in seconds of a logfile before rotation */
+          {
+            char* end = 0;
+
+            if (!optarg || 
+                (logfile_rotate_size = strtol (optarg, &end, 10)) < 2 ||
+                (*end == ',' && (logfile_rotate_period = strtol (end + 1, &end, 10)) < 1) ||
+                *end)
+              {
+                fprintf (stderr, "%s: error: -l option should be followed by a number >= 2 "
+                         "and optionally by a comma and a period >= 1 sec.\n", __func__);
+                return -1;
+              }
+          }
+          break;
+
+        case 'm': /* Modes of loading: HYPER, SMOOTH and URING */
 
             if (!optarg || 
                 (((loading_mode = atol (optarg)) != LOAD_MODE_SMOOTH && 
-                  loading_mode != LOAD_MODE_HYPER )))
+                  loading_mode != LOAD_MODE_HYPER &&
+                  loading_mode != LOAD_MODE_URING)))
             {
-              fprintf (stderr, "%s error: -m to be followed by a number either %d or %d.\n",
-                       __func__, LOAD_MODE_SMOOTH, LOAD_MODE_HYPER);
+              fprintf (stderr, "%s error: -m to be followed by a number %d, %d or %d.\n",
+                       __func__, LOAD_MODE_HYPER, LOAD_MODE_SMOOTH, LOAD_MODE_URING);
               return -1;
             }
 
@@ -158,6 +256,23 @@ int parse_command_line (int argc, char *argv [])
           output_to_stdout = 1;
           break;
 
+        case 'q': /* Timer queue: heap or wheel */
+          if (optarg && !strcmp (optarg, "heap"))
+            {
+              timer_queue_type = TQ_TYPE_HEAP;
+            }
+          else if (optarg && !strcmp (optarg, "wheel"))
+            {
+              timer_queue_type = TQ_TYPE_WHEEL;
+            }
+          else
+            {
+              fprintf (stderr, "%s error: -q option should be followed by \"heap\" "
+                       "or \"wheel\".\n", __func__);
+              return -1;
+            }
+          break;
+
         case 'r':
           break;
 
@@ -167,11 +282,15 @@ int parse_command_line (int argc, char *argv [])
 
         case 't': /* Create sub-batches and run each sub-batch of clients 
                      in a dedicated thread. */
-          if (!optarg ||
+          if (optarg && !strcmp (optarg, "auto"))
+            {
+              threads_subbatches_auto = 1;
+            }
+          else if (!optarg ||
               (threads_subbatches_num = atoi (optarg)) < 2)
             {
-              fprintf (stderr, "%s error: -t option should be followed by a number >= 2.\n", 
-                       __func__);
+              fprintf (stderr, "%s error: -t option should be followed by a number >= 2 "
+                       "or by \"auto\".\n", __func__);
               return -1;
             }
             break;
@@ -215,6 +334,10 @@ int parse_command_line (int argc, char *argv [])
       return -1;
     }
 
+  /* Sampled are the traces of the verbose logging */
+  if (trace_sampling && ! verbose_logging)
+    verbose_logging = 1;
+
   return 0;
 }
 
@@ -223,14 +346,21 @@ void print_help ()
   fprintf (stderr, "Note, to run your load, create your batch configuration file.\n\n");
   fprintf (stderr, "usage: run as a root:\n");
   fprintf (stderr, "./curl-loader -f <configuration file name> with [other options below]:\n");
+  fprintf (stderr, " -a[t completion statistics; fast, without verbose tracing of libcurl for urls, not scanning responses]\n");
+  fprintf (stderr, " -b[inary statistics stream to <batch-name>.sts, record interval in msec]\n");
   fprintf (stderr, " -c[onnection establishment timeout, seconds]\n");
   fprintf (stderr, " -d[etailed logging; outputs to logfile headers and bodies of requests/responses. Good for text pages/files]\n");
   fprintf (stderr, " -e[rror drop client (smooth mode). Client on error doesn't attempt next cycle]\n");
+  fprintf (stderr, " -g[et metrics: OpenMetrics exporter listening on <host:port>, e.g. 127.0.0.1:9090]\n");
   fprintf (stderr, " -i[ntermediate (snapshot) statistics time interval (default 3 sec)]\n");
-  fprintf (stderr, " -l[ogfile max size in MB (default 1024). On the size reached, file pointer rewinded]\n");
-  fprintf (stderr, " -m[ode of loading, 0 - hyper  (default), 1 - smooth]\n");
+  fprintf (stderr, " -j[ust slow, failed and 1-in-N sampled url fetches are logged: <slow-msec>[,<N>]; implies -v]\n");
+  fprintf (stderr, " -k[eep number of the rotated compressed logfiles (default 8)]\n");
+  fprintf (stderr, " -l[ogfile max size in MB (default 1024)[,period in seconds]. On the size or period reached, logfile is rotated]\n");
+  fprintf (stderr, " -m[ode of loading, 0 - hyper  (default), 1 - smooth, 2 - io_uring]\n");
+  fprintf (stderr, " -q[ueue of timers: \"heap\" or hierarchical timing \"wheel\"]\n");
   fprintf (stderr, " -r[euse onnections disabled. Close connections and re-open them. Try with and without]\n");
-  fprintf (stderr, " -t[hreads number to run batch clients as sub-batches in several threads. Works to utilize SMP/m-core HW]\n");
+  fprintf (stderr, " -t[hreads number to run batch clients as sub-batches in several threads. Works to utilize SMP/m-core HW.\n"
+           "   \"auto\" runs a thread per CPU, pinned to the CPU]\n");
   fprintf (stderr, " -v[erbose output to the logfiles; includes info about headers sent/received]\n");
   fprintf (stderr, " -u[rl logging - logs url names to logfile, when -v verbose option is used]\n");
   fprintf (stderr, " -w[arnings skip]\n");
@@ -40,8 +40,8 @@ extern int connect_timeout;
 
 /* 
    Flag, whether to perform verbose logging. Very usefull for debugging, but files
-   tend to become huge. Thus, they can be kept smaller by using 
-   logfile_rewind_size.
+   tend to become huge. Thus, they are rotated by logfile_rotate_size
+   and logfile_rotate_period.
 */
 extern int verbose_logging;
 
@@ -53,18 +53,39 @@ extern int verbose_logging;
 */
 extern int threads_subbatches_num;
 
+/* 
+   Flag, whether the number of sub-batch threads is to be a thread per 
+   CPU, each thread pinned to its CPU (-t auto command line option).
+*/
+extern int threads_subbatches_auto;
+
 /* 
    Time in seconds between intermediate statistics printouts to
    screen as well as to the statistics file
 */
 extern long snapshot_statistics_timeout;
 
+/* 
+   Time in msec between records of the binary statistics stream; 
+   0 - no stream (-b command line option)
+*/
+extern long stats_stream_interval;
+
+/* 
+   Address <host:port> of the metrics exporter, serving OpenMetrics text at
+   /metrics; empty - no exporter (-g command line option)
+*/
+#define METRICS_ADDRESS_SIZE 128
+extern char metrics_address[METRICS_ADDRESS_SIZE];
+
 /*
-  Output to the logfile will be re-directed to the file's start, thus 
-  overwriting previous logged strings. Effectively, keeps the log history
-  limited to below number of cycles.
+  Logfile is rotated, when above the size in MB or, if the period in seconds
+  is not zero, older than the period. The rotated logfiles are compressed, and
+  the last logfile_rotate_keep of them are kept.
 */
-extern long logfile_rewind_size;
+extern long logfile_rotate_size;
+extern long logfile_rotate_period;
+extern long logfile_rotate_keep;
 
 /* 
    Whether to print to stdout the body of the downloaded file.
@@ -90,13 +111,20 @@ extern unsigned long error_recovery_client;
 enum load_mode
   {
     LOAD_MODE_HYPER = 0, /* Hyper-mode via epoll () */
-    LOAD_MODE_SMOOTH = 1,    /* Smooth mode via select () */
+    LOAD_MODE_SMOOTH = 1,    /* Smooth mode via epoll () */
+    LOAD_MODE_URING = 2,    /* io_uring mode */
   };
 
 #define LOAD_MODE_DEFAULT LOAD_MODE_HYPER
 
 extern int loading_mode;
 
+/*
+  Timer queue of the loading threads: TQ_TYPE_HEAP or TQ_TYPE_WHEEL 
+  (see timer_queue.h). Set by -q command line option.
+*/
+extern int timer_queue_type;
+
 /* 
    Whether to include url name string to all log outputs. May be useful,
    normally used with verbose logging, like '-v -u' in command line.
@@ -104,6 +132,17 @@ extern int loading_mode;
 extern int url_logging;
 extern int detailed_logging;
 
+/*
+  Tail-based sampling of the traces of url fetches (-j): a trace is kept by
+  the client and logged only, when the fetch is slower than trace_sample_slow
+  msec (0 - no threshold), failed or is each 1-in-trace_sample_rate fetch
+  (0 - no sampling).
+*/
+extern int trace_sampling;
+extern long trace_sample_slow;
+extern long trace_sample_rate;
+extern int fast_statistics;
+
 extern int warnings_skip;
 
 /*
@@ -152,6 +191,7 @@ int create_response_logfiles_dirs (struct batch_context* bctx);
 int alloc_client_formed_buffers (struct batch_context* bctx);
 int alloc_client_fetch_decision_array (struct batch_context* bctx);
 int init_operational_statistics(struct batch_context* bctx);
+int init_loading_statistics (struct batch_context* bctx);
 
 /*
   Prints out usage of the program.
@@ -0,0 +1,242 @@
+/*
+*     hdr_hist.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <string.h>
+
+#include "hdr_hist.h"
+
+#define HDR_HIST_VALUE_MAX ((1ULL << HDR_HIST_MAX_BITS) - 1)
+
+/*
+  Index of the counter for a value. Bucket 0 keeps the values below
+  1 << sub_bits with unit 1, bucket N >= 1 keeps the values from
+  1 << (sub_bits - 1 + N) up to 1 << (sub_bits + N) with unit 1 << N.
+*/
+static int hist_index (unsigned long long value, int sub_bits)
+{
+  const int sub_num = 1 << sub_bits, sub_half = sub_num / 2;
+  int bucket;
+
+  if (value > HDR_HIST_VALUE_MAX)
+    value = HDR_HIST_VALUE_MAX;
+
+  if (value < (unsigned long long) sub_num)
+    return (int) value;
+
+  bucket = 63 - __builtin_clzll (value) - (sub_bits - 1);
+
+  return sub_num + (bucket - 1) * sub_half + (int) (value >> bucket) - sub_half;
+}
+
+/* The highest value, counted by the counter of an index */
+static unsigned long long hist_index_value (int index, int sub_bits)
+{
+  const int sub_num = 1 << sub_bits, sub_half = sub_num / 2;
+  int bucket, sub;
+
+  if (index < sub_num)
+    return (unsigned long long) index;
+
+  bucket = (index - sub_num) / sub_half + 1;
+  sub = (index - sub_num) % sub_half + sub_half;
+
+  return (((unsigned long long) sub + 1) << bucket) - 1;
+}
+
+static void hist_record (unsigned long long* count,
+                         unsigned long long* max,
+                         unsigned long long* counts,
+                         int sub_bits,
+                         unsigned long long value)
+{
+  counts[hist_index (value, sub_bits)]++;
+  (*count)++;
+
+  if (value > *max)
+    *max = value;
+}
+
+static void hist_add (unsigned long long* counts_left,
+                      const unsigned long long* counts_right,
+                      int counts_num)
+{
+  int i;
+
+  for (i = 0; i < counts_num; i++)
+    {
+      counts_left[i] += counts_right[i];
+    }
+}
+
+static unsigned long long hist_percentile (unsigned long long count,
+                                           unsigned long long max,
+                                           const unsigned long long* counts,
+                                           int counts_num,
+                                           int sub_bits,
+                                           double percentile)
+{
+  unsigned long long target, seen = 0;
+  int i;
+
+  if (! count)
+    return 0;
+
+  if (percentile >= 100.0)
+    return max;
+
+  /* Number of values at or below the percentile, at least one */
+  target = (unsigned long long) (percentile / 100.0 * count + 0.999999);
+  if (! target)
+    target = 1;
+
+  for (i = 0; i < counts_num; i++)
+    {
+      seen += counts[i];
+      if (seen >= target)
+        {
+          const unsigned long long value = hist_index_value (i, sub_bits);
+          return value < max ? value : max;
+        }
+    }
+
+  return max;
+}
+
+void hdr_hist_record (hdr_hist* h, unsigned long long value)
+{
+  hist_record (&h->count, &h->max, h->counts, HDR_HIST_SUB_BITS, value);
+}
+
+void hdr_hist_add (hdr_hist* left, const hdr_hist* right)
+{
+  if (! right->count)
+    return;
+
+  hist_add (left->counts, right->counts, HDR_HIST_COUNTS_NUM);
+  left->count += right->count;
+
+  if (right->max > left->max)
+    left->max = right->max;
+}
+
+void hdr_hist_reset (hdr_hist* h)
+{
+  if (! h->count)
+    return;
+
+  memset (h, 0, sizeof (*h));
+}
+
+unsigned long long hdr_hist_percentile (const hdr_hist* h, double percentile)
+{
+  return hist_percentile (h->count, h->max, h->counts, HDR_HIST_COUNTS_NUM,
+                          HDR_HIST_SUB_BITS, percentile);
+}
+
+void hdr_hist_small_record (hdr_hist_small* h, unsigned long long value)
+{
+  hist_record (&h->count, &h->max, h->counts, HDR_HIST_SMALL_SUB_BITS, value);
+}
+
+void hdr_hist_small_add (hdr_hist_small* left, const hdr_hist_small* right)
+{
+  if (! right->count)
+    return;
+
+  hist_add (left->counts, right->counts, HDR_HIST_SMALL_COUNTS_NUM);
+  left->count += right->count;
+
+  if (right->max > left->max)
+    left->max = right->max;
+}
+
+void hdr_hist_small_reset (hdr_hist_small* h)
+{
+  if (! h->count)
+    return;
+
+  memset (h, 0, sizeof (*h));
+}
+
+unsigned long long hdr_hist_small_percentile (const hdr_hist_small* h, 
+                                              double percentile)
+{
+  return hist_percentile (h->count, h->max, h->counts, HDR_HIST_SMALL_COUNTS_NUM,
+                          HDR_HIST_SMALL_SUB_BITS, percentile);
+}
+
+void hdr_hist_small_add_hist (hdr_hist_small* left, const hdr_hist* right)
+{
+  int i;
+
+  if (! right->count)
+    return;
+
+  /* Buckets of a small histogram are unions of buckets of a histogram */
+  for (i = 0; i < HDR_HIST_COUNTS_NUM; i++)
+    {
+      if (right->counts[i])
+        left->counts[hist_index (hist_index_value (i, HDR_HIST_SUB_BITS),
+                                 HDR_HIST_SMALL_SUB_BITS)] += right->counts[i];
+    }
+
+  left->count += right->count;
+
+  if (right->max > left->max)
+    left->max = right->max;
+}
+
+void hdr_hist_small_sub (hdr_hist_small* left, const hdr_hist_small* right)
+{
+  int i, top = -1;
+
+  for (i = 0; i < HDR_HIST_SMALL_COUNTS_NUM; i++)
+    {
+      left->counts[i] -= right->counts[i];
+      if (left->counts[i])
+        top = i;
+    }
+
+  left->count -= right->count;
+
+  if (top < 0)
+    left->max = 0;
+  else if (hist_index_value (top, HDR_HIST_SMALL_SUB_BITS) < left->max)
+    left->max = hist_index_value (top, HDR_HIST_SMALL_SUB_BITS);
+}
+
+unsigned long long hdr_hist_small_count_le (const hdr_hist_small* h,
+                                            unsigned long long value)
+{
+  const int last = hist_index (value, HDR_HIST_SMALL_SUB_BITS);
+  unsigned long long count = 0;
+  int i;
+
+  if (value >= h->max)
+    return h->count;
+
+  for (i = 0; i <= last; i++)
+    {
+      count += h->counts[i];
+    }
+
+  return count;
+}
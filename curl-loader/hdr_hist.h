@@ -0,0 +1,167 @@
+/*
+*     hdr_hist.h
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef HDR_HIST_H
+#define HDR_HIST_H
+
+/*
+  Log-linear histogram of usec values in the manner of HdrHistogram.
+  Values below HDR_HIST_SUB_NUM are counted exactly. Above it each power
+  of two range is split into HDR_HIST_SUB_HALF linear sub-buckets, which
+  keeps the relative error below 1/HDR_HIST_SUB_HALF (1.6%). Values
+  above 2^HDR_HIST_MAX_BITS usec (19 hours) are counted in the last bucket.
+  Histograms are merged losslessly by adding their counters.
+
+  hdr_hist_small is the same with HDR_HIST_SMALL_SUB_BITS, thus with
+  HDR_HIST_SMALL_SUB_HALF (8) linear sub-buckets per power of two and
+  relative error below 1/8 (12.5%), for many histograms, like a histogram
+  per url.
+*/
+#define HDR_HIST_SUB_BITS 7
+#define HDR_HIST_SUB_NUM (1 << HDR_HIST_SUB_BITS)
+#define HDR_HIST_SUB_HALF (HDR_HIST_SUB_NUM / 2)
+#define HDR_HIST_MAX_BITS 36
+#define HDR_HIST_COUNTS_NUM \
+  (HDR_HIST_SUB_NUM + (HDR_HIST_MAX_BITS - HDR_HIST_SUB_BITS) * HDR_HIST_SUB_HALF)
+
+#define HDR_HIST_SMALL_SUB_BITS 4
+#define HDR_HIST_SMALL_SUB_NUM (1 << HDR_HIST_SMALL_SUB_BITS)
+#define HDR_HIST_SMALL_SUB_HALF (HDR_HIST_SMALL_SUB_NUM / 2)
+#define HDR_HIST_SMALL_COUNTS_NUM \
+  (HDR_HIST_SMALL_SUB_NUM + (HDR_HIST_MAX_BITS - HDR_HIST_SMALL_SUB_BITS) * \
+   HDR_HIST_SMALL_SUB_HALF)
+
+typedef struct hdr_hist
+{
+  /* Number of the recorded values */
+  unsigned long long count;
+
+  /* Maximal recorded value */
+  unsigned long long max;
+
+  /* Counters of the buckets */
+  unsigned long long counts[HDR_HIST_COUNTS_NUM];
+
+} hdr_hist;
+
+typedef struct hdr_hist_small
+{
+  /* Number of the recorded values */
+  unsigned long long count;
+
+  /* Maximal recorded value */
+  unsigned long long max;
+
+  /* Counters of the buckets */
+  unsigned long long counts[HDR_HIST_SMALL_COUNTS_NUM];
+
+} hdr_hist_small;
+
+
+/****************************************************************************************
+* Function name - hdr_hist_record
+*
+* Description - Counts a value into a histogram
+*
+* Input -       *h    - pointer to the histogram
+*               value - value in usec
+* Return Code/Output - None
+****************************************************************************************/
+void hdr_hist_record (hdr_hist* h, unsigned long long value);
+
+/****************************************************************************************
+* Function name - hdr_hist_add
+*
+* Description - Adds counters of one histogram to another
+*
+* Input -       *left  - pointer to the histogram, where counters will be added
+*               *right - pointer to the histogram, which counters will be added
+* Return Code/Output - None
+****************************************************************************************/
+void hdr_hist_add (hdr_hist* left, const hdr_hist* right);
+
+/****************************************************************************************
+* Function name - hdr_hist_reset
+*
+* Description - Nulls counters of a histogram
+*
+* Input -       *h - pointer to the histogram
+* Return Code/Output - None
+****************************************************************************************/
+void hdr_hist_reset (hdr_hist* h);
+
+/****************************************************************************************
+* Function name - hdr_hist_percentile
+*
+* Description - Returns the value at a percentile: the highest value of the bucket,
+*               where the percentile falls, but not above the maximal recorded value.
+*
+* Input -       *h         - pointer to the histogram
+*               percentile - percentile from 0 to 100, e.g. 99.9
+* Return Code/Output - Value in usec or 0 for an empty histogram
+****************************************************************************************/
+unsigned long long hdr_hist_percentile (const hdr_hist* h, double percentile);
+
+/*
+  The same operations for small histograms.
+*/
+void hdr_hist_small_record (hdr_hist_small* h, unsigned long long value);
+void hdr_hist_small_add (hdr_hist_small* left, const hdr_hist_small* right);
+void hdr_hist_small_reset (hdr_hist_small* h);
+unsigned long long hdr_hist_small_percentile (const hdr_hist_small* h, 
+                                              double percentile);
+
+/****************************************************************************************
+* Function name - hdr_hist_small_add_hist
+*
+* Description - Adds counters of a histogram to a small histogram
+*
+* Input -       *left  - pointer to the small histogram, where counters will be added
+*               *right - pointer to the histogram, which counters will be added
+* Return Code/Output - None
+****************************************************************************************/
+void hdr_hist_small_add_hist (hdr_hist_small* left, const hdr_hist* right);
+
+/****************************************************************************************
+* Function name - hdr_hist_small_sub
+*
+* Description - Subtracts counters of an earlier state of a small histogram, leaving
+*               the values recorded since. The maximum becomes the highest value of
+*               the highest non-empty bucket, but not above the maximal recorded value.
+*
+* Input -       *left  - pointer to the small histogram, where counters will be subtracted
+*               *right - pointer to the earlier state of the small histogram
+* Return Code/Output - None
+****************************************************************************************/
+void hdr_hist_small_sub (hdr_hist_small* left, const hdr_hist_small* right);
+
+/****************************************************************************************
+* Function name - hdr_hist_small_count_le
+*
+* Description - Returns the number of values in the buckets up to the bucket of a
+*               value, i.e. values not above it within the bucket resolution. All the
+*               values, when the value is not below the maximal recorded value.
+*
+* Input -       *h    - pointer to the small histogram
+*               value - value in usec
+* Return Code/Output - Number of values
+****************************************************************************************/
+unsigned long long hdr_hist_small_count_le (const hdr_hist_small* h,
+                                            unsigned long long value);
+
+#endif /* HDR_HIST_H */
@@ -392,6 +392,19 @@ long heap_push (heap* const h, hnode* const nd, int keep_node_id)
     {
       /* Get free node-id */
       new_node_id = heap_get_node_id (h);
+
+      /* 
+         All node-ids may be in use with a free slot in heap, when a 
+         periodical timer is popped out with its node-id reserved.
+      */
+      if (new_node_id >= (long) h->max_heap_size)
+        {
+          if (heap_increase (h) == -1)
+            {
+              fprintf(stderr, "%s - error: heap_increase() failed\n", __func__);
+              return -1;
+            }
+        }
 	
       /* 
          Set node-id to the hnode, it will be further passed from 
@@ -57,6 +57,11 @@
 #include "ssl_thr_lock.h"
 #include "screen.h"
 #include "cl_alloc.h"
+#include "stats_stream.h"
+#include "metrics.h"
+#include "log_ring.h"
+#include "resp_capture.h"
+#include "trace_sample.h"
 
 
 static int client_tracing_function (CURL *handle, 
@@ -64,6 +69,9 @@ static int client_tracing_function (CURL *handle,
                              unsigned char *data, 
                              size_t size, 
                              void *userp);
+static void response_status_check (client_context* cctx,
+                                   url_context* url_ctx,
+                                   long response_status);
 static size_t do_nothing_write_func (void *ptr, 
                               size_t size, 
                               size_t nmemb, 
@@ -73,6 +81,8 @@ static int create_ip_addrs (batch_context* bctx, int bctx_num);
 
 static void* batch_function (void *batch_data);
 static int initial_handles_init (struct client_context*const cdata);
+static int setup_curl_handle_plan (struct client_context*const cctx,  
+                                   url_context* url_ctx);
 static int setup_curl_handle_appl (struct client_context*const cctx,  
                                    url_context* url_ctx);
 static int init_client_formed_buffer (client_context* cctx, 
@@ -81,6 +91,7 @@ static int init_client_formed_buffer (client_context* cctx,
                                       size_t buffer_len);
 static int init_client_contexts (batch_context* bctx, FILE* output_file);
 static void free_batch_data_allocations (struct batch_context* bctx);
+static void free_batch_urls (struct batch_context* bctx);
 static void free_url (url_context* url, int clients_max);
 static int ipv6_increment(const struct in6_addr *const src, 
                           struct in6_addr *const dest);
@@ -91,6 +102,17 @@ static int ip_addr_str_allocate_init (batch_context* bctx,
 
 int stop_loading = 0;
 
+/* 
+   Number of threads still running their loading. Threads, rebalancing clients
+   between them, release their allocations only, when all the threads are over,
+   since the migrated clients are living in the clients array of their origin.
+*/
+static int threads_loading_num = 0;
+static pthread_mutex_t threads_loading_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t threads_loading_cond = PTHREAD_COND_INITIALIZER;
+
+static void threads_loading_over (int wait);
+
 
 static void sigint_handler (int signum)
 {
@@ -108,13 +130,14 @@ static void sigint_handler (int signum)
 typedef int (*pf_user_activity) (struct client_context*const);
 
 /*
- * Batch functions for the 2 loading modes: 
- * hyper (epoll-based) and smooth (poll-based).
+ * Batch functions for the 3 loading modes: 
+ * hyper (libevent-based), smooth (epoll-based) and io_uring-based.
 */
-static pf_user_activity ua_array[2] = 
+static pf_user_activity ua_array[3] = 
 { 
   user_activity_hyper,
-  user_activity_smooth
+  user_activity_smooth,
+  user_activity_uring
 };
 
 static FILE *create_file (batch_context* bctx, char* fname)
@@ -131,6 +154,7 @@ main (int argc, char *argv [])
 {
   batch_context bc_arr[BATCHES_MAX_NUM];
   pthread_t tid[BATCHES_MAX_NUM];
+  int started[BATCHES_MAX_NUM];
   int batches_num = 0; 
   int i = 0, error = 0;
 
@@ -163,6 +187,34 @@ main (int argc, char *argv [])
       return -1;
     }
 
+  /* 
+     -t auto: a thread per CPU of THREAD_AFFINITY or, when not configured, 
+     per CPU the process may run on. 
+  */
+  if (threads_subbatches_auto)
+    {
+      if (! bc_arr[0].cpu_affinity_num && 
+          batch_cpu_affinity_online (&bc_arr[0]) == -1)
+        {
+          fprintf (stderr, "%s - error: batch_cpu_affinity_online () failed.\n", 
+                   __func__);
+          return -1;
+        }
+
+      threads_subbatches_num = bc_arr[0].cpu_affinity_num < BATCHES_MAX_NUM ?
+        bc_arr[0].cpu_affinity_num : BATCHES_MAX_NUM;
+
+      /* Each thread runs at least a client */
+      if (threads_subbatches_num > bc_arr[0].client_num_max)
+        threads_subbatches_num = bc_arr[0].client_num_max;
+
+      if (threads_subbatches_num < 2)
+        threads_subbatches_num = 0;
+
+      fprintf (stderr, "%s - note: running %d threads, a thread per CPU.\n", 
+               __func__, threads_subbatches_num ? threads_subbatches_num : 1);
+    }
+
    /*
     * De-facto the support is only for a single batch. However, we are using 
     * internal support for multiple batches for loading from several threads, 
@@ -193,6 +245,15 @@ main (int argc, char *argv [])
 
   signal (SIGINT, sigint_handler);
 
+  /* Client logs are written by the log writer thread */
+  if (log_writer_start () == -1)
+    fprintf (stderr, "%s - warning: logging without the log writer.\n", __func__);
+
+  /* Segments of the responses capture are prepared by the segment preparer */
+  if (bc_arr[0].log_resp_segment_size && resp_capture_preparer_start () == -1)
+    fprintf (stderr, "%s - warning: capture segments are prepared by the loading "
+             "threads.\n", __func__);
+
   screen_init ();
   
   if (! threads_subbatches_num)
@@ -201,7 +262,10 @@ main (int argc, char *argv [])
       sleep (1);
       batch_function (&bc_arr[0]);
       fprintf (stderr, "Exited batch_function\n");
+      log_writer_stop ();
+      resp_capture_preparer_stop ();
       screen_release ();
+      batch_share_release (&bc_arr[0]);
     }
   else
     {
@@ -215,8 +279,18 @@ main (int argc, char *argv [])
           return -1;
         }
 
-      create_thr_subbatches (bc_arr, threads_subbatches_num); 
+      if (create_thr_subbatches (bc_arr, threads_subbatches_num) == -1)
+        {
+          fprintf (stderr, "%s - error: create_thr_subbatches () failed.\n", __func__);
+          return -1;
+        }
       
+      /* 
+         The threads wait for each other before the cleanup; a thread,
+         which fails to start, is not waited for.
+      */
+      threads_loading_num = threads_subbatches_num;
+
       /* 
          Opening threads for the batches of clients 
       */
@@ -229,11 +303,17 @@ main (int argc, char *argv [])
           if (0 != error)
             {
             fprintf(stderr, "%s - error: Couldn't run thread number %d, errno %d\n", 
-                    __func__, i, errno);
+                    __func__, i, error);
+            threads_loading_over (0);
+            started[i] = 0;
+
+            /* The leader does not wait for its statistics */
+            stat_handoff_finish (&bc_arr[i]);
             }
           else 
             {
               bc_arr[i].thread_id = tid[i]; /* Set the thread-id */
+              started[i] = 1;
 
               fprintf(stderr, "%s - note: Thread %d, started normally\n", __func__, i);
             }
@@ -242,16 +322,55 @@ main (int argc, char *argv [])
       /* Waiting for all running threads to terminate */
       for (i = 0 ; i < threads_subbatches_num ; i++) 
         {
+          if (! started[i])
+            continue;
+
           error = pthread_join (tid[i], NULL) ;
           fprintf(stderr, "%s - note: Thread %d terminated normally\n", __func__, i) ;
         }
 
+      log_writer_stop ();
+      resp_capture_preparer_stop ();
+
+      /* Handles of migrated clients may be attached to shares of other threads */
+      for (i = 0 ; i < threads_subbatches_num ; i++) 
+        batch_share_release (&bc_arr[i]);
+
+      /* Sub-batches share url allocations of the first batch */
+      for (i = 0 ; i < threads_subbatches_num ; i++) 
+        free_batch_urls (&bc_arr[i]);
+
       thread_openssl_cleanup ();
     }
+
+  /* Sub-batches share the CPU list of the first batch */
+  free (bc_arr[0].cpu_affinity);
    
   return 0;
 }
 
+/****************************************************************************************
+* Function name - threads_loading_over
+*
+* Description - Counts a loading thread as over and, when required, blocks till all
+*               the loading threads are over
+*
+* Input -       wait - whether to wait for the other threads
+* Return Code/Output - None
+****************************************************************************************/
+static void threads_loading_over (int wait)
+{
+  pthread_mutex_lock (&threads_loading_mutex);
+
+  if (--threads_loading_num == 0)
+    pthread_cond_broadcast (&threads_loading_cond);
+
+  while (wait && threads_loading_num)
+    pthread_cond_wait (&threads_loading_cond, &threads_loading_mutex);
+
+  pthread_mutex_unlock (&threads_loading_mutex);
+}
+
 /****************************************************************************************
 * Function name - batch_function
 * Description -   Runs the batch test either within the main-thread or in a separate thread.
@@ -276,6 +395,16 @@ static void* batch_function (void * batch_data)
       return NULL;
     }
 
+  /* 
+     Pin the thread before allocating client contexts, the timer queue and
+     its memory pool, so that they are first-touched at the local NUMA node.
+  */
+  if (batch_cpu_affinity_set (bctx) == -1)
+    {
+      fprintf (stderr, "%s - warning: \"%s\" runs without CPU affinity.\n", 
+               __func__, bctx->batch_name);
+    }
+
   if (! stderr_print_client_msg)
     {
       /*
@@ -283,23 +412,36 @@ static void* batch_function (void * batch_data)
       */
       (void)sprintf (bctx-> batch_logfile, "./%s.log", bctx->batch_name);
       if (!(log_file = create_file(bctx,bctx->batch_logfile)))
-          return NULL;
+          goto cleanup;
       else
         {
           char tbuf[256];
-          (void)fprintf(log_file,"# %ld %s",get_tick_count(),ascii_time(tbuf));
+          struct timeval tval;
+
+          /* Wall-clock msec, the ticks are counted by the monotonic clock */
+          (void)gettimeofday (&tval, NULL);
+          (void)fprintf(log_file,"# %ld %s",
+                        (long) tval.tv_sec * 1000 + tval.tv_usec / 1000,
+                        ascii_time(tbuf));
 	  (void)fprintf(log_file,
             "# msec_offset cycle_no url_no client_no (ip) indic info\n");
         }
     }
 
+  if (log_ring_open (bctx, log_file ? log_file : stderr,
+                     log_file ? bctx->batch_logfile : NULL) == -1)
+    goto cleanup;
+
+  if (bctx->log_resp_segment_size && resp_capture_open (bctx) == -1)
+    goto cleanup;
+
   /*
     Init batch statistics file
   */
   (void)sprintf (bctx->batch_statistics, "./%s.txt", bctx->batch_name);
   if (!(bctx->statistics_file = statistics_file = create_file(bctx,
     bctx->batch_statistics)))
-      return NULL;
+      goto cleanup;
   else
       print_statistics_header (statistics_file);
   
@@ -311,9 +453,20 @@ static void* batch_function (void * batch_data)
       (void)sprintf (bctx->batch_opstats, "./%s.ops", bctx->batch_name);
       if (!(bctx->opstats_file = opstats_file = create_file(bctx,
        bctx->batch_opstats)))
-          return NULL;
+          goto cleanup;
     }
   
+  /*
+    Init binary statistics stream and metrics exporter of the batch group
+  */
+  if ((stats_stream_interval || metrics_address[0]) && 
+      is_batch_group_leader (bctx) && stats_stream_open (bctx) == -1)
+    goto cleanup;
+
+  if (metrics_address[0] && is_batch_group_leader (bctx) && 
+      metrics_server_start (bctx) == -1)
+    goto cleanup;
+
   /* 
      Init the objects, containing client-context information.
   */
@@ -352,9 +505,19 @@ static void* batch_function (void * batch_data)
     }
 
  cleanup:
+  /* The leader may collect the statistics counters of the batch from now on */
+  stat_handoff_finish (bctx);
+
+  if (threads_subbatches_num > 1)
+    threads_loading_over (1);
+
   if (bctx->multiple_handle)
     curl_multi_cleanup(bctx->multiple_handle);
 
+  log_ring_close (bctx);
+
+  resp_capture_close (bctx);
+
   if (log_file)
       fclose (log_file);
 
@@ -364,6 +527,11 @@ static void* batch_function (void * batch_data)
   if (opstats_file)
       fclose (opstats_file);
 
+  if (metrics_address[0] && is_batch_group_leader (bctx))
+    metrics_server_stop ();
+
+  stats_stream_close (bctx);
+
   free_batch_data_allocations (bctx);
 
   return NULL;
@@ -392,6 +560,13 @@ static int initial_handles_init (client_context*const ctx_array)
       return -1;
     }
 
+  /* Curl share objects of the thread for urls sharing data between clients */
+  if (batch_share_init (bctx) == -1)
+    {
+      fprintf (stderr, "%s - error: batch_share_init () failed.\n", __func__);
+      return -1;
+    }
+
   /* Initialize all CURL handles */
   for (k = 0 ; k < bctx->client_num_max ; k++)
     {
@@ -454,9 +629,13 @@ int setup_curl_handle (client_context*const cctx, url_context* url)
 /****************************************************************************
 * Function name - setup_curl_handle_init
 *
-* Description - Resets client context kept CURL handle and inits it locally, using 
-*               setup_curl_handle_appl () function for the application-specific 
-*               (HTTP/FTP) initialization.
+* Description - Inits client context kept CURL handle for fetching a url. The handle
+*               plan of the url, the options, which are the same for each fetch of 
+*               the url by the client, is applied by setup_curl_handle_plan (), 
+*               when the client comes to the url from another url or the handle
+*               has been reset. Repeated fetching of the same url sets only the per 
+*               fetch options: the url string, POST-buffer, upload stream and 
+*               response logfiles.
 *
 * Input -       *cctx- pointer to client context, containing CURL handle pointer;
 *               *url - pointer to url-context, containing all url-related information;
@@ -473,7 +652,16 @@ int setup_curl_handle_init (client_context*const cctx, url_context* url)
   batch_context* bctx = cctx->bctx;
   CURL* handle = cctx->handle;
 
-  curl_easy_reset (handle);
+  if (cctx->handle_plan_url != url)
+    {
+      if (setup_curl_handle_plan (cctx, url) == -1)
+        {
+          fprintf (stderr,"%s - error: setup_curl_handle_plan () failed.\n",
+                   __func__);
+          return -1;
+        }
+      cctx->handle_plan_url = url;
+    }
 
   /*
    Choose the next URL from an url set, or complete the url template from 
@@ -487,18 +675,6 @@ int setup_curl_handle_init (client_context*const cctx, url_context* url)
 	  return -1;
   }
   
-  if (bctx->ipv6)
-    curl_easy_setopt (handle, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V6);
-      
-  /* Bind the handle to a certain IP-address */
-  curl_easy_setopt (handle, CURLOPT_INTERFACE, 
-                    bctx->ip_addr_array [cctx->client_index]);
-
-  curl_easy_setopt (handle, CURLOPT_NOSIGNAL, 1);
-
-  /* set|unset the curl proxy */
-  curl_easy_setopt (handle, CURLOPT_PROXY, config_proxy);
-    
   /* Set the url */
   if (url->url_str && url->url_str_len)
     {
@@ -575,6 +751,97 @@ int setup_curl_handle_init (client_context*const cctx, url_context* url)
   
   bctx->url_index = url->url_ind;
 
+  if (url->log_resp_bodies || url->log_resp_headers)
+    {
+      if (response_logfiles_set (cctx, url) == -1)
+        {
+          fprintf (stderr,"%s - error: response_logfiles_set () .\n",
+                   __func__);
+          return -1;
+        }
+    }
+
+  /* GF  */
+  if (url->upload_file)
+  {
+      if (upload_file_stream_init (cctx, url) < 0)
+          return -1;
+  }
+
+  if ((url->url_appl_type == URL_APPL_HTTPS ||
+       url->url_appl_type == URL_APPL_HTTP) &&
+      url->req_type == HTTP_REQ_TYPE_POST)
+    {
+      /* 
+         Make POST, using post buffer, if requested. 
+      */
+      if (url->upload_file && url->upload_file_ptr && (!cctx->post_data || !cctx->post_data[0]))
+        {
+          curl_easy_setopt(handle, CURLOPT_POST, 1);
+        }
+      else if (cctx->post_data || url->mpart_form_post)
+        {
+          /* 
+             Sets POST as the HTTP request method using either:
+             - POST-fields;
+             - multipart form-data as in RFC 1867;
+          */
+          if (init_client_url_post_data (cctx, url) == -1)
+            {
+              fprintf (stderr,
+                       "%s - error: init_client_url_post_data() failed.\n",
+                       __func__);
+              return -1;
+            }
+        }
+      else
+        {
+          fprintf (stderr, "%s - error: post_data is NULL.\n", __func__);
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+* Function name - setup_curl_handle_plan
+*
+* Description - Resets client context kept CURL handle and applies the handle plan
+*               of a url: options, which are the same for each fetch of the url by 
+*               the client, using setup_curl_handle_appl () function for the 
+*               application-specific (HTTP/FTP) initialization.
+*
+* Input -       *cctx- pointer to client context, containing CURL handle pointer;
+*               *url - pointer to url-context, containing all url-related information;
+* Return Code/Output - On Success - 0, on Error -1
+******************************************************************************/
+static int setup_curl_handle_plan (client_context*const cctx, url_context* url)
+{
+  batch_context* bctx = cctx->bctx;
+  CURL* handle = cctx->handle;
+
+  curl_easy_reset (handle);
+
+  if (bctx->ipv6)
+    curl_easy_setopt (handle, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V6);
+      
+  /* Bind the handle to a certain IP-address */
+  curl_easy_setopt (handle, CURLOPT_INTERFACE, 
+                    bctx->ip_addr_array [cctx->client_index]);
+
+  curl_easy_setopt (handle, CURLOPT_NOSIGNAL, 1);
+
+  /* 
+     Attach the handle to the thread share of TLS sessions, DNS cache and 
+     connections, configured for the url, or detach it.
+  */
+  curl_easy_setopt (handle, CURLOPT_SHARE, 
+                    url->share_data ? bctx->shares[url->share_data]->share : NULL);
+
+  /* set|unset the curl proxy */
+  curl_easy_setopt (handle, CURLOPT_PROXY, config_proxy);
+    
   curl_easy_setopt (handle, CURLOPT_DNS_CACHE_TIMEOUT, -1);
 
   /* Set the connection timeout */
@@ -599,15 +866,25 @@ int setup_curl_handle_init (client_context*const cctx, url_context* url)
      curl_easy_setopt (handle, CURLOPT_DNS_USE_GLOBAL_CACHE, 1); 
   */
   
-  curl_easy_setopt (handle, CURLOPT_VERBOSE, 1);
-  curl_easy_setopt (handle, CURLOPT_DEBUGFUNCTION, 
-                    client_tracing_function);
-
   /* 
-     This is to return cctx pointer as the void* userp to the 
-     tracing function. 
+     Fast statistics are collected at the url completion, unless the 
+     tracing function is required for logging or to scan responses for tokens.
   */
-  curl_easy_setopt (handle, CURLOPT_DEBUGDATA, cctx);
+  cctx->stats_at_completion = fast_statistics && !verbose_logging && 
+    !detailed_logging && !url->response.n_tokens;
+
+  if (! cctx->stats_at_completion)
+    {
+      curl_easy_setopt (handle, CURLOPT_VERBOSE, 1);
+      curl_easy_setopt (handle, CURLOPT_DEBUGFUNCTION, 
+                        client_tracing_function);
+
+      /* 
+         This is to return cctx pointer as the void* userp to the 
+         tracing function. 
+      */
+      curl_easy_setopt (handle, CURLOPT_DEBUGDATA, cctx);
+    }
 
 #if 0
   curl_easy_setopt(handle, CURLOPT_PROGRESSFUNCTION, prog_cb);
@@ -618,16 +895,7 @@ int setup_curl_handle_init (client_context*const cctx, url_context* url)
     }
 #endif
   
-  if (url->log_resp_bodies || url->log_resp_headers)
-    {
-      if (response_logfiles_set (cctx, url) == -1)
-        {
-          fprintf (stderr,"%s - error: response_logfiles_set () .\n",
-                   __func__);
-          return -1;
-        }
-    }
-  else
+  if (! url->log_resp_bodies && ! url->log_resp_headers)
     {
       curl_easy_setopt (handle, CURLOPT_WRITEFUNCTION,
                         do_nothing_write_func);
@@ -687,20 +955,11 @@ int setup_curl_handle_init (client_context*const cctx, url_context* url)
     }
   #endif
 
-  /* GF  */
-  if (url->upload_file)
-  {
-      if (upload_file_stream_init (cctx, url) < 0)
-          return -1;
-  }
-  else
-  {
-      if (url->transfer_limit_rate)
-      {
-          curl_easy_setopt(handle, CURLOPT_MAX_RECV_SPEED_LARGE,
-                           (curl_off_t) url->transfer_limit_rate);
-      }
-  }
+  if (! url->upload_file && url->transfer_limit_rate)
+    {
+      curl_easy_setopt(handle, CURLOPT_MAX_RECV_SPEED_LARGE,
+                       (curl_off_t) url->transfer_limit_rate);
+    }
 
   /* 
      Application (url) specific setups, like HTTP-specific, FTP-specific, etc. 
@@ -719,7 +978,8 @@ int setup_curl_handle_init (client_context*const cctx, url_context* url)
 /****************************************************************************************
 * Function name - setup_curl_handle_appl
 *
-* Description - Application/url-type specific setup for a single curl handle (client)
+* Description - Application/url-type specific setup for a single curl handle (client),
+*               which is a part of the url handle plan
 *
 * Input -       *cctx- pointer to client context, containing CURL handle pointer;
 *               *url - pointer to url-context, containing all url-related information;
@@ -772,42 +1032,13 @@ int setup_curl_handle_appl (client_context*const cctx, url_context* url)
           curl_easy_setopt (handle, CURLOPT_COOKIEFILE, "");
         }
       
-      if (url->req_type == HTTP_REQ_TYPE_POST)
+      if (url->req_type == HTTP_REQ_TYPE_PUT)
         {
-          /* 
-             Make POST, using post buffer, if requested. 
-          */
-            if (url->upload_file && url->upload_file_ptr && (!cctx->post_data || !cctx->post_data[0]))
-            {
-                curl_easy_setopt(handle, CURLOPT_POST, 1);
-            }
-            else if (cctx->post_data || url->mpart_form_post)
-            {
-              /* 
-                 Sets POST as the HTTP request method using either:
-                 - POST-fields;
-                 - multipart form-data as in RFC 1867;
-              */
-              if (init_client_url_post_data (cctx, url) == -1)
-                {
-                  fprintf (stderr,
-                           "%s - error: init_client_url_post_data() failed.\n",
-                           __func__);
-                  return -1;
-                }
-            }
-            else
-            {
-              fprintf (stderr, "%s - error: post_data is NULL.\n", __func__);
-              return -1;
-            }
-        }
-      else if (url->req_type == HTTP_REQ_TYPE_PUT)
-        {
-          if (!url->upload_file || ! url->upload_file_ptr)
+          /* Opening of the file is checked by upload_file_stream_init () */
+          if (!url->upload_file)
             {            
               fprintf (stderr, 
-                       "%s - error: upload file is NULL or cannot be opened.\n", 
+                       "%s - error: upload file is NULL.\n", 
                        __func__);
               return -1;
             }
@@ -914,7 +1145,7 @@ int setup_curl_handle_appl (client_context*const cctx, url_context* url)
 * Description - Opens a logfile for responses to be used for a certain client
 *               and a certain url. A separate file to be opened for headers 
 *               and bodies. Sets the files to the logging mechanism of
-*               libcurl.
+*               libcurl. With segmented capture sets the capture callbacks.
 * 
 * Input -       *cctx - pointer to client context
 *               *url  - pointer to url context
@@ -924,6 +1155,22 @@ int response_logfiles_set (client_context* cctx, url_context* url)
 {
   CURL* handle = cctx->handle;
 
+  if (cctx->bctx->capture)
+    {
+      /* Segmented capture, no files to open */
+      if (url->log_resp_bodies)
+        {
+          curl_easy_setopt (handle, CURLOPT_WRITEDATA, cctx);
+          curl_easy_setopt (handle, CURLOPT_WRITEFUNCTION, resp_capture_body_write);
+        }
+      if (url->log_resp_headers)
+        {
+          curl_easy_setopt (handle, CURLOPT_WRITEHEADER, cctx);
+          curl_easy_setopt (handle, CURLOPT_HEADERFUNCTION, resp_capture_header_write);
+        }
+      return 0;
+    }
+
   if (url->log_resp_bodies && url->dir_log)
     {
       // open the file
@@ -1158,14 +1405,12 @@ static int init_client_formed_buffer (client_context* cctx,
     char *end = data+strlen(data)-1;\
     if (*end == '\n')\
       *end = '\0';\
-    (void)fprintf(cctx->file_output,"%ld %ld %d %s%s %s",\
+    trace_sample_printf(cctx,\
+     "%ld %ld %d %s%s %s%s%s%s%s\n",\
      offs_resp, cctx->cycle_num, cctx->url_curr_index, cctx->client_name,\
-     ind, data);\
-    if (url_print)\
-      (void)fprintf(cctx->file_output," eff-url: url %s",url);\
-    if (url_diff)\
-      (void)fprintf(cctx->file_output," url: url %s",url_target);\
-    (void)fprintf(cctx->file_output,"\n");\
+     ind, data,\
+     url_print ? " eff-url: url " : "", url_print ? url : "",\
+     url_diff ? " url: url " : "", url_diff ? url_target : "");\
   }
 
 #define write_log_num(ind, num) \
@@ -1247,8 +1492,10 @@ static int client_tracing_function (CURL *handle,
    */
   scan_response(type, (char*) data, size, cctx);
 
-  const unsigned long time_resp = get_tick_count();
-  const unsigned long offs_resp = time_resp - cctx->bctx->start_time;
+  /* "now" cached by the loop iteration, which runs libcurl */
+  const unsigned long long time_resp = get_tick_count_cached_usec ();
+  const unsigned long offs_resp = 
+    (unsigned long) (time_resp / TICK_USEC_PER_MSEC) - cctx->bctx->start_time;
 
   switch (type)
     {
@@ -1400,33 +1647,12 @@ static int client_tracing_function (CURL *handle,
           }
       } /* switch of response status */
 
-      if (url_ctx->resp_status_errors_tbl)
-        {
-          if (response_status < 0 ||
-              response_status > URL_RESPONSE_STATUS_ERRORS_TABLE_SIZE ||
-              url_ctx->resp_status_errors_tbl[response_status])
-            {
-              cctx->client_state = CSTATE_ERROR;
-            }
-        }
-      else
-      {
-        if (response_status < 0 || response_status >= 400)
-          {
-            /* 401 and 407 responses are just authentication challenges, that 
-              virtual client may overcome. */
-            if (response_status != 401 && response_status != 407)
-              {
-                cctx->client_state = CSTATE_ERROR;
-              }
-          }
-      }
-
+      response_status_check (cctx, url_ctx, response_status);
       break;
 
     case CURLINFO_DATA_IN:     
       if (verbose_logging > 1) 
-          (void)fprintf(cctx->file_output,
+          trace_sample_printf(cctx,
                  "%ld %ld %d %s<= Recv data: eff-url: %s, url: %s\n", 
                   offs_resp, cctx->cycle_num, cctx->url_curr_index,
 		  cctx->client_name,
@@ -1460,7 +1686,8 @@ static int client_tracing_function (CURL *handle,
       memcpy (detailed_buff, data, nbytes);
       
       detailed_buff[nbytes] = '\0';
-      fprintf(cctx->file_output, "%s%s\n\n", detailed_buff, nbytes < size? "..." : "");
+      trace_sample_printf(cctx, "%s%s\n\n", 
+                          detailed_buff, nbytes < size? "..." : "");
   }
 
   
@@ -1470,6 +1697,273 @@ static int client_tracing_function (CURL *handle,
 
 
 
+/****************************************************************************************
+* Function name - response_status_check
+* 
+* Description - Sets the client to the error state, when the response status is 
+*               considered as an error for the url
+*
+* Input -       *cctx           - pointer to the client context
+*               *url_ctx        - pointer to the url context
+*               response_status - response status of the server
+* Return Code/Output - None
+****************************************************************************************/
+static void response_status_check (client_context* cctx,
+                                   url_context* url_ctx,
+                                   long response_status)
+{
+  if (url_ctx->resp_status_errors_tbl)
+    {
+      if (response_status < 0 ||
+          response_status > URL_RESPONSE_STATUS_ERRORS_TABLE_SIZE ||
+          url_ctx->resp_status_errors_tbl[response_status])
+        {
+          cctx->client_state = CSTATE_ERROR;
+        }
+    }
+  else
+    {
+      if (response_status < 0 || response_status >= 400)
+        {
+          /* 401 and 407 responses are just authentication challenges, that 
+             virtual client may overcome. */
+          if (response_status != 401 && response_status != 407)
+            {
+              cctx->client_state = CSTATE_ERROR;
+            }
+        }
+    }
+}
+
+/*
+  Time info of a CURL handle in usec. The curl_off_t *_T infos are 
+  supported since libcurl 7.61.0, previously only seconds as double.
+*/
+#if LIBCURL_VERSION_NUM >= 0x073d00
+#define handle_time_usec(handle, info) handle_time_usec_get (handle, info##_T)
+#else
+#define handle_time_usec(handle, info) handle_time_usec_get (handle, info)
+#endif
+
+static unsigned long handle_time_usec_get (CURL* handle, CURLINFO info)
+{
+#if LIBCURL_VERSION_NUM >= 0x073d00
+  curl_off_t t = 0;
+
+  curl_easy_getinfo (handle, info, &t);
+  return t > 0 ? (unsigned long) t : 0;
+#else
+  double t = 0.;
+
+  curl_easy_getinfo (handle, info, &t);
+  return t > 0. ? (unsigned long) (t * 1000000.) : 0;
+#endif
+}
+
+/****************************************************************************************
+* Function name - phase_stats_collect
+* 
+* Description - Collects times of the phases of a successfully completed url fetch:
+*               resolving, connecting, TLS handshake, waiting for the first 
+*               response byte, transfer of the response and redirections.
+*
+* Input -       *cctx  - pointer to the client context
+* Return Code/Output - None
+****************************************************************************************/
+static void phase_stats_collect (client_context* cctx)
+{
+  CURL* handle = cctx->handle;
+  unsigned long phases[PHASE_NUM];
+  
+  const unsigned long t_dns = handle_time_usec (handle, CURLINFO_NAMELOOKUP_TIME);
+  const unsigned long t_conn = handle_time_usec (handle, CURLINFO_CONNECT_TIME);
+  const unsigned long t_appconn = handle_time_usec (handle, CURLINFO_APPCONNECT_TIME);
+  const unsigned long t_pre = handle_time_usec (handle, CURLINFO_PRETRANSFER_TIME);
+  const unsigned long t_start = handle_time_usec (handle, CURLINFO_STARTTRANSFER_TIME);
+  const unsigned long t_total = handle_time_usec (handle, CURLINFO_TOTAL_TIME);
+
+  /* The times are since the fetch start; zero for a step not done */
+  phases[PHASE_DNS] = t_dns;
+  phases[PHASE_CONNECT] = t_conn > t_dns ? t_conn - t_dns : 0;
+  phases[PHASE_TLS] = t_appconn > t_conn ? t_appconn - t_conn : 0;
+  phases[PHASE_TTFB] = t_start > t_pre ? t_start - t_pre : 0;
+  phases[PHASE_TRANSFER] = t_total > t_start ? t_total - t_start : 0;
+  phases[PHASE_REDIRECT] = handle_time_usec (handle, CURLINFO_REDIRECT_TIME);
+  phases[PHASE_TOTAL] = t_total;
+
+  stat_phases_add (cctx, phases);
+}
+
+/****************************************************************************************
+* Function name - stats_at_completion_collect
+* 
+* Description - Fast statistics. Collects statistics of a completed url fetch from 
+*               the libcurl infos instead of the tracing function: requests, 
+*               responses, data in/out and the server application delay. 
+*               Authentication challenges and 1xx responses, as well as TLS 
+*               handshake bytes, are not seen at the completion and are not counted.
+*
+* Input -       *cctx  - pointer to the client context
+*               result - libcurl result of the fetch
+* Return Code/Output - None
+****************************************************************************************/
+void stats_at_completion_collect (client_context* cctx, CURLcode result)
+{
+  CURL* handle = cctx->handle;
+  url_context* url_ctx = &cctx->bctx->url_ctx_array[cctx->url_curr_index];
+  long response_status = 0, redirects = 0, req_size = 0, hdr_size = 0;
+  unsigned long long time_resp = 0;
+  long i;
+  const unsigned long time_total = handle_time_usec (handle, CURLINFO_TOTAL_TIME);
+  const unsigned long time_start = handle_time_usec (handle, CURLINFO_STARTTRANSFER_TIME);
+#if LIBCURL_VERSION_NUM >= 0x073d00
+  curl_off_t size_up = 0, size_down = 0;
+
+  curl_easy_getinfo (handle, CURLINFO_SIZE_UPLOAD_T, &size_up);
+  curl_easy_getinfo (handle, CURLINFO_SIZE_DOWNLOAD_T, &size_down);
+#else
+  double size_up = 0., size_down = 0.;
+
+  curl_easy_getinfo (handle, CURLINFO_SIZE_UPLOAD, &size_up);
+  curl_easy_getinfo (handle, CURLINFO_SIZE_DOWNLOAD, &size_down);
+#endif
+
+  if (result != CURLE_OK)
+    {
+      cctx->client_state = CSTATE_ERROR;
+      stat_err_inc (cctx);
+    }
+
+  curl_easy_getinfo (handle, CURLINFO_REQUEST_SIZE, &req_size);
+  curl_easy_getinfo (handle, CURLINFO_HEADER_SIZE, &hdr_size);
+  curl_easy_getinfo (handle, CURLINFO_RESPONSE_CODE, &response_status);
+  curl_easy_getinfo (handle, CURLINFO_REDIRECT_COUNT, &redirects);
+
+  stat_data_out_add (cctx, (unsigned long) (req_size + size_up));
+  stat_data_in_add (cctx, (unsigned long) (hdr_size + size_down));
+
+  if (! req_size && response_status <= 0)
+    {
+      return; /* Nothing has been sent */
+    }
+
+  /* Each followed redirection is a request with a 3xx response */
+  for (i = 0; i <= redirects; i++)
+    {
+      stat_req_inc (cctx);
+    }
+  for (i = 0; i < redirects; i++)
+    {
+      stat_3xx_inc (cctx);
+    }
+
+  if (response_status <= 0)
+    {
+      return;
+    }
+
+  /* 
+     The first byte of the last response: completion time "now" cached by the 
+     loop iteration, which runs libcurl, less the transfer time after the 
+     first byte.
+  */
+  time_resp = get_tick_count_cached_usec ();
+  if (time_total > time_start && time_total - time_start < time_resp)
+    {
+      time_resp -= time_total - time_start;
+    }
+
+  switch (response_status / 100)
+    {
+    case 1:
+      stat_1xx_inc (cctx);
+      stat_appl_delay_add (cctx, time_resp);
+      break;
+
+    case 2:
+      stat_2xx_inc (cctx);
+      stat_appl_delay_2xx_add (cctx, time_resp);
+      stat_appl_delay_add (cctx, time_resp);
+      break;
+
+    case 3:
+      stat_3xx_inc (cctx);
+      stat_appl_delay_add (cctx, time_resp);
+      break;
+
+    case 4:
+      stat_4xx_inc (cctx);
+      stat_appl_delay_add (cctx, time_resp);
+      break;
+
+    case 5:
+      stat_5xx_inc (cctx);
+      stat_appl_delay_add (cctx, time_resp);
+      break;
+
+    default:
+      break;
+    }
+
+  response_status_check (cctx, url_ctx, response_status);
+}
+
+/****************************************************************************************
+* Function name - completion_stats_collect
+* 
+* Description - Collects statistics of a completed url fetch: fast statistics, when
+*               used by the client, and for a successful fetch times of its phases 
+*               and the url total time, received body bytes and response status 
+*               to the operational statistics of the url. Completes the sampled
+*               trace of the fetch.
+*
+* Input -       *cctx  - pointer to the client context
+*               result - libcurl result of the fetch
+* Return Code/Output - None
+****************************************************************************************/
+void completion_stats_collect (client_context* cctx, CURLcode result)
+{
+  long response_status = 0;
+#if LIBCURL_VERSION_NUM >= 0x073d00
+  curl_off_t size_down = 0;
+#else
+  double size_down = 0.;
+#endif
+
+  if (cctx->stats_at_completion)
+    {
+      stats_at_completion_collect (cctx, result);
+    }
+
+  if (trace_sampling)
+    {
+      trace_sample_complete (cctx, 
+                             result != CURLE_OK || cctx->client_state == CSTATE_ERROR,
+                             result != CURLE_OK ? curl_easy_strerror (result) : NULL,
+                             handle_time_usec (cctx->handle, CURLINFO_TOTAL_TIME));
+    }
+
+  if (result != CURLE_OK)
+    {
+      return;
+    }
+
+  phase_stats_collect (cctx);
+
+#if LIBCURL_VERSION_NUM >= 0x073d00
+  curl_easy_getinfo (cctx->handle, CURLINFO_SIZE_DOWNLOAD_T, &size_down);
+#else
+  curl_easy_getinfo (cctx->handle, CURLINFO_SIZE_DOWNLOAD, &size_down);
+#endif
+  curl_easy_getinfo (cctx->handle, CURLINFO_RESPONSE_CODE, &response_status);
+
+  op_stat_url_completed (&cctx->bctx->op_delta,
+                         cctx->url_curr_index,
+                         handle_time_usec (cctx->handle, CURLINFO_TOTAL_TIME),
+                         size_down > 0 ? (unsigned long long) size_down : 0,
+                         response_status);
+}
+
 /****************************************************************************************
 * Function name - init_client_contexts
 *
@@ -1515,6 +2009,7 @@ static int init_client_contexts (batch_context* bctx,
          Useful to get the client's CURL handle from bctx. 
       */
       cctx->client_index = i;
+      cctx->batch_client_index = bctx->client_index_base + i;
       cctx->url_curr_index = 0; /* Actually zeroed by calloc. */
       
       /* Set output stream for each client to be either batch logfile or stderr. */
@@ -1548,6 +2043,13 @@ static void free_batch_data_allocations (batch_context* bctx)
 
   op_stat_point_release (&bctx->op_delta);
   op_stat_point_release (&bctx->op_total);
+
+  stat_point_release (&bctx->http_delta);
+  stat_point_release (&bctx->http_total);
+  stat_point_release (&bctx->https_delta);
+  stat_point_release (&bctx->https_total);
+
+  stat_handoff_release (bctx);
   
   /*
      Free client contexts 
@@ -1588,30 +2090,60 @@ static void free_batch_data_allocations (batch_context* bctx)
               free (cctx->url_fetch_decision);
               cctx->url_fetch_decision = NULL;
           }
+
+          trace_sample_release (cctx);
       }/* from for */
       
       free(bctx->cctx_array);
       bctx->cctx_array = NULL;
   }
-  
+
   /* 
-     Free url contexts
+     Url contexts of sub-batches share allocations of the first batch
+     and are released, when all the threads are over.
   */
-  if (bctx->url_ctx_array)
+  if (! threads_subbatches_num)
   {
-      /* Free all URL objects */
-      
-      for (i = 0 ; i < bctx->urls_num; i++)
+      free_batch_urls (bctx);
+  }
+}
+
+/****************************************************************************************
+* Function name - free_batch_urls
+*
+* Description - Deallocates url contexts of a batch. Url contexts of a sub-batch 
+*               are shallow copies of the first batch urls with own url strings only.
+* Input -       *bctx - pointer to batch context to release its urls
+* Return Code/Output - None
+****************************************************************************************/
+static void free_batch_urls (batch_context* bctx)
+{
+  int i;
+
+  if (! bctx->url_ctx_array)
+  {
+      return;
+  }
+
+  /* Free all URL objects */
+  for (i = 0 ; i < bctx->urls_num; i++)
+  {
+      url_context* url = &bctx->url_ctx_array[i];
+
+      if (bctx->batch_id)
+      {
+          free (url->url_str);
+          url->url_str = 0;
+      }
+      else
       {
-          url_context* url = &bctx->url_ctx_array[i];
-          
           free_url (url, bctx->client_num_max);
       }
-      
-      /* Free URL context array */
-      free (bctx->url_ctx_array);
-      bctx->url_ctx_array = NULL;
   }
+      
+  /* Free URL context array */
+  free (bctx->url_ctx_array);
+  bctx->url_ctx_array = NULL;
 }
 
 static void free_url (url_context* url, int clients_max)
@@ -1898,40 +2430,6 @@ static int ip_addr_str_allocate_init (batch_context* bctx,
   return 0;
 }
 
-/****************************************************************************************
-* Function name - rewind_logfile_above_maxsize
-*
-* Description - Rewinds the file pointer, when reaching configurable max-size
-*
-* Input -       *filepointer - file pointer to control and rewind, when necessary
-* Return Code/Output - On Success - 0, on Error -1
-****************************************************************************************/
-int rewind_logfile_above_maxsize (FILE* filepointer)
-{
-  long position = -1;
-
-  if (!filepointer)
-    return -1;
-
-  if (filepointer == stderr)
-    return 0;
-
-  if ((position = ftell (filepointer)) == -1)
-    {
-      fprintf (stderr, 
-               "%s - error: ftell () failed with errno = %d\n", __func__, errno);
-      return 0;
-    }
-
-  if (position > (logfile_rewind_size* 1024*1024))
-    {
-      rewind (filepointer);
-      fprintf (stderr, "%s - logfile with size %ld rewinded.\n", __func__, position);
-    }
-
-  return 0;
-}
-
 /****************************************************************************************
 * Function name - ipv6_increment
 *
@@ -2011,6 +2509,13 @@ static int create_thr_subbatches (batch_context *bc_arr, int subbatches_num)
       return -1;
   }
 
+  if (master.req_rate && master.req_rate < subbatches_num)
+  {
+      fprintf (stderr, "%s - error: wrong input REQ_RATE is less than "
+               "the subbatches number (%d).\n", __func__, subbatches_num);
+      return -1;
+  }
+
   int c_num_max = 0;
 
 
@@ -2021,6 +2526,8 @@ static int create_thr_subbatches (batch_context *bc_arr, int subbatches_num)
       sprintf (bc_arr[i].batch_logfile, "%s.log", bc_arr[i].batch_name);
       sprintf (bc_arr[i].batch_statistics, "%s.txt", bc_arr[i].batch_name);
       
+      bc_arr[i].client_index_base = c_num_max;
+
       if (i != subbatches_num)
       {
           bc_arr[i].client_num_max = master.client_num_max / subbatches_num;
@@ -2039,6 +2546,35 @@ static int create_thr_subbatches (batch_context *bc_arr, int subbatches_num)
               bc_arr[i].client_num_start = 1;
       }
       
+      bc_arr[i].req_rate_open_loop = master.req_rate_open_loop;
+
+      bc_arr[i].arrival_process = master.arrival_process;
+      bc_arr[i].arrival_burst_ratio = master.arrival_burst_ratio;
+      bc_arr[i].arrival_burst_msec = master.arrival_burst_msec;
+      bc_arr[i].arrival_idle_msec = master.arrival_idle_msec;
+      memcpy (bc_arr[i].arrival_trace_file, master.arrival_trace_file, 
+              sizeof (bc_arr[i].arrival_trace_file));
+
+      /* 
+         The arrival schedule of the batch is precomputed for the whole rate,
+         each sub-batch takes its share of the requests.
+      */
+      if (batch_arrival_split (&bc_arr[i], master.arrival_ia, 
+                               master.arrival_ia_num, i, subbatches_num) == -1)
+      {
+          fprintf (stderr, "%s - error: batch_arrival_split () failed.\n", 
+                   __func__);
+          return -1;
+      }
+
+      if (master.req_rate)
+      {
+          /* The request rate is split as the clients, the first batches 
+             take the remainder. */
+          bc_arr[i].req_rate = master.req_rate / subbatches_num +
+            (i < master.req_rate % subbatches_num);
+      }
+
       if (master.clients_rampup_inc)
       {
           bc_arr[i].clients_rampup_inc = master.clients_rampup_inc / subbatches_num;
@@ -2116,6 +2652,13 @@ static int create_thr_subbatches (batch_context *bc_arr, int subbatches_num)
 
       bc_arr[i].cycles_num = master.cycles_num;
 
+      bc_arr[i].run_time = master.run_time;
+
+      bc_arr[i].cpu_affinity = master.cpu_affinity;
+      bc_arr[i].cpu_affinity_num = master.cpu_affinity_num;
+
+      bc_arr[i].log_resp_segment_size = master.log_resp_segment_size;
+
       strncpy (bc_arr[i].user_agent, 
                master.user_agent, 
                sizeof (bc_arr[i].user_agent) -1);
@@ -2227,6 +2770,18 @@ static int create_thr_subbatches (batch_context *bc_arr, int subbatches_num)
               }
           }
       }
+      else if (master.req_rate)
+      {
+          /*
+            The first batch keeps its list of free clients, refilled
+            with its own share of the clients.
+          */
+          bc_arr[i].free_clients_count = bc_arr[i].client_num_max;
+          int ix = bc_arr[i].free_clients_count, client_num = 1;
+          memset (bc_arr[i].free_clients, 0, master.client_num_max * sizeof (int));
+          while (ix-- > 0)
+              bc_arr[i].free_clients[ix] = client_num++;
+      }
       
       /* Zero the pointers to be initialized. */
       bc_arr[i].do_client_num_gradual_increase = 
@@ -2266,7 +2821,23 @@ static int create_thr_subbatches (batch_context *bc_arr, int subbatches_num)
                    __func__);
           return -1;
       }
+
+      if (init_loading_statistics (&bc_arr[i]) == -1)
+      {
+          fprintf (stderr, 
+                   "\"%s\" - init_loading_statistics () failed .\n", 
+                   __func__);
+          return -1;
+      }
+
+      /* Clients migration between the subbatches */
+      pthread_mutex_init (&bc_arr[i].migrate_lock, NULL);
+      bc_arr[i].migrate_head = 0;
+      bc_arr[i].migrate_num = bc_arr[i].migrate_closed = 0;
+      bc_arr[i].loop_lag = 0;
   }
-  
+
+  free (master.arrival_ia);
+
   return 0;
 }
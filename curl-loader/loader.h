@@ -34,8 +34,7 @@
 #define DEFAULT_SMOOTH_URL_COMPLETION_TIME 6.0
 #define TIME_RECALCULATION_CYCLES_NUM 10
 #define TIME_RECALCULATION_MSG_NUM 100
-#define PERIODIC_TIMERS_NUMBER 2
-#define LOGFILE_TEST_TIMER_PERIOD 10 /* once in 10 seconds */
+#define PERIODIC_TIMERS_NUMBER 3
 
 
 /* forward declarations */
@@ -67,9 +66,11 @@ int setup_curl_handle (struct client_context*const cctx, struct url_context* url
 /***************************************************************************
 * Function name - setup_curl_handle_init
 *
-* Description - Resets client context kept CURL handle and inits it locally and using 
-*               setup_curl_handle_appl () function for the application-specific 
-*               (HTTP/FTP) initialization.
+* Description - Inits client context kept CURL handle for fetching a url. Options,
+*               which are the same for each fetch of the url (the handle plan), are 
+*               applied after the handle reset, only when the client comes from 
+*               another url, including setup_curl_handle_appl () for the 
+*               application-specific (HTTP/FTP) initialization.
 *
 * Input -       *cctx    - pointer to client context, which contains CURL handle pointer;
 *               *url_ctx - pointer to url-context, containing all url-related information;
@@ -96,7 +97,7 @@ int init_client_url_post_data (struct client_context* cctx, struct url_context*
 * Description - Opens a logfile for responses to be used for a certain client
 *               and a certain url. A separate file to be opened for headers 
 *               and bodies. Sets the files to the logging mechanism of
-*               libcurl.
+*               libcurl. With segmented capture sets the capture callbacks.
 * 
 * Input -       *cctx - pointer to client context
 *               *url  - pointer to url context
@@ -104,6 +105,33 @@ int init_client_url_post_data (struct client_context* cctx, struct url_context*
 ***********************************************************************/
 int response_logfiles_set (struct client_context* cctx, struct url_context* url);
 
+/**********************************************************************
+* Function name - stats_at_completion_collect
+*
+* Description - Collects statistics of a completed url fetch from libcurl infos
+*               for a client with fast statistics (command-line option -a), 
+*               where the libcurl tracing function is not used.
+* 
+* Input -       *cctx  - pointer to client context
+*               result - libcurl result of the fetch
+* Return Code/Output - None
+***********************************************************************/
+void stats_at_completion_collect (struct client_context* cctx, CURLcode result);
+
+/**********************************************************************
+* Function name - completion_stats_collect
+*
+* Description - Collects statistics of a completed url fetch: fast statistics,
+*               when used by the client, and for a successful fetch times of 
+*               its phases to the batch statistics and total time, body bytes 
+*               and response status to the operational statistics of the url.
+* 
+* Input -       *cctx  - pointer to client context
+*               result - libcurl result of the fetch
+* Return Code/Output - None
+***********************************************************************/
+void completion_stats_collect (struct client_context* cctx, CURLcode result);
+
 
 /*******************************************************************************
 * Function name - add_secondary_ip_to_device
@@ -154,15 +182,6 @@ int parse_config_file (char* const filename,
                        struct batch_context* bctx_array, 
                        size_t bctx_array_size);
 
-/*******************************************************************************
-* Function name - rewind_logfile_above_maxsize
-*
-* Description - Rewinds logfile, when file reaches maximum allowed size
-* Input-        filepointer - pointer to the open logfile
-* Return Code/Output - On success - 0, on errors -1
-********************************************************************************/
-int rewind_logfile_above_maxsize (FILE* filepointer);
-
 
 /****************************************************************************************
  * Function name - pending_active_and_waiting_clients_num
@@ -318,6 +337,17 @@ int user_activity_hyper (struct client_context*const cctx_array);
 ****************************************************************************************/
 int user_activity_smooth (struct client_context*const cctx_array);
 
+/*-------------- io_uring-mode loading function ----------------*/
+
+/****************************************************************************************
+* Function name - user_activity_uring
+*
+* Description - Simulates user-activities using io_uring mode
+* Input -       *cctx_array - array of client contexts (related to a certain batch of clients)
+* Return Code/Output - On Success - 0, on Error -1
+****************************************************************************************/
+int user_activity_uring (struct client_context*const cctx_array);
+
 
 
 int update_url_from_set_or_template (CURL* handle, struct client_context* client, struct url_context* url);
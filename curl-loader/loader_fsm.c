@@ -33,6 +33,8 @@
 #include "heap.h"
 #include "screen.h"
 #include "cl_alloc.h"
+#include "log_ring.h"
+#include "trace_sample.h"
 
 /*
    Number of request rate timer invocations per second used to
@@ -47,6 +49,24 @@ static const int req_rate_timer_invs_per_sec = 5;
 */
 static const int req_rate_timer_fudge = 20;
 
+/*
+   Maximal period of the open-loop request rate timer, msec. The timer 
+   period is the interval between the requests, but not above the value.
+*/
+static const int req_rate_open_loop_period_max = 10;
+
+/* Period of the timer rebalancing clients between threads, msec */
+static const int rebalance_timer_period = 1000;
+
+/* 
+   Minimal event loop lag (msec) of a thread to start migrating its clients
+   to a thread with at least twice lesser lag.
+*/
+static const int rebalance_lag_min = 20;
+
+/* Part of the sleeping clients, which may be migrated at once: 1/8 */
+static const int rebalance_clients_part = 8;
+
 static int load_error_state (client_context* cctx, unsigned long now_time,
                              unsigned long *wait_msec);
 static int load_init_state (client_context* cctx, unsigned long now_time,
@@ -79,9 +99,6 @@ static int setup_url (client_context* cctx);
 static int handle_screen_input_timer (timer_node* tn, 
                                       void* pvoid_param, 
                                       unsigned long ulong_param);
-static int handle_logfile_rewinding_timer (timer_node* tn, 
-                                           void* pvoid_param, 
-                                           unsigned long ulong_param);
 static int 
 handle_gradual_increase_clients_num_timer (timer_node* tn,
                                            void* pvoid_param, 
@@ -100,11 +117,23 @@ static int client_remove_from_load (batch_context* bctx,
 static int client_add_to_load (batch_context* bctx, 
                                client_context* cctx,
                                unsigned long now_time);
+static int clients_add_to_load_woken (batch_context* bctx, 
+                                      unsigned long now_time);
 static int fetching_decision (client_context* cctx, url_context* url);
 static int orderly_sched_clients (batch_context* bctx, int clients_to_sched);
 static int req_rate_sched_clients (batch_context* bctx);
+static int req_rate_open_loop_sched_clients (batch_context* bctx);
+static int req_rate_arrival_sched_clients (batch_context* bctx);
+static void req_rate_backlog_reset (batch_context* bctx);
 static int get_free_client (batch_context* bctx, client_context **pcctx);
 
+static int handle_rebalance_timer (timer_node* tn,
+                                   void* pvoid_param,
+                                   unsigned long ulong_param);
+static int rebalance_enabled (batch_context* bctx);
+static int rebalance_receive_clients (batch_context* bctx, unsigned long now_time);
+static int rebalance_migrate_clients (batch_context* bctx, batch_context* target);
+
 
 
 /*****************************************************************************
@@ -124,13 +153,14 @@ int alloc_init_timer_waiting_queue (size_t size, timer_queue** wq)
 
   *wq = NULL;
 
-  if (! (tq = cl_calloc (1, sizeof (heap))))
+  if (! (tq = cl_calloc (1, sizeof (timer_queue))))
     {
       fprintf (stderr, "%s - error: failed to allocate queue.\n", __func__);
       return -1;
     }
   
   if (tq_init (tq,
+               timer_queue_type, /* heap or timing wheel */
                size,     /* tq size */
                10,       /* tq increase step; 0 - means don't increase */
                size      /* number of nodes to prealloc */
@@ -161,35 +191,11 @@ int init_timers_and_add_initial_clients_to_load (batch_context* bctx,
 {
   //client_context* cctx = bctx->cctx_array;
 
-    /* 
-     Init logfile rewinding timer and schedule it.
-  */
-  const unsigned long logfile_timer_msec  = 
-    1000*LOGFILE_TEST_TIMER_PERIOD;
-
-  bctx->logfile_timer_node.next_timer = now_time + logfile_timer_msec;
-  bctx->logfile_timer_node.period = logfile_timer_msec;
-  bctx->logfile_timer_node.func_timer = handle_logfile_rewinding_timer;
-
-  if (tq_schedule_timer (bctx->waiting_queue, 
-  	                 &bctx->logfile_timer_node) == -1)
-    {
-      fprintf (stderr, "%s - error: tq_schedule_timer () failed.\n", __func__);
-      return -1;
-    }
-#if 0
-   else
-    {
-     fprintf (cctx->file_output, "SCHED: %s - logfile_timer_id is %ld.\n", 
-   __func__, logfile_timer_id);
-    }
-#endif
-
   /* 
      Init screen input testing timer and schedule it.
   */
-  bctx->screen_input_timer_node.next_timer = now_time + 3000;
-  bctx->screen_input_timer_node.period = 1000;
+  bctx->screen_input_timer_node.next_timer = (now_time + 3000) * TICK_USEC_PER_MSEC;
+  bctx->screen_input_timer_node.period = 1000 * TICK_USEC_PER_MSEC;
   bctx->screen_input_timer_node.func_timer = handle_screen_input_timer;
 
   if (tq_schedule_timer (bctx->waiting_queue, &bctx->screen_input_timer_node)== -1)
@@ -221,8 +227,9 @@ int init_timers_and_add_initial_clients_to_load (batch_context* bctx,
          Schedule the gradual loading clients increase timer.
       */
       
-      bctx->clients_num_inc_timer_node.next_timer = now_time + 1000;
-      bctx->clients_num_inc_timer_node.period = 1000;
+      bctx->clients_num_inc_timer_node.next_timer = 
+        (now_time + 1000) * TICK_USEC_PER_MSEC;
+      bctx->clients_num_inc_timer_node.period = 1000 * TICK_USEC_PER_MSEC;
       bctx->clients_num_inc_timer_node.func_timer = 
         handle_gradual_increase_clients_num_timer;
 
@@ -241,15 +248,66 @@ int init_timers_and_add_initial_clients_to_load (batch_context* bctx,
 #endif
     }
 
+  bctx->rebalance_timer_node.timer_id = -1;
+
+  if (rebalance_enabled (bctx))
+    {
+      /* 
+         Schedule timer migrating clients from this thread, when overloaded,
+         to the least loaded thread.
+      */
+      bctx->rebalance_timer_node.next_timer = 
+        (now_time + rebalance_timer_period) * TICK_USEC_PER_MSEC;
+      bctx->rebalance_timer_node.period = rebalance_timer_period * TICK_USEC_PER_MSEC;
+      bctx->rebalance_timer_node.func_timer = handle_rebalance_timer;
+
+      if (tq_schedule_timer (bctx->waiting_queue, 
+                             &bctx->rebalance_timer_node) == -1)
+        {
+          fprintf (stderr, "%s - error: tq_schedule_timer () failed.\n", __func__);
+          return -1;
+        }
+    }
+
   if (bctx->req_rate)
     {
       /* 
          Schedule fixied request rate timer.
       */
-      bctx->req_rate_timer_node.next_timer = now_time + 1000;
-      bctx->req_rate_timer_node.period = 1000/req_rate_timer_invs_per_sec -
-        req_rate_timer_fudge;
+      bctx->req_rate_timer_node.next_timer = (now_time + 1000) * TICK_USEC_PER_MSEC;
+      bctx->req_rate_timer_node.period = (1000/req_rate_timer_invs_per_sec -
+        req_rate_timer_fudge) * TICK_USEC_PER_MSEC;
       bctx->req_rate_timer_node.func_timer = handle_req_rate_timer;
+
+      if (bctx->req_rate_open_loop)
+        {
+          /* 
+             The requests schedule starts with the first timer invocation.
+             The timer is fired for each request, but not rarely than 
+             req_rate_open_loop_period_max.
+          */
+          bctx->req_rate_start_time = bctx->req_rate_timer_node.next_timer;
+          req_rate_backlog_reset (bctx);
+          bctx->req_rate_timer_node.period = 
+            max (TICK_USEC_PER_MSEC, 
+                 min (1000 * TICK_USEC_PER_MSEC / bctx->req_rate, 
+                      req_rate_open_loop_period_max * TICK_USEC_PER_MSEC));
+        }
+
+      if (bctx->arrival_process != ARRIVAL_UNIFORM)
+        {
+          /* 
+             The timer is scheduled once for each request arrival time by 
+             the precomputed inter-arrival times.
+          */
+          bctx->req_rate_start_time = bctx->req_rate_timer_node.next_timer;
+          req_rate_backlog_reset (bctx);
+          bctx->arrival_due_index = bctx->arrival_dispatch_index = 0;
+          bctx->arrival_due_time = bctx->arrival_dispatch_time = 
+            bctx->req_rate_start_time + bctx->arrival_offset;
+          bctx->req_rate_timer_node.period = 0;
+        }
+
       if (tq_schedule_timer (bctx->waiting_queue, 
                              &bctx->req_rate_timer_node) == -1)
         {
@@ -271,13 +329,6 @@ int init_timers_and_add_initial_clients_to_load (batch_context* bctx,
  ***************************************************************************/
 int cancel_periodic_timers (batch_context* bctx)
 {
-  if (bctx->logfile_timer_node.timer_id != -1)
-    {
-      tq_cancel_timer (bctx->waiting_queue, 
-                       bctx->logfile_timer_node.timer_id);
-      bctx->logfile_timer_node.timer_id = -1;
-    }
-
   if (bctx->clients_num_inc_timer_node.timer_id != -1)
     {
       tq_cancel_timer (bctx->waiting_queue, 
@@ -299,6 +350,13 @@ int cancel_periodic_timers (batch_context* bctx)
       bctx->req_rate_timer_node.timer_id = -1;
     }
 
+  if (bctx->rebalance_timer_node.timer_id != -1)
+    {
+      tq_cancel_timer (bctx->waiting_queue, 
+                       bctx->rebalance_timer_node.timer_id);
+      bctx->rebalance_timer_node.timer_id = -1;
+    }
+
   return 0;
 }
 
@@ -421,10 +479,18 @@ int load_next_step (client_context* cctx,
           // Re-init clients in CSTATE_ERROR state to enable their optional
           // scheduling
           cctx->handle = curl_easy_init ();
+          cctx->handle_plan_url = 0;
       }
       return rval_load;
   }
 
+  /* 
+     Open-loop request rate schedule paces the requests instead of
+     the client sleeping after urls.
+  */
+  if (bctx->req_rate_open_loop)
+    interleave_waiting_time = 0;
+
   /* 
      Schedule virtual clients by adding them to multi-handle, 
      if the clients are not in error or finished final states.
@@ -452,7 +518,7 @@ int load_next_step (client_context* cctx,
          Postpone client scheduling for the interleave_waiting_time msec by 
          placing it to the timer queue. Schedule the timer now.
       */
-      cctx->tn.next_timer = now_time + interleave_waiting_time;
+      cctx->tn.next_timer = (now_time + interleave_waiting_time) * TICK_USEC_PER_MSEC;
       cctx->tn.period = 0;
       cctx->tn.func_timer = handle_cctx_sleeping_timer;
 		
@@ -641,19 +707,39 @@ dispatch_expired_timers (batch_context* bctx, unsigned long now_time)
   if (!tq)
     return -1;
 
+  /* Timers are kept in usec; take "now" cached by the loop iteration */
+  unsigned long long now_usec = get_tick_count_cached_usec ();
+  if (now_usec < now_time * TICK_USEC_PER_MSEC)
+    now_usec = now_time * TICK_USEC_PER_MSEC;
+
+  /* Take clients migrated from other threads */
+  if (__atomic_load_n (&bctx->migrate_num, __ATOMIC_RELAXED) &&
+      rebalance_receive_clients (bctx, now_time) == -1)
+    return -1;
+
+  /* Publish statistics counters, when requested by the leader thread */
+  stat_handoff_publish (bctx);
+
   if (tq_empty (tq))
     return 0;
 
   while (! tq_empty (tq))
     {
-      unsigned long time_nearest = tq_time_to_nearest_timer (tq);
+      unsigned long long time_nearest = tq_time_to_nearest_timer (tq);
 
-      if (time_nearest <= now_time)
+      if (time_nearest <= now_usec)
         {
-          if (tq_dispatch_nearest_timer (tq, bctx, now_time) == -1)
+          /* Event loop lag is a running average of timers lateness in msec */
+          __atomic_store_n (&bctx->loop_lag, 
+                            (7 * bctx->loop_lag + 
+                             (int) ((now_usec - time_nearest) / TICK_USEC_PER_MSEC)) / 8,
+                            __ATOMIC_RELAXED);
+
+          if (tq_dispatch_nearest_timer (tq, bctx, now_usec) == -1)
             {
               // fprintf (stderr, "%s - error: tq_dispatch_nearest_timer () failed "
               // "or handle_timer () returns (-1).\n", __func__);
+              clients_add_to_load_woken (bctx, now_time);
               return -1;
             }
           else
@@ -665,9 +751,57 @@ dispatch_expired_timers (batch_context* bctx, unsigned long now_time)
         break;
     }
 
+  /* Clients woken up by the expired timers go to load as a batch */
+  if (clients_add_to_load_woken (bctx, now_time) == -1)
+    return -1;
+
   return count;
 }
 
+/******************************************************************************
+ * Function name - clients_add_to_load_woken
+ *
+ * Description - Adds to the multi-handle the clients, woken up by expired 
+ *               sleeping timers at the current dispatching of the waiting 
+ *               queue. When thousands of clients wake up at the same msec, 
+ *               they are added by a single sweep. libcurl sets its timeout to 
+ *               start the added transfers, thus they are started by a single
+ *               timeout action of the event loop, which reads the completed 
+ *               transfers after it, rather than by an iteration per client.
+ *
+ * Input -       *bctx    - pointer to the batch context
+ *               now_time - current time in msec
+ * Return Code/Output - On success - number of the added clients, 
+ *                      on error - (-1)
+ *******************************************************************************/
+static int clients_add_to_load_woken (batch_context* bctx, 
+                                      unsigned long now_time)
+{
+  client_context* cctx = bctx->wake_head;
+  client_context* next = 0;
+  int added = 0, rval = 0;
+
+  if (!cctx)
+    return 0;
+
+  bctx->wake_head = bctx->wake_tail = 0;
+
+  for (; cctx; cctx = next)
+    {
+      next = cctx->wake_next;
+      cctx->wake_next = 0;
+
+      if (client_add_to_load (bctx, cctx, now_time) == -1)
+        {
+          rval = -1;
+          continue;
+        }
+      added++;
+    }
+
+  return rval ? rval : added;
+}
+
 /******************************************************************************
  * Function name - client_add_to_load
  *
@@ -687,8 +821,13 @@ static int client_add_to_load (batch_context* bctx,
   cctx->preload_state = cctx->client_state;
   cctx->preload_url_curr_index = cctx->url_curr_index;
 
-  /* Schedule the client immediately */
-  cctx->req_sent_timestamp = now_time;
+  /* 
+     Schedule the client immediately. Open-loop fixed rate requests are timed
+     from their intended start.
+  */
+  cctx->req_sent_timestamp = cctx->req_intended_timestamp ? 
+    cctx->req_intended_timestamp : get_tick_count_cached_usec ();
+  cctx->req_intended_timestamp = 0;
   if (curl_multi_add_handle (bctx->multiple_handle, cctx->handle) ==  CURLM_OK)
     {
       unsigned long timer_url_completion = 0;
@@ -706,7 +845,7 @@ static int client_add_to_load (batch_context* bctx,
 
       if (timer_url_completion)
         {
-          cctx->tn.next_timer = now_time + timer_url_completion;
+          cctx->tn.next_timer = (now_time + timer_url_completion) * TICK_USEC_PER_MSEC;
           cctx->tn.period = 0;
           cctx->tn.func_timer = handle_cctx_url_completion_timer;
           
@@ -810,35 +949,6 @@ static int handle_gradual_increase_clients_num_timer (timer_node* timer_node,
   return 0;
 }
 
-/****************************************************************************************
- * Function name - handle_logfile_rewinding_timer
- *
- * Description -   Handling of logfile controlling periodic timer
- *
- * Input -        *timer_node  - pointer to timer node structure
- *                *pvoid_param - pointer to some extra data; here batch context
- *                *ulong_param - some extra data.
- * Return Code/Output - On success -0, on error - (-1)
- ****************************************************************************************/
-static int handle_logfile_rewinding_timer (timer_node* timer_node, 
-                                           void* pvoid_param, 
-                                           unsigned long ulong_param)
-{
-  batch_context* bctx = (batch_context *) pvoid_param;
-  (void) timer_node;
-  (void) ulong_param;
-
-  if (rewind_logfile_above_maxsize (bctx->cctx_array->file_output) == -1)
-    {
-      fprintf (stderr, "%s - rewind_logfile_above_maxsize() failed .\n", 
-      	__func__);
-      return -1;
-    }
-  
-  //fprintf (stderr, "%s - runs.\n", __func__);
-  return 0;
-}
-
 /******************************************************************************
  * Function name - handle_screen_input_timer
  *
@@ -868,8 +978,8 @@ static int handle_screen_input_timer (timer_node* timer_node,
  * Function name - handle_cctx_sleeping_timer
  *
  * Description - Handling of timer for a client waiting in the waiting queue to 
- *               respect url interleave timeout. Schedules the client to perform 
- *               the next loading operation.
+ *               respect url interleave timeout. Puts the client to the list of 
+ *               woken up clients to perform the next loading operation.
  *
  * Input -       *tn          - pointer to timer node structure
  *               *pvoid_param - pointer to some extra data; here batch context
@@ -887,6 +997,7 @@ int handle_cctx_sleeping_timer (timer_node* tn,
   batch_context* bctx = cctx->bctx;
   url_context* url = &bctx->url_ctx_array[cctx->url_curr_index];
 
+  cctx->tid_sleeping = -1;
   bctx->sleeping_clients_count--;
 
   if (url->fresh_connect)
@@ -901,9 +1012,18 @@ int handle_cctx_sleeping_timer (timer_node* tn,
       setup_url (cctx);
     }
 
-  const unsigned long now_time = get_tick_count ();
+  /* 
+     Added to load by dispatch_expired_timers () together with the other 
+     clients woken up at this dispatching.
+  */
+  cctx->wake_next = 0;
+  if (bctx->wake_tail)
+    bctx->wake_tail->wake_next = cctx;
+  else
+    bctx->wake_head = cctx;
+  bctx->wake_tail = cctx;
 
-  return client_add_to_load (bctx, cctx, now_time);
+  return 0;
 }
 
 /*****************************************************************************
@@ -978,16 +1098,31 @@ static int handle_cctx_url_completion_timer (timer_node* tn,
   stat_url_timeout_err_inc (cctx);
   cctx->client_state = CSTATE_ERROR;
 
-  const unsigned long now_time = get_tick_count ();
+  /* The fetch is cut, count what it has done; the timeout is counted above */
+  if (cctx->stats_at_completion)
+    {
+      stats_at_completion_collect (cctx, CURLE_OK);
+    }
+
+  const unsigned long now_time = get_tick_count_cached ();
   if (verbose_logging)
     {
-      fprintf (cctx->file_output, 
+      trace_sample_printf (cctx, 
                "%ld %ld %ld %s !! ERUT url completion timeout: url: %s\n", 
               now_time - bctx->start_time,
               cctx->cycle_num, cctx->url_curr_index, cctx->client_name, 
               bctx->url_ctx_array[cctx->url_curr_index].url_str);
     }
 
+  if (trace_sampling)
+    {
+      const unsigned long long now_usec = get_tick_count_cached_usec ();
+
+      trace_sample_complete (cctx, 1, "url completion timeout",
+                             cctx->req_sent_timestamp && now_usec > cctx->req_sent_timestamp ?
+                             (unsigned long) (now_usec - cctx->req_sent_timestamp) : 0);
+    }
+
 
   /*
     If fixed request rate is specified, free the client, the next step
@@ -1016,7 +1151,13 @@ static int handle_req_rate_timer (timer_node* tn,
   (void) tn;
   (void) ulong_param;
 
-  (void)req_rate_sched_clients(bctx);
+  if (bctx->arrival_process != ARRIVAL_UNIFORM)
+    return req_rate_arrival_sched_clients (bctx);
+
+  if (bctx->req_rate_open_loop)
+    (void)req_rate_open_loop_sched_clients(bctx);
+  else
+    (void)req_rate_sched_clients(bctx);
   return 0;
 }
 
@@ -1063,8 +1204,203 @@ int pending_active_and_waiting_clients_num_stat (batch_context* bctx)
   return total;
 }
 
+/****************************************************************************************
+ * Function name - rebalance_close
+ *
+ * Description -  Called by a thread, which has no more clients to load. Closes the batch
+ *                for clients migration from other threads, unless some clients have
+ *                been already migrated to the batch and are still to be taken.
+ *
+ * Input -       *bctx - pointer to the batch context
+ * Return Code/Output - 0, when closed, -1, when migrated clients are to be loaded
+ ****************************************************************************************/
+int rebalance_close (batch_context* bctx)
+{
+  int rval = 0;
+
+  if (! rebalance_enabled (bctx))
+    return 0;
+
+  pthread_mutex_lock (&bctx->migrate_lock);
+
+  if (bctx->migrate_num)
+    rval = -1;
+  else
+    __atomic_store_n (&bctx->migrate_closed, 1, __ATOMIC_RELAXED);
+
+  pthread_mutex_unlock (&bctx->migrate_lock);
+
+  return rval;
+}
+
 /*================= STATIC FUNCTIONS =================== */
 
+/*************************************************************************
+ * Function name - rebalance_enabled
+ *
+ * Description - Whether clients may be migrated between threads. Clients 
+ *               of a fixed request rate are kept by index at their batches.
+ *
+ * Input -       *bctx - pointer to the batch context
+ * Return Code/Output - true, when enabled, false - when not
+ ***************************************************************************/
+static int rebalance_enabled (batch_context* bctx)
+{
+  return threads_subbatches_num > 1 && ! bctx->req_rate;
+}
+
+/*************************************************************************
+ * Function name - handle_rebalance_timer
+ *
+ * Description - Handling of the timer rebalancing clients. When event loop 
+ *               lag of the thread exceeds rebalance_lag_min, migrates some 
+ *               of its sleeping clients to the thread with the least lag, 
+ *               if the lag of that thread is at least twice lesser.
+ *
+ * Input -       *tn          - pointer to timer node structure
+ *               *pvoid_param - pointer to some extra data; here batch context
+ *               *ulong_param - some extra data.
+ * Return Code/Output - On success 0, on error -1
+ ***************************************************************************/
+static int handle_rebalance_timer (timer_node* tn,
+                                   void* pvoid_param,
+                                   unsigned long ulong_param)
+{
+  batch_context* bctx = (batch_context *) pvoid_param;
+  batch_context* bctx_first = bctx - bctx->batch_id;
+  batch_context* target = 0;
+  int target_lag = bctx->loop_lag;
+  int i;
+
+  (void) tn;
+  (void) ulong_param;
+
+  if (bctx->loop_lag < rebalance_lag_min)
+    return 0;
+
+  for (i = 0; i < threads_subbatches_num; i++)
+    {
+      batch_context* other = bctx_first + i;
+      int other_lag = __atomic_load_n (&other->loop_lag, __ATOMIC_RELAXED);
+
+      if (other != bctx && 2 * other_lag < target_lag &&
+          ! __atomic_load_n (&other->migrate_closed, __ATOMIC_RELAXED))
+        {
+          target = other;
+          target_lag = 2 * other_lag;
+        }
+    }
+
+  return target ? rebalance_migrate_clients (bctx, target) : 0;
+}
+
+/*************************************************************************
+ * Function name - rebalance_migrate_clients
+ *
+ * Description - Takes from the waiting queue up to rebalance_clients_part 
+ *               of the batch sleeping clients and passes them to the target 
+ *               batch. Only clients of the batch own clients array are 
+ *               migrated, thus a migrated client is further loaded by the 
+ *               target thread only. CURL handles of sleeping clients are 
+ *               out of multi-handle and move along with the clients.
+ *
+ * Input -       *bctx   - pointer to the batch context
+ *               *target - pointer to the target batch context
+ * Return Code/Output - On success number of migrated clients, on error -1
+ ***************************************************************************/
+static int rebalance_migrate_clients (batch_context* bctx, batch_context* target)
+{
+  int to_migrate = bctx->sleeping_clients_count / rebalance_clients_part;
+  int migrated = 0;
+  int i;
+
+  if (! to_migrate)
+    return 0;
+
+  pthread_mutex_lock (&target->migrate_lock);
+
+  if (target->migrate_closed)
+    {
+      pthread_mutex_unlock (&target->migrate_lock);
+      return 0;
+    }
+
+  for (i = 0; i < bctx->client_num_max && migrated < to_migrate; i++)
+    {
+      client_context* cctx = &bctx->cctx_array[i];
+
+      /* 
+         Sleeping clients of the batch only. Target IP-addresses are taken by
+         the client index.
+      */
+      if (cctx->bctx != bctx || cctx->tid_sleeping == -1 ||
+          cctx->client_index >= (size_t) target->client_num_max)
+        continue;
+
+      if (tq_cancel_timer (bctx->waiting_queue, cctx->tid_sleeping) == -1)
+        continue;
+
+      cctx->tid_sleeping = -1;
+      bctx->sleeping_clients_count--;
+
+      /* The plan has IP-address, error buffer and share of this thread */
+      cctx->handle_plan_url = 0;
+      cctx->bctx = target;
+      cctx->migrate_next = target->migrate_head;
+      target->migrate_head = cctx;
+      migrated++;
+    }
+
+  __atomic_store_n (&target->migrate_num, target->migrate_num + migrated, 
+                    __ATOMIC_RELAXED);
+
+  pthread_mutex_unlock (&target->migrate_lock);
+
+  return migrated;
+}
+
+/*************************************************************************
+ * Function name - rebalance_receive_clients
+ *
+ * Description - Takes clients migrated to the batch by other threads and
+ *               places them to the batch waiting queue to sleep the rest 
+ *               of their sleeping time.
+ *
+ * Input -       *bctx    - pointer to the batch context
+ *               now_time - current time in msec
+ * Return Code/Output - On success 0, on error -1
+ ***************************************************************************/
+static int rebalance_receive_clients (batch_context* bctx, unsigned long now_time)
+{
+  client_context* cctx;
+
+  pthread_mutex_lock (&bctx->migrate_lock);
+
+  cctx = bctx->migrate_head;
+  bctx->migrate_head = 0;
+  __atomic_store_n (&bctx->migrate_num, 0, __ATOMIC_RELAXED);
+
+  pthread_mutex_unlock (&bctx->migrate_lock);
+
+  for (; cctx; cctx = cctx->migrate_next)
+    {
+      if (cctx->tn.next_timer < now_time * TICK_USEC_PER_MSEC)
+        cctx->tn.next_timer = now_time * TICK_USEC_PER_MSEC;
+
+      if ((cctx->tid_sleeping = tq_schedule_timer (bctx->waiting_queue, 
+                                                   (struct timer_node *) cctx)) == -1)
+        {
+          fprintf (stderr, "%s - error: tq_schedule_timer () failed.\n", __func__);
+          return -1;
+        }
+
+      bctx->sleeping_clients_count++;
+    }
+
+  return 0;
+}
+
+
 static int fetching_first_cycling_url (client_context* cctx)
 {
   batch_context* bctx = cctx->bctx;
@@ -1139,6 +1475,12 @@ static int setup_url (client_context* cctx)
               return -1;
             }
         }
+
+      /* 
+         The options are set outside of the handle plan, thus the next url
+         resets the handle and applies its plan in full.
+      */
+      cctx->handle_plan_url = 0;
     }
 
   return cctx->client_state = CSTATE_URLS;
@@ -1365,6 +1707,7 @@ static int load_urls_state (client_context* cctx,
             timer handler.
           */
           curl_easy_reset (handle);
+          cctx->handle_plan_url = 0;
         }
       else
         {
@@ -1408,7 +1751,7 @@ static int orderly_sched_clients (batch_context* bctx,
                                   int clients_to_sched)
 {
   int scheduled_now = 0;
-  unsigned long now_time = get_tick_count ();
+  unsigned long now_time = get_tick_count_cached ();
   long j;
 
   for (j = bctx->clients_current_sched_num; 
@@ -1446,7 +1789,7 @@ static int orderly_sched_clients (batch_context* bctx,
 static int req_rate_sched_clients (batch_context* bctx)
 {
   int scheduled_now = 0;
-  unsigned long now_time = get_tick_count ();
+  unsigned long now_time = get_tick_count_cached ();
   int j;
 
   /*
@@ -1486,6 +1829,203 @@ static int req_rate_sched_clients (batch_context* bctx)
   return 0;
 }
 
+/*****************************************************************************
+ * Function name - req_rate_backlog_reset
+ *
+ * Description - Zeroes the open-loop request rate counters. The counters are
+ *               written by the batch thread only, but are read by the 
+ *               statistics leader thread, thus are stored atomically.
+ *
+ * Input -       *bctx - pointer to the batch context
+ * Return Code/Output - None
+ ******************************************************************************/
+static void req_rate_backlog_reset (batch_context* bctx)
+{
+  __atomic_store_n (&bctx->req_rate_due_num, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&bctx->req_rate_dispatched_num, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&bctx->req_rate_backlogged_num, 0, __ATOMIC_RELAXED);
+}
+
+/*****************************************************************************
+ * Function name - req_rate_open_loop_sched_clients
+ *
+ * Description - Schedule clients to run (using load_next_step () ) for the
+ *               open-loop fixed request rate. The k-th request is due at 
+ *               req_rate_start_time + k*1000000/req_rate usec, its intended 
+ *               start time, and the latency of the request is counted from 
+ *               that time. Requests, which are due, but cannot be started 
+ *               for lack of free clients, are kept as backlog and are 
+ *               started at the next invocations in their schedule order.
+ *
+ * Input -       *bctx - pointer to the batch context
+ * Return Code/Output - On success 0, on error -1
+ ******************************************************************************/
+static int req_rate_open_loop_sched_clients (batch_context* bctx)
+{
+  const unsigned long long now_usec = get_tick_count_cached_usec ();
+  const unsigned long now_time = (unsigned long) (now_usec / TICK_USEC_PER_MSEC);
+  unsigned long due_num;
+  int scheduled_now;
+
+  if (now_usec < bctx->req_rate_start_time)
+    return 0;
+
+  due_num = (unsigned long) 
+    ((now_usec - bctx->req_rate_start_time) * bctx->req_rate / 1000000ULL) + 1;
+
+  /* 
+     Requests coming due now, but not started at this invocation, are 
+     counted as backlogged.
+  */
+  const unsigned long due_prev = bctx->req_rate_due_num;
+  if (due_num > bctx->req_rate_due_num)
+    __atomic_store_n (&bctx->req_rate_due_num, due_num, __ATOMIC_RELAXED);
+
+  while (bctx->req_rate_dispatched_num < bctx->req_rate_due_num)
+    {
+      client_context *cctx;
+
+      /*
+        Respect gradual increase of clients if any
+      */
+      if (bctx->clients_current_sched_num < bctx->client_num_max &&
+          bctx->client_num_max - bctx->free_clients_count >= 
+          bctx->clients_current_sched_num)
+        break;
+
+      if (get_free_client (bctx, &cctx) < 0)
+        break;
+
+      cctx->req_intended_timestamp = bctx->req_rate_start_time + 
+        (unsigned long long) bctx->req_rate_dispatched_num * 1000000ULL / 
+        bctx->req_rate;
+      __atomic_store_n (&bctx->req_rate_dispatched_num, 
+                        bctx->req_rate_dispatched_num + 1, __ATOMIC_RELAXED);
+
+      scheduled_now = 0;
+      load_next_step (cctx, now_time, &scheduled_now);
+
+      /* Not taken by client_add_to_load (), when the client is finished */
+      cctx->req_intended_timestamp = 0;
+    }
+
+  __atomic_store_n (&bctx->req_rate_backlogged_num, 
+                    bctx->req_rate_backlogged_num + bctx->req_rate_due_num - 
+                    max (bctx->req_rate_dispatched_num, due_prev),
+                    __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+/*****************************************************************************
+ * Function name - req_rate_arrival_sched_clients
+ *
+ * Description - Schedule clients to run (using load_next_step () ) by the 
+ *               arrival process of the fixed request rate. Requests come due
+ *               at the times of the precomputed inter-arrival times. With the
+ *               open-loop rate a request gets its arrival time as the intended
+ *               start time and is kept as backlog, when it cannot be started.
+ *               Otherwise requests, which cannot be started, are skipped.
+ *               The one-shot request rate timer is scheduled again for the next
+ *               arrival, or sooner to retry the backlog.
+ *
+ * Input -       *bctx - pointer to the batch context
+ * Return Code/Output - On success 0, on error -1
+ ******************************************************************************/
+static int req_rate_arrival_sched_clients (batch_context* bctx)
+{
+  const unsigned long long now_usec = get_tick_count_cached_usec ();
+  const unsigned long now_time = (unsigned long) (now_usec / TICK_USEC_PER_MSEC);
+  const unsigned long due_prev = bctx->req_rate_due_num;
+  int scheduled_now;
+
+  /* The timer has been dispatched and its timer-id released */
+  bctx->req_rate_timer_node.timer_id = -1;
+
+  /* Clients are not returned to the free list after the run time */
+  if (bctx->requests_completed)
+    return 0;
+
+  unsigned long due_num = bctx->req_rate_due_num;
+
+  while (bctx->arrival_due_time <= now_usec)
+    {
+      due_num++;
+      bctx->arrival_due_time += bctx->arrival_ia[bctx->arrival_due_index];
+      if (++bctx->arrival_due_index == bctx->arrival_ia_num)
+        bctx->arrival_due_index = 0;
+    }
+
+  __atomic_store_n (&bctx->req_rate_due_num, due_num, __ATOMIC_RELAXED);
+
+  while (bctx->req_rate_dispatched_num < bctx->req_rate_due_num)
+    {
+      client_context *cctx = 0;
+
+      /*
+        Respect gradual increase of clients if any
+      */
+      const int rampup_full = 
+        bctx->clients_current_sched_num < bctx->client_num_max &&
+        bctx->client_num_max - bctx->free_clients_count >= 
+        bctx->clients_current_sched_num;
+
+      if (rampup_full || get_free_client (bctx, &cctx) < 0)
+        {
+          if (bctx->req_rate_open_loop)
+            break;
+
+          if (!rampup_full)
+            fprintf(stderr, "%s error: need free clients (%lu)\n",
+                    __func__, bctx->req_rate_due_num - bctx->req_rate_dispatched_num);
+
+          __atomic_store_n (&bctx->req_rate_dispatched_num, 
+                            bctx->req_rate_due_num, __ATOMIC_RELAXED);
+          bctx->arrival_dispatch_index = bctx->arrival_due_index;
+          bctx->arrival_dispatch_time = bctx->arrival_due_time;
+          break;
+        }
+
+      if (bctx->req_rate_open_loop)
+        cctx->req_intended_timestamp = bctx->arrival_dispatch_time;
+
+      __atomic_store_n (&bctx->req_rate_dispatched_num, 
+                        bctx->req_rate_dispatched_num + 1, __ATOMIC_RELAXED);
+      bctx->arrival_dispatch_time += 
+        bctx->arrival_ia[bctx->arrival_dispatch_index];
+      if (++bctx->arrival_dispatch_index == bctx->arrival_ia_num)
+        bctx->arrival_dispatch_index = 0;
+
+      scheduled_now = 0;
+      load_next_step (cctx, now_time, &scheduled_now);
+
+      /* Not taken by client_add_to_load (), when the client is finished */
+      cctx->req_intended_timestamp = 0;
+    }
+
+  if (bctx->req_rate_open_loop)
+    __atomic_store_n (&bctx->req_rate_backlogged_num, 
+                      bctx->req_rate_backlogged_num + bctx->req_rate_due_num - 
+                      max (bctx->req_rate_dispatched_num, due_prev),
+                      __ATOMIC_RELAXED);
+
+  bctx->req_rate_timer_node.next_timer = bctx->arrival_due_time;
+
+  if (bctx->req_rate_dispatched_num < bctx->req_rate_due_num)
+    bctx->req_rate_timer_node.next_timer = 
+      min (bctx->req_rate_timer_node.next_timer, 
+           now_usec + req_rate_open_loop_period_max * TICK_USEC_PER_MSEC);
+
+  if (tq_schedule_timer (bctx->waiting_queue, 
+                         &bctx->req_rate_timer_node) == -1)
+    {
+      fprintf (stderr, "%s - error: tq_schedule_timer () failed.\n", __func__);
+      return -1;
+    }
+
+  return 0;
+}
+
 /*****************************************************************************
  * Function name - get_free_client
  *
@@ -36,13 +36,24 @@
 #include "loader.h"
 #include "conf.h"
 #include "cl_alloc.h"
+#include "mpool.h"
 #include "screen.h"
+#include "stats_stream.h"
 
 
-#define TIMER_NEXT_LOAD 20000
+/* 
+   Maximum time (msec) to wait for the next load, when no timers are due 
+   in the waiting queue.
+*/
+#define NEXT_LOAD_MAX_WAIT 1000
+
+/* Number of sockets table entries to be reserved above the clients number. */
+#define SOCK_TABLE_RESERVE 64
 
 static int mget_url_hyper (batch_context* bctx);
 static int mperform_hyper (batch_context* bctx, int* still_running);
+static void schedule_next_load_hyper (batch_context* bctx, 
+                                      unsigned long now_time);
 
 
 #if 0
@@ -53,14 +64,19 @@ static int mperform_hyper (batch_context* bctx, int* still_running);
 
 
 
+/*
+  Live socket of a batch, kept in the batch sockets table at the index
+  of its descriptor and allocated from the batch sockets pool.
+*/
 typedef struct sock_info
 {
+  /* Base for the "allocatable" property. */
+  allocatable alloc;
+
   curl_socket_t sockfd;
 
   int action;  /*CURL_POLL_IN CURL_POLL_OUT */
 
-  long timeout;
-
   struct event ev;
 
   int evset;
@@ -68,13 +84,14 @@ typedef struct sock_info
 } sock_info;
 
 
-int still_running;
-
 static void event_cb_hyper (int fd, short kind, void *userp);
 static void update_timeout_hyper (batch_context *bctx);
 
 static int on_exit_hyper (batch_context* bctx);
 
+static int sock_table_init (batch_context* bctx);
+static int sock_table_grow (batch_context* bctx, curl_socket_t socket);
+
 
 //static struct event timer_event;
 //static struct event timer_next_load_event;
@@ -84,6 +101,8 @@ static int on_exit_hyper (batch_context* bctx);
  * Function name - event_cb_hyper
  *
  * Description - A libevent callback. Called by libevent when we get action on a socket.
+ *               Passes the action to libcurl and proceeds with the completed 
+ *               transfers immediately.
  * Input -       fd - descriptor (socket)
  *                   kind -  a bitmask of events from libevent
  *                   *userp - user pointer, we pass pointer to batch-context structure
@@ -107,6 +126,9 @@ static void event_cb_hyper (int fd, short kind, void *userp)
     }
   
   PRINTF("event_cb_hyper enter\n");
+
+  /* "now" of the iteration for libcurl callbacks and timers */
+  update_tick_count_cached ();
   
   /* 
      Tell libcurl to deal with the transfer associated with this socket 
@@ -118,26 +140,16 @@ static void event_cb_hyper (int fd, short kind, void *userp)
     } 
   while (rc == CURLM_CALL_MULTI_PERFORM);
 
-  if(st) 
-    {
-      update_timeout_hyper(bctx);
-    } 
-  else 
-    {
-#if 0
-      PRINTF("last transfer done, kill timeout\n");
-      if (evtimer_pending(&timer_event, NULL)) {
-        evtimer_del(&timer_event);
-      }
-#endif
-    }
+  mperform_hyper (bctx, &st);
+
   PRINTF("event_cb_hyper exit\n");
 }
 
 /************************************************************************
  * Function name - timer_cb_hyper
  *
- * Description - A libevent callback. Called by libevent when timeout expires
+ * Description - A libevent callback. Called by libevent when libcurl timeout 
+ *               expires. Proceeds with the completed transfers immediately.
  * Input -       fd - descriptor (socket)
  *                   kind -  a bitmask of events from libevent
  *                   *userp - user pointer, we pass pointer to batch-context structure
@@ -153,28 +165,104 @@ static void timer_cb_hyper (int fd, short kind, void *userp)
 
   //PRINTF("timer_cb_hyper enter\n");
 
+  update_tick_count_cached ();
+
   do 
     {
-      rc = curl_multi_socket(bctx->multiple_handle, CURL_SOCKET_TIMEOUT, &st);
+      rc = curl_multi_socket_action (bctx->multiple_handle, 
+                                     CURL_SOCKET_TIMEOUT, 
+                                     0, 
+                                     &st);
     } 
   while (rc == CURLM_CALL_MULTI_PERFORM);
-    
-  if (still_running ) 
-    { 
-      update_timeout_hyper(bctx); 
-    }
+
+  mperform_hyper (bctx, &st);
 
   //PRINTF("timer_cb_hyper exit\n");
 }
 
+/************************************************************************
+ * Function name - sock_table_init
+ *
+ * Description - Allocates the batch sockets table, indexed by socket 
+ *               descriptors, and initializes the pool of sock_info objects.
+ *
+ * Input -       *bctx - pointer to batch context
+ * Return Code/Output - On Success - 0, on Error -1
+ *************************************************************************/
+static int sock_table_init (batch_context* bctx)
+{
+  bctx->sock_table_size = bctx->client_num_max + SOCK_TABLE_RESERVE;
+
+  if (! (bctx->sock_table = cl_calloc (bctx->sock_table_size, 
+                                       sizeof (sock_info *))))
+    {
+      fprintf (stderr, "%s - error: sockets table allocation failed.\n", 
+               __func__);
+      return -1;
+    }
+
+  if (! (bctx->sock_pool = cl_calloc (1, sizeof (mpool))))
+    {
+      fprintf (stderr, "%s - error: sockets pool allocation failed.\n", 
+               __func__);
+      return -1;
+    }
+
+  if (mpool_init (bctx->sock_pool, sizeof (sock_info), 1) == -1)
+    {
+      fprintf (stderr, "%s - error: mpool_init () failed.\n", __func__);
+      return -1;
+    }
+
+  return 0;
+}
+
+/************************************************************************
+ * Function name - sock_table_grow
+ *
+ * Description - Grows the batch sockets table to fit the socket descriptor
+ *
+ * Input -       *bctx - pointer to batch context
+ *               socket - socket descriptor
+ * Return Code/Output - On Success - 0, on Error -1
+ *************************************************************************/
+static int sock_table_grow (batch_context* bctx, curl_socket_t socket)
+{
+  int new_size = 2 * bctx->sock_table_size;
+  struct sock_info** new_table;
+
+  if (new_size <= socket)
+    {
+      new_size = socket + SOCK_TABLE_RESERVE;
+    }
+
+  if (! (new_table = realloc (bctx->sock_table, 
+                              new_size * sizeof (sock_info *))))
+    {
+      fprintf (stderr, "%s - error: realloc () failed with errno %d.\n", 
+               __func__, errno);
+      return -1;
+    }
+
+  memset (new_table + bctx->sock_table_size, 0, 
+          (new_size - bctx->sock_table_size) * sizeof (sock_info *));
+
+  bctx->sock_table = new_table;
+  bctx->sock_table_size = new_size;
+  return 0;
+}
+
 /************************************************************************
  * Function name - remsock
  *
- * Description - Clean up the sock_info structure
+ * Description - Clean up the sock_info structure, removes it from the 
+ *               sockets table and returns to the sockets pool
  * Input -      *sinfo - pointer to sinfo structure 
+ *              *bctx - pointer to batch context
  * Return Code/Output - None
  *************************************************************************/
-static void remsock(sock_info *sinfo)
+static void remsock(sock_info *sinfo, batch_context* bctx)
 {
   PRINTF("remsock- enter\n");
 
@@ -188,6 +276,9 @@ static void remsock(sock_info *sinfo)
       event_del(&sinfo->ev); 
     }
   sinfo->evset = 0;
+
+  bctx->sock_table[sinfo->sockfd] = 0;
+  mpool_return_obj (bctx->sock_pool, (allocatable *) sinfo);
 }
 
 /************************************************************************
@@ -235,28 +326,41 @@ static void setsock_hyper(sock_info*sinfo,
 /************************************************************************
  * Function name - addsock_hyper
  *
- * Description - Initialize a new sock_info structure
+ * Description - Takes a new sock_info structure from the sockets pool,
+ *               initializes it and places to the sockets table
  *
  * Input -   socket - socket descriptor   
  *               *handle -  pointer to CURL library handle
  *               action - bitmask of events from curl library
- *               *cctx - pointer to client context
- *               *sinfo - pointer to sinfo structure to fill
  *               *bctx - pointer to batch context
- * Return Code/Output - None
+ * Return Code/Output - On Success - 0, on Error -1
  *************************************************************************/
-static void addsock_hyper(curl_socket_t socket, 
+static int addsock_hyper(curl_socket_t socket, 
                     CURL *handle, 
                     int action,
-                    client_context *cctx, 
-                    sock_info *sinfo, 
                     batch_context *bctx) 
 {
+  sock_info *sinfo;
+
   PRINTF("addsock_hyper - enter\n");
 
-  setsock_hyper (sinfo, socket, handle, action, bctx);
+  if (socket >= bctx->sock_table_size && 
+      sock_table_grow (bctx, socket) == -1)
+    {
+      return -1;
+    }
+
+  if (! (sinfo = (sock_info *) mpool_take_obj (bctx->sock_pool)))
+    {
+      fprintf (stderr, "%s - error: mpool_take_obj () failed.\n", __func__);
+      return -1;
+    }
 
-  curl_multi_assign (bctx->multiple_handle, socket, cctx);
+  sinfo->evset = 0;
+  bctx->sock_table[socket] = sinfo;
+
+  setsock_hyper (sinfo, socket, handle, action, bctx);
+  return 0;
 }
 
 #if 0
@@ -267,13 +371,15 @@ static char *whatstr[]={ "none", "IN", "OUT", "INOUT", "REMOVE" };
  * Function name - socket_callback
  *
  * Description - A libcurl socket callback. Called by libcurl, when there is an
- *                    event on socket. Unfortunately, it is called only for the trasfer stage.
+ *                    event on socket. Sockets are looked up in the batch sockets
+ *                    table by their descriptors, thus a client may have several
+ *                    sockets alive, e.g. FTP control and data connections.
  *
  * Input -       *handle - pointer to CURL handle
  *                   socket - socket descriptor
  *                  what - libcurl event bitmask
  *                  *cbp - libcurl callback pointer; we pass batch context here
- *                   *sockp - pointer to the handle user-assigned private data, here client-context 
+ *                   *sockp - pointer to the socket user-assigned private data, not used
  * Return Code/Output - On Success - 0, on Error -1
  *************************************************************************/
 static int socket_callback (CURL *handle, 
@@ -283,50 +389,27 @@ static int socket_callback (CURL *handle,
                     void *sockp)
 {
   batch_context* bctx = (batch_context *) cbp;
-  client_context* cctx = (client_context *) sockp;
-  sock_info *sinfo = (sock_info*) cctx ? cctx->ext_data : 0;
-
-  PRINTF("socket_callback - enter\n");
-
-  if (!cctx)
-    {
-      curl_easy_getinfo (handle, CURLINFO_PRIVATE, (char **)&cctx);
-
-      if (cctx) 
-        {
-          sinfo = (sock_info*)cctx->ext_data;
-        }
-    }
+  sock_info *sinfo = socket < bctx->sock_table_size ? 
+    bctx->sock_table[socket] : 0;
 
-  if (!cctx) 
-    {
-      PRINTF("no client context\n");
-      return 0;
-    }
-
-  if (!sinfo) 
-    {
-      PRINTF("no extension data\n");
-      return 0;
-    }
-  
-  PRINTF("socket callback: ctx=%p sock=%d what=%s\n", cctx, socket , whatstr[what]);
+  (void) sockp;
 
+  PRINTF("socket callback: sock=%d what=%s\n", socket , whatstr[what]);
    
   if (what == CURL_POLL_REMOVE) 
     {
       PRINTF("\n");
-      remsock(sinfo);
+      remsock(sinfo, bctx);
     } 
   else 
     {
-      if (!sinfo->evset) 
+      if (!sinfo) 
         {
           PRINTF("Adding data: %s%s\n",
                  what & CURL_POLL_IN ? "READ":"",
                  what & CURL_POLL_OUT ? "WRITE":"" );
 
-          addsock_hyper (socket, handle, what, cctx, sinfo, bctx);
+          return addsock_hyper (socket, handle, what, bctx);
         }
       else 
         {
@@ -340,8 +423,9 @@ static int socket_callback (CURL *handle,
 /****************************************************************************************
  * Function name - update_timeout_hyper
  *
- * Description - Unclear, whether we need it? Update the event timer 
- *                     after curl_multi library calls?
+ * Description - Updates the libcurl event timer after curl_multi library calls.
+ *               Zero timeout makes libcurl to start just added transfers at 
+ *               the next event loop iteration.
  *
  * Input -       *bctx - pointer to the batch of contexts
  * Return Code/Output - None
@@ -369,11 +453,47 @@ static void update_timeout_hyper (batch_context *bctx)
 }
 
 
+/****************************************************************************************
+ * Function name - schedule_next_load_hyper
+ *
+ * Description - Arms the next load timer to expire, when the nearest timer in 
+ *               the waiting queue is due, but not later than NEXT_LOAD_MAX_WAIT.
+ *
+ * Input -       *bctx    - pointer to the batch of contexts
+ *               now_time - current time in msec
+ * Return Code/Output - None
+ ****************************************************************************************/
+static void schedule_next_load_hyper (batch_context* bctx, 
+                                      unsigned long now_time)
+{
+  unsigned long long time_nearest = tq_time_to_nearest_timer (bctx->waiting_queue);
+  unsigned long long now_usec = get_tick_count_cached_usec ();
+  unsigned long long wait_usec = NEXT_LOAD_MAX_WAIT * TICK_USEC_PER_MSEC;
+  struct timeval tv;
+
+  if (now_usec < now_time * TICK_USEC_PER_MSEC)
+    now_usec = now_time * TICK_USEC_PER_MSEC;
+
+  if (time_nearest <= now_usec)
+    {
+      wait_usec = 0;
+    }
+  else if (time_nearest - now_usec < wait_usec)
+    {
+      wait_usec = time_nearest - now_usec;
+    }
+
+  tv.tv_sec = wait_usec / 1000000;
+  tv.tv_usec = wait_usec % 1000000;
+  evtimer_add (bctx->timer_next_load_event, &tv);
+}
+
 /************************************************************************
  * Function name - next_load_cb_hyper
  *
- * Description - Called on timer. Makes next load actions and dispatches
- *                  expired timers on the waiting queue.
+ * Description - Called on timer, when the nearest timer of the waiting queue 
+ *               is due. Dispatches expired timers on the waiting queue and 
+ *               schedules itself for the next due timer.
  *
  * Input -   fd - socket descriptor   
  *               kind - bitmask of events from libevent
@@ -388,20 +508,16 @@ static void next_load_cb_hyper (int fd, short kind, void *userp)
   int st;
 
   PRINTF("next_load_cb_hyper\n");
+
+  update_tick_count_cached ();
   
   /* 
      1. Checks completion of operations and goes to the next step;
      2. Dispatches expired timers, adds clients from waiting queue to multihandle;
-     3. Runs multi_socket_all () to open sockets, call event_cb_hyper  and add 
-         their the sockets to the epoll.
+     3. Re-arms libcurl timer to start the added transfers and the next load 
+        timer for the next due timer of the waiting queue.
   */
   mperform_hyper (bctx, &st);
-
-  struct timeval tv;
-  timerclear(&tv);
-  tv.tv_usec = TIMER_NEXT_LOAD;
-  
-  event_add (bctx->timer_next_load_event, &tv);  
 }
 
 /****************************************************************************************
@@ -415,8 +531,6 @@ static void next_load_cb_hyper (int fd, short kind, void *userp)
 int user_activity_hyper (client_context* cctx_array)
 {
   batch_context* bctx = cctx_array->bctx;
-  sock_info *sinfo;
-  int k, st;
 
   if (!bctx)
     {
@@ -424,8 +538,15 @@ int user_activity_hyper (client_context* cctx_array)
       return -1;
     }
 
-  /* Init libevent library */
-  bctx->eb = event_init ();
+  /* 
+     Each batch (thread) runs its own event base, thus nothing is shared 
+     between the loading threads.
+  */
+  if (! (bctx->eb = event_base_new ()))
+  {
+      fprintf (stderr, "%s - error: event_base_new () failed.\n", __func__);
+      return -1;
+  }
 
   if (! (bctx->timer_event = cl_calloc (sizeof (struct event), 1)))
   {
@@ -446,19 +567,10 @@ int user_activity_hyper (client_context* cctx_array)
 
   curl_multi_setopt (bctx->multiple_handle, CURLMOPT_SOCKETDATA, bctx);
 
-
-  still_running = 1; 
- 
-  for (k = 0 ; k < bctx->client_num_max ; k++)
+  if (sock_table_init (bctx) == -1)
     {
-      sinfo = cl_calloc (1, sizeof (sock_info));
-      if (!sinfo)
-        {
-           fprintf (stderr, "%s - error: allocation of sock_info failed.\n", __func__);
-          return -1;
-        }
-
-      bctx->cctx_array[k].ext_data = sinfo;
+      fprintf (stderr, "%s - error: sock_table_init () failed.\n", __func__);
+      return -1;
     }
 
   if (alloc_init_timer_waiting_queue (
@@ -469,7 +581,7 @@ int user_activity_hyper (client_context* cctx_array)
       return -1;
     }
 
-  const unsigned long now_time = get_tick_count ();
+  const unsigned long now_time = update_tick_count_cached ();
   
   if (init_timers_and_add_initial_clients_to_load (bctx,
                                                    now_time) == -1)
@@ -483,17 +595,10 @@ int user_activity_hyper (client_context* cctx_array)
   evtimer_set (bctx->timer_event, timer_cb_hyper, bctx);
   event_base_set(bctx->eb, bctx->timer_event);
 
-  while (CURLM_CALL_MULTI_PERFORM == 
-         curl_multi_socket_all(bctx->multiple_handle, &st))
-         ;
-
   evtimer_set (bctx->timer_next_load_event, next_load_cb_hyper, bctx);
   event_base_set(bctx->eb, bctx->timer_next_load_event);
   
-  struct timeval tv;
-  timerclear(&tv);
-  tv.tv_usec = TIMER_NEXT_LOAD;	
-  event_add (bctx->timer_next_load_event, &tv);
+  schedule_next_load_hyper (bctx, now_time);
 
   if (is_batch_group_leader (bctx))
     {
@@ -510,16 +615,21 @@ int user_activity_hyper (client_context* cctx_array)
   }
 
 
-  on_exit_hyper (bctx);
-
-  return 0;
+  return on_exit_hyper (bctx);
 }
 
+/****************************************************************************************
+ * Function name - on_exit_hyper
+ *
+ * Description - Dumps final statistics and releases the batch resources of hyper mode,
+ *               including the batch event base.
+ *
+ * Input -       *bctx - pointer to the batch of contexts
+ * Return Code/Output - Always 0
+ ****************************************************************************************/
 static int on_exit_hyper (batch_context* bctx)
 {
-    //fprintf (stderr, "%s - entered.\n", __func__);
-
-    still_running =0;
+  int fd;
 
   dump_final_statistics (bctx->cctx_array);
   screen_release ();
@@ -537,7 +647,52 @@ static int on_exit_hyper (batch_context* bctx)
       bctx->waiting_queue = 0;
     }
 
-  exit (0);
+  /* 
+     No more socket notifications from libcurl: the sockets and the event base
+     are released below, whereas the multi-handle is cleaned up later.
+  */
+  curl_multi_setopt (bctx->multiple_handle, CURLMOPT_SOCKETFUNCTION, NULL);
+
+  if (bctx->sock_table)
+    {
+      for (fd = 0; fd < bctx->sock_table_size; fd++)
+        {
+          remsock (bctx->sock_table[fd], bctx);
+        }
+
+      free (bctx->sock_table);
+      bctx->sock_table = 0;
+      bctx->sock_table_size = 0;
+    }
+
+  if (bctx->sock_pool)
+    {
+      mpool_free (bctx->sock_pool);
+      free (bctx->sock_pool);
+      bctx->sock_pool = 0;
+    }
+
+  if (bctx->timer_event)
+    {
+      event_del (bctx->timer_event);
+      free (bctx->timer_event);
+      bctx->timer_event = 0;
+    }
+
+  if (bctx->timer_next_load_event)
+    {
+      event_del (bctx->timer_next_load_event);
+      free (bctx->timer_next_load_event);
+      bctx->timer_next_load_event = 0;
+    }
+
+  if (bctx->eb)
+    {
+      event_base_free (bctx->eb);
+      bctx->eb = 0;
+    }
+
+  return 0;
 }
 
 
@@ -574,10 +729,11 @@ static int mget_url_hyper (batch_context* bctx)
 /****************************************************************************************
  * Function name - mperform_hyper
  *
- * Description - Uses curl_multi_perform () for initial url-fetch and to react on socket events.
- *               Uses curl_multi_info_read () to test url-fetch completion events and to proceed
- *               with the next step for the client, using load_next_step (). Cares about statistics
- *               at certain timeouts.
+ * Description - Called after each libcurl socket action or timeout and on the waiting queue
+ *               timer. Uses curl_multi_info_read () to test url-fetch completion events and 
+ *               to proceed with the next step for the client, using load_next_step (). 
+ *               Dispatches expired timers of the waiting queue and re-arms the libcurl and 
+ *               next load timers. Cares about statistics at certain timeouts.
  *
  * Input -       *bctx - pointer to the batch of contexts;
  *               *still_running - pointer to counter of still running clients (CURL handles)
@@ -588,21 +744,15 @@ static int mperform_hyper (batch_context* bctx, int* still_running)
 {
   CURLM *mhandle =  bctx->multiple_handle;
   int cycle_counter = 0;	
-  int msg_num = 0, st;
+  int msg_num = 0;
   const int snapshot_timeout = snapshot_statistics_timeout*1000;
   unsigned long now_time;
   CURLMsg *msg;
-  int scheduled_now_count = 0, scheduled_now = 0;
+  int scheduled_now = 0;
 
   (void)still_running;
 
-  if (pending_active_and_waiting_clients_num (bctx) == 0 &&
-      bctx->do_client_num_gradual_increase == 0)
-  {
-      return on_exit_hyper (bctx);
-  }
-    
-  now_time = get_tick_count ();
+  now_time = get_tick_count_cached ();
 
   if ((long)(now_time - bctx->last_measure) > snapshot_timeout) 
     {
@@ -612,6 +762,8 @@ static int mperform_hyper (batch_context* bctx, int* still_running)
         }
     }
 
+  stats_stream_tick (bctx, now_time);
+
   while( (msg = curl_multi_info_read (mhandle, &msg_num)) != 0)
     {
       if (msg->msg == CURLMSG_DONE)
@@ -638,9 +790,11 @@ static int mperform_hyper (batch_context* bctx, int* still_running)
               // cctx->client_name, msg->data.result, curl_easy_strerror(msg->data.result ));
             }
 
+          completion_stats_collect (cctx, msg->data.result);
+
           if (! (++cycle_counter % TIME_RECALCULATION_MSG_NUM))
             {
-              now_time = get_tick_count ();
+              now_time = update_tick_count_cached ();
             }
 
           /*
@@ -661,11 +815,6 @@ static int mperform_hyper (batch_context* bctx, int* still_running)
               /*cstate client_state =  */
               load_next_step (cctx, now_time, &scheduled_now);
 
-             if (scheduled_now)
-               {
-                 scheduled_now_count++;
-               }
-
              //fprintf (stderr, "%s - after load_next_step client state %d.\n", __func__, client_state);
             }
 
@@ -678,12 +827,19 @@ static int mperform_hyper (batch_context* bctx, int* still_running)
         }
     }
 
-  if (dispatch_expired_timers (bctx, now_time) > 0 || scheduled_now_count)
-    {
-      while (CURLM_CALL_MULTI_PERFORM == 
-             curl_multi_socket_all (bctx->multiple_handle, &st))
-          ;
-    }
+  dispatch_expired_timers (bctx, now_time);
+
+  if (pending_active_and_waiting_clients_num (bctx) == 0 &&
+      bctx->do_client_num_gradual_increase == 0 &&
+      rebalance_close (bctx) == 0)
+  {
+      /* Loading is over; user_activity_hyper () proceeds with on_exit_hyper () */
+      event_base_loopbreak (bctx->eb);
+      return 0;
+  }
+
+  update_timeout_hyper (bctx);
+  schedule_next_load_hyper (bctx, now_time);
 
   return 0;
 }
@@ -28,8 +28,11 @@
 #include "fdsetsize.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <limits.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 
 #include "batch.h"
@@ -37,12 +40,25 @@
 #include "loader.h"
 #include "conf.h"
 #include "screen.h"
+#include "stats_stream.h"
 
+/* Maximum number of socket events to be fetched by a single epoll_wait () */
+#define SMOOTH_EPOLL_EVENTS_NUM 256
+
+/* Maximum time to sleep in epoll_wait (), msec */
+#define SMOOTH_EPOLL_TIMEOUT_MAX 250
 
 static int mget_url_smooth (batch_context* bctx);
 static int mperform_smooth (batch_context* bctx,
                             unsigned long* now_time,
                             int* still_running);
+static int socket_callback_smooth (CURL* handle, 
+                                   curl_socket_t sockfd, 
+                                   int what, 
+                                   void* cbp, 
+                                   void* sockp);
+static int timer_callback_smooth (CURLM* multi, long timeout_ms, void* cbp);
+static int epoll_timeout_smooth (batch_context* bctx, unsigned long now_time);
 
 /******************************************************************************
  * Function name - user_activity_smooth
@@ -62,6 +78,24 @@ int user_activity_smooth (client_context* cctx_array)
       return -1;
     }
 
+  if ((bctx->epoll_fd = epoll_create (bctx->client_num_max + 1)) == -1)
+    {
+      fprintf (stderr, "%s - error: epoll_create () failed with errno %d.\n", 
+               __func__, errno);
+      return -1;
+    }
+
+  bctx->curl_timeout_time = 0;
+
+  curl_multi_setopt (bctx->multiple_handle, 
+                     CURLMOPT_SOCKETFUNCTION, 
+                     socket_callback_smooth);
+  curl_multi_setopt (bctx->multiple_handle, CURLMOPT_SOCKETDATA, bctx);
+  curl_multi_setopt (bctx->multiple_handle, 
+                     CURLMOPT_TIMERFUNCTION, 
+                     timer_callback_smooth);
+  curl_multi_setopt (bctx->multiple_handle, CURLMOPT_TIMERDATA, bctx);
+
   if (alloc_init_timer_waiting_queue (bctx->client_num_max + PERIODIC_TIMERS_NUMBER + 1,
                                       &bctx->waiting_queue) == -1)
     {
@@ -71,7 +105,7 @@ int user_activity_smooth (client_context* cctx_array)
       return -1;
     }
 
-  const unsigned long now_time = get_tick_count ();
+  const unsigned long now_time = update_tick_count_cached ();
   
   if (init_timers_and_add_initial_clients_to_load (bctx, now_time) == -1)
     {
@@ -90,7 +124,8 @@ int user_activity_smooth (client_context* cctx_array)
      ========= Run the loading machinery ================
   */
   while ((pending_active_and_waiting_clients_num (bctx)) ||
-         bctx->do_client_num_gradual_increase)
+         bctx->do_client_num_gradual_increase ||
+         rebalance_close (bctx) == -1)
     {
       if (mget_url_smooth (bctx) == -1)
         {
@@ -115,6 +150,9 @@ int user_activity_smooth (client_context* cctx_array)
       bctx->waiting_queue = 0;
     }
 
+  close (bctx->epoll_fd);
+  bctx->epoll_fd = -1;
+
   return 0;
 }
 
@@ -123,9 +161,11 @@ int user_activity_smooth (client_context* cctx_array)
 /*******************************************************************************
  * Function name - mget_url_smooth
  *
- * Description - Performs actual fetching of urls for a whole batch. Starts 
- *               with initial fetch by mperform_smooth () and further acts 
- *               using mperform_smooth () on select events
+ * Description - Performs actual fetching of urls for a whole batch. Waits for 
+ *               socket events by epoll_wait () and passes them to libcurl using
+ *               curl_multi_socket_action (). The wait is limited by the nearest
+ *               of libcurl and waiting queue timeouts. Returns after about a 
+ *               second to let the caller re-test, whether the loading is over.
  *
  * Input -       *bctx - pointer to the batch of contexts
  *
@@ -133,62 +173,183 @@ int user_activity_smooth (client_context* cctx_array)
  ********************************************************************************/
 static int mget_url_smooth (batch_context* bctx)  		       
 {
-  int max_timeout_msec = 1000;
-  unsigned long now_time = get_tick_count ();
-  int cycle_counter = 0;
-    
+  struct epoll_event events[SMOOTH_EPOLL_EVENTS_NUM];
+  const unsigned long start_time = update_tick_count_cached ();
+  unsigned long now_time = start_time;
   int still_running = 0;
-  struct timeval timeout;
-
-  mperform_smooth (bctx, &now_time, &still_running);
+  int events_num, i;
 
-  while (max_timeout_msec > 0) 
+  while (now_time - start_time < 1000) 
     {
-      int rc, maxfd;
-      fd_set fdread, fdwrite, fdexcep;
+      events_num = epoll_wait (bctx->epoll_fd, 
+                               events, 
+                               SMOOTH_EPOLL_EVENTS_NUM, 
+                               epoll_timeout_smooth (bctx, now_time));
 
-      FD_ZERO(&fdread); FD_ZERO(&fdwrite); FD_ZERO(&fdexcep);
-      timeout.tv_sec = 0;
-      timeout.tv_usec = 250000;
-
-      max_timeout_msec -= timeout.tv_sec*1000 + timeout.tv_usec * 0.001;
-
-      curl_multi_fdset(bctx->multiple_handle, &fdread, &fdwrite, &fdexcep, &maxfd);
-
-      //fprintf (stderr, "%s - Waiting for %d clients with seconds %f.\n", 
-      //name, still_running, max_timeout);
+      if (events_num == -1 && errno != EINTR)
+        {
+          fprintf (stderr, "%s - error: epoll_wait () failed with errno %d.\n", 
+                   __func__, errno);
+          return -1;
+        }
 
-      rc = select (maxfd + 1, &fdread, &fdwrite, &fdexcep, &timeout);
+      /* "now" of the iteration for libcurl callbacks and timers */
+      now_time = update_tick_count_cached ();
 
-      switch(rc)
+      for (i = 0; i < events_num; i++)
         {
-        case -1: /* select error */
-          break;
-
-        case 0: /* timeout */
-          now_time = get_tick_count ();
-        default: /* timeout or readable/writable sockets */
-          mperform_smooth (bctx, &now_time, &still_running);            
-          break;
+          int bitmask = 0;
+
+          if (events[i].events & EPOLLIN)
+            bitmask |= CURL_CSELECT_IN;
+          if (events[i].events & EPOLLOUT)
+            bitmask |= CURL_CSELECT_OUT;
+          if (events[i].events & (EPOLLERR | EPOLLHUP))
+            bitmask |= CURL_CSELECT_ERR;
+
+          curl_multi_socket_action (bctx->multiple_handle, 
+                                    events[i].data.fd, 
+                                    bitmask, 
+                                    &still_running);
         }
-          
-      if (! (++cycle_counter % TIME_RECALCULATION_CYCLES_NUM))
+
+      if (bctx->curl_timeout_time && now_time >= bctx->curl_timeout_time)
         {
-          now_time = get_tick_count ();
+          bctx->curl_timeout_time = 0;
+          curl_multi_socket_action (bctx->multiple_handle, 
+                                    CURL_SOCKET_TIMEOUT, 
+                                    0, 
+                                    &still_running);
         }
 
+      mperform_smooth (bctx, &now_time, &still_running);
+
       dispatch_expired_timers (bctx, now_time);
     } 
   return 0;
 }
 
+/*******************************************************************************
+ * Function name - epoll_timeout_smooth
+ *
+ * Description - Calculates the time to sleep in epoll_wait () as the nearest of
+ *               the libcurl timeout and the nearest timer in waiting queue, but 
+ *               not more than SMOOTH_EPOLL_TIMEOUT_MAX.
+ *
+ * Input -       *bctx    - pointer to the batch of contexts
+ *               now_time - current time in msec
+ *
+ * Return Code/Output - Timeout in msec
+ ********************************************************************************/
+static int epoll_timeout_smooth (batch_context* bctx, unsigned long now_time)
+{
+  unsigned long wakeup_time = now_time + SMOOTH_EPOLL_TIMEOUT_MAX;
+  unsigned long long timer_time = tq_time_to_nearest_timer (bctx->waiting_queue);
+
+  if (bctx->curl_timeout_time && bctx->curl_timeout_time < wakeup_time)
+    wakeup_time = bctx->curl_timeout_time;
+
+  /* Timers are in usec; round up not to wake up before the timer */
+  if (timer_time != ULLONG_MAX &&
+      (timer_time + TICK_USEC_PER_MSEC - 1) / TICK_USEC_PER_MSEC < wakeup_time)
+    wakeup_time = (unsigned long) 
+      ((timer_time + TICK_USEC_PER_MSEC - 1) / TICK_USEC_PER_MSEC);
+
+  return wakeup_time > now_time ? (int) (wakeup_time - now_time) : 0;
+}
+
+/*******************************************************************************
+ * Function name - socket_callback_smooth
+ *
+ * Description - CURLMOPT_SOCKETFUNCTION callback. Adds, modifies or removes 
+ *               the socket at the batch epoll descriptor.
+ *
+ * Input -       *handle - curl easy handle, owning the socket
+ *               sockfd  - the socket
+ *               what    - CURL_POLL_* events, which libcurl wishes to wait for
+ *               *cbp    - pointer to the batch context
+ *               *sockp  - non-zero, when the socket is already at epoll
+ *
+ * Return Code/Output - Always 0
+ ********************************************************************************/
+static int socket_callback_smooth (CURL* handle, 
+                                   curl_socket_t sockfd, 
+                                   int what, 
+                                   void* cbp, 
+                                   void* sockp)
+{
+  batch_context* bctx = (batch_context *) cbp;
+  struct epoll_event ev;
+
+  (void) handle;
+
+  if (what == CURL_POLL_REMOVE)
+    {
+      if (sockp)
+        {
+          epoll_ctl (bctx->epoll_fd, EPOLL_CTL_DEL, sockfd, NULL);
+          curl_multi_assign (bctx->multiple_handle, sockfd, NULL);
+        }
+      return 0;
+    }
+
+  memset (&ev, 0, sizeof (ev));
+  ev.data.fd = sockfd;
+
+  if (what & CURL_POLL_IN)
+    ev.events |= EPOLLIN;
+  if (what & CURL_POLL_OUT)
+    ev.events |= EPOLLOUT;
+
+  if (epoll_ctl (bctx->epoll_fd, 
+                 sockp ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, 
+                 sockfd, 
+                 &ev) == -1)
+    {
+      fprintf (stderr, "%s - error: epoll_ctl () failed with errno %d.\n", 
+               __func__, errno);
+      return 0;
+    }
+
+  if (!sockp)
+    {
+      curl_multi_assign (bctx->multiple_handle, sockfd, bctx);
+    }
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Function name - timer_callback_smooth
+ *
+ * Description - CURLMOPT_TIMERFUNCTION callback. Keeps the time, when libcurl 
+ *               wishes to be called with CURL_SOCKET_TIMEOUT.
+ *
+ * Input -       *multi     - curl multi handle
+ *               timeout_ms - timeout in msec, -1 means to delete the timeout
+ *               *cbp       - pointer to the batch context
+ *
+ * Return Code/Output - Always 0
+ ********************************************************************************/
+static int timer_callback_smooth (CURLM* multi, long timeout_ms, void* cbp)
+{
+  batch_context* bctx = (batch_context *) cbp;
+
+  (void) multi;
+
+  bctx->curl_timeout_time = timeout_ms < 0 ? 0 : 
+    get_tick_count_cached () + (unsigned long) timeout_ms;
+
+  return 0;
+}
+
 /****************************************************************************************
  * Function name - mperform_smooth
  *
- * Description - Uses curl_multi_perform () for initial url-fetch and to react 
- *               on socket events. It calls curl_multi_info_read () to test url-fetch 
- *               completion events and to proceed with the next step for a client, 
- *               using load_next_step (). It cares about statistics at certain timeouts.
+ * Description - Calls curl_multi_info_read () to test url-fetch completion events, 
+ *               which follow socket events and timeouts passed to libcurl, and to 
+ *               proceed with the next step for a client, using load_next_step (). 
+ *               It cares about statistics at certain timeouts.
  *
  * Input -       *bctx          - pointer to the batch of contexts;
  *               *still_running - pointer to counter of still running clients (CURL handles)
@@ -205,10 +366,8 @@ static int mperform_smooth (batch_context* bctx,
   const int snapshot_timeout = snapshot_statistics_timeout*1000;
   CURLMsg *msg;
   int sched_now = 0; 
-    
-  while (CURLM_CALL_MULTI_PERFORM == 
-        curl_multi_perform(mhandle, still_running))
-    ;
+
+  (void) still_running;
 
   if ((long)(*now_time - bctx->last_measure) > snapshot_timeout) 
     {
@@ -218,6 +377,8 @@ static int mperform_smooth (batch_context* bctx,
         }
     }
 
+  stats_stream_tick (bctx, *now_time);
+
   while( (msg = curl_multi_info_read (mhandle, &msg_num)) != 0)
     {
       if (msg->msg == CURLMSG_DONE)
@@ -247,9 +408,11 @@ static int mperform_smooth (batch_context* bctx,
               // cctx->client_name, msg->data.result, curl_easy_strerror(msg->data.result ));
             }
 
+          completion_stats_collect (cctx, msg->data.result);
+
           if (! (++cycle_counter % TIME_RECALCULATION_MSG_NUM))
             {
-              *now_time = get_tick_count ();
+              *now_time = update_tick_count_cached ();
             }
 
             /*
@@ -0,0 +1,780 @@
+/*
+ *     loader_uring.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Loading engine, where socket readiness polling and waiting for timeouts
+ * are done by a single io_uring of a batch (thread). The ring is driven
+ * by raw io_uring_setup () and io_uring_enter () syscalls.
+ */
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+
+#include "batch.h"
+#include "client.h"
+#include "loader.h"
+#include "conf.h"
+#include "cl_alloc.h"
+#include "screen.h"
+#include "stats_stream.h"
+
+/* Number of submission queue entries */
+#define URING_SQ_ENTRIES 1024
+
+/* Maximum number of completion queue entries supported by kernel */
+#define URING_CQ_ENTRIES_MAX 65536
+
+/* Maximum time to wait for completions, msec */
+#define URING_TIMEOUT_MAX 250
+
+/*
+   user_data of requests. Poll requests encode socket descriptor and
+   generation of its poll; the values below are never used by polls.
+*/
+#define URING_UD_IGNORE  0
+#define URING_UD_TIMEOUT 1
+
+#define URING_UD_POLL(fd, gen) \
+  ((((__u64) (gen)) << 32) | (((__u64) (unsigned int) (fd)) << 1) | 1)
+
+/* Poll state of a socket, kept in the ring sockets table */
+typedef struct uring_sock
+{
+  /* Poll events, which libcurl wishes to wait for. Zero - no poll. */
+  unsigned int events;
+
+  /*
+     Generation of the poll request. Advanced on each change of events
+     to recognize completions of cancelled polls.
+  */
+  unsigned int gen;
+
+  /* Whether a poll request is pending in kernel */
+  int armed;
+} uring_sock;
+
+/* io_uring of a batch */
+typedef struct uring_ctx
+{
+  int ring_fd;
+
+  /* Submission queue ring */
+  void* sq_ring;
+  size_t sq_ring_size;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+  struct io_uring_sqe* sqes;
+  size_t sqes_size;
+
+  /* Submission queue entries filled, but not passed to kernel yet */
+  unsigned sq_pending;
+
+  /* Completion queue ring */
+  void* cq_ring;
+  size_t cq_ring_size;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  struct io_uring_cqe* cqes;
+
+  /* Whether the timeout request is pending in kernel */
+  int timeout_armed;
+  struct __kernel_timespec timeout;
+
+  /* Sockets table, indexed by socket descriptors */
+  uring_sock* socks;
+  int socks_size;
+} uring_ctx;
+
+
+static int uring_init (uring_ctx* ring, unsigned cq_entries);
+static void uring_release (uring_ctx* ring);
+static struct io_uring_sqe* uring_get_sqe (uring_ctx* ring);
+static int uring_enter (uring_ctx* ring, unsigned wait_nr);
+static int uring_arm_poll (uring_ctx* ring, curl_socket_t sockfd);
+
+static int mget_url_uring (batch_context* bctx);
+static int mperform_uring (batch_context* bctx, unsigned long* now_time);
+static int uring_timeout_msec (batch_context* bctx, unsigned long now_time);
+static int socket_callback_uring (CURL* handle,
+                                  curl_socket_t sockfd,
+                                  int what,
+                                  void* cbp,
+                                  void* sockp);
+static int timer_callback_uring (CURLM* multi, long timeout_ms, void* cbp);
+
+
+/******************************************************************************
+ * Function name - user_activity_uring
+ *
+ * Description - Simulates user-activities using io_uring mode
+ * Input -       *cctx_array - array of client contexts (related to a certain
+ *                             batch of clients)
+ * Return Code/Output - On Success - 0, on Error -1
+ *******************************************************************************/
+int user_activity_uring (client_context* cctx_array)
+{
+  batch_context* bctx = cctx_array->bctx;
+  unsigned cq_entries = 2 * URING_SQ_ENTRIES;
+
+  if (!bctx)
+    {
+      fprintf (stderr, "%s - error: bctx is a NULL pointer.\n", __func__);
+      return -1;
+    }
+
+  /* A poll per socket and a timeout may be completed at once */
+  while (cq_entries < 2 * (unsigned) bctx->client_num_max + 1 &&
+         cq_entries < URING_CQ_ENTRIES_MAX)
+    {
+      cq_entries <<= 1;
+    }
+
+  if (! (bctx->uring = cl_calloc (1, sizeof (uring_ctx))))
+    {
+      fprintf (stderr, "%s - error: uring allocation failed.\n", __func__);
+      return -1;
+    }
+
+  if (uring_init (bctx->uring, cq_entries) == -1)
+    {
+      fprintf (stderr,
+               "%s - error: uring_init () failed. Is io_uring supported by "
+               "the kernel? Consider hyper or smooth modes (-m 0 or -m 1).\n",
+               __func__);
+      return -1;
+    }
+
+  bctx->curl_timeout_time = 0;
+
+  curl_multi_setopt (bctx->multiple_handle,
+                     CURLMOPT_SOCKETFUNCTION,
+                     socket_callback_uring);
+  curl_multi_setopt (bctx->multiple_handle, CURLMOPT_SOCKETDATA, bctx);
+  curl_multi_setopt (bctx->multiple_handle,
+                     CURLMOPT_TIMERFUNCTION,
+                     timer_callback_uring);
+  curl_multi_setopt (bctx->multiple_handle, CURLMOPT_TIMERDATA, bctx);
+
+  if (alloc_init_timer_waiting_queue (bctx->client_num_max + PERIODIC_TIMERS_NUMBER + 1,
+                                      &bctx->waiting_queue) == -1)
+    {
+      fprintf (stderr,
+               "%s - error: failed to alloc or init timer waiting queue.\n",
+               __func__);
+      return -1;
+    }
+
+  const unsigned long now_time = update_tick_count_cached ();
+
+  if (init_timers_and_add_initial_clients_to_load (bctx, now_time) == -1)
+    {
+      fprintf (stderr,
+               "%s - error: init_timers_and_add_initial_clients_to_load () failed.\n",
+               __func__);
+      return -1;
+    }
+
+  if (is_batch_group_leader (bctx))
+    {
+      dump_snapshot_interval (bctx, now_time);
+    }
+
+  /*
+     ========= Run the loading machinery ================
+  */
+  while ((pending_active_and_waiting_clients_num (bctx)) ||
+         bctx->do_client_num_gradual_increase ||
+         rebalance_close (bctx) == -1)
+    {
+      if (mget_url_uring (bctx) == -1)
+        {
+          fprintf (stderr, "%s error: mget_url () failed.\n", __func__) ;
+          return -1;
+        }
+    }
+
+  dump_final_statistics (cctx_array);
+  screen_release ();
+
+  /*
+     ======= Release resources =========================
+  */
+  if (bctx->waiting_queue)
+    {
+      /* Cancel periodic timers */
+      cancel_periodic_timers (bctx);
+
+      tq_release (bctx->waiting_queue);
+      free (bctx->waiting_queue);
+      bctx->waiting_queue = 0;
+    }
+
+  curl_multi_setopt (bctx->multiple_handle, CURLMOPT_SOCKETFUNCTION, NULL);
+  curl_multi_setopt (bctx->multiple_handle, CURLMOPT_TIMERFUNCTION, NULL);
+
+  uring_release (bctx->uring);
+  free (bctx->uring);
+  bctx->uring = 0;
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Function name - mget_url_uring
+ *
+ * Description - Performs actual fetching of urls for a whole batch. Submits
+ *               the pending poll requests together with a timeout request and
+ *               waits for completions by a single io_uring_enter (). Passes
+ *               the socket events to libcurl using curl_multi_socket_action ().
+ *               Returns after about a second to let the caller re-test, whether
+ *               the loading is over.
+ *
+ * Input -       *bctx - pointer to the batch of contexts
+ *
+ * Return Code/Output - On Success - 0, on Error -1
+ ********************************************************************************/
+static int mget_url_uring (batch_context* bctx)
+{
+  uring_ctx* ring = bctx->uring;
+  const unsigned long start_time = update_tick_count_cached ();
+  unsigned long now_time = start_time;
+  int still_running = 0;
+
+  while (now_time - start_time < 1000)
+    {
+      unsigned head = *ring->cq_head;
+      int wait_msec;
+
+      /* Nothing completed yet - wait for the nearest timeout or completion */
+      if (head == __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE) &&
+          (wait_msec = uring_timeout_msec (bctx, now_time)) > 0)
+        {
+          if (! ring->timeout_armed)
+            {
+              struct io_uring_sqe* sqe = uring_get_sqe (ring);
+
+              if (!sqe)
+                return -1;
+
+              ring->timeout.tv_sec = wait_msec / 1000;
+              ring->timeout.tv_nsec = (wait_msec % 1000) * 1000000L;
+
+              /* Completes on time or on any other completion */
+              sqe->opcode = IORING_OP_TIMEOUT;
+              sqe->fd = -1;
+              sqe->addr = (unsigned long) &ring->timeout;
+              sqe->len = 1;
+              sqe->off = 1;
+              sqe->user_data = URING_UD_TIMEOUT;
+              ring->timeout_armed = 1;
+            }
+
+          if (uring_enter (ring, 1) == -1)
+            return -1;
+        }
+      else if (ring->sq_pending && uring_enter (ring, 0) == -1)
+        {
+          return -1;
+        }
+
+      /* "now" of the iteration for libcurl callbacks and timers */
+      now_time = update_tick_count_cached ();
+
+      /* Reap completions */
+      head = *ring->cq_head;
+
+      while (head != __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE))
+        {
+          struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+          const __u64 user_data = cqe->user_data;
+          const int res = cqe->res;
+
+          __atomic_store_n (ring->cq_head, ++head, __ATOMIC_RELEASE);
+
+          if (user_data == URING_UD_TIMEOUT)
+            {
+              ring->timeout_armed = 0;
+            }
+          else if (user_data != URING_UD_IGNORE)
+            {
+              const curl_socket_t sockfd = (curl_socket_t)
+                ((user_data & 0xFFFFFFFF) >> 1);
+              uring_sock* us = &ring->socks[sockfd];
+              int bitmask = 0;
+
+              /* Completion of a poll cancelled or replaced meanwhile */
+              if ((unsigned int) (user_data >> 32) != us->gen)
+                continue;
+
+              us->armed = 0;
+
+              if (res < 0)
+                {
+                  bitmask = CURL_CSELECT_ERR;
+                }
+              else
+                {
+                  if (res & POLLIN)
+                    bitmask |= CURL_CSELECT_IN;
+                  if (res & POLLOUT)
+                    bitmask |= CURL_CSELECT_OUT;
+                  if (res & (POLLERR | POLLHUP))
+                    bitmask |= CURL_CSELECT_ERR;
+                }
+
+              curl_multi_socket_action (bctx->multiple_handle,
+                                        sockfd,
+                                        bitmask,
+                                        &still_running);
+
+              /* One-shot poll: re-arm, when libcurl still waits on socket */
+              if (us->events && !us->armed && uring_arm_poll (ring, sockfd) == -1)
+                return -1;
+            }
+        }
+
+      if (bctx->curl_timeout_time && now_time >= bctx->curl_timeout_time)
+        {
+          bctx->curl_timeout_time = 0;
+          curl_multi_socket_action (bctx->multiple_handle,
+                                    CURL_SOCKET_TIMEOUT,
+                                    0,
+                                    &still_running);
+        }
+
+      if (mperform_uring (bctx, &now_time) == -1)
+        return -1;
+
+      dispatch_expired_timers (bctx, now_time);
+    }
+  return 0;
+}
+
+/*******************************************************************************
+ * Function name - uring_timeout_msec
+ *
+ * Description - Calculates the time to wait for completions as the nearest of
+ *               the libcurl timeout and the nearest timer in waiting queue, but
+ *               not more than URING_TIMEOUT_MAX.
+ *
+ * Input -       *bctx    - pointer to the batch of contexts
+ *               now_time - current time in msec
+ *
+ * Return Code/Output - Timeout in msec
+ ********************************************************************************/
+static int uring_timeout_msec (batch_context* bctx, unsigned long now_time)
+{
+  unsigned long wakeup_time = now_time + URING_TIMEOUT_MAX;
+  unsigned long long timer_time = tq_time_to_nearest_timer (bctx->waiting_queue);
+
+  if (bctx->curl_timeout_time && bctx->curl_timeout_time < wakeup_time)
+    wakeup_time = bctx->curl_timeout_time;
+
+  /* Timers are in usec; round up not to wake up before the timer */
+  if (timer_time != ULLONG_MAX &&
+      (timer_time + TICK_USEC_PER_MSEC - 1) / TICK_USEC_PER_MSEC < wakeup_time)
+    wakeup_time = (unsigned long) 
+      ((timer_time + TICK_USEC_PER_MSEC - 1) / TICK_USEC_PER_MSEC);
+
+  return wakeup_time > now_time ? (int) (wakeup_time - now_time) : 0;
+}
+
+/****************************************************************************************
+ * Function name - mperform_uring
+ *
+ * Description - Calls curl_multi_info_read () to test url-fetch completion events,
+ *               and to proceed with the next step for a client, using load_next_step ().
+ *               It cares about statistics at certain timeouts.
+ *
+ * Input -       *bctx          - pointer to the batch of contexts;
+ * Input/Output  *now_time      - current time in msec
+ *
+ * Return Code/Output - On Success - 0, on Error -1
+ ****************************************************************************************/
+static int mperform_uring (batch_context* bctx, unsigned long* now_time)
+{
+  CURLM *mhandle =  bctx->multiple_handle;
+  int cycle_counter = 0;
+  int msg_num = 0;
+  const int snapshot_timeout = snapshot_statistics_timeout*1000;
+  CURLMsg *msg;
+  int sched_now = 0;
+
+  if ((long)(*now_time - bctx->last_measure) > snapshot_timeout)
+    {
+      if (is_batch_group_leader (bctx))
+        {
+          dump_snapshot_interval (bctx, *now_time);
+        }
+    }
+
+  stats_stream_tick (bctx, *now_time);
+
+  while( (msg = curl_multi_info_read (mhandle, &msg_num)) != 0)
+    {
+      if (msg->msg == CURLMSG_DONE)
+        {
+          CURL *handle = msg->easy_handle;
+          client_context *cctx = NULL;
+
+          curl_easy_getinfo (handle, CURLINFO_PRIVATE, (char **)&cctx);
+
+          if (!cctx)
+            {
+              fprintf (stderr, "%s - error: cctx is a NULL pointer.\n", __func__);
+              return -1;
+            }
+
+          if (msg->data.result)
+            {
+              cctx->client_state = CSTATE_ERROR;
+            }
+
+          completion_stats_collect (cctx, msg->data.result);
+
+          if (! (++cycle_counter % TIME_RECALCULATION_MSG_NUM))
+            {
+              *now_time = update_tick_count_cached ();
+            }
+
+            /*
+              Load next step only if request rate is not specified.
+              Otherwise requests are made on a timer.
+            */
+          if (bctx->req_rate)
+            {
+              if (put_free_client(cctx) < 0)
+                {
+                  fprintf (stderr, "%s error: cannot free a client.\n",
+                   __func__);
+                  return -1;
+                }
+            }
+          else
+            {
+              load_next_step (cctx, *now_time, &sched_now);
+            }
+
+          if (msg_num <= 0)
+            {
+              break;  /* If no messages left in the queue - go out */
+            }
+        }
+    }
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Function name - socket_callback_uring
+ *
+ * Description - CURLMOPT_SOCKETFUNCTION callback. Replaces the poll request of
+ *               the socket according to the new events or cancels it.
+ *
+ * Input -       *handle - curl easy handle, owning the socket
+ *               sockfd  - the socket
+ *               what    - CURL_POLL_* events, which libcurl wishes to wait for
+ *               *cbp    - pointer to the batch context
+ *               *sockp  - not used
+ *
+ * Return Code/Output - On Success - 0, on Error -1
+ ********************************************************************************/
+static int socket_callback_uring (CURL* handle,
+                                  curl_socket_t sockfd,
+                                  int what,
+                                  void* cbp,
+                                  void* sockp)
+{
+  batch_context* bctx = (batch_context *) cbp;
+  uring_ctx* ring = bctx->uring;
+  unsigned int events = 0;
+  uring_sock* us;
+
+  (void) handle;
+  (void) sockp;
+
+  if (sockfd >= ring->socks_size)
+    {
+      int new_size = 2 * ring->socks_size > sockfd ?
+        2 * ring->socks_size : sockfd + 1;
+      uring_sock* new_socks = realloc (ring->socks,
+                                       new_size * sizeof (uring_sock));
+      if (!new_socks)
+        {
+          fprintf (stderr, "%s - error: realloc () failed with errno %d.\n",
+                   __func__, errno);
+          return -1;
+        }
+
+      memset (new_socks + ring->socks_size, 0,
+              (new_size - ring->socks_size) * sizeof (uring_sock));
+      ring->socks = new_socks;
+      ring->socks_size = new_size;
+    }
+
+  us = &ring->socks[sockfd];
+
+  if (what != CURL_POLL_REMOVE)
+    {
+      if (what & CURL_POLL_IN)
+        events |= POLLIN;
+      if (what & CURL_POLL_OUT)
+        events |= POLLOUT;
+    }
+
+  if (us->armed && us->events == events)
+    return 0;
+
+  if (us->armed)
+    {
+      struct io_uring_sqe* sqe = uring_get_sqe (ring);
+
+      if (!sqe)
+        return -1;
+
+      sqe->opcode = IORING_OP_POLL_REMOVE;
+      sqe->fd = -1;
+      sqe->addr = URING_UD_POLL (sockfd, us->gen);
+      sqe->user_data = URING_UD_IGNORE;
+      us->armed = 0;
+    }
+
+  /* Completions of the previous poll to be ignored */
+  us->gen++;
+  us->events = events;
+
+  if (events)
+    {
+      return uring_arm_poll (ring, sockfd);
+    }
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Function name - timer_callback_uring
+ *
+ * Description - CURLMOPT_TIMERFUNCTION callback. Keeps the time, when libcurl
+ *               wishes to be called with CURL_SOCKET_TIMEOUT.
+ *
+ * Input -       *multi     - curl multi handle
+ *               timeout_ms - timeout in msec, -1 means to delete the timeout
+ *               *cbp       - pointer to the batch context
+ *
+ * Return Code/Output - Always 0
+ ********************************************************************************/
+static int timer_callback_uring (CURLM* multi, long timeout_ms, void* cbp)
+{
+  batch_context* bctx = (batch_context *) cbp;
+
+  (void) multi;
+
+  bctx->curl_timeout_time = timeout_ms < 0 ? 0 :
+    get_tick_count_cached () + (unsigned long) timeout_ms;
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Function name - uring_arm_poll
+ *
+ * Description - Queues one-shot poll request for the socket events
+ *
+ * Input -       *ring  - pointer to the ring
+ *               sockfd - the socket
+ *
+ * Return Code/Output - On Success - 0, on Error -1
+ ********************************************************************************/
+static int uring_arm_poll (uring_ctx* ring, curl_socket_t sockfd)
+{
+  uring_sock* us = &ring->socks[sockfd];
+  struct io_uring_sqe* sqe = uring_get_sqe (ring);
+
+  if (!sqe)
+    return -1;
+
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = sockfd;
+  sqe->poll32_events = us->events;
+  sqe->user_data = URING_UD_POLL (sockfd, us->gen);
+  us->armed = 1;
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Function name - uring_get_sqe
+ *
+ * Description - Returns the next free submission queue entry, zeroed. When the
+ *               submission queue is full, passes its entries to kernel first.
+ *
+ * Input -       *ring - pointer to the ring
+ *
+ * Return Code/Output - On Success - pointer to the entry, on Error - NULL
+ ********************************************************************************/
+static struct io_uring_sqe* uring_get_sqe (uring_ctx* ring)
+{
+  unsigned tail = *ring->sq_tail;
+  struct io_uring_sqe* sqe;
+
+  if (tail - __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE) > *ring->sq_mask)
+    {
+      if (uring_enter (ring, 0) == -1)
+        return NULL;
+    }
+
+  sqe = &ring->sqes[tail & *ring->sq_mask];
+  memset (sqe, 0, sizeof (*sqe));
+
+  ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+  __atomic_store_n (ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->sq_pending++;
+
+  return sqe;
+}
+
+/*******************************************************************************
+ * Function name - uring_enter
+ *
+ * Description - Passes the pending submission queue entries to kernel and,
+ *               optionally, waits for completions.
+ *
+ * Input -       *ring   - pointer to the ring
+ *               wait_nr - number of completions to wait for
+ *
+ * Return Code/Output - On Success - 0, on Error -1
+ ********************************************************************************/
+static int uring_enter (uring_ctx* ring, unsigned wait_nr)
+{
+  int rc;
+
+  do
+    {
+      rc = syscall (__NR_io_uring_enter, ring->ring_fd, ring->sq_pending,
+                    wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    }
+  while (rc == -1 && errno == EINTR);
+
+  if (rc == -1 && errno != EBUSY && errno != ETIME)
+    {
+      fprintf (stderr, "%s - error: io_uring_enter () failed with errno %d.\n",
+               __func__, errno);
+      return -1;
+    }
+
+  if (rc > 0)
+    {
+      ring->sq_pending -= rc;
+    }
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Function name - uring_init
+ *
+ * Description - Sets up io_uring and maps its submission and completion queues
+ *
+ * Input -       *ring      - pointer to the zeroed ring
+ *               cq_entries - number of completion queue entries
+ *
+ * Return Code/Output - On Success - 0, on Error -1
+ ********************************************************************************/
+static int uring_init (uring_ctx* ring, unsigned cq_entries)
+{
+  struct io_uring_params p;
+
+  memset (&p, 0, sizeof (p));
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = cq_entries;
+
+  if ((ring->ring_fd = syscall (__NR_io_uring_setup, URING_SQ_ENTRIES, &p)) < 0)
+    {
+      fprintf (stderr, "%s - error: io_uring_setup () failed with errno %d.\n",
+               __func__, errno);
+      return -1;
+    }
+
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+  ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+  ring->sq_ring = mmap (0, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+  ring->cq_ring = mmap (0, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+  ring->sqes = mmap (0, ring->sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+
+  if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+      ring->sqes == MAP_FAILED)
+    {
+      fprintf (stderr, "%s - error: mmap () failed with errno %d.\n",
+               __func__, errno);
+      return -1;
+    }
+
+  ring->sq_head = (unsigned *) ((char *) ring->sq_ring + p.sq_off.head);
+  ring->sq_tail = (unsigned *) ((char *) ring->sq_ring + p.sq_off.tail);
+  ring->sq_mask = (unsigned *) ((char *) ring->sq_ring + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *) ((char *) ring->sq_ring + p.sq_off.array);
+
+  ring->cq_head = (unsigned *) ((char *) ring->cq_ring + p.cq_off.head);
+  ring->cq_tail = (unsigned *) ((char *) ring->cq_ring + p.cq_off.tail);
+  ring->cq_mask = (unsigned *) ((char *) ring->cq_ring + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *) ((char *) ring->cq_ring + p.cq_off.cqes);
+
+  return 0;
+}
+
+/*******************************************************************************
+ * Function name - uring_release
+ *
+ * Description - Unmaps the ring queues and closes the ring
+ *
+ * Input -       *ring - pointer to the ring
+ *
+ * Return Code/Output - None
+ ********************************************************************************/
+static void uring_release (uring_ctx* ring)
+{
+  if (ring->sq_ring && ring->sq_ring != MAP_FAILED)
+    munmap (ring->sq_ring, ring->sq_ring_size);
+  if (ring->cq_ring && ring->cq_ring != MAP_FAILED)
+    munmap (ring->cq_ring, ring->cq_ring_size);
+  if (ring->sqes && ring->sqes != MAP_FAILED)
+    munmap (ring->sqes, ring->sqes_size);
+
+  if (ring->ring_fd > 0)
+    close (ring->ring_fd);
+
+  free (ring->socks);
+  ring->socks = 0;
+  ring->socks_size = 0;
+}
@@ -0,0 +1,453 @@
+/*
+*     log_ring.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "batch.h"
+#include "client.h"
+#include "loader.h"
+#include "conf.h"
+#include "timer_tick.h"
+#include "log_ring.h"
+#include "log_rotate.h"
+
+/* The rings of the batches, a slot is NULL, when the ring is released */
+static log_ring* log_rings[BATCHES_MAX_NUM];
+static int log_rings_num = 0;
+
+static pthread_t log_writer_tid;
+static int log_writer_running = 0;
+static int log_writer_stopping = 0;
+
+static void* log_writer_function (void* arg);
+
+/*
+  Writes the records of a ring to its file and reports the records dropped
+  since the previous call. Returns the number of bytes written.
+*/
+static unsigned long log_ring_drain (log_ring* r)
+{
+  const unsigned long tail = r->tail;
+  const unsigned long head = __atomic_load_n (&r->head, __ATOMIC_ACQUIRE);
+  const unsigned long dropped = __atomic_load_n (&r->dropped, __ATOMIC_RELAXED);
+  const unsigned long len = head - tail;
+  const unsigned long off = tail & (LOG_RING_SIZE - 1);
+
+  if (len)
+    {
+      const unsigned long first = len < LOG_RING_SIZE - off ? len : LOG_RING_SIZE - off;
+
+      /* The ring is written in at most two large chunks */
+      (void) fwrite (r->buf + off, 1, first, r->file);
+      if (len > first)
+        (void) fwrite (r->buf, 1, len - first, r->file);
+
+      __atomic_store_n (&r->tail, head, __ATOMIC_RELEASE);
+    }
+
+  r->file_size += len;
+
+  if (dropped != r->dropped_reported)
+    {
+      const int n = fprintf (r->file, "# %lu log records dropped\n",
+                             dropped - r->dropped_reported);
+      if (n > 0)
+        r->file_size += n;
+      r->dropped_reported = dropped;
+      fflush (r->file);
+    }
+  else if (len)
+    fflush (r->file);
+
+  return len;
+}
+
+/*
+  Rotates the logfile of a ring, when it is above the size of -l option or
+  older than its period
+*/
+static void log_ring_rotate_check (log_ring* r, unsigned long now)
+{
+  if (! r->path || r->rotate_failed || ! r->file_size)
+    return;
+
+  if (r->file_size < (unsigned long long) logfile_rotate_size << 20 &&
+      (! logfile_rotate_period ||
+       now - r->file_start < (unsigned long) logfile_rotate_period * 1000))
+    return;
+
+  fflush (r->file);
+
+  if (log_rotate (r->file, r->path, r->rotations + 1) == -1)
+    {
+      fprintf (stderr, "%s - error: rotation of %s stopped.\n", __func__, r->path);
+      r->rotate_failed = 1;
+      return;
+    }
+
+  r->rotations++;
+  r->file_size = 0;
+  r->file_start = now;
+}
+
+/****************************************************************************************
+* Function name - log_writer_function
+*
+* Description - The log writer thread. Drains the rings, rotates their logfiles,
+*               releases the closing rings and sleeps, when nothing is to be written.
+*
+* Input -       *arg - not used
+* Return Code/Output - NULL
+****************************************************************************************/
+static void* log_writer_function (void* arg)
+{
+  unsigned long written;
+  int i, rings_num, stopping;
+
+  (void) arg;
+
+  for (;;)
+    {
+      stopping = __atomic_load_n (&log_writer_stopping, __ATOMIC_ACQUIRE);
+      rings_num = __atomic_load_n (&log_rings_num, __ATOMIC_ACQUIRE);
+      written = 0;
+
+      for (i = 0; i < rings_num; i++)
+        {
+          log_ring* r = __atomic_load_n (&log_rings[i], __ATOMIC_ACQUIRE);
+          int closing;
+
+          if (! r)
+            continue;
+
+          /* The last records are in the ring before the closing flag is set */
+          closing = __atomic_load_n (&r->closing, __ATOMIC_ACQUIRE);
+
+          written += log_ring_drain (r);
+
+          log_ring_rotate_check (r, get_tick_count ());
+
+          if (closing)
+            {
+              __atomic_store_n (&log_rings[i], NULL, __ATOMIC_RELEASE);
+              __atomic_store_n (&r->closed, 1, __ATOMIC_RELEASE);
+            }
+        }
+
+      if (stopping)
+        break;
+
+      if (! written)
+        usleep (LOG_WRITER_IDLE_USEC);
+    }
+
+  return NULL;
+}
+
+/****************************************************************************************
+* Function name - log_writer_start
+*
+* Description - Starts the log writer thread and the log compressor thread
+*
+* Input -       None
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int log_writer_start (void)
+{
+  int error;
+
+  if (log_compressor_start () == -1)
+    fprintf (stderr, "%s - warning: rotated logfiles are not compressed.\n",
+             __func__);
+
+  if ((error = pthread_create (&log_writer_tid, NULL, log_writer_function, NULL)))
+    {
+      fprintf (stderr, "%s - error: pthread_create () failed with %d.\n",
+               __func__, error);
+      log_compressor_stop ();
+      return -1;
+    }
+
+  log_writer_running = 1;
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - log_writer_stop
+*
+* Description - Stops the log writer thread after the rings are closed and then
+*               the log compressor thread, when the rotated logfiles are compressed
+*
+* Input -       None
+* Return Code/Output - None
+****************************************************************************************/
+void log_writer_stop (void)
+{
+  if (! log_writer_running)
+    return;
+
+  __atomic_store_n (&log_writer_stopping, 1, __ATOMIC_RELEASE);
+  pthread_join (log_writer_tid, NULL);
+
+  log_writer_running = 0;
+
+  log_compressor_stop ();
+}
+
+/****************************************************************************************
+* Function name - log_ring_open
+*
+* Description - Allocates the log ring of a batch and passes it to the log writer.
+*               Without the writer running the batch logs directly to the file,
+*               through a direct ring without buffer, when the file is rotated.
+*               The rotations continue the numbers of the rotated files of the
+*               previous runs.
+*
+* Input -       *bctx - pointer to the batch context
+*               *file - the file to log to
+*               *path - path of the file to be rotated or NULL
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int log_ring_open (batch_context* bctx, FILE* file, const char* path)
+{
+  long position;
+
+  log_ring* r = 0;
+  int slot;
+
+  if (! log_writer_running && ! path)
+    return 0;
+
+  if (! (r = calloc (1, sizeof (log_ring))) ||
+      (log_writer_running && ! (r->buf = malloc (LOG_RING_SIZE))))
+    {
+      fprintf (stderr, "%s - error: allocation failed with errno %d.\n",
+               __func__, errno);
+      free (r);
+      return -1;
+    }
+  r->file = file;
+  r->path = path;
+  r->file_start = get_tick_count ();
+
+  if (path)
+    {
+      r->rotations = log_rotate_last_seq (path);
+
+      if ((position = ftell (file)) > 0)
+        r->file_size = position;
+    }
+
+  if (! log_writer_running)
+    {
+      r->direct = 1;
+      bctx->log_ring = r;
+      return 0;
+    }
+
+  if ((slot = __atomic_fetch_add (&log_rings_num, 1, __ATOMIC_ACQ_REL)) >=
+      BATCHES_MAX_NUM)
+    {
+      fprintf (stderr, "%s - error: too many log rings.\n", __func__);
+      free (r->buf);
+      free (r);
+      return -1;
+    }
+
+  __atomic_store_n (&log_rings[slot], r, __ATOMIC_RELEASE);
+
+  bctx->log_ring = r;
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - log_ring_close
+*
+* Description - Waits for the log writer to drain the log ring of a batch and
+*               releases it. Reports the number of dropped records, if any.
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - None
+****************************************************************************************/
+void log_ring_close (batch_context* bctx)
+{
+  log_ring* r = bctx->log_ring;
+
+  if (! r)
+    return;
+
+  if (r->direct)
+    {
+      free (r);
+      bctx->log_ring = 0;
+      return;
+    }
+
+  __atomic_store_n (&r->closing, 1, __ATOMIC_RELEASE);
+
+  while (! __atomic_load_n (&r->closed, __ATOMIC_ACQUIRE))
+    usleep (1000);
+
+  if (r->dropped)
+    fprintf (stderr, "%s - \"%s\" dropped %lu log records, logging could not "
+             "keep up with the load.\n", __func__, bctx->batch_name, r->dropped);
+
+  free (r->buf);
+  free (r);
+
+  bctx->log_ring = 0;
+}
+
+/*
+  Puts a record into the ring or drops it, when the record doesn't fit
+*/
+static void log_ring_put (log_ring* r, const char* rec, unsigned long len)
+{
+  unsigned long head, tail, off, first;
+
+  head = r->head;
+  tail = __atomic_load_n (&r->tail, __ATOMIC_ACQUIRE);
+
+  if (LOG_RING_SIZE - (head - tail) < len)
+    {
+      __atomic_store_n (&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+  off = head & (LOG_RING_SIZE - 1);
+  first = len < LOG_RING_SIZE - off ? len : LOG_RING_SIZE - off;
+
+  memcpy (r->buf + off, rec, first);
+  if (len > first)
+    memcpy (r->buf, rec + first, len - first);
+
+  __atomic_store_n (&r->head, head + len, __ATOMIC_RELEASE);
+}
+
+/*
+  Counts a record, written directly to the file by the batch thread without
+  the log writer, and rotates the file, when due
+*/
+static void log_ring_direct_done (log_ring* r, int len)
+{
+  if (len > 0)
+    r->file_size += (unsigned long) len;
+
+  log_ring_rotate_check (r, get_tick_count_cached ());
+}
+
+/****************************************************************************************
+* Function name - log_ring_vprintf
+*
+* Description - Formats a log record into the log ring or, when no ring, directly
+*               to the file
+*
+* Input -       *ring - pointer to the log ring or NULL
+*               *file - the file to log to without a ring
+*               *fmt  - format of the record, as for printf ()
+*               ap    - arguments of the format
+* Return Code/Output - None
+****************************************************************************************/
+void log_ring_vprintf (log_ring* r, FILE* file, const char* fmt, va_list ap)
+{
+  char rec[LOG_RING_RECORD_MAX];
+  int len;
+
+  if (! r)
+    {
+      (void) vfprintf (file, fmt, ap);
+      return;
+    }
+
+  if (r->direct)
+    {
+      log_ring_direct_done (r, vfprintf (r->file, fmt, ap));
+      return;
+    }
+
+  len = vsnprintf (rec, sizeof (rec), fmt, ap);
+
+  if (len < 0)
+    return;
+
+  if (len >= (int) sizeof (rec))
+    {
+      /* Truncated, the record still ends the line */
+      len = sizeof (rec) - 1;
+      rec[len - 1] = '\n';
+    }
+
+  log_ring_put (r, rec, (unsigned long) len);
+}
+
+/****************************************************************************************
+* Function name - log_ring_printf
+*
+* Description - Formats a log record into the log ring or, when no ring, directly
+*               to the file
+*
+* Input -       *ring - pointer to the log ring or NULL
+*               *file - the file to log to without a ring
+*               *fmt  - format of the record, as for printf ()
+* Return Code/Output - None
+****************************************************************************************/
+void log_ring_printf (log_ring* r, FILE* file, const char* fmt, ...)
+{
+  va_list ap;
+
+  va_start (ap, fmt);
+  log_ring_vprintf (r, file, fmt, ap);
+  va_end (ap);
+}
+
+/****************************************************************************************
+* Function name - log_ring_write
+*
+* Description - Puts formatted log records as a whole into the log ring or, when no
+*               ring, writes them directly to the file
+*
+* Input -       *ring - pointer to the log ring or NULL
+*               *file - the file to log to without a ring
+*               *data - the records, ending a line
+*               len   - length of the records, at most LOG_RING_SIZE
+* Return Code/Output - None
+****************************************************************************************/
+void log_ring_write (log_ring* r, FILE* file, const char* data, size_t len)
+{
+  if (! r)
+    {
+      (void) fwrite (data, 1, len, file);
+      return;
+    }
+
+  if (r->direct)
+    {
+      log_ring_direct_done (r, (int) fwrite (data, 1, len, r->file));
+      return;
+    }
+
+  log_ring_put (r, data, (unsigned long) len);
+}
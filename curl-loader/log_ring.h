@@ -0,0 +1,182 @@
+/*
+*     log_ring.h
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "statistics.h"
+
+/*
+  Asynchronous logging of clients. Each batch thread formats its log records
+  into its own single-producer single-consumer ring of bytes, and the log
+  writer thread drains all the rings to their files in large sequential
+  writes. A record, which doesn't fit into the free space of the ring, is
+  dropped and counted; the loading thread never waits for the writer.
+  The writer rotates the logfiles as well, see log_rotate.h.
+*/
+
+/* Size of the ring of a batch, a power of two */
+#define LOG_RING_SIZE (1UL << 22)
+
+/* Maximal length of a record; longer records are truncated */
+#define LOG_RING_RECORD_MAX 4096
+
+/* Sleep of the writer, when all the rings are empty, usec */
+#define LOG_WRITER_IDLE_USEC 5000
+
+typedef struct log_ring
+{
+  /* Written by the batch thread */
+  unsigned long head __attribute__ ((aligned (STAT_CACHE_LINE_SIZE)));
+
+  /* Number of dropped records */
+  unsigned long dropped;
+
+  /* Set by the batch thread, when the ring is to be drained and released */
+  int closing;
+
+  /* Written by the log writer thread */
+  unsigned long tail __attribute__ ((aligned (STAT_CACHE_LINE_SIZE)));
+
+  /* Number of dropped records, already reported to the file */
+  unsigned long dropped_reported;
+
+  /* Set by the writer, when the ring is drained and released by it */
+  int closed;
+
+  /* The file, where the records are written */
+  FILE* file;
+
+  /* Path of the file, when it is rotated, or NULL */
+  const char* path;
+
+  /* Size of the current file and the time it was started, msec */
+  unsigned long long file_size;
+  unsigned long file_start;
+
+  /* Number of the rotations done */
+  unsigned int rotations;
+
+  /* Set on a failed rotation, which is not retried */
+  int rotate_failed;
+
+  /* 
+     Set without the log writer: the batch thread writes the records directly
+     to the file and rotates it, the ring has no buffer.
+  */
+  int direct;
+
+  char* buf;
+
+} log_ring;
+
+/* Forward declaration */
+struct batch_context;
+
+/****************************************************************************************
+* Function name - log_writer_start
+*
+* Description - Starts the log writer thread and the log compressor thread
+*
+* Input -       None
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int log_writer_start (void);
+
+/****************************************************************************************
+* Function name - log_writer_stop
+*
+* Description - Stops the log writer thread after the rings are closed and then
+*               the log compressor thread, when the rotated logfiles are compressed
+*
+* Input -       None
+* Return Code/Output - None
+****************************************************************************************/
+void log_writer_stop (void);
+
+/****************************************************************************************
+* Function name - log_ring_open
+*
+* Description - Allocates the log ring of a batch and passes it to the log writer.
+*               Without the writer running the batch logs directly to the file.
+*
+* Input -       *bctx - pointer to the batch context
+*               *file - the file to log to
+*               *path - path of the file to be rotated or NULL
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int log_ring_open (struct batch_context* bctx, FILE* file, const char* path);
+
+/****************************************************************************************
+* Function name - log_ring_close
+*
+* Description - Waits for the log writer to drain the log ring of a batch and
+*               releases it. Reports the number of dropped records, if any.
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - None
+****************************************************************************************/
+void log_ring_close (struct batch_context* bctx);
+
+/****************************************************************************************
+* Function name - log_ring_printf
+*
+* Description - Formats a log record into the log ring or, when no ring, directly
+*               to the file
+*
+* Input -       *ring - pointer to the log ring or NULL
+*               *file - the file to log to without a ring
+*               *fmt  - format of the record, as for printf ()
+* Return Code/Output - None
+****************************************************************************************/
+void log_ring_printf (log_ring* ring, FILE* file, const char* fmt, ...)
+  __attribute__ ((format (printf, 3, 4)));
+
+/****************************************************************************************
+* Function name - log_ring_vprintf
+*
+* Description - Formats a log record into the log ring or, when no ring, directly
+*               to the file
+*
+* Input -       *ring - pointer to the log ring or NULL
+*               *file - the file to log to without a ring
+*               *fmt  - format of the record, as for printf ()
+*               ap    - arguments of the format
+* Return Code/Output - None
+****************************************************************************************/
+void log_ring_vprintf (log_ring* ring, FILE* file, const char* fmt, va_list ap)
+  __attribute__ ((format (printf, 3, 0)));
+
+/****************************************************************************************
+* Function name - log_ring_write
+*
+* Description - Puts formatted log records as a whole into the log ring or, when no
+*               ring, writes them directly to the file
+*
+* Input -       *ring - pointer to the log ring or NULL
+*               *file - the file to log to without a ring
+*               *data - the records, ending a line
+*               len   - length of the records, at most LOG_RING_SIZE
+* Return Code/Output - None
+****************************************************************************************/
+void log_ring_write (log_ring* ring, FILE* file, const char* data, size_t len);
+
+#endif /* LOG_RING_H */
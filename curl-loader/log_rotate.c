@@ -0,0 +1,381 @@
+/*
+*     log_rotate.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <limits.h>
+#include <zlib.h>
+
+#include "conf.h"
+#include "log_rotate.h"
+
+/*
+  A rotated logfile <path>.<seq> to be compressed
+*/
+typedef struct log_rotate_job
+{
+  struct log_rotate_job* next;
+
+  unsigned int seq;
+
+  char path[1];
+
+} log_rotate_job;
+
+/* The jobs in the order of rotation, from the log writer to the compressor */
+static log_rotate_job* jobs_head = 0;
+static log_rotate_job* jobs_tail = 0;
+
+static pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t log_compressor_tid;
+static int log_compressor_running = 0;
+static int log_compressor_stopping = 0;
+
+static void* log_compressor_function (void* arg);
+
+
+/*
+  Removes the rotated logfile, which is the first beyond the number of the kept
+  ones after the rotation seq
+*/
+static void log_rotate_retain (const char* path, unsigned int seq)
+{
+  char name[FILENAME_MAX];
+
+  if (seq <= (unsigned int) logfile_rotate_keep)
+    return;
+
+  seq -= logfile_rotate_keep;
+
+  snprintf (name, sizeof (name), "%s.%u.gz", path, seq);
+  (void) unlink (name);
+
+  snprintf (name, sizeof (name), "%s.%u", path, seq);
+  (void) unlink (name);
+}
+
+/****************************************************************************************
+* Function name - log_compress
+*
+* Description - Compresses a rotated logfile <path>.<seq> to <path>.<seq>.gz and
+*               removes it
+*
+* Input -       *job - pointer to the job with the path and the rotation number
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+static int log_compress (const log_rotate_job* job)
+{
+  char src_name[FILENAME_MAX];
+  char dst_name[FILENAME_MAX];
+  char* buf = 0;
+  FILE* src = 0;
+  gzFile dst = 0;
+  size_t n;
+  int rval = -1;
+
+  snprintf (src_name, sizeof (src_name), "%s.%u", job->path, job->seq);
+  snprintf (dst_name, sizeof (dst_name), "%s.%u.gz", job->path, job->seq);
+
+  if (! (buf = malloc (LOG_ROTATE_COPY_SIZE)))
+    {
+      fprintf (stderr, "%s - error: malloc () failed with errno %d.\n",
+               __func__, errno);
+      return -1;
+    }
+
+  if (! (src = fopen (src_name, "r")))
+    {
+      fprintf (stderr, "%s - error: fopen () of %s failed with errno %d.\n",
+               __func__, src_name, errno);
+      goto cleanup;
+    }
+
+  if (! (dst = gzopen (dst_name, LOG_ROTATE_GZIP_MODE)))
+    {
+      fprintf (stderr, "%s - error: gzopen () of %s failed with errno %d.\n",
+               __func__, dst_name, errno);
+      goto cleanup;
+    }
+
+  while ((n = fread (buf, 1, LOG_ROTATE_COPY_SIZE, src)) > 0)
+    {
+      if (gzwrite (dst, buf, (unsigned int) n) != (int) n)
+        {
+          fprintf (stderr, "%s - error: gzwrite () to %s failed.\n",
+                   __func__, dst_name);
+          goto cleanup;
+        }
+    }
+
+  if (ferror (src))
+    {
+      fprintf (stderr, "%s - error: fread () of %s failed.\n", __func__, src_name);
+      goto cleanup;
+    }
+
+  rval = 0;
+
+ cleanup:
+  if (dst && gzclose (dst) != Z_OK && ! rval)
+    {
+      fprintf (stderr, "%s - error: gzclose () of %s failed.\n", __func__, dst_name);
+      rval = -1;
+    }
+
+  if (src)
+    fclose (src);
+
+  free (buf);
+
+  /* The rotated logfile is kept, when not compressed */
+  if (rval)
+    (void) unlink (dst_name);
+  else
+    (void) unlink (src_name);
+
+  return rval;
+}
+
+/****************************************************************************************
+* Function name - log_compressor_function
+*
+* Description - The log compressor thread. Compresses the rotated logfiles in the
+*               order of rotation and removes the ones beyond the number kept.
+*
+* Input -       *arg - not used
+* Return Code/Output - NULL
+****************************************************************************************/
+static void* log_compressor_function (void* arg)
+{
+  log_rotate_job* job;
+
+  (void) arg;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&jobs_mutex);
+
+      while (! jobs_head && ! log_compressor_stopping)
+        pthread_cond_wait (&jobs_cond, &jobs_mutex);
+
+      if (! (job = jobs_head))
+        {
+          /* Stopping and all the jobs done */
+          pthread_mutex_unlock (&jobs_mutex);
+          break;
+        }
+
+      if (! (jobs_head = job->next))
+        jobs_tail = 0;
+
+      pthread_mutex_unlock (&jobs_mutex);
+
+      (void) log_compress (job);
+      log_rotate_retain (job->path, job->seq);
+
+      free (job);
+    }
+
+  return NULL;
+}
+
+/****************************************************************************************
+* Function name - log_compressor_start
+*
+* Description - Starts the log compressor thread
+*
+* Input -       None
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int log_compressor_start (void)
+{
+  int error;
+
+  if ((error = pthread_create (&log_compressor_tid, NULL,
+                               log_compressor_function, NULL)))
+    {
+      fprintf (stderr, "%s - error: pthread_create () failed with %d.\n",
+               __func__, error);
+      return -1;
+    }
+
+  log_compressor_running = 1;
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - log_compressor_stop
+*
+* Description - Stops the log compressor thread, when all the rotated logfiles
+*               are compressed
+*
+* Input -       None
+* Return Code/Output - None
+****************************************************************************************/
+void log_compressor_stop (void)
+{
+  if (! log_compressor_running)
+    return;
+
+  pthread_mutex_lock (&jobs_mutex);
+  log_compressor_stopping = 1;
+  pthread_cond_signal (&jobs_cond);
+  pthread_mutex_unlock (&jobs_mutex);
+
+  pthread_join (log_compressor_tid, NULL);
+
+  log_compressor_running = 0;
+}
+
+/****************************************************************************************
+* Function name - log_rotate_last_seq
+*
+* Description - Finds the highest sequence number of the rotated logfiles <path>.<seq>
+*               and <path>.<seq>.gz, left by the previous runs
+*
+* Input -       *path - path of the logfile
+* Return Code/Output - The highest sequence number or 0, when none
+****************************************************************************************/
+unsigned int log_rotate_last_seq (const char* path)
+{
+  char dir_name[FILENAME_MAX];
+  const char* base = strrchr (path, '/');
+  struct dirent* de;
+  unsigned int seq = 0;
+  unsigned long n;
+  size_t base_len;
+  char* end;
+  DIR* dir;
+
+  if (base)
+    {
+      snprintf (dir_name, sizeof (dir_name), "%.*s",
+                (int) (base - path) + 1, path);
+      base++;
+    }
+  else
+    {
+      snprintf (dir_name, sizeof (dir_name), ".");
+      base = path;
+    }
+
+  if (! (dir = opendir (dir_name)))
+    return 0;
+
+  base_len = strlen (base);
+
+  while ((de = readdir (dir)))
+    {
+      if (strncmp (de->d_name, base, base_len) || de->d_name[base_len] != '.' ||
+          de->d_name[base_len + 1] < '0' || de->d_name[base_len + 1] > '9')
+        continue;
+
+      n = strtoul (de->d_name + base_len + 1, &end, 10);
+
+      if ((! *end || ! strcmp (end, ".gz")) && n > seq && n <= UINT_MAX)
+        seq = (unsigned int) n;
+    }
+
+  closedir (dir);
+  return seq;
+}
+
+/****************************************************************************************
+* Function name - log_rotate
+*
+* Description - Renames a logfile to <path>.<seq> and continues the logging to a new
+*               file with the path through the same FILE; passes the rotated file
+*               to the log compressor
+*
+* Input -       *file - the logfile, flushed
+*               *path - path of the logfile
+*               seq   - sequence number of the rotation, from 1
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int log_rotate (FILE* file, const char* path, unsigned int seq)
+{
+  char name[FILENAME_MAX];
+  log_rotate_job* job;
+  int fd;
+
+  snprintf (name, sizeof (name), "%s.%u", path, seq);
+
+  if (rename (path, name) == -1)
+    {
+      fprintf (stderr, "%s - error: rename () of %s failed with errno %d.\n",
+               __func__, path, errno);
+      return -1;
+    }
+
+  /*
+     The descriptor of the FILE is replaced, thus the batch keeps its FILE
+     and the writer continues at the start of the new file.
+  */
+  if ((fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1 ||
+      dup2 (fd, fileno (file)) == -1)
+    {
+      fprintf (stderr, "%s - error: reopening of %s failed with errno %d.\n",
+               __func__, path, errno);
+      if (fd != -1)
+        close (fd);
+      return -1;
+    }
+
+  close (fd);
+
+  if (! log_compressor_running)
+    {
+      log_rotate_retain (path, seq);
+      return 0;
+    }
+
+  if (! (job = malloc (sizeof (log_rotate_job) + strlen (path))))
+    {
+      fprintf (stderr, "%s - error: malloc () failed, %s is not compressed.\n",
+               __func__, name);
+      log_rotate_retain (path, seq);
+      return 0;
+    }
+
+  job->next = 0;
+  job->seq = seq;
+  strcpy (job->path, path);
+
+  pthread_mutex_lock (&jobs_mutex);
+
+  if (jobs_tail)
+    jobs_tail->next = job;
+  else
+    jobs_head = job;
+  jobs_tail = job;
+
+  pthread_cond_signal (&jobs_cond);
+  pthread_mutex_unlock (&jobs_mutex);
+
+  return 0;
+}
@@ -0,0 +1,87 @@
+/*
+*     log_rotate.h
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef LOG_ROTATE_H
+#define LOG_ROTATE_H
+
+#include <stdio.h>
+
+/*
+  Rotation of the batch logfiles. The log writer thread renames a logfile,
+  which exceeds the size of -l option or is older than its period, to
+  <logfile>.<n>, n = 1, 2, ..., and continues in a new <logfile> through the
+  same FILE. The log compressor thread gzips the rotated files to
+  <logfile>.<n>.gz in the order of rotation and keeps the last -k of them.
+*/
+
+/* Number of rotated logfiles kept by default */
+#define LOG_ROTATE_KEEP_DEFAULT 8
+
+/* Mode of gzopen () for the rotated logfiles */
+#define LOG_ROTATE_GZIP_MODE "wb6"
+
+/* Size of the copy buffer of the compressor */
+#define LOG_ROTATE_COPY_SIZE (1 << 16)
+
+/****************************************************************************************
+* Function name - log_compressor_start
+*
+* Description - Starts the log compressor thread
+*
+* Input -       None
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int log_compressor_start (void);
+
+/****************************************************************************************
+* Function name - log_compressor_stop
+*
+* Description - Stops the log compressor thread, when all the rotated logfiles
+*               are compressed
+*
+* Input -       None
+* Return Code/Output - None
+****************************************************************************************/
+void log_compressor_stop (void);
+
+/****************************************************************************************
+* Function name - log_rotate_last_seq
+*
+* Description - Finds the highest sequence number of the rotated logfiles <path>.<seq>
+*               and <path>.<seq>.gz, left by the previous runs
+*
+* Input -       *path - path of the logfile
+* Return Code/Output - The highest sequence number or 0, when none
+****************************************************************************************/
+unsigned int log_rotate_last_seq (const char* path);
+
+/****************************************************************************************
+* Function name - log_rotate
+*
+* Description - Renames a logfile to <path>.<seq> and continues the logging to a new
+*               file with the path through the same FILE; passes the rotated file
+*               to the log compressor
+*
+* Input -       *file - the logfile, flushed
+*               *path - path of the logfile
+*               seq   - sequence number of the rotation, from 1
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int log_rotate (FILE* file, const char* path, unsigned int seq);
+
+#endif /* LOG_ROTATE_H */
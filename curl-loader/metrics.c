@@ -0,0 +1,742 @@
+/*
+*     metrics.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "batch.h"
+#include "conf.h"
+#include "metrics.h"
+
+/* Index bits of a triple buffer state and the flag of a fresh snapshot */
+#define METRICS_BUF_INDEX_MASK 0x3
+#define METRICS_BUF_FRESH 0x4
+
+/* Upper bounds of the histogram buckets in usec and as label values in seconds */
+static const struct
+{
+  unsigned long long usec;
+  const char* le;
+} metrics_bounds[] =
+  {{500, "0.0005"}, {1000, "0.001"}, {2500, "0.0025"}, {5000, "0.005"},
+   {10000, "0.01"}, {25000, "0.025"}, {50000, "0.05"}, {100000, "0.1"},
+   {250000, "0.25"}, {500000, "0.5"}, {1000000, "1.0"}, {2500000, "2.5"},
+   {5000000, "5.0"}, {10000000, "10.0"}};
+
+#define METRICS_BOUNDS_NUM \
+  ((int) (sizeof (metrics_bounds) / sizeof (metrics_bounds[0])))
+
+/* Names of the phases as label values */
+static const char* metrics_phase_names[PHASE_NUM] =
+  {"dns", "connect", "tls", "ttfb", "transfer", "redirect", "total"};
+
+static const char* metrics_class_names[OP_STAT_RESP_CLASSES] =
+  {"1xx", "2xx", "3xx", "4xx", "5xx"};
+
+/*
+  metrics_server - the state of the exporter. The snapshots are a triple
+  buffer: the leader writes to <back> and swaps it with <middle>, the exporter
+  swaps <middle> with <front>, when a fresh one is there, and reads <front>.
+*/
+typedef struct metrics_server
+{
+  /* Whether started, the other fields are valid */
+  int inited;
+
+  int fd;
+
+  pthread_t tid;
+  int running;
+  int stop;
+
+  char batch_name[BATCH_NAME_SIZE];
+
+  int url_num;
+  char (*url_names)[URL_SHORT_NAME_LEN + 1];
+
+  size_t record_size;
+  char* bufs[3];
+
+  /* Owned by the leader */
+  int back;
+
+  /* Index of the middle buffer with METRICS_BUF_FRESH, shared */
+  int middle;
+
+  /* Owned by the exporter thread */
+  int front;
+
+} metrics_server;
+
+/* Text of a response, growing as needed */
+typedef struct metrics_text
+{
+  char* data;
+  size_t size;
+  size_t len;
+  int failed;
+} metrics_text;
+
+/* Only the leader of the batch group runs the exporter */
+static metrics_server metrics;
+
+static void* metrics_server_function (void* arg);
+
+static int metrics_listen (const char* address);
+
+static void metrics_serve (int fd);
+
+static void metrics_format (metrics_text* t, const sts_record* rec);
+
+static void metrics_text_printf (metrics_text* t, const char* fmt, ...)
+  __attribute__ ((format (printf, 2, 3)));
+
+static void metrics_text_label (metrics_text* t, const char* value);
+
+
+/****************************************************************************************
+* Function name - metrics_server_start
+*
+* Description - Binds and listens on metrics_address and starts the exporter thread
+*
+* Input -       *bctx - pointer to the batch context of the leader
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int metrics_server_start (batch_context* bctx)
+{
+  int i, error;
+
+  memset (&metrics, 0, sizeof (metrics));
+  metrics.inited = 1;
+  metrics.fd = -1;
+
+  snprintf (metrics.batch_name, sizeof (metrics.batch_name), "%s", bctx->batch_name);
+
+  metrics.url_num = bctx->urls_num;
+  if (! (metrics.url_names = calloc (bctx->urls_num ? bctx->urls_num : 1,
+                                     sizeof (*metrics.url_names))))
+    {
+      fprintf (stderr, "%s - error: calloc () failed with errno %d.\n",
+               __func__, errno);
+      goto error;
+    }
+
+  for (i = 0; i < bctx->urls_num; i++)
+    {
+      snprintf (metrics.url_names[i], sizeof (metrics.url_names[i]), "%s",
+                bctx->url_ctx_array[i].url_short_name);
+    }
+
+  metrics.record_size = STS_RECORD_SIZE (bctx->urls_num);
+
+  for (i = 0; i < 3; i++)
+    {
+      if (! (metrics.bufs[i] = calloc (1, metrics.record_size)))
+        {
+          fprintf (stderr, "%s - error: calloc () failed with errno %d.\n",
+                   __func__, errno);
+          goto error;
+        }
+    }
+
+  metrics.front = 0;
+  metrics.middle = 1;
+  metrics.back = 2;
+
+  if ((metrics.fd = metrics_listen (metrics_address)) == -1)
+    goto error;
+
+  if ((error = pthread_create (&metrics.tid, NULL, metrics_server_function, NULL)))
+    {
+      fprintf (stderr, "%s - error: pthread_create () failed with %d.\n",
+               __func__, error);
+      goto error;
+    }
+
+  metrics.running = 1;
+
+  fprintf (stderr, "%s - exporting metrics at http://%s/metrics\n",
+           __func__, metrics_address);
+  return 0;
+
+ error:
+  metrics_server_stop ();
+  return -1;
+}
+
+/****************************************************************************************
+* Function name - metrics_server_stop
+*
+* Description - Stops the exporter thread, closes the socket and releases the snapshots
+*
+* Input -       None
+* Return Code/Output - None
+****************************************************************************************/
+void metrics_server_stop (void)
+{
+  int i;
+
+  if (! metrics.inited)
+    return;
+
+  if (metrics.running)
+    {
+      __atomic_store_n (&metrics.stop, 1, __ATOMIC_RELEASE);
+      pthread_join (metrics.tid, NULL);
+      metrics.running = 0;
+    }
+
+  if (metrics.fd != -1)
+    {
+      close (metrics.fd);
+      metrics.fd = -1;
+    }
+
+  for (i = 0; i < 3; i++)
+    {
+      free (metrics.bufs[i]);
+      metrics.bufs[i] = 0;
+    }
+
+  free (metrics.url_names);
+  metrics.url_names = 0;
+
+  metrics.inited = 0;
+}
+
+/****************************************************************************************
+* Function name - metrics_publish
+*
+* Description - Publishes a record as the latest snapshot to the exporter. Called by
+*               the leader only; never blocks.
+*
+* Input -       *rec - pointer to the record
+* Return Code/Output - None
+****************************************************************************************/
+void metrics_publish (const sts_record* rec)
+{
+  if (! metrics.bufs[metrics.back])
+    return;
+
+  memcpy (metrics.bufs[metrics.back], rec, metrics.record_size);
+
+  metrics.back = __atomic_exchange_n (&metrics.middle,
+                                      metrics.back | METRICS_BUF_FRESH,
+                                      __ATOMIC_ACQ_REL) & METRICS_BUF_INDEX_MASK;
+}
+
+/****************************************************************************************
+* Function name - metrics_listen
+*
+* Description - Resolves the address and opens a non-blocking listening socket
+*
+* Input -       *address - <host:port>, IPv6 host in brackets, empty or * host for
+*                          any address
+* Return Code/Output - On success - the socket, on error -1
+****************************************************************************************/
+static int metrics_listen (const char* address)
+{
+  char host[METRICS_ADDRESS_SIZE];
+  char* port = 0;
+  struct addrinfo hints, *res = 0, *ai = 0;
+  int fd = -1, on = 1, error;
+
+  strcpy (host, address);
+
+  if (host[0] == '[' && (port = strchr (host, ']')) && port[1] == ':')
+    {
+      memmove (host, host + 1, (size_t) (port - host - 1));
+      port[-1] = '\0';
+      port += 2;
+    }
+  else if ((port = strrchr (host, ':')))
+    {
+      *port++ = '\0';
+    }
+
+  if (! port || ! *port)
+    {
+      fprintf (stderr, "%s - error: no port in \"%s\".\n", __func__, address);
+      return -1;
+    }
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+
+  if ((error = getaddrinfo ((host[0] && strcmp (host, "*")) ? host : NULL,
+                            port, &hints, &res)))
+    {
+      fprintf (stderr, "%s - error: getaddrinfo () of \"%s\" failed: %s.\n",
+               __func__, address, gai_strerror (error));
+      return -1;
+    }
+
+  for (ai = res; ai; ai = ai->ai_next)
+    {
+      if ((fd = socket (ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        ai->ai_protocol)) == -1)
+        continue;
+
+      setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+      if (bind (fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen (fd, 16) == 0)
+        break;
+
+      close (fd);
+      fd = -1;
+    }
+
+  if (fd == -1)
+    fprintf (stderr, "%s - error: failed to listen on \"%s\", errno %d.\n",
+             __func__, address, errno);
+
+  freeaddrinfo (res);
+  return fd;
+}
+
+/****************************************************************************************
+* Function name - metrics_server_function
+*
+* Description - The exporter thread. Accepts and serves connections one by one till
+*               stopped.
+*
+* Input -       *arg - not used
+* Return Code/Output - NULL
+****************************************************************************************/
+static void* metrics_server_function (void* arg)
+{
+  struct pollfd pfd;
+  int fd;
+
+  (void) arg;
+
+  while (! __atomic_load_n (&metrics.stop, __ATOMIC_ACQUIRE))
+    {
+      pfd.fd = metrics.fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+
+      if (poll (&pfd, 1, METRICS_POLL_TIMEOUT) <= 0)
+        continue;
+
+      if ((fd = accept (metrics.fd, NULL, NULL)) == -1)
+        continue;
+
+      if (fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK) == -1)
+        {
+          close (fd);
+          continue;
+        }
+
+      metrics_serve (fd);
+      close (fd);
+    }
+
+  return NULL;
+}
+
+/* Waits for a socket to be ready till the deadline; returns -1 on timeout */
+static int metrics_wait (int fd, short events, unsigned long deadline)
+{
+  struct pollfd pfd;
+  unsigned long now = get_tick_count ();
+
+  if ((long) (deadline - now) <= 0)
+    return -1;
+
+  pfd.fd = fd;
+  pfd.events = events;
+  pfd.revents = 0;
+
+  return poll (&pfd, 1, (int) (deadline - now)) > 0 ? 0 : -1;
+}
+
+static void metrics_send (int fd, const char* data, size_t len, unsigned long deadline)
+{
+  ssize_t sent;
+
+  while (len)
+    {
+      if ((sent = send (fd, data, len, MSG_NOSIGNAL)) > 0)
+        {
+          data += sent;
+          len -= (size_t) sent;
+        }
+      else if (sent == -1 && (errno == EAGAIN || errno == EINTR))
+        {
+          if (metrics_wait (fd, POLLOUT, deadline) == -1)
+            return;
+        }
+      else
+        return;
+    }
+}
+
+/****************************************************************************************
+* Function name - metrics_serve
+*
+* Description - Receives a request and sends the metrics or an error response
+*
+* Input -       fd - the accepted connection
+* Return Code/Output - None
+****************************************************************************************/
+static void metrics_serve (int fd)
+{
+  char req[METRICS_REQUEST_SIZE];
+  char head[256];
+  size_t len = 0;
+  ssize_t got;
+  const unsigned long deadline = get_tick_count () + METRICS_IO_TIMEOUT;
+  metrics_text t;
+  const char* status = "200 OK";
+  int is_head = 0, is_get = 0;
+
+  memset (&t, 0, sizeof (t));
+
+  /* Only the request line and headers end are looked for */
+  while (len < sizeof (req) - 1)
+    {
+      if ((got = recv (fd, req + len, sizeof (req) - 1 - len, 0)) > 0)
+        {
+          len += (size_t) got;
+          req[len] = '\0';
+          if (strstr (req, "\r\n\r\n") || strstr (req, "\n\n"))
+            break;
+        }
+      else if (got == -1 && (errno == EAGAIN || errno == EINTR))
+        {
+          if (metrics_wait (fd, POLLIN, deadline) == -1)
+            return;
+        }
+      else
+        return;
+    }
+  req[len] = '\0';
+
+  is_get = ! strncmp (req, "GET ", 4);
+  is_head = ! strncmp (req, "HEAD ", 5);
+
+  if (! is_get && ! is_head)
+    status = "405 Method Not Allowed";
+  else
+    {
+      const char* path = req + (is_get ? 4 : 5);
+      const size_t path_len = strcspn (path, " ?\r\n");
+
+      if (path_len != strlen ("/metrics") || strncmp (path, "/metrics", path_len))
+        status = "404 Not Found";
+    }
+
+  if (! strcmp (status, "200 OK"))
+    {
+      /* Take the latest published snapshot, if any */
+      if (__atomic_load_n (&metrics.middle, __ATOMIC_ACQUIRE) & METRICS_BUF_FRESH)
+        {
+          metrics.front = __atomic_exchange_n (&metrics.middle, metrics.front,
+                                               __ATOMIC_ACQ_REL) & METRICS_BUF_INDEX_MASK;
+        }
+
+      metrics_format (&t, (const sts_record *) metrics.bufs[metrics.front]);
+
+      if (t.failed)
+        status = "500 Internal Server Error";
+    }
+
+  if (strcmp (status, "200 OK"))
+    {
+      t.len = 0;
+      t.failed = 0;
+      metrics_text_printf (&t, "%s\n", status);
+    }
+
+  snprintf (head, sizeof (head),
+            "HTTP/1.1 %s\r\n"
+            "Content-Type: %s\r\n"
+            "Content-Length: %lu\r\n"
+            "Connection: close\r\n"
+            "\r\n",
+            status,
+            strcmp (status, "200 OK") ? "text/plain; charset=utf-8" :
+            "application/openmetrics-text; version=1.0.0; charset=utf-8",
+            t.failed ? 0UL : (unsigned long) t.len);
+
+  metrics_send (fd, head, strlen (head), deadline);
+
+  if (! is_head && ! t.failed)
+    metrics_send (fd, t.data, t.len, deadline);
+
+  free (t.data);
+}
+
+static void metrics_text_printf (metrics_text* t, const char* fmt, ...)
+{
+  va_list ap;
+  int n;
+  char* data;
+
+  if (t->failed)
+    return;
+
+  for (;;)
+    {
+      va_start (ap, fmt);
+      n = vsnprintf (t->data ? t->data + t->len : NULL, t->size - t->len, fmt, ap);
+      va_end (ap);
+
+      if (n < 0)
+        {
+          t->failed = 1;
+          return;
+        }
+
+      if (t->len + (size_t) n < t->size)
+        {
+          t->len += (size_t) n;
+          return;
+        }
+
+      if (! (data = realloc (t->data, t->size * 2 + (size_t) n + 4096)))
+        {
+          t->failed = 1;
+          return;
+        }
+      t->data = data;
+      t->size = t->size * 2 + (size_t) n + 4096;
+    }
+}
+
+/* Prints a label value escaped */
+static void metrics_text_label (metrics_text* t, const char* value)
+{
+  for (; *value; value++)
+    {
+      if (*value == '\\')
+        metrics_text_printf (t, "\\\\");
+      else if (*value == '"')
+        metrics_text_printf (t, "\\\"");
+      else if (*value == '\n')
+        metrics_text_printf (t, "\\n");
+      else
+        metrics_text_printf (t, "%c", *value);
+    }
+}
+
+static void metrics_family (metrics_text* t,
+                            const char* name,
+                            const char* type,
+                            const char* unit,
+                            const char* help)
+{
+  metrics_text_printf (t, "# TYPE %s %s\n", name, type);
+  if (unit)
+    metrics_text_printf (t, "# UNIT %s %s\n", name, unit);
+  metrics_text_printf (t, "# HELP %s %s\n", name, help);
+}
+
+/* Prints the buckets of a histogram in seconds, labels end with a comma */
+static void metrics_buckets (metrics_text* t,
+                             const char* name,
+                             const char* labels,
+                             const hdr_hist_small* h)
+{
+  int i;
+
+  for (i = 0; i < METRICS_BOUNDS_NUM; i++)
+    {
+      metrics_text_printf (t, "%s_bucket{%sle=\"%s\"} %llu\n", name, labels,
+                           metrics_bounds[i].le,
+                           hdr_hist_small_count_le (h, metrics_bounds[i].usec));
+    }
+  metrics_text_printf (t, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, labels, h->count);
+}
+
+/****************************************************************************************
+* Function name - metrics_format
+*
+* Description - Formats a snapshot as OpenMetrics text
+*
+* Input -       *t   - pointer to the text
+*               *rec - pointer to the snapshot record
+* Return Code/Output - None
+****************************************************************************************/
+static void metrics_format (metrics_text* t, const sts_record* rec)
+{
+  const sts_proto* protos[2] = {&rec->http, &rec->https};
+  const char* appls[2] = {"http", "https"};
+  char labels[64];
+  int i, j;
+
+  metrics_family (t, "curl_loader_batch", "info", NULL, "Loading batch.");
+  metrics_text_printf (t, "curl_loader_batch_info{name=\"");
+  metrics_text_label (t, metrics.batch_name);
+  metrics_text_printf (t, "\"} 1\n");
+
+  metrics_family (t, "curl_loader_elapsed_seconds", "gauge", "seconds",
+                  "Time since the load start.");
+  metrics_text_printf (t, "curl_loader_elapsed_seconds %.3f\n", rec->time / 1000.0);
+
+  metrics_family (t, "curl_loader_clients", "gauge", NULL,
+                  "Number of pending, active and waiting clients.");
+  metrics_text_printf (t, "curl_loader_clients %llu\n", rec->clients);
+
+  metrics_family (t, "curl_loader_calls", "counter", NULL,
+                  "Number of initiated calls.");
+  metrics_text_printf (t, "curl_loader_calls_total %llu\n", rec->call_init_count);
+
+  metrics_family (t, "curl_loader_requests", "counter", NULL,
+                  "Number of sent requests.");
+  for (i = 0; i < 2; i++)
+    metrics_text_printf (t, "curl_loader_requests_total{appl=\"%s\"} %llu\n",
+                         appls[i], protos[i]->requests);
+
+  metrics_family (t, "curl_loader_responses", "counter", NULL,
+                  "Number of received responses by status class.");
+  for (i = 0; i < 2; i++)
+    {
+      const unsigned long long resp[OP_STAT_RESP_CLASSES] =
+        {protos[i]->resp_1xx, protos[i]->resp_2xx, protos[i]->resp_3xx,
+         protos[i]->resp_4xx, protos[i]->resp_5xx};
+
+      for (j = 0; j < OP_STAT_RESP_CLASSES; j++)
+        metrics_text_printf (t, "curl_loader_responses_total{appl=\"%s\",class=\"%s\"} %llu\n",
+                             appls[i], metrics_class_names[j], resp[j]);
+    }
+
+  metrics_family (t, "curl_loader_errors", "counter", NULL,
+                  "Number of failed fetches by the error type.");
+  for (i = 0; i < 2; i++)
+    {
+      metrics_text_printf (t, "curl_loader_errors_total{appl=\"%s\",type=\"other\"} %llu\n",
+                           appls[i], protos[i]->other_errs);
+      metrics_text_printf (t, "curl_loader_errors_total{appl=\"%s\",type=\"url_timeout\"} %llu\n",
+                           appls[i], protos[i]->url_timeout_errs);
+    }
+
+  metrics_family (t, "curl_loader_data_in_bytes", "counter", "bytes",
+                  "Inbound bytes.");
+  for (i = 0; i < 2; i++)
+    metrics_text_printf (t, "curl_loader_data_in_bytes_total{appl=\"%s\"} %llu\n",
+                         appls[i], protos[i]->data_in);
+
+  metrics_family (t, "curl_loader_data_out_bytes", "counter", "bytes",
+                  "Outbound bytes.");
+  for (i = 0; i < 2; i++)
+    metrics_text_printf (t, "curl_loader_data_out_bytes_total{appl=\"%s\"} %llu\n",
+                         appls[i], protos[i]->data_out);
+
+  metrics_family (t, "curl_loader_response_delay_seconds", "histogram", "seconds",
+                  "Application delays between requests and responses.");
+  for (i = 0; i < 2; i++)
+    {
+      snprintf (labels, sizeof (labels), "appl=\"%s\",", appls[i]);
+      metrics_buckets (t, "curl_loader_response_delay_seconds", labels,
+                       &protos[i]->appl_delay);
+      metrics_text_printf (t, "curl_loader_response_delay_seconds_count{appl=\"%s\"} %llu\n",
+                           appls[i], protos[i]->appl_delay.count);
+      metrics_text_printf (t, "curl_loader_response_delay_seconds_sum{appl=\"%s\"} %.6f\n",
+                           appls[i], protos[i]->appl_delay_sum / 1000000.0);
+    }
+
+  metrics_family (t, "curl_loader_phase_seconds", "summary", "seconds",
+                  "Times of the phases of successful fetches.");
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < PHASE_NUM; j++)
+      {
+        metrics_text_printf (t, "curl_loader_phase_seconds_count{appl=\"%s\",phase=\"%s\"} %llu\n",
+                             appls[i], metrics_phase_names[j], protos[i]->phase_points);
+        metrics_text_printf (t, "curl_loader_phase_seconds_sum{appl=\"%s\",phase=\"%s\"} %.6f\n",
+                             appls[i], metrics_phase_names[j],
+                             protos[i]->phase_sum[j] / 1000000.0);
+      }
+
+  metrics_family (t, "curl_loader_phase_max_seconds", "gauge", "seconds",
+                  "Maximal times of the phases of successful fetches.");
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < PHASE_NUM; j++)
+      metrics_text_printf (t, "curl_loader_phase_max_seconds{appl=\"%s\",phase=\"%s\"} %.6f\n",
+                           appls[i], metrics_phase_names[j],
+                           protos[i]->phase_max[j] / 1000000.0);
+
+  metrics_family (t, "curl_loader_url_fetches", "counter", NULL,
+                  "Number of url fetches by the result.");
+  for (i = 0; i < metrics.url_num; i++)
+    {
+      const sts_url* u = STS_RECORD_URL (rec, i);
+      const char* results[3] = {"ok", "failed", "timeouted"};
+      const unsigned long long values[3] = {u->ok, u->failed, u->timeouted};
+
+      for (j = 0; j < 3; j++)
+        {
+          metrics_text_printf (t, "curl_loader_url_fetches_total{url=\"%d\",name=\"", i);
+          metrics_text_label (t, metrics.url_names[i]);
+          metrics_text_printf (t, "\",result=\"%s\"} %llu\n", results[j], values[j]);
+        }
+    }
+
+  metrics_family (t, "curl_loader_url_responses", "counter", NULL,
+                  "Number of url responses by status class.");
+  for (i = 0; i < metrics.url_num; i++)
+    {
+      const sts_url* u = STS_RECORD_URL (rec, i);
+
+      for (j = 0; j < OP_STAT_RESP_CLASSES; j++)
+        {
+          metrics_text_printf (t, "curl_loader_url_responses_total{url=\"%d\",name=\"", i);
+          metrics_text_label (t, metrics.url_names[i]);
+          metrics_text_printf (t, "\",class=\"%s\"} %llu\n",
+                               metrics_class_names[j], u->resp_class[j]);
+        }
+    }
+
+  metrics_family (t, "curl_loader_url_fetch_seconds", "histogram", "seconds",
+                  "Total times of successful url fetches.");
+  for (i = 0; i < metrics.url_num; i++)
+    {
+      metrics_text t_labels;
+
+      /* The url name is escaped to the labels prefix of the buckets */
+      memset (&t_labels, 0, sizeof (t_labels));
+      metrics_text_printf (&t_labels, "url=\"%d\",name=\"", i);
+      metrics_text_label (&t_labels, metrics.url_names[i]);
+      metrics_text_printf (&t_labels, "\",");
+
+      if (t_labels.failed)
+        t->failed = 1;
+      else
+        metrics_buckets (t, "curl_loader_url_fetch_seconds", t_labels.data,
+                         &STS_RECORD_URL (rec, i)->delay);
+
+      free (t_labels.data);
+    }
+
+  metrics_text_printf (t, "# EOF\n");
+}
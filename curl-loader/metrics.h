@@ -0,0 +1,80 @@
+/*
+*     metrics.h
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "stats_stream.h"
+
+/*
+  Metrics exporter - an HTTP endpoint at <metrics_address>, serving
+  GET /metrics in OpenMetrics text format to Prometheus-like scrapers.
+
+  The exporter runs in its own thread and never touches the loading
+  threads or their counters. The leader composes a stream record each
+  METRICS_SNAPSHOT_INTERVAL and publishes it to a triple buffer; the
+  exporter takes the latest published record at each scrape. Neither
+  side waits for the other.
+*/
+
+/* Time between the snapshots published to the exporter, msec */
+#define METRICS_SNAPSHOT_INTERVAL 250
+
+/* Timeout of polling the listening socket, msec */
+#define METRICS_POLL_TIMEOUT 200
+
+/* Time to receive a request or to send a response, msec */
+#define METRICS_IO_TIMEOUT 2000
+
+#define METRICS_REQUEST_SIZE 4096
+
+/* Forward declaration */
+struct batch_context;
+
+/****************************************************************************************
+* Function name - metrics_server_start
+*
+* Description - Binds and listens on metrics_address and starts the exporter thread
+*
+* Input -       *bctx - pointer to the batch context of the leader
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int metrics_server_start (struct batch_context* bctx);
+
+/****************************************************************************************
+* Function name - metrics_server_stop
+*
+* Description - Stops the exporter thread, closes the socket and releases the snapshots
+*
+* Input -       None
+* Return Code/Output - None
+****************************************************************************************/
+void metrics_server_stop (void);
+
+/****************************************************************************************
+* Function name - metrics_publish
+*
+* Description - Publishes a record as the latest snapshot to the exporter. Called by
+*               the leader only; never blocks.
+*
+* Input -       *rec - pointer to the record
+* Return Code/Output - None
+****************************************************************************************/
+void metrics_publish (const sts_record* rec);
+
+#endif /* METRICS_H */
@@ -45,6 +45,7 @@
 #include "client.h"
 #include "cl_alloc.h"
 #include "url.h"
+#include "resp_capture.h"
 
 extern char * strcasestr(const char *, const char *);
 
@@ -115,6 +116,10 @@ static int user_agent_parser (batch_context*const bctx, char*const value);
 static int urls_num_parser (batch_context*const bctx, char*const value);
 static int dump_opstats_parser (batch_context*const bctx, char*const value);
 static int req_rate_parser (batch_context*const bctx, char*const value);
+static int req_rate_open_loop_parser (batch_context*const bctx, char*const value);
+static int arrival_process_parser (batch_context*const bctx, char*const value);
+static int thread_affinity_parser (batch_context*const bctx, char*const value);
+static int log_resp_segment_size_parser (batch_context*const bctx, char*const value);
 
 /*
  * URL section tag parsers. 
@@ -142,6 +147,9 @@ static int proxy_auth_method_parser (batch_context*const bctx, char*const value)
 static int proxy_auth_credentials_parser (batch_context*const bctx, char*const value);
 
 static int fresh_connect_parser (batch_context*const bctx, char*const value);
+static int share_tls_sessions_parser (batch_context*const bctx, char*const value);
+static int share_dns_parser (batch_context*const bctx, char*const value);
+static int share_connections_parser (batch_context*const bctx, char*const value);
 
 static int timer_tcp_conn_setup_parser (batch_context*const bctx, char*const value);
 static int timer_url_completion_parser (batch_context*const bctx, char*const value);
@@ -192,6 +200,10 @@ static const tag_parser_pair tp_map [] =
     {"URLS_NUM", urls_num_parser},
     {"DUMP_OPSTATS", dump_opstats_parser},
     {"REQ_RATE", req_rate_parser},
+    {"REQ_RATE_OPEN_LOOP", req_rate_open_loop_parser},
+    {"ARRIVAL_PROCESS", arrival_process_parser},
+    {"THREAD_AFFINITY", thread_affinity_parser},
+    {"LOG_RESP_SEGMENT_SIZE", log_resp_segment_size_parser},
     
 
     /*------------------------ URL SECTION -------------------------------- */
@@ -219,6 +231,9 @@ static const tag_parser_pair tp_map [] =
     {"PROXY_AUTH_CREDENTIALS", proxy_auth_credentials_parser},
 
     {"FRESH_CONNECT", fresh_connect_parser},
+    {"SHARE_TLS_SESSIONS", share_tls_sessions_parser},
+    {"SHARE_DNS", share_dns_parser},
+    {"SHARE_CONNECTIONS", share_connections_parser},
 
     {"TIMER_TCP_CONN_SETUP", timer_tcp_conn_setup_parser},
     {"TIMER_URL_COMPLETION", timer_url_completion_parser},
@@ -993,6 +1008,24 @@ static int dump_opstats_parser (batch_context*const bctx, char*const value)
     return 0;
 }
 
+static int log_resp_segment_size_parser (batch_context*const bctx, 
+                                         char*const value)
+{
+    bctx->log_resp_segment_size = atol (value);
+
+    if (bctx->log_resp_segment_size && 
+        (bctx->log_resp_segment_size < RESP_CAPTURE_SEGMENT_SIZE_MIN ||
+         bctx->log_resp_segment_size > RESP_CAPTURE_SEGMENT_SIZE_MAX))
+    {
+        fprintf (stderr, 
+                 "%s - error: LOG_RESP_SEGMENT_SIZE (%s) should be 0 or from %d "
+                 "to %d MB.\n", __func__, value, RESP_CAPTURE_SEGMENT_SIZE_MIN,
+                 RESP_CAPTURE_SEGMENT_SIZE_MAX);
+        return -1;
+    }
+    return 0;
+}
+
 static int req_rate_parser (batch_context*const bctx, char*const value)
 {
     bctx->req_rate = atol (value);
@@ -1003,6 +1036,134 @@ static int req_rate_parser (batch_context*const bctx, char*const value)
     return 0;
 }
 
+static int req_rate_open_loop_parser (batch_context*const bctx, char*const value)
+{
+    if (value[0] == 'Y' || value[0] == 'y' ||
+      value[0] == 'N' || value[0] == 'n')
+    	bctx->req_rate_open_loop = (value[0] == 'Y' || value[0] == 'y');
+    else
+    {
+        fprintf (stderr, 
+           "%s - error: REQ_RATE_OPEN_LOOP value (%s) must start with Y|y|N|n.\n",
+                 __func__, value);
+        return -1;
+    }    
+    return 0;
+}
+
+/*
+  ARRIVAL_PROCESS is "uniform", "poisson", 
+  "mmpp:<burst ratio>,<mean burst msec>,<mean idle msec>" or
+  "trace:<file of inter-arrival times in usec>".
+*/
+static int arrival_process_parser (batch_context*const bctx, char*const value)
+{
+    if (!strcmp (value, "uniform"))
+    {
+        bctx->arrival_process = ARRIVAL_UNIFORM;
+    }
+    else if (!strcmp (value, "poisson"))
+    {
+        bctx->arrival_process = ARRIVAL_POISSON;
+    }
+    else if (!strncmp (value, "mmpp:", 5))
+    {
+        if (sscanf (value + 5, "%lf,%lu,%lu", &bctx->arrival_burst_ratio,
+                    &bctx->arrival_burst_msec, &bctx->arrival_idle_msec) != 3 ||
+            bctx->arrival_burst_ratio < 1.0 || 
+            !bctx->arrival_burst_msec || !bctx->arrival_idle_msec)
+        {
+            fprintf (stderr, 
+                     "%s - error: ARRIVAL_PROCESS value (%s) should be "
+                     "mmpp:<burst ratio not less than 1>,<burst msec>,<idle msec>.\n",
+                     __func__, value);
+            return -1;
+        }
+        bctx->arrival_process = ARRIVAL_MMPP;
+    }
+    else if (!strncmp (value, "trace:", 6) && value[6])
+    {
+        if (strlen (value + 6) >= sizeof (bctx->arrival_trace_file))
+        {
+            fprintf (stderr, "%s - error: ARRIVAL_PROCESS trace file name is too long.\n",
+                     __func__);
+            return -1;
+        }
+        strcpy (bctx->arrival_trace_file, value + 6);
+        bctx->arrival_process = ARRIVAL_TRACE;
+    }
+    else
+    {
+        fprintf (stderr, 
+                 "%s - error: ARRIVAL_PROCESS value (%s) should be uniform, poisson, "
+                 "mmpp:<ratio>,<burst msec>,<idle msec> or trace:<file>.\n",
+                 __func__, value);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+  THREAD_AFFINITY is either "auto" for all CPUs, the process may run on, 
+  or a list of CPUs and CPU ranges like "0-3,8,10-11".
+*/
+static int thread_affinity_parser (batch_context*const bctx, char*const value)
+{
+    char *token = 0, *strtokp = 0;
+    int first, last, cpus_max = 0;
+
+    if (!strcmp (value, "auto"))
+    {
+        return batch_cpu_affinity_online (bctx) == -1 ? -1 : 0;
+    }
+
+    free (bctx->cpu_affinity);
+    bctx->cpu_affinity = 0;
+    bctx->cpu_affinity_num = 0;
+
+    for (token = strtok_r (value, ",", &strtokp); 
+         token != 0;
+         token = strtok_r (0, ",", &strtokp))
+    {
+        switch (sscanf (token, "%d-%d", &first, &last))
+        {
+        case 1:
+            last = first;
+            break;
+        case 2:
+            break;
+        default:
+            first = last = -1;
+            break;
+        }
+
+        if (first < 0 || last < first)
+        {
+            fprintf (stderr, 
+                     "%s - error: THREAD_AFFINITY value (%s) is not \"auto\" "
+                     "or a list of CPUs like \"0-3,8\".\n", __func__, token);
+            return -1;
+        }
+
+        for (; first <= last; first++)
+        {
+            if (bctx->cpu_affinity_num == cpus_max)
+            {
+                cpus_max = cpus_max ? 2 * cpus_max : 16;
+
+                if (! (bctx->cpu_affinity = realloc (bctx->cpu_affinity, 
+                                                     cpus_max * sizeof (int))))
+                {
+                    fprintf (stderr, "%s - error: realloc () failed.\n", __func__);
+                    return -1;
+                }
+            }
+            bctx->cpu_affinity[bctx->cpu_affinity_num++] = first;
+        }
+    }
+    return 0;
+}
+
 static int url_parser (batch_context*const bctx, char*const value)
 {
     size_t url_length = 0;
@@ -1849,6 +2010,51 @@ static int fresh_connect_parser (batch_context*const bctx, char*const value)
     return 0;
 }
 
+/*
+  Sets or clears a URL_SHARE_* bit of the url <share_data> mask.
+*/
+static int share_data_parse (batch_context*const bctx, char*const value, int share_bit)
+{
+    long boo = atol (value);
+
+    if (boo < 0 || boo > 1)
+    {
+        fprintf(stderr, 
+                "%s error: boolean input 0 or 1 is expected\n", __func__);
+        return -1;
+    }
+
+    if (boo)
+        bctx->url_ctx_array[bctx->url_index].share_data |= share_bit;
+    else
+        bctx->url_ctx_array[bctx->url_index].share_data &= ~share_bit;
+    return 0;
+}
+
+static int share_tls_sessions_parser (batch_context*const bctx, char*const value)
+{
+    return share_data_parse (bctx, value, URL_SHARE_TLS_SESSIONS);
+}
+
+static int share_dns_parser (batch_context*const bctx, char*const value)
+{
+    return share_data_parse (bctx, value, URL_SHARE_DNS);
+}
+
+static int share_connections_parser (batch_context*const bctx, char*const value)
+{
+#if LIBCURL_VERSION_NUM < 0x073900
+    if (atol (value))
+    {
+        fprintf(stderr, 
+                "%s error: SHARE_CONNECTIONS requires libcurl 7.57.0 or later\n", 
+                __func__);
+        return -1;
+    }
+#endif
+    return share_data_parse (bctx, value, URL_SHARE_CONNECTIONS);
+}
+
 static int timer_tcp_conn_setup_parser (batch_context*const bctx, char*const value)
 {
     long timer = atol (value);
@@ -2271,6 +2477,30 @@ static int validate_batch_general (batch_context*const bctx)
                  __func__);
         return -1;
     }
+
+    if (bctx->req_rate_open_loop && !bctx->req_rate)
+    {
+        fprintf (stderr, "%s - error: REQ_RATE_OPEN_LOOP requires REQ_RATE.\n",
+                 __func__);
+        return -1;
+    }
+
+    if (bctx->arrival_process != ARRIVAL_UNIFORM)
+    {
+        if (!bctx->req_rate)
+        {
+            fprintf (stderr, "%s - error: ARRIVAL_PROCESS requires REQ_RATE.\n",
+                     __func__);
+            return -1;
+        }
+
+        if (batch_arrival_init (bctx) == -1)
+        {
+            fprintf (stderr, "%s - error: batch_arrival_init () failed.\n",
+                     __func__);
+            return -1;
+        }
+    }
   
     return 0;
 }
@@ -2464,6 +2694,10 @@ int create_response_logfiles_dirs (batch_context* bctx)
   char dir_log_resp[256];
   const mode_t mode= S_IRWXU|S_IRWXG|S_IRWXO;
   
+  /* Responses are captured to the segment files of the batch */
+  if (bctx->log_resp_segment_size)
+    return 0;
+
   memset (dir_log_resp, 0, sizeof (dir_log_resp));
 
   snprintf (dir_log_resp, sizeof (dir_log_resp) -1, 
@@ -2687,6 +2921,31 @@ int init_operational_statistics(batch_context* bctx)
 }
 
 
+/******************************************************************************
+* Function name - init_loading_statistics
+*
+* Description - Allocates the delay histograms of the batch loading statistics
+*               and the handoff of the statistics to the leader thread.
+* 
+* Input -      *bctx - pointer to the initialized batch context
+* Return Code/Output - On success - 0, on failure - (-1)
+*******************************************************************************/
+int init_loading_statistics (batch_context* bctx)
+{
+  if (stat_point_init (&bctx->http_delta) == -1 ||
+      stat_point_init (&bctx->http_total) == -1 ||
+      stat_point_init (&bctx->https_delta) == -1 ||
+      stat_point_init (&bctx->https_total) == -1 ||
+      stat_handoff_init (bctx) == -1)
+    {
+      fprintf (stderr, "%s - error: init of statistics failed.\n",__func__);
+      return -1;
+    }
+
+  return 0;
+}
+
+
 /******************************************************************************
 * Function name - post_validate_init
 *
@@ -2769,6 +3028,14 @@ static int post_validate_init (batch_context*const bctx)
       return -1;
     }
 
+  if (init_loading_statistics (bctx) == -1)
+    {
+      fprintf (stderr, 
+               "\"%s\" - init_loading_statistics () failed .\n", 
+               __func__);
+      return -1;
+    }
+
   /* 
      It should be the last check.
   */
@@ -3401,10 +3668,11 @@ pick_url_from_set (CURL* handle, client_context* client, url_context* url)
        return -1;
    }
 	
-   if (u->cookie)
-   {
-       curl_easy_setopt(handle, CURLOPT_COOKIE, u->cookie);
-   }
+   /* 
+      The handle is not reset between fetches of the same url, thus an entry 
+      without a cookie clears the cookie of the previous one.
+   */
+   curl_easy_setopt(handle, CURLOPT_COOKIE, u->cookie);
 	
    return 1;
 }
@@ -3754,6 +4022,8 @@ build_urle (char* line, url_template* template)
     if ((u.string = strdup(buf)) == 0)
         return 0;
 	
+    u.cookie = 0; /* u is static, a line without a cookie has none */
+
     if (cookie && (u.cookie = strdup(cookie)) == 0)
     {
         free(u.string);
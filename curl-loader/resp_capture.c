@@ -0,0 +1,618 @@
+/*
+*     resp_capture.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "batch.h"
+#include "client.h"
+#include "resp_capture.h"
+
+/* States of the next segment of a capture store */
+#define RESP_CAPTURE_NEXT_NONE 0
+#define RESP_CAPTURE_NEXT_QUEUED 1
+#define RESP_CAPTURE_NEXT_PREPARING 2
+#define RESP_CAPTURE_NEXT_READY 3
+#define RESP_CAPTURE_NEXT_FAILED 4
+
+/*
+  resp_capture - the capture store of a batch, used only by the batch thread,
+  besides the next segment, prepared by the segment preparer thread.
+*/
+typedef struct resp_capture
+{
+  /* The current segment and its mapping */
+  int fd;
+  char* map;
+  unsigned int segment;
+  size_t segment_size;
+  size_t used;
+
+  /* Set by the batch thread, when the next segment has been requested */
+  int next_requested;
+
+  /* 
+     The next segment and its state, guarded by the preparer mutex. The batch
+     thread takes the segment, when it is ready.
+  */
+  int next_state;
+  unsigned int next_segment;
+  int next_fd;
+  char* next_map;
+
+  /* The next capture store in the queue of the preparer */
+  struct resp_capture* prepare_next;
+
+  FILE* index;
+
+  /* The latest entry, extended, while the pieces are contiguous */
+  rcap_entry last;
+  int last_valid;
+
+  /* Set on an error; the capture stops */
+  int failed;
+
+  char batch_name[BATCH_NAME_SIZE];
+
+} resp_capture;
+
+/* The capture stores waiting for their next segment, in the order of requests */
+static resp_capture* prepare_head = 0;
+static resp_capture* prepare_tail = 0;
+
+static pthread_mutex_t prepare_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prepare_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t prepared_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t resp_capture_preparer_tid;
+static int resp_capture_preparer_running = 0;
+static int resp_capture_preparer_stopping = 0;
+
+static void* resp_capture_preparer_function (void* arg);
+static void resp_capture_prepare (resp_capture* rc);
+static int resp_capture_next_take (resp_capture* rc);
+static int resp_capture_segment_create (resp_capture* rc,
+                                       unsigned int segment,
+                                       int* fd,
+                                       char** map);
+static int resp_capture_segment_next (resp_capture* rc);
+static void resp_capture_segment_close (resp_capture* rc);
+static void resp_capture_write (client_context* cctx,
+                                unsigned char kind,
+                                const char* data,
+                                size_t len);
+
+
+/****************************************************************************************
+* Function name - resp_capture_open
+*
+* Description - When responses of some url are to be logged, opens the index file
+*               and the first segment of the batch
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int resp_capture_open (batch_context* bctx)
+{
+  resp_capture* rc = 0;
+  char file_name[BATCH_NAME_SIZE + BATCH_NAME_EXTRA_SIZE];
+  rcap_header h;
+  int i;
+
+  for (i = 0; i < bctx->urls_num; i++)
+    {
+      if (bctx->url_ctx_array[i].log_resp_bodies ||
+          bctx->url_ctx_array[i].log_resp_headers)
+        break;
+    }
+
+  if (i == bctx->urls_num)
+    return 0;
+
+  if (! (rc = calloc (1, sizeof (resp_capture))))
+    {
+      fprintf (stderr, "%s - error: calloc () failed with errno %d.\n",
+               __func__, errno);
+      return -1;
+    }
+
+  rc->fd = rc->next_fd = -1;
+  rc->segment_size = (size_t) bctx->log_resp_segment_size << 20;
+  (void) snprintf (rc->batch_name, sizeof (rc->batch_name), "%s", bctx->batch_name);
+
+  (void)sprintf (file_name, "./%s.cidx", bctx->batch_name);
+
+  if (! (rc->index = fopen (file_name, "w")))
+    {
+      fprintf (stderr, "%s - error: fopen () of %s failed with errno %d.\n",
+               __func__, file_name, errno);
+      free (rc);
+      return -1;
+    }
+
+  memset (&h, 0, sizeof (h));
+  memcpy (h.magic, RESP_CAPTURE_MAGIC, RESP_CAPTURE_MAGIC_SIZE);
+  h.version = RESP_CAPTURE_VERSION;
+  h.entry_size = sizeof (rcap_entry);
+  h.segment_size = rc->segment_size;
+  (void) snprintf (h.batch_name, sizeof (h.batch_name), "%s", bctx->batch_name);
+
+  if (fwrite (&h, sizeof (h), 1, rc->index) != 1)
+    {
+      fprintf (stderr, "%s - error: fwrite () to %s failed with errno %d.\n",
+               __func__, file_name, errno);
+      fclose (rc->index);
+      free (rc);
+      return -1;
+    }
+
+  bctx->capture = rc;
+
+  /* The first segment is ready before the load */
+  if (resp_capture_segment_next (rc) == -1)
+    {
+      resp_capture_close (bctx);
+      return -1;
+    }
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - resp_capture_close
+*
+* Description - Completes the index, truncates the last segment to its used size and
+*               unmaps it. The prepared next segment, not used, is removed.
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - None
+****************************************************************************************/
+void resp_capture_close (batch_context* bctx)
+{
+  resp_capture* rc = bctx->capture;
+  char file_name[BATCH_NAME_SIZE + BATCH_NAME_EXTRA_SIZE];
+
+  if (! rc)
+    return;
+
+  if (rc->last_valid)
+    (void) fwrite (&rc->last, sizeof (rc->last), 1, rc->index);
+
+  fclose (rc->index);
+
+  resp_capture_segment_close (rc);
+
+  if (rc->next_requested && resp_capture_next_take (rc))
+    {
+      munmap (rc->next_map, rc->segment_size);
+      close (rc->next_fd);
+
+      (void)sprintf (file_name, "./%s.%04u.cap", rc->batch_name, rc->next_segment);
+      (void) unlink (file_name);
+    }
+
+  free (rc);
+  bctx->capture = 0;
+}
+
+/*
+  Unmaps the current segment and truncates the file to the used size
+*/
+static void resp_capture_segment_close (resp_capture* rc)
+{
+  if (rc->map)
+    {
+      munmap (rc->map, rc->segment_size);
+      rc->map = 0;
+    }
+
+  if (rc->fd != -1)
+    {
+      if (ftruncate (rc->fd, (off_t) rc->used) == -1)
+        fprintf (stderr, "%s - error: ftruncate () failed with errno %d.\n",
+                 __func__, errno);
+      close (rc->fd);
+      rc->fd = -1;
+    }
+}
+
+/****************************************************************************************
+* Function name - resp_capture_preparer_function
+*
+* Description - The segment preparer thread. Creates, allocates and maps the next
+*               segments of the capture stores in the order of requests.
+*
+* Input -       *arg - not used
+* Return Code/Output - NULL
+****************************************************************************************/
+static void* resp_capture_preparer_function (void* arg)
+{
+  resp_capture* rc;
+  unsigned int segment;
+  char* map = 0;
+  int fd = -1, rval;
+
+  (void) arg;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&prepare_mutex);
+
+      while (! prepare_head && ! resp_capture_preparer_stopping)
+        pthread_cond_wait (&prepare_cond, &prepare_mutex);
+
+      if (! (rc = prepare_head))
+        {
+          /* Stopping; the capture stores have been closed */
+          pthread_mutex_unlock (&prepare_mutex);
+          break;
+        }
+
+      if (! (prepare_head = rc->prepare_next))
+        prepare_tail = 0;
+
+      rc->prepare_next = 0;
+      rc->next_state = RESP_CAPTURE_NEXT_PREPARING;
+      segment = rc->next_segment;
+
+      pthread_mutex_unlock (&prepare_mutex);
+
+      rval = resp_capture_segment_create (rc, segment, &fd, &map);
+
+      pthread_mutex_lock (&prepare_mutex);
+
+      rc->next_fd = fd;
+      rc->next_map = map;
+      rc->next_state = rval == -1 ? RESP_CAPTURE_NEXT_FAILED : RESP_CAPTURE_NEXT_READY;
+
+      pthread_cond_broadcast (&prepared_cond);
+      pthread_mutex_unlock (&prepare_mutex);
+    }
+
+  return NULL;
+}
+
+/****************************************************************************************
+* Function name - resp_capture_preparer_start
+*
+* Description - Starts the segment preparer thread
+*
+* Input -       None
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int resp_capture_preparer_start (void)
+{
+  int error;
+
+  if ((error = pthread_create (&resp_capture_preparer_tid, NULL,
+                               resp_capture_preparer_function, NULL)))
+    {
+      fprintf (stderr, "%s - error: pthread_create () failed with %d.\n",
+               __func__, error);
+      return -1;
+    }
+
+  resp_capture_preparer_running = 1;
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - resp_capture_preparer_stop
+*
+* Description - Stops the segment preparer thread, when the capture stores are closed
+*
+* Input -       None
+* Return Code/Output - None
+****************************************************************************************/
+void resp_capture_preparer_stop (void)
+{
+  if (! resp_capture_preparer_running)
+    return;
+
+  pthread_mutex_lock (&prepare_mutex);
+  resp_capture_preparer_stopping = 1;
+  pthread_cond_signal (&prepare_cond);
+  pthread_mutex_unlock (&prepare_mutex);
+
+  pthread_join (resp_capture_preparer_tid, NULL);
+
+  resp_capture_preparer_running = 0;
+}
+
+/*
+  Requests the segment preparer to prepare the segment next to the current one.
+  Called, when the current segment is filled above the half.
+*/
+static void resp_capture_prepare (resp_capture* rc)
+{
+  rc->next_requested = 1;
+
+  pthread_mutex_lock (&prepare_mutex);
+
+  rc->next_segment = rc->segment + 1;
+  rc->next_state = RESP_CAPTURE_NEXT_QUEUED;
+
+  if (prepare_tail)
+    prepare_tail->prepare_next = rc;
+  else
+    prepare_head = rc;
+  prepare_tail = rc;
+
+  pthread_cond_signal (&prepare_cond);
+  pthread_mutex_unlock (&prepare_mutex);
+}
+
+/****************************************************************************************
+* Function name - resp_capture_next_take
+*
+* Description - Takes the requested next segment from the preparer. A request, not
+*               taken by the preparer yet, is cancelled; a segment in preparation is
+*               waited for.
+*
+* Input -       *rc - pointer to the capture store
+* Return Code/Output - 1, when the next segment is ready in next_fd and next_map,
+*                      0 - otherwise
+****************************************************************************************/
+static int resp_capture_next_take (resp_capture* rc)
+{
+  resp_capture* prev = 0;
+  resp_capture* it;
+  int ready;
+
+  pthread_mutex_lock (&prepare_mutex);
+
+  if (rc->next_state == RESP_CAPTURE_NEXT_QUEUED)
+    {
+      for (it = prepare_head; it != rc; it = it->prepare_next)
+        prev = it;
+
+      if (prev)
+        prev->prepare_next = rc->prepare_next;
+      else
+        prepare_head = rc->prepare_next;
+
+      if (prepare_tail == rc)
+        prepare_tail = prev;
+
+      rc->prepare_next = 0;
+      rc->next_state = RESP_CAPTURE_NEXT_NONE;
+    }
+
+  while (rc->next_state == RESP_CAPTURE_NEXT_PREPARING)
+    pthread_cond_wait (&prepared_cond, &prepare_mutex);
+
+  ready = rc->next_state == RESP_CAPTURE_NEXT_READY;
+  rc->next_state = RESP_CAPTURE_NEXT_NONE;
+
+  pthread_mutex_unlock (&prepare_mutex);
+
+  rc->next_requested = 0;
+  return ready;
+}
+
+/****************************************************************************************
+* Function name - resp_capture_segment_create
+*
+* Description - Creates, allocates and maps a segment file
+*
+* Input -       *rc     - pointer to the capture store
+*               segment - number of the segment
+*               *fd     - pointer to the file descriptor to be set
+*               **map   - pointer to the mapping to be set
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+static int resp_capture_segment_create (resp_capture* rc,
+                                       unsigned int segment,
+                                       int* fd,
+                                       char** map)
+{
+  char file_name[BATCH_NAME_SIZE + BATCH_NAME_EXTRA_SIZE];
+  int error;
+
+  (void)sprintf (file_name, "./%s.%04u.cap", rc->batch_name, segment);
+
+  if ((*fd = open (file_name, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+    {
+      fprintf (stderr, "%s - error: open () of %s failed with errno %d.\n",
+               __func__, file_name, errno);
+      return -1;
+    }
+
+  /*
+     Blocks are allocated in advance, thus the loading thread doesn't wait
+     for the filesystem allocating them at page faults.
+  */
+  if ((error = posix_fallocate (*fd, 0, (off_t) rc->segment_size)))
+    {
+      fprintf (stderr, "%s - error: posix_fallocate () of %s failed with %d.\n",
+               __func__, file_name, error);
+      close (*fd);
+      *fd = -1;
+      return -1;
+    }
+
+  if ((*map = mmap (NULL, rc->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    *fd, 0)) == MAP_FAILED)
+    {
+      *map = 0;
+      fprintf (stderr, "%s - error: mmap () of %s failed with errno %d.\n",
+               __func__, file_name, errno);
+      close (*fd);
+      *fd = -1;
+      return -1;
+    }
+
+  (void) madvise (*map, rc->segment_size, MADV_SEQUENTIAL);
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - resp_capture_segment_next
+*
+* Description - Closes the current segment and switches to the next one, prepared
+*               by the segment preparer, or creates it, when not prepared
+*
+* Input -       *rc - pointer to the capture store
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+static int resp_capture_segment_next (resp_capture* rc)
+{
+  const int ready = rc->next_requested && resp_capture_next_take (rc);
+
+  if (rc->map)
+    {
+      resp_capture_segment_close (rc);
+      rc->segment++;
+    }
+
+  rc->used = 0;
+
+  if (ready)
+    {
+      rc->fd = rc->next_fd;
+      rc->map = rc->next_map;
+      rc->next_fd = -1;
+      rc->next_map = 0;
+      return 0;
+    }
+
+  return resp_capture_segment_create (rc, rc->segment, &rc->fd, &rc->map);
+}
+
+/****************************************************************************************
+* Function name - resp_capture_write
+*
+* Description - Appends a piece of a response to the segments and describes it in
+*               the index. A piece, contiguous with the latest one of the same
+*               response, extends its entry.
+*
+* Input -       *cctx - pointer to the client context
+*               kind  - RESP_CAPTURE_HEADERS or RESP_CAPTURE_BODY
+*               *data - pointer to the data
+*               len   - length of the data
+* Return Code/Output - None
+****************************************************************************************/
+static void resp_capture_write (client_context* cctx,
+                                unsigned char kind,
+                                const char* data,
+                                size_t len)
+{
+  resp_capture* rc = cctx->bctx->capture;
+  rcap_entry* last = 0;
+  size_t n;
+
+  if (! rc || rc->failed)
+    return;
+
+  last = &rc->last;
+
+  while (len)
+    {
+      if (rc->used == rc->segment_size && resp_capture_segment_next (rc) == -1)
+        {
+          fprintf (stderr, "%s - error: responses capture of \"%s\" stopped.\n",
+                   __func__, rc->batch_name);
+          rc->failed = 1;
+          return;
+        }
+
+      n = rc->segment_size - rc->used < len ? rc->segment_size - rc->used : len;
+
+      memcpy (rc->map + rc->used, data, n);
+
+      if (rc->last_valid &&
+          last->client == (unsigned int) cctx->batch_client_index &&
+          last->cycle == (unsigned int) cctx->cycle_num &&
+          last->url == (unsigned short) cctx->url_curr_index &&
+          last->kind == kind &&
+          last->segment == rc->segment &&
+          last->offset + last->length == rc->used)
+        {
+          last->length += n;
+        }
+      else
+        {
+          if (rc->last_valid)
+            (void) fwrite (last, sizeof (*last), 1, rc->index);
+
+          last->client = (unsigned int) cctx->batch_client_index;
+          last->cycle = (unsigned int) cctx->cycle_num;
+          last->url = (unsigned short) cctx->url_curr_index;
+          last->kind = kind;
+          last->reserved = 0;
+          last->segment = rc->segment;
+          last->offset = rc->used;
+          last->length = n;
+          rc->last_valid = 1;
+        }
+
+      rc->used += n;
+      data += n;
+      len -= n;
+    }
+
+  /* The next segment is prepared, while the current one is filled */
+  if (! rc->next_requested && resp_capture_preparer_running &&
+      rc->used >= rc->segment_size / 2)
+    resp_capture_prepare (rc);
+}
+
+/****************************************************************************************
+* Function name - resp_capture_body_write
+*
+* Description - libcurl write callback, capturing a piece of response body
+*
+* Input -       *ptr  - pointer to the data
+*               size  - size of an item
+*               nmemb - number of items
+*               *userp - pointer to the client context
+* Return Code/Output - Number of bytes taken
+****************************************************************************************/
+size_t resp_capture_body_write (void* ptr, size_t size, size_t nmemb, void* userp)
+{
+  resp_capture_write ((client_context *) userp, RESP_CAPTURE_BODY,
+                      (const char *) ptr, size * nmemb);
+  return size * nmemb;
+}
+
+/****************************************************************************************
+* Function name - resp_capture_header_write
+*
+* Description - libcurl header callback, capturing a response header line
+*
+* Input -       *ptr  - pointer to the data
+*               size  - size of an item
+*               nmemb - number of items
+*               *userp - pointer to the client context
+* Return Code/Output - Number of bytes taken
+****************************************************************************************/
+size_t resp_capture_header_write (void* ptr, size_t size, size_t nmemb, void* userp)
+{
+  resp_capture_write ((client_context *) userp, RESP_CAPTURE_HEADERS,
+                      (const char *) ptr, size * nmemb);
+  return size * nmemb;
+}
@@ -0,0 +1,173 @@
+/*
+*     resp_capture.h
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef RESP_CAPTURE_H
+#define RESP_CAPTURE_H
+
+#include <stddef.h>
+
+/*
+  Segmented capture of response headers and bodies, enabled by the
+  LOG_RESP_SEGMENT_SIZE tag instead of a file per client per cycle.
+
+  A batch thread appends the headers and bodies of the urls with
+  LOG_RESP_HEADERS/LOG_RESP_BODIES to memory-mapped segment files
+  <batch-name>.<segment-num>.cap of LOG_RESP_SEGMENT_SIZE MB, allocated
+  in advance. When the current segment is half full, the segment preparer
+  thread creates, allocates and maps the next one. Without the preparer
+  thread, the batch thread does it, when the current one is full, and
+  stalls for the allocation.
+
+  Each contiguous piece of a response is described by an entry of the
+  index file <batch-name>.cidx; pieces of concurrent responses interleave,
+  and a response is the concatenation of its entries in the index order.
+  The last segment is truncated to its used size.
+
+  Responses are extracted by tools/cap_extract.
+*/
+
+#define RESP_CAPTURE_MAGIC "CLCAP\0\0\0"
+#define RESP_CAPTURE_MAGIC_SIZE 8
+#define RESP_CAPTURE_VERSION 1
+
+/* Limits of LOG_RESP_SEGMENT_SIZE, MB */
+#define RESP_CAPTURE_SEGMENT_SIZE_MIN 1
+#define RESP_CAPTURE_SEGMENT_SIZE_MAX 4096
+
+#define RESP_CAPTURE_NAME_SIZE 64
+
+/* Kinds of the captured data */
+#define RESP_CAPTURE_HEADERS 1
+#define RESP_CAPTURE_BODY 2
+
+typedef struct rcap_header
+{
+  char magic[RESP_CAPTURE_MAGIC_SIZE];
+
+  unsigned int version;
+
+  /* Size of an index entry */
+  unsigned int entry_size;
+
+  /* Size of a segment file, bytes */
+  unsigned long long segment_size;
+
+  /* Segment files are named <batch_name>.<segment-num>.cap */
+  char batch_name[RESP_CAPTURE_NAME_SIZE];
+
+  /* Followed by the entries till the end of the file */
+
+} rcap_header;
+
+typedef struct rcap_entry
+{
+  /* 
+     Index of the client among all the clients of the batch, kept by a client
+     migrated to another thread sub-batch
+  */
+  unsigned int client;
+
+  unsigned int cycle;
+
+  unsigned short url;
+
+  /* RESP_CAPTURE_HEADERS or RESP_CAPTURE_BODY */
+  unsigned char kind;
+
+  unsigned char reserved;
+
+  unsigned int segment;
+
+  /* Offset in the segment and length of the piece */
+  unsigned long long offset;
+  unsigned long long length;
+
+} rcap_entry;
+
+/* Forward declaration */
+struct batch_context;
+
+/****************************************************************************************
+* Function name - resp_capture_open
+*
+* Description - When responses of some url are to be logged, opens the index file
+*               and the first segment of the batch
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int resp_capture_open (struct batch_context* bctx);
+
+/****************************************************************************************
+* Function name - resp_capture_close
+*
+* Description - Completes the index, truncates the last segment to its used size and
+*               unmaps it
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - None
+****************************************************************************************/
+void resp_capture_close (struct batch_context* bctx);
+
+/****************************************************************************************
+* Function name - resp_capture_preparer_start
+*
+* Description - Starts the segment preparer thread
+*
+* Input -       None
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int resp_capture_preparer_start (void);
+
+/****************************************************************************************
+* Function name - resp_capture_preparer_stop
+*
+* Description - Stops the segment preparer thread, when the capture stores are closed
+*
+* Input -       None
+* Return Code/Output - None
+****************************************************************************************/
+void resp_capture_preparer_stop (void);
+
+/****************************************************************************************
+* Function name - resp_capture_body_write
+*
+* Description - libcurl write callback, capturing a piece of response body
+*
+* Input -       *ptr  - pointer to the data
+*               size  - size of an item
+*               nmemb - number of items
+*               *userp - pointer to the client context
+* Return Code/Output - Number of bytes taken
+****************************************************************************************/
+size_t resp_capture_body_write (void* ptr, size_t size, size_t nmemb, void* userp);
+
+/****************************************************************************************
+* Function name - resp_capture_header_write
+*
+* Description - libcurl header callback, capturing a response header line
+*
+* Input -       *ptr  - pointer to the data
+*               size  - size of an item
+*               nmemb - number of items
+*               *userp - pointer to the client context
+* Return Code/Output - Number of bytes taken
+****************************************************************************************/
+size_t resp_capture_header_write (void* ptr, size_t size, size_t nmemb, void* userp);
+
+#endif /* RESP_CAPTURE_H */
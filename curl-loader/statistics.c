@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "batch.h"
 #include "client.h"
@@ -35,6 +36,7 @@
 #include "conf.h"
 
 #include "statistics.h"
+#include "stats_stream.h"
 #include "screen.h"
 
 #define UNSECURE_APPL_STR "H/F   "
@@ -69,6 +71,82 @@ static void dump_stat_to_screen (char* protocol,
                                  unsigned long period);
 
 static void dump_clients (client_context* cctx_array);
+static void dump_req_rate_backlog (batch_context* bctx);
+
+/* Percentiles of the delays, printed followed by the maximal delay */
+static const double delay_percentiles[] = {50.0, 90.0, 99.0, 99.9};
+
+/****************************************************************************************
+* Function name - stat_delay_avg
+*
+* Description - Returns average delay in usec
+* Input -       sum    - sum of the delays in usec
+*               points - number of the delays
+* Return Code/Output - Average delay or 0 without delays
+****************************************************************************************/
+static unsigned long stat_delay_avg (unsigned long long sum, unsigned long points)
+{
+  return points ? (unsigned long) (sum / points) : 0;
+}
+
+/****************************************************************************************
+* Function name - print_delay_percentiles
+*
+* Description - Prints in msec the percentiles of a delay histogram and the maximal 
+*               delay, or zeros without a histogram
+* Input -       *file  - open file pointer
+*               *h     - pointer to the histogram or NULL
+*               *lead  - string printed before the first value
+*               *sep   - separator of the values
+* Return Code/Output - None
+****************************************************************************************/
+static void print_delay_percentiles (FILE* file, 
+                                     const hdr_hist* h, 
+                                     const char* lead,
+                                     const char* sep)
+{
+  const int num = sizeof (delay_percentiles) / sizeof (delay_percentiles[0]);
+  unsigned long long value;
+  int i;
+
+  for (i = 0; i <= num; i++)
+    {
+      value = ! h ? 0 : 
+        (i < num ? hdr_hist_percentile (h, delay_percentiles[i]) : h->max);
+      fprintf (file, "%s%llu.%03llu", i ? sep : lead, value / 1000, value % 1000);
+    }
+}
+
+/****************************************************************************************
+* Function name - print_phase_percentiles
+*
+* Description - Prints in msec the percentiles of a phase time histogram, or zeros 
+*               without a histogram. The maximal time is printed with the averages.
+* Input -       *file  - open file pointer
+*               *h     - pointer to the histogram or NULL
+*               *lead  - string printed before the first value
+*               *sep   - separator of the values
+* Return Code/Output - None
+****************************************************************************************/
+static void print_phase_percentiles (FILE* file, 
+                                     const hdr_hist* h, 
+                                     const char* lead,
+                                     const char* sep)
+{
+  const int num = sizeof (delay_percentiles) / sizeof (delay_percentiles[0]);
+  unsigned long long value;
+  int i;
+
+  for (i = 0; i < num; i++)
+    {
+      value = h ? hdr_hist_percentile (h, delay_percentiles[i]) : 0;
+      fprintf (file, "%s%llu.%03llu", i ? sep : lead, value / 1000, value % 1000);
+    }
+}
+
+/* Names of the url fetch phases, as printed to screen and statistics file */
+static const char* phase_names[PHASE_NUM] = 
+  {"DNS", "Conn", "TLS", "TTFB", "Xfer", "Redir", "Total"};
 
 /****************************************************************************************
 * Function name - stat_point_add
@@ -97,28 +175,27 @@ void stat_point_add (stat_point* left, stat_point* right)
   left->other_errs += right->other_errs;
   left->url_timeout_errs += right->url_timeout_errs;
   
-  const int total_points = left->appl_delay_points + right->appl_delay_points;
+  left->appl_delay_points += right->appl_delay_points;
+  left->appl_delay_sum += right->appl_delay_sum;
+  left->appl_delay_2xx_points += right->appl_delay_2xx_points;
+  left->appl_delay_2xx_sum += right->appl_delay_2xx_sum;
 
-  if (total_points > 0)
-    {
-      left->appl_delay = (left->appl_delay * left->appl_delay_points  + 
-                 right->appl_delay * right->appl_delay_points) / total_points;
+  if (left->appl_delay_hist && right->appl_delay_hist)
+    hdr_hist_add (left->appl_delay_hist, right->appl_delay_hist);
+  if (left->appl_delay_2xx_hist && right->appl_delay_2xx_hist)
+    hdr_hist_add (left->appl_delay_2xx_hist, right->appl_delay_2xx_hist);
 
-      left->appl_delay_points = total_points;
-    }
-  else
-      left->appl_delay = 0;
-
-   const int total_points_2xx = left->appl_delay_2xx_points + right->appl_delay_2xx_points;
+  int i;
 
-  if (total_points_2xx > 0)
+  left->phase_points += right->phase_points;
+  for (i = 0; i < PHASE_NUM; i++)
     {
-      left->appl_delay_2xx = (left->appl_delay_2xx * left->appl_delay_2xx_points  + 
-                 right->appl_delay_2xx * right->appl_delay_2xx_points) / total_points_2xx;
-      left->appl_delay_2xx_points = total_points_2xx;
+      left->phase_sum[i] += right->phase_sum[i];
+      if (right->phase_max[i] > left->phase_max[i])
+        left->phase_max[i] = right->phase_max[i];
+      if (left->phase_hist && right->phase_hist)
+        hdr_hist_add (&left->phase_hist[i], &right->phase_hist[i]);
     }
-  else
-      left->appl_delay_2xx = 0;
 }
 
 /****************************************************************************************
@@ -139,8 +216,89 @@ void stat_point_reset (stat_point* p)
       p->resp_5xx = p->other_errs = p->url_timeout_errs =0;
 
   p->appl_delay_points = p->appl_delay_2xx_points = 0;
-  p->appl_delay = p->appl_delay_2xx = 0;
+  p->appl_delay_sum = p->appl_delay_2xx_sum = 0;
+
+  if (p->appl_delay_hist)
+    hdr_hist_reset (p->appl_delay_hist);
+  if (p->appl_delay_2xx_hist)
+    hdr_hist_reset (p->appl_delay_2xx_hist);
+
+  p->phase_points = 0;
+  memset (p->phase_sum, 0, sizeof (p->phase_sum));
+  memset (p->phase_max, 0, sizeof (p->phase_max));
+
+  if (p->phase_hist)
+    {
+      int i;
+      for (i = 0; i < PHASE_NUM; i++)
+        hdr_hist_reset (&p->phase_hist[i]);
+    }
+}
+
+/****************************************************************************************
+* Function name - stat_point_init
+*
+* Description - Allocates the delay and phase histograms of a stat_point, unless 
+*               allocated
+* 
+* Input -       *point -  pointer to the stat_point
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int stat_point_init (stat_point* point)
+{
+  if (! point->appl_delay_hist &&
+      ! (point->appl_delay_hist = calloc (1, sizeof (hdr_hist))))
+    {
+      goto allocation_failed;
+    }
+
+  if (! point->appl_delay_2xx_hist &&
+      ! (point->appl_delay_2xx_hist = calloc (1, sizeof (hdr_hist))))
+    {
+      goto allocation_failed;
+    }
+
+  if (! point->phase_hist &&
+      ! (point->phase_hist = calloc (PHASE_NUM, sizeof (hdr_hist))))
+    {
+      goto allocation_failed;
+    }
+
+  return 0;
+
+ allocation_failed:
+  fprintf(stderr, "%s - calloc () failed with errno %d.\n", 
+              __func__, errno);
+  return -1;
+}
 
+/****************************************************************************************
+* Function name - stat_point_release
+*
+* Description - Releases memory allocated by stat_point_init ()
+* 
+* Input -       *point -  pointer to the stat_point
+* Return Code/Output - None
+****************************************************************************************/
+void stat_point_release (stat_point* point)
+{
+  if (point->appl_delay_hist)
+    {
+      free (point->appl_delay_hist);
+      point->appl_delay_hist = NULL;
+    }
+
+  if (point->appl_delay_2xx_hist)
+    {
+      free (point->appl_delay_2xx_hist);
+      point->appl_delay_2xx_hist = NULL;
+    }
+
+  if (point->phase_hist)
+    {
+      free (point->phase_hist);
+      point->phase_hist = NULL;
+    }
 }
 
 /****************************************************************************************
@@ -167,6 +325,14 @@ void op_stat_point_add (op_stat_point* left, op_stat_point* right)
       left->url_ok[i] += right->url_ok[i];
       left->url_failed[i] += right->url_failed[i];
       left->url_timeouted[i] += right->url_timeouted[i];
+
+      hdr_hist_small_add (&left->url_delay[i], &right->url_delay[i]);
+      hdr_hist_small_add (&left->url_bytes_in[i], &right->url_bytes_in[i]);
+    }
+
+  for ( i = 0; i < left->url_num * OP_STAT_RESP_CLASSES; i++)
+    {
+      left->url_resp_class[i] += right->url_resp_class[i];
     }
   
   left->call_init_count += right->call_init_count;
@@ -190,7 +356,13 @@ void op_stat_point_reset (op_stat_point* point)
       for ( i = 0; i < point->url_num; i++)
         {
           point->url_ok[i] = point->url_failed[i] = point->url_timeouted[i] = 0;
+
+          hdr_hist_small_reset (&point->url_delay[i]);
+          hdr_hist_small_reset (&point->url_bytes_in[i]);
         }
+
+      memset (point->url_resp_class, 0, 
+              point->url_num * OP_STAT_RESP_CLASSES * sizeof (unsigned long));
     }
     /* Don't null point->url_num ! */
 
@@ -224,6 +396,24 @@ void op_stat_point_release (op_stat_point* point)
       point->url_timeouted = NULL;
     }
 
+  if (point->url_delay)
+    {
+      free (point->url_delay);
+      point->url_delay = NULL;
+    }
+
+  if (point->url_bytes_in)
+    {
+      free (point->url_bytes_in);
+      point->url_bytes_in = NULL;
+    }
+
+  if (point->url_resp_class)
+    {
+      free (point->url_resp_class);
+      point->url_resp_class = NULL;
+    }
+
   memset (point, 0, sizeof (op_stat_point));
 }
 
@@ -243,11 +433,18 @@ int op_stat_point_init (op_stat_point* point, size_t url_num)
   if (! point)
     return -1;
 
+  /* Sub-batch 0 of a threaded load is initialized twice */
+  op_stat_point_release (point);
+
    if (url_num)
     { 
       if (!(point->url_ok = calloc (url_num, sizeof (unsigned long))) ||
           !(point->url_failed = calloc (url_num, sizeof (unsigned long))) ||
-          !(point->url_timeouted = calloc (url_num, sizeof (unsigned long)))
+          !(point->url_timeouted = calloc (url_num, sizeof (unsigned long))) ||
+          !(point->url_delay = calloc (url_num, sizeof (hdr_hist_small))) ||
+          !(point->url_bytes_in = calloc (url_num, sizeof (hdr_hist_small))) ||
+          !(point->url_resp_class = calloc (url_num * OP_STAT_RESP_CLASSES, 
+                                            sizeof (unsigned long)))
           )
         {
           goto allocation_failed;
@@ -308,31 +505,218 @@ void op_stat_timeouted (op_stat_point* op_stat, size_t url_index)
     op_stat-> url_timeouted[url_index]++;
 }
 
+/****************************************************************************************
+* Function name -  op_stat_url_completed
+*
+* Description - Counts a completed url fetch into the url distributions
+*
+* Input -       *op_stat        - pointer to the op_stat_point
+*               url_index       - index of the url
+*               delay           - delay in usec from the request till the completion
+*               bytes_in        - received body bytes
+*               response_status - status of the final response or 0
+* Return Code/Output - None
+****************************************************************************************/
+void op_stat_url_completed (op_stat_point* op_stat, 
+                            size_t url_index,
+                            unsigned long long delay,
+                            unsigned long long bytes_in,
+                            long response_status)
+{
+  if (!op_stat || url_index >= op_stat->url_num)
+    return;
+
+  hdr_hist_small_record (&op_stat->url_delay[url_index], delay);
+  hdr_hist_small_record (&op_stat->url_bytes_in[url_index], bytes_in);
+
+  if (response_status >= 100 && response_status < 600)
+    {
+      op_stat->url_resp_class[url_index * OP_STAT_RESP_CLASSES + 
+                              response_status / 100 - 1]++;
+    }
+}
+
 void op_stat_call_init_count_inc (op_stat_point* op_stat)
 {
   op_stat->call_init_count++;
 }
 
 /****************************************************************************************
-* Function name - get_tick_count
+* Function name - stat_handoff_init
 *
-* Description - Delivers timestamp in milliseconds.
-* 
-* Return Code/Output - timestamp in milliseconds or -1 on errors
+* Description - Allocates the handoff points of a batch
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - On success - 0, on error -1
 ****************************************************************************************/
-unsigned long get_tick_count ()
+int stat_handoff_init (batch_context* bctx)
 {
-  struct timeval  tval;
+  stat_handoff* h = &bctx->handoff;
 
-  if (gettimeofday (&tval, NULL) == -1)
+  if (stat_point_init (&h->http) == -1 ||
+      stat_point_init (&h->https) == -1 ||
+      op_stat_point_init (&h->op, bctx->urls_num) == -1)
     {
-      fprintf(stderr, "%s - gettimeofday () failed with errno %d.\n", 
-              __func__, errno);
-      exit (1);
+      return -1;
     }
-  return tval.tv_sec * 1000 + (tval.tv_usec / 1000);
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - stat_handoff_release
+*
+* Description - Releases memory allocated by stat_handoff_init ()
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - None
+****************************************************************************************/
+void stat_handoff_release (batch_context* bctx)
+{
+  stat_point_release (&bctx->handoff.http);
+  stat_point_release (&bctx->handoff.https);
+  op_stat_point_release (&bctx->handoff.op);
+}
+
+/****************************************************************************************
+* Function name - stat_handoff_publish
+*
+* Description - Called by a sub-batch thread at its loop iterations. When the leader
+*               has requested a publication, moves the delta counters of the 
+*               sub-batch to its handoff points. 
+*
+* Input -       *bctx - pointer to the batch context of the thread
+* Return Code/Output - None
+****************************************************************************************/
+void stat_handoff_publish (batch_context* bctx)
+{
+  stat_handoff* h = &bctx->handoff;
+
+  /* 
+     The leader requests a publication only after collecting the previous one,
+     thus the handoff points are free. 
+  */
+  if (__atomic_load_n (&h->requested, __ATOMIC_ACQUIRE) == h->published)
+    return;
+
+  stat_point_add (&h->http, &bctx->http_delta);
+  stat_point_add (&h->https, &bctx->https_delta);
+  op_stat_point_add (&h->op, &bctx->op_delta);
+
+  stat_point_reset (&bctx->http_delta);
+  stat_point_reset (&bctx->https_delta);
+  op_stat_point_reset (&bctx->op_delta);
+
+  __atomic_store_n (&h->published, h->published + 1, __ATOMIC_RELEASE);
 }
 
+/****************************************************************************************
+* Function name - stat_handoff_finish
+*
+* Description - Called by a sub-batch thread, when loading is completed and the 
+*               delta counters of the sub-batch are not updated any more.
+*
+* Input -       *bctx - pointer to the batch context of the thread
+* Return Code/Output - None
+****************************************************************************************/
+void stat_handoff_finish (batch_context* bctx)
+{
+  __atomic_store_n (&bctx->handoff.finished, 1, __ATOMIC_RELEASE);
+}
+
+/****************************************************************************************
+* Function name - stat_handoff_take
+*
+* Description - Adds the published counters of a thread sub-batch to the delta
+*               counters of the leader, when a publication has not been collected yet.
+*
+* Input -       *bctx - pointer to the batch context of the leader
+*               *sub  - pointer to the batch context of the thread sub-batch
+* Return Code/Output - 1, when a publication has been collected, 0 - otherwise
+****************************************************************************************/
+static int stat_handoff_take (batch_context* bctx, batch_context* sub)
+{
+  stat_handoff* h = &sub->handoff;
+  const unsigned long published = __atomic_load_n (&h->published, __ATOMIC_ACQUIRE);
+
+  if (published == h->collected)
+    return 0;
+
+  stat_point_add (&bctx->http_delta, &h->http);
+  stat_point_add (&bctx->https_delta, &h->https);
+  op_stat_point_add (&bctx->op_delta, &h->op);
+
+  stat_point_reset (&h->http);
+  stat_point_reset (&h->https);
+  op_stat_point_reset (&h->op);
+
+  h->collected = published;
+  return 1;
+}
+
+/****************************************************************************************
+* Function name - stat_handoff_collect
+*
+* Description - Collects by the leader delta counters of the other thread sub-batches
+*               without stopping them. Takes the publication of each thread, which 
+*               has been published since the previous collection, and requests the
+*               next one, which the thread makes at its next loop iteration. Thus,
+*               counters of a thread come to the leader at most a collection later 
+*               and the leader never waits. The final collection waits for the 
+*               threads to complete, but not longer than STAT_HANDOFF_FINISH_WAIT_MSEC
+*               or, when loading is stopped, STAT_HANDOFF_WAIT_MSEC.
+*
+* Input -       *bctx - pointer to the batch context of the leader
+*               final - whether the collection is the final one
+* Return Code/Output - None
+****************************************************************************************/
+void stat_handoff_collect (batch_context* bctx, int final)
+{
+  int i, waited = 0;
+
+  for (i = 1; i < threads_subbatches_num; i++)
+    {
+      batch_context* sub = bctx + i;
+      stat_handoff* h = &sub->handoff;
+
+      /* A thread publishes once per request, the last one may be still pending */
+      if (stat_handoff_take (bctx, sub) || h->requested == h->collected)
+        __atomic_store_n (&h->requested, h->collected + 1, __ATOMIC_RELEASE);
+
+      /* The time is counted for all the threads together */
+      for (; final; waited++)
+        {
+          if (__atomic_load_n (&h->finished, __ATOMIC_ACQUIRE))
+            break;
+
+          if ((stop_loading && waited >= STAT_HANDOFF_WAIT_MSEC) ||
+              waited >= STAT_HANDOFF_FINISH_WAIT_MSEC)
+            {
+              fprintf (stderr, "%s - warning: thread %d has not completed loading, "
+                       "its final statistics are partial.\n", __func__, i);
+              break;
+            }
+
+          usleep (1000);
+        }
+
+      if (__atomic_load_n (&h->finished, __ATOMIC_ACQUIRE))
+        {
+          stat_handoff_take (bctx, sub);
+
+          /* The thread does not update its counters any more */
+          stat_point_add (&bctx->http_delta, &sub->http_delta);
+          stat_point_add (&bctx->https_delta, &sub->https_delta);
+          op_stat_point_add (&bctx->op_delta, &sub->op_delta);
+
+          stat_point_reset (&sub->http_delta);
+          stat_point_reset (&sub->https_delta);
+          op_stat_point_reset (&sub->op_delta);
+        }
+      else if (final)
+        stat_handoff_take (bctx, sub);
+    }
+}
 
 /****************************************************************************************
 * Function name - dump_final_statistics
@@ -347,21 +731,16 @@ unsigned long get_tick_count ()
 ****************************************************************************************/
 void dump_final_statistics (client_context* cctx)
 {
-  int i;
   batch_context* bctx = cctx->bctx;
   unsigned long now = get_tick_count();
 
-  for (i = 0; i <= threads_subbatches_num; i++)
+  if (is_batch_group_leader (bctx))
     {
-      if (i)
-        {
-          stat_point_add (&bctx->http_delta, &(bctx + i)->http_delta);
-          stat_point_add (&bctx->https_delta, &(bctx + i)->https_delta);
-          
-          /* Other threads statistics - reset just after collecting */
-          stat_point_reset (&(bctx + i)->http_delta); 
-          stat_point_reset (&(bctx + i)->https_delta);
-        }
+      /* Other threads statistics till their completion */
+      stat_handoff_collect (bctx, 1);
+
+      /* The last record of the binary statistics stream */
+      stats_stream_record (bctx, now);
     }
   
   print_snapshot_interval_statistics (now - bctx->last_measure,
@@ -386,21 +765,13 @@ void dump_final_statistics (client_context* cctx)
   fprintf(stdout,"\nTest total duration was %d seconds and CAPS average %ld:\n", 
           seconds_run, bctx->op_total.call_init_count / seconds_run);
 
+  dump_req_rate_backlog (bctx);
+
   dump_statistics (seconds_run, 
                    &bctx->http_total,
                    &bctx->https_total);
 
 
-  for (i = 0; i <= threads_subbatches_num; i++)
-    {
-      if (i)
-        {
-          op_stat_point_add (&bctx->op_delta, &(bctx + i)->op_delta );
-          
-          /* Other threads operational statistics - reset just after collecting */
-          op_stat_point_reset (&(bctx + i)->op_delta);
-        }
-    }
   op_stat_point_add (&bctx->op_total, &bctx->op_delta);
   
   print_operational_statistics (bctx->opstats_file,
@@ -590,7 +961,6 @@ void dump_snapshot_interval_and_advance_total_statistics (batch_context* bctx,
                                                           unsigned long now_time,
                                                           int clients_total_num)
 {
-  int i;
   const unsigned long delta_t = now_time - bctx->last_measure; 
   const unsigned long delta_time = delta_t ? delta_t : 1;
 
@@ -605,18 +975,8 @@ void dump_snapshot_interval_and_advance_total_statistics (batch_context* bctx,
           "==================\n",
           bctx->batch_name);
 
-  /*Collect the operational statistics*/
-
-  for (i = 0; i <= threads_subbatches_num; i++)
-    {
-      if (i)
-        {
-          op_stat_point_add (&bctx->op_delta, &(bctx + i)->op_delta );
-
-          /* Other threads operational statistics - reset just after collecting */
-          op_stat_point_reset (&(bctx + i)->op_delta);
-        }
-    }
+  /* Collect statistics of the other threads */
+  stat_handoff_collect (bctx, 0);
 
   op_stat_point_add (&bctx->op_total, &bctx->op_delta );
 
@@ -632,21 +992,10 @@ void dump_snapshot_interval_and_advance_total_statistics (batch_context* bctx,
           (unsigned long ) delta_time/1000, clients_total_num,
           bctx->op_delta.call_init_count* 1000/delta_time);
 
-  op_stat_point_reset (&bctx->op_delta);
-
+  dump_req_rate_backlog (bctx);
 
-  for (i = 0; i <= threads_subbatches_num; i++)
-    {
-      if (i)
-        {
-          stat_point_add (&bctx->http_delta, &(bctx + i)->http_delta);
-          stat_point_add (&bctx->https_delta, &(bctx + i)->https_delta);
+  op_stat_point_reset (&bctx->op_delta);
 
-          /* Other threads statistics - reset just after collecting */
-          stat_point_reset (&(bctx + i)->http_delta); 
-          stat_point_reset (&(bctx + i)->https_delta);
-        }
-    }
 
   stat_point_add (&bctx->http_total, &bctx->http_delta);
   stat_point_add (&bctx->https_total, &bctx->https_delta);
@@ -723,14 +1072,57 @@ static void dump_stat_to_screen (char* protocol,
                                  stat_point* sd, 
                                  unsigned long period)
 {
+  const unsigned long appl_delay = 
+    stat_delay_avg (sd->appl_delay_sum, sd->appl_delay_points);
+  const unsigned long appl_delay_2xx = 
+    stat_delay_avg (sd->appl_delay_2xx_sum, sd->appl_delay_2xx_points);
+
   fprintf(stdout, "%sReq:%ld,1xx:%ld,2xx:%ld,3xx:%ld,4xx:%ld,5xx:%ld,Err:%ld,T-Err:%ld,"
-          "D:%ldms,D-2xx:%ldms,Ti:%lldB/s,To:%lldB/s\n",
+          "D:%lu.%03lums,D-2xx:%lu.%03lums,Ti:%lldB/s,To:%lldB/s\n",
           protocol, sd->requests, sd->resp_1xx, sd->resp_2xx, sd->resp_3xx,
-          sd->resp_4xx, sd->resp_5xx, sd->other_errs, sd->url_timeout_errs, sd->appl_delay, 
-          sd->appl_delay_2xx, sd->data_in/period, sd->data_out/period);
+          sd->resp_4xx, sd->resp_5xx, sd->other_errs, sd->url_timeout_errs, 
+          appl_delay / 1000, appl_delay % 1000,
+          appl_delay_2xx / 1000, appl_delay_2xx % 1000,
+          sd->data_in/period, sd->data_out/period);
 
     //fprintf (stdout, "Appl-Delay-Points %d, Appl-Delay-2xx-Points %d \n", 
   //         sd->appl_delay_points, sd->appl_delay_2xx_points);
+
+  if (sd->appl_delay_points && sd->appl_delay_hist)
+    {
+      fprintf(stdout, "%sD p50/p90/p99/p99.9/max ms:", protocol);
+      print_delay_percentiles (stdout, sd->appl_delay_hist, "", "/");
+      fprintf(stdout, ",D-2xx:");
+      print_delay_percentiles (stdout, sd->appl_delay_2xx_hist, "", "/");
+      fprintf(stdout, "\n");
+    }
+
+  if (sd->phase_points)
+    {
+      int i;
+      unsigned long avg;
+
+      fprintf(stdout, "%sPhases avg/max ms:", protocol);
+      for (i = 0; i < PHASE_NUM; i++)
+        {
+          avg = (unsigned long) (sd->phase_sum[i] / sd->phase_points);
+          fprintf(stdout, "%s%s:%lu.%03lu/%lu.%03lu", i ? "," : "", phase_names[i],
+                  avg / 1000, avg % 1000, 
+                  sd->phase_max[i] / 1000, sd->phase_max[i] % 1000);
+        }
+      fprintf(stdout, "\n");
+
+      if (sd->phase_hist)
+        {
+          fprintf(stdout, "%sPhases p50/p90/p99/p99.9 ms:", protocol);
+          for (i = 0; i < PHASE_NUM; i++)
+            {
+              fprintf(stdout, "%s%s:", i ? "," : "", phase_names[i]);
+              print_phase_percentiles (stdout, &sd->phase_hist[i], "", "/");
+            }
+          fprintf(stdout, "\n");
+        }
+    }
 }
 
 /****************************************************************************************
@@ -743,7 +1135,19 @@ static void dump_stat_to_screen (char* protocol,
 void print_statistics_header (FILE* file)
 {
     fprintf (file, 
-             "RunTime(sec),Appl,Clients,Req,1xx,2xx,3xx,4xx,5xx,Err,T-Err,D,D-2xx,Ti,To\n");
+             "RunTime(sec),Appl,Clients,Req,1xx,2xx,3xx,4xx,5xx,Err,T-Err,D,D-2xx,Ti,To,"
+             "DNS,Conn,TLS,TTFB,Xfer,Redir,Total,DNS-max,Conn-max,TLS-max,TTFB-max,"
+             "Xfer-max,Redir-max,Total-max,D-p50,D-p90,D-p99,D-p99.9,D-max,"
+             "D-2xx-p50,D-2xx-p90,D-2xx-p99,D-2xx-p99.9,D-2xx-max");
+
+    int i;
+    const int num = sizeof (delay_percentiles) / sizeof (delay_percentiles[0]);
+    const char* percentile_names[] = {"p50", "p90", "p99", "p99.9"};
+
+    for (i = 0; i < PHASE_NUM * num; i++)
+      fprintf (file, ",%s-%s", phase_names[i / num], percentile_names[i % num]);
+
+    fprintf (file, "\n");
     fflush (file);
 }
 
@@ -758,7 +1162,17 @@ void print_statistics_header (FILE* file)
 ****************************************************************************************/
 static void print_statistics_footer_to_file (FILE* file)
 {
-    fprintf (file, "*, *, *, *, *, *, *, *, *, *, *, *, *, *\n");
+    fprintf (file, "*, *, *, *, *, *, *, *, *, *, *, *, *, *, *, "
+             "*, *, *, *, *, *, *, *, *, *, *, *, *, *, "
+             "*, *, *, *, *, *, *, *, *, *");
+
+    int i;
+    const int num = sizeof (delay_percentiles) / sizeof (delay_percentiles[0]);
+
+    for (i = 0; i < PHASE_NUM * num; i++)
+      fprintf (file, ", *");
+
+    fprintf (file, "\n");
     fflush (file);
 }
 
@@ -790,14 +1204,77 @@ static void print_statistics_data_to_file (FILE* file,
         period = 1;
       }
 
-    fprintf (file, "%ld, %s, %ld, %ld, %ld, %ld, %ld, %ld, %ld, %ld, %ld, %ld, %ld, %lld, %lld\n",
+    const unsigned long appl_delay = 
+      stat_delay_avg (sd->appl_delay_sum, sd->appl_delay_points);
+    const unsigned long appl_delay_2xx = 
+      stat_delay_avg (sd->appl_delay_2xx_sum, sd->appl_delay_2xx_points);
+
+    fprintf (file, "%ld, %s, %ld, %ld, %ld, %ld, %ld, %ld, %ld, %ld, %ld, %lu.%03lu, %lu.%03lu, %lld, %lld",
              timestamp, prot, clients_num, sd->requests, sd->resp_1xx, sd->resp_2xx,
              sd->resp_3xx, sd->resp_4xx, sd->resp_5xx, 
-             sd->other_errs, sd->url_timeout_errs, sd->appl_delay, sd->appl_delay_2xx, 
+             sd->other_errs, sd->url_timeout_errs, 
+             appl_delay / 1000, appl_delay % 1000,
+             appl_delay_2xx / 1000, appl_delay_2xx % 1000,
              sd->data_in/period, sd->data_out/period);
+
+    int i;
+    unsigned long avg;
+
+    for (i = 0; i < PHASE_NUM; i++)
+      {
+        avg = sd->phase_points ? 
+          (unsigned long) (sd->phase_sum[i] / sd->phase_points) : 0;
+        fprintf (file, ", %lu.%03lu", avg / 1000, avg % 1000);
+      }
+    for (i = 0; i < PHASE_NUM; i++)
+      {
+        fprintf (file, ", %lu.%03lu", sd->phase_max[i] / 1000, sd->phase_max[i] % 1000);
+      }
+
+    print_delay_percentiles (file, sd->appl_delay_hist, ", ", ", ");
+    print_delay_percentiles (file, sd->appl_delay_2xx_hist, ", ", ", ");
+    for (i = 0; i < PHASE_NUM; i++)
+      print_phase_percentiles (file, sd->phase_hist ? &sd->phase_hist[i] : NULL, 
+                               ", ", ", ");
+    fprintf (file, "\n");
     fflush (file);
 }
 
+/****************************************************************************************
+* Function name - dump_req_rate_backlog
+*
+* Description - Prints to stdout the open-loop fixed request rate backlog of all threads:
+*               number of requests due, but still not started, and the total number 
+*               of requests, which have not been started, when they came due.
+*
+* Input -       *bctx - pointer to the first batch context
+* Return Code/Output - None
+****************************************************************************************/
+static void dump_req_rate_backlog (batch_context* bctx)
+{
+  unsigned long backlog = 0, backlogged = 0;
+  int i;
+
+  if (! bctx->req_rate_open_loop)
+    return;
+
+  /* The counters of other threads are updated by them concurrently */
+  for (i = 0; i < (threads_subbatches_num ? threads_subbatches_num : 1); i++)
+    {
+      const unsigned long dispatched = 
+        __atomic_load_n (&(bctx + i)->req_rate_dispatched_num, __ATOMIC_RELAXED);
+      const unsigned long due = 
+        __atomic_load_n (&(bctx + i)->req_rate_due_num, __ATOMIC_RELAXED);
+
+      backlog += due > dispatched ? due - dispatched : 0;
+      backlogged += __atomic_load_n (&(bctx + i)->req_rate_backlogged_num, 
+                                     __ATOMIC_RELAXED);
+    }
+
+  fprintf(stdout,"Open-loop request rate backlog:%lu, backlogged total:%lu\n",
+          backlog, backlogged);
+}
+
 /****************************************************************************************
 * Function name - dump_clients
 *
@@ -836,6 +1313,40 @@ static void dump_clients (client_context* cctx_array)
   fclose (ct_file);
 }
 
+/***********************************************************************************
+* Function name - print_url_distributions
+*
+* Description - writes percentiles of the url fetch time and received body bytes
+*               and counters of the url response classes
+*
+* Input -       *opstats_file - FILE pointer
+*               *osp - pointer to the operational statistics point
+*               url_index - index of the url
+*
+* Return Code/Output - None
+*************************************************************************************/
+static void print_url_distributions (FILE *opstats_file,
+                                     op_stat_point*const osp,
+                                     unsigned long url_index)
+{
+  const hdr_hist_small* delay = &osp->url_delay[url_index];
+  const hdr_hist_small* bytes_in = &osp->url_bytes_in[url_index];
+  const unsigned long* resp_class = 
+    &osp->url_resp_class[url_index * OP_STAT_RESP_CLASSES];
+
+  (void)fprintf (opstats_file, 
+                 "%llu/%llu/%llu/%llu\t\t\t%llu/%llu/%llu\t\t\t%lu/%lu/%lu/%lu/%lu",
+                 hdr_hist_small_percentile (delay, 50.) / 1000,
+                 hdr_hist_small_percentile (delay, 90.) / 1000,
+                 hdr_hist_small_percentile (delay, 99.) / 1000,
+                 delay->max / 1000,
+                 hdr_hist_small_percentile (bytes_in, 50.),
+                 hdr_hist_small_percentile (bytes_in, 90.),
+                 bytes_in->max,
+                 resp_class[0], resp_class[1], resp_class[2], 
+                 resp_class[3], resp_class[4]);
+}
+
 /***********************************************************************************
 * Function name - print_operational_statistics
 *
@@ -871,5 +1382,19 @@ static void print_operational_statistics (FILE *opstats_file,
                    osp_curr->url_failed[i], osp_total->url_failed[i],
                    osp_curr->url_timeouted[i], osp_total->url_timeouted[i]);
         }
+
+      (void)fprintf (opstats_file,
+        " Distributions:\t\t Time p50/p90/p99/max ms\t\t"
+        " Bytes-In p50/p90/max\t\t 1xx/2xx/3xx/4xx/5xx\n");
+
+      for (i = 0; i < osp_curr->url_num; i++)
+        {
+          (void)fprintf (opstats_file, "URL%ld:%-12.12s\t", 
+                         i, url_arr[i].url_short_name);
+          print_url_distributions (opstats_file, osp_curr, i);
+          (void)fprintf (opstats_file, "\n%-17s\t", "");
+          print_url_distributions (opstats_file, osp_total, i);
+          (void)fprintf (opstats_file, "\n");
+        }
     }
 }
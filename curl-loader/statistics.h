@@ -28,6 +28,24 @@
 #include <stdio.h>
 
 #include "timer_tick.h"
+#include "hdr_hist.h"
+
+/*
+  Phases of url fetches, timed by libcurl. With redirections followed the 
+  times of all the requests are summed, and PHASE_REDIRECT is the time of 
+  all redirection steps before the final request.
+*/
+typedef enum phase_type
+{
+  PHASE_DNS = 0,     /* Resolving of the name */
+  PHASE_CONNECT,     /* TCP connection establishment */
+  PHASE_TLS,         /* TLS/SSL handshake */
+  PHASE_TTFB,        /* From the request ready to be sent to the first response byte */
+  PHASE_TRANSFER,    /* From the first response byte to the completion */
+  PHASE_REDIRECT,    /* Redirection steps */
+  PHASE_TOTAL,       /* The whole fetch */
+  PHASE_NUM
+} phase_type;
 
 /*
   stat_point -the structure is used to collect loading statistics.
@@ -70,20 +88,45 @@ typedef struct stat_point
   unsigned long url_timeout_errs;
 
    /* Num of data points used to calculate average application delay */
-  int appl_delay_points;
-  /* Average delay in msec between request and response */
-  unsigned long  appl_delay;
+  unsigned long appl_delay_points;
+  /* Sum of delays in usec between request and response */
+  unsigned long long appl_delay_sum;
 
   /* 
      Num of data points used to calculate average application delay 
      for 2xx-OK responses.
   */
-  int appl_delay_2xx_points;
-   /* Average delay in msec between request and 2xx-OK response */
-  unsigned long  appl_delay_2xx;
+  unsigned long appl_delay_2xx_points;
+   /* Sum of delays in usec between request and 2xx-OK response */
+  unsigned long long appl_delay_2xx_sum;
+
+  /* 
+     Histograms of the delays for percentiles. Allocated by stat_point_init ()
+     only for the batch statistics, NULL for the client statistics.
+  */
+  hdr_hist* appl_delay_hist;
+  hdr_hist* appl_delay_2xx_hist;
+
+  /* Number of successful url fetches with timed phases */
+  unsigned long phase_points;
+
+  /* Sums of the phase times in usec */
+  unsigned long long phase_sum[PHASE_NUM];
+
+  /* Maximal phase times in usec */
+  unsigned long phase_max[PHASE_NUM];
+
+  /* 
+     Histograms of the phase times, PHASE_NUM of them, for percentiles. 
+     Allocated by stat_point_init () as the delay histograms.
+  */
+  hdr_hist* phase_hist;
 
 } stat_point;
 
+/* Number of response status classes: 1xx - 5xx */
+#define OP_STAT_RESP_CLASSES 5
+
 /*
   op_stat_point - operation statistics point.
   Two instances are residing in each batch context and used:
@@ -104,11 +147,60 @@ typedef struct op_stat_point
   /* Array of url counters for timeouted fetches */
   unsigned long* url_timeouted;
 
+  /* 
+     Arrays of url distributions of completed fetches: delays in usec from 
+     the request till the completion and received body bytes. Small
+     histograms keep the memory about 4.5 KB per url.
+  */
+  hdr_hist_small* url_delay;
+  hdr_hist_small* url_bytes_in;
+
+  /* Array of url counters of 1xx-5xx responses, OP_STAT_RESP_CLASSES per url */
+  unsigned long* url_resp_class;
+
   /* Used for CAPS calculation */
   unsigned long call_init_count;
 
 } op_stat_point;
 
+/* Size of a CPU cache line to keep counters of threads apart */
+#define STAT_CACHE_LINE_SIZE 64
+
+/*
+  stat_handoff - handoff of the interval counters of a thread sub-batch
+  to the batch group leader.
+
+  The leader requests a publication by advancing <requested>. The sub-batch
+  thread at its loop iteration moves its delta counters to the handoff points
+  and advances <published>; the leader adds the published points to its own
+  delta counters and marks them as <collected>. Thus, each counter is either in
+  the delta of the thread or in the handoff and nothing is lost or read
+  torn, whereas the thread is never stopped.
+
+  When the thread completes loading, it sets <finished> and does not touch
+  its delta counters any more, which are then collected by the leader directly.
+*/
+typedef struct stat_handoff
+{
+  /* Written by the leader: number of the requested publication */
+  unsigned long requested __attribute__ ((aligned (STAT_CACHE_LINE_SIZE)));
+
+  /* Written by the leader: number of the collected publication */
+  unsigned long collected;
+
+  /* Written by the sub-batch thread: number of the published publication */
+  unsigned long published __attribute__ ((aligned (STAT_CACHE_LINE_SIZE)));
+
+  /* Written by the sub-batch thread: loading completed */
+  int finished;
+
+  /* Published counters */
+  stat_point http __attribute__ ((aligned (STAT_CACHE_LINE_SIZE)));
+  stat_point https;
+  op_stat_point op;
+
+} stat_handoff;
+
 /*******************************************************************************
 * Function name - stat_point_add
 *
@@ -120,6 +212,24 @@ typedef struct op_stat_point
 ********************************************************************************/
 void stat_point_add (stat_point* left, stat_point* right);
 
+/*******************************************************************************
+* Function name - stat_point_init
+*
+* Description - Allocates the delay histograms of a stat_point, unless allocated
+* Input -       *point -  pointer to the stat_point
+* Return Code/Output - On success - 0, on error -1
+********************************************************************************/
+int stat_point_init (stat_point* point);
+
+/*******************************************************************************
+* Function name - stat_point_release
+*
+* Description - Releases memory allocated by stat_point_init ()
+* Input -       *point -  pointer to the stat_point
+* Return Code/Output - None
+********************************************************************************/
+void stat_point_release (stat_point* point);
+
 /******************************************************************************
 * Function name - stat_point_reset
 *
@@ -198,11 +308,102 @@ void op_stat_update (op_stat_point* op_stat,
 
 void op_stat_timeouted (op_stat_point* op_stat, size_t url_index);
 
+/*******************************************************************************
+* Function name -  op_stat_url_completed
+*
+* Description - Counts a completed url fetch into the url distributions
+*
+* Input -       *op_stat        - pointer to the op_stat_point
+*               url_index       - index of the url
+*               delay           - delay in usec from the request till the completion
+*               bytes_in        - received body bytes
+*               response_status - status of the final response or 0
+* Return Code/Output - None
+*********************************************************************************/
+void op_stat_url_completed (op_stat_point* op_stat, 
+                            size_t url_index,
+                            unsigned long long delay,
+                            unsigned long long bytes_in,
+                            long response_status);
+
 void op_stat_call_init_count_inc (op_stat_point* op_stat);
 
 struct client_context;
 struct batch_context;
 
+/****************************************************************************************
+* Function name - stat_handoff_init
+*
+* Description - Allocates the handoff points of a batch
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int stat_handoff_init (struct batch_context* bctx);
+
+/****************************************************************************************
+* Function name - stat_handoff_release
+*
+* Description - Releases memory allocated by stat_handoff_init ()
+*
+* Input -       *bctx - pointer to the batch context
+* Return Code/Output - None
+****************************************************************************************/
+void stat_handoff_release (struct batch_context* bctx);
+
+/****************************************************************************************
+* Function name - stat_handoff_publish
+*
+* Description - Called by a sub-batch thread at its loop iterations. When the leader
+*               has requested a publication, moves the delta counters of the 
+*               sub-batch to its handoff points. 
+*
+* Input -       *bctx - pointer to the batch context of the thread
+* Return Code/Output - None
+****************************************************************************************/
+void stat_handoff_publish (struct batch_context* bctx);
+
+/* 
+   Maximum time (msec) for the leader to wait at the final collection for a 
+   publication of a thread, when loading is stopped.
+*/
+#define STAT_HANDOFF_WAIT_MSEC 20
+
+/* 
+   Maximum time (msec) for the leader to wait at the final collection for all
+   the threads to complete their loading.
+*/
+#define STAT_HANDOFF_FINISH_WAIT_MSEC 10000
+
+/****************************************************************************************
+* Function name - stat_handoff_collect
+*
+* Description - Collects by the leader delta counters of the other thread sub-batches
+*               without stopping them. Takes the publication of each thread, which 
+*               has been published since the previous collection, and requests the
+*               next one, which the thread makes at its next loop iteration. Thus,
+*               counters of a thread come to the leader at most a collection later 
+*               and the leader never waits. The final collection waits for the 
+*               threads to complete, but not longer than STAT_HANDOFF_FINISH_WAIT_MSEC
+*               or, when loading is stopped, STAT_HANDOFF_WAIT_MSEC.
+*
+* Input -       *bctx - pointer to the batch context of the leader
+*               final - whether the collection is the final one
+* Return Code/Output - None
+****************************************************************************************/
+void stat_handoff_collect (struct batch_context* bctx, int final);
+
+/****************************************************************************************
+* Function name - stat_handoff_finish
+*
+* Description - Called by a sub-batch thread, when loading is completed and the 
+*               delta counters of the sub-batch are not updated any more.
+*
+* Input -       *bctx - pointer to the batch context of the thread
+* Return Code/Output - None
+****************************************************************************************/
+void stat_handoff_finish (struct batch_context* bctx);
+
 /****************************************************************************************
 * Function name - dump_final_statistics
 *
@@ -0,0 +1,397 @@
+/*
+*     stats_stream.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include "batch.h"
+#include "client.h"
+#include "loader.h"
+#include "conf.h"
+#include "stats_stream.h"
+#include "metrics.h"
+
+#define STATS_STREAM_PAGE_SIZE 4096
+
+/*
+  stats_stream - records of the leader for the mapped stream file and
+  snapshots for the metrics exporter.
+*/
+typedef struct stats_stream
+{
+  int fd;
+
+  /* The mapping of the whole file */
+  char* map;
+  size_t map_size;
+
+  sts_header* header;
+
+  /* The record being composed, copied to the ring, when complete */
+  sts_record* record;
+
+  /* Time of the latest record to the file, msec */
+  unsigned long last_record_time;
+
+  /* Time of the latest snapshot for the metrics exporter, msec */
+  unsigned long last_snapshot_time;
+
+} stats_stream;
+
+static int stats_stream_file_open (batch_context* bctx, stats_stream* st);
+
+static void sts_proto_fill (sts_proto* p, stat_point* total, stat_point* delta)
+{
+  int i;
+
+  p->requests = total->requests + delta->requests;
+  p->resp_1xx = total->resp_1xx + delta->resp_1xx;
+  p->resp_2xx = total->resp_2xx + delta->resp_2xx;
+  p->resp_3xx = total->resp_3xx + delta->resp_3xx;
+  p->resp_4xx = total->resp_4xx + delta->resp_4xx;
+  p->resp_5xx = total->resp_5xx + delta->resp_5xx;
+  p->other_errs = total->other_errs + delta->other_errs;
+  p->url_timeout_errs = total->url_timeout_errs + delta->url_timeout_errs;
+  p->data_in = total->data_in + delta->data_in;
+  p->data_out = total->data_out + delta->data_out;
+
+  p->appl_delay_points = total->appl_delay_points + delta->appl_delay_points;
+  p->appl_delay_sum = total->appl_delay_sum + delta->appl_delay_sum;
+  p->appl_delay_2xx_points =
+    total->appl_delay_2xx_points + delta->appl_delay_2xx_points;
+  p->appl_delay_2xx_sum = total->appl_delay_2xx_sum + delta->appl_delay_2xx_sum;
+
+  p->phase_points = total->phase_points + delta->phase_points;
+  for (i = 0; i < PHASE_NUM; i++)
+    {
+      p->phase_sum[i] = total->phase_sum[i] + delta->phase_sum[i];
+      p->phase_max[i] = total->phase_max[i] > delta->phase_max[i] ? 
+        total->phase_max[i] : delta->phase_max[i];
+    }
+
+  memset (&p->appl_delay, 0, sizeof (p->appl_delay));
+  if (total->appl_delay_hist)
+    hdr_hist_small_add_hist (&p->appl_delay, total->appl_delay_hist);
+  if (delta->appl_delay_hist)
+    hdr_hist_small_add_hist (&p->appl_delay, delta->appl_delay_hist);
+}
+
+static void sts_url_fill (sts_url* u,
+                          op_stat_point* total,
+                          op_stat_point* delta,
+                          size_t i)
+{
+  int j;
+
+  u->ok = total->url_ok[i] + delta->url_ok[i];
+  u->failed = total->url_failed[i] + delta->url_failed[i];
+  u->timeouted = total->url_timeouted[i] + delta->url_timeouted[i];
+
+  for (j = 0; j < OP_STAT_RESP_CLASSES; j++)
+    {
+      u->resp_class[j] = total->url_resp_class[i * OP_STAT_RESP_CLASSES + j] +
+        delta->url_resp_class[i * OP_STAT_RESP_CLASSES + j];
+    }
+
+  memset (&u->delay, 0, sizeof (u->delay));
+  hdr_hist_small_add (&u->delay, &total->url_delay[i]);
+  hdr_hist_small_add (&u->delay, &delta->url_delay[i]);
+}
+
+/****************************************************************************************
+* Function name - stats_stream_compose
+*
+* Description - Makes a record of the counters since the load start and writes it
+*               to the file and/or publishes to the metrics exporter
+*
+* Input -       *bctx      - pointer to the batch context of the leader
+*               now_time   - current time in msec
+*               to_file    - when true, writes the record to the file, if any
+*               to_metrics - when true, publishes the record to the metrics exporter,
+*                            if enabled
+* Return Code/Output - None
+****************************************************************************************/
+static void stats_stream_compose (batch_context* bctx,
+                                  unsigned long now_time,
+                                  int to_file,
+                                  int to_metrics)
+{
+  stats_stream* st = bctx->stream;
+  sts_header* h = 0;
+  sts_record* rec = 0;
+  unsigned long long clients = 0;
+  int i;
+
+  if (! st)
+    return;
+
+  rec = st->record;
+
+  for (i = 0; i <= threads_subbatches_num; i++)
+    {
+      clients += pending_active_and_waiting_clients_num_stat (bctx + i);
+    }
+
+  rec->time = now_time - bctx->start_time;
+  rec->clients = clients;
+  rec->call_init_count =
+    bctx->op_total.call_init_count + bctx->op_delta.call_init_count;
+
+  sts_proto_fill (&rec->http, &bctx->http_total, &bctx->http_delta);
+  sts_proto_fill (&rec->https, &bctx->https_total, &bctx->https_delta);
+
+  for (i = 0; i < bctx->urls_num; i++)
+    {
+      sts_url_fill (STS_RECORD_URL (rec, i), &bctx->op_total, &bctx->op_delta, i);
+    }
+
+  if (to_metrics && metrics_address[0])
+    {
+      metrics_publish (rec);
+      st->last_snapshot_time = now_time;
+    }
+
+  if (! to_file || ! st->map)
+    return;
+
+  h = st->header;
+
+  /* Copy to the ring and then advance the number of records */
+  memcpy (st->map + h->header_size +
+          (h->records_written % h->records_num) * h->record_size,
+          rec, h->record_size);
+
+  __atomic_store_n (&h->records_written, h->records_written + 1, __ATOMIC_RELEASE);
+
+  st->last_record_time = now_time;
+}
+
+/****************************************************************************************
+* Function name - stats_stream_open
+*
+* Description - Inits the records of the leader and, with stats_stream_interval, 
+*               creates and maps the binary statistics stream file <batch-name>.sts
+*
+* Input -       *bctx - pointer to the batch context of the leader
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int stats_stream_open (batch_context* bctx)
+{
+  stats_stream* st = 0;
+
+  if (! (st = calloc (1, sizeof (stats_stream))))
+    {
+      fprintf (stderr, "%s - error: calloc () failed with errno %d.\n",
+               __func__, errno);
+      return -1;
+    }
+  st->fd = -1;
+
+  if (! (st->record = calloc (1, STS_RECORD_SIZE (bctx->urls_num))))
+    {
+      fprintf (stderr, "%s - error: calloc () failed with errno %d.\n",
+               __func__, errno);
+      free (st);
+      return -1;
+    }
+
+  bctx->stream = st;
+
+  if (stats_stream_interval && stats_stream_file_open (bctx, st) == -1)
+    {
+      stats_stream_close (bctx);
+      return -1;
+    }
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - stats_stream_file_open
+*
+* Description - Creates and maps the binary statistics stream file <batch-name>.sts
+*
+* Input -       *bctx - pointer to the batch context of the leader
+*               *st   - pointer to the stream
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+static int stats_stream_file_open (batch_context* bctx, stats_stream* st)
+{
+  char file_name[BATCH_NAME_SIZE + BATCH_NAME_EXTRA_SIZE];
+  size_t header_size, record_size, records_num;
+  struct timeval tv;
+  int i;
+
+  header_size = sizeof (sts_header) +
+    bctx->urls_num * STATS_STREAM_URL_NAME_SIZE;
+  header_size = (header_size + STATS_STREAM_PAGE_SIZE - 1) /
+    STATS_STREAM_PAGE_SIZE * STATS_STREAM_PAGE_SIZE;
+  record_size = STS_RECORD_SIZE (bctx->urls_num);
+
+  /* Ring of many urls records is shortened to the maximal size */
+  records_num = STATS_STREAM_SIZE_MAX / record_size;
+  if (records_num > STATS_STREAM_RECORDS_NUM)
+    records_num = STATS_STREAM_RECORDS_NUM;
+  else if (records_num < STATS_STREAM_RECORDS_MIN)
+    records_num = STATS_STREAM_RECORDS_MIN;
+
+  st->map_size = header_size + record_size * records_num;
+
+  (void)sprintf (file_name, "./%s.sts", bctx->batch_name);
+
+  if ((st->fd = open (file_name, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+    {
+      fprintf (stderr, "%s - error: open () of %s failed with errno %d.\n",
+               __func__, file_name, errno);
+      return -1;
+    }
+
+  /* The file is sparse till the ring is filled */
+  if (ftruncate (st->fd, (off_t) st->map_size) == -1)
+    {
+      fprintf (stderr, "%s - error: ftruncate () of %s failed with errno %d.\n",
+               __func__, file_name, errno);
+      return -1;
+    }
+
+  if ((st->map = mmap (NULL, st->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       st->fd, 0)) == MAP_FAILED)
+    {
+      st->map = 0;
+      fprintf (stderr, "%s - error: mmap () of %s failed with errno %d.\n",
+               __func__, file_name, errno);
+      return -1;
+    }
+
+  st->header = (sts_header *) st->map;
+
+  memcpy (st->header->magic, STATS_STREAM_MAGIC, STATS_STREAM_MAGIC_SIZE);
+  st->header->version = STATS_STREAM_VERSION;
+  st->header->phase_num = PHASE_NUM;
+  st->header->hist_sub_bits = HDR_HIST_SMALL_SUB_BITS;
+  st->header->hist_counts_num = HDR_HIST_SMALL_COUNTS_NUM;
+  st->header->header_size = (unsigned int) header_size;
+  st->header->record_size = (unsigned int) record_size;
+  st->header->records_num = (unsigned int) records_num;
+  st->header->url_num = (unsigned int) bctx->urls_num;
+  st->header->interval = (unsigned long long) stats_stream_interval;
+
+  gettimeofday (&tv, NULL);
+  st->header->start_time =
+    (unsigned long long) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+  snprintf (st->header->batch_name, sizeof (st->header->batch_name), "%s", 
+            bctx->batch_name);
+
+  for (i = 0; i < bctx->urls_num; i++)
+    {
+      snprintf (st->map + sizeof (sts_header) + i * STATS_STREAM_URL_NAME_SIZE,
+                STATS_STREAM_URL_NAME_SIZE, "%s", 
+                bctx->url_ctx_array[i].url_short_name);
+    }
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - stats_stream_tick
+*
+* Description - Called by the leader at its loop iterations. Writes a record, when
+*               stats_stream_interval has passed since the previous record to the 
+*               file or METRICS_SNAPSHOT_INTERVAL since the previous snapshot of
+*               the metrics exporter.
+*
+* Input -       *bctx    - pointer to the batch context of the leader
+*               now_time - current time in msec
+* Return Code/Output - None
+****************************************************************************************/
+void stats_stream_tick (batch_context* bctx, unsigned long now_time)
+{
+  stats_stream* st = bctx->stream;
+  int to_file, to_metrics;
+
+  if (! st)
+    return;
+
+  to_file = st->map && 
+    (long) (now_time - st->last_record_time) >= stats_stream_interval;
+  to_metrics = metrics_address[0] &&
+    (long) (now_time - st->last_snapshot_time) >= METRICS_SNAPSHOT_INTERVAL;
+
+  if (! to_file && ! to_metrics)
+    return;
+
+  /* Other threads counters, as published, without waiting */
+  stat_handoff_collect (bctx, 0);
+
+  stats_stream_compose (bctx, now_time, to_file, to_metrics);
+}
+
+/****************************************************************************************
+* Function name - stats_stream_record
+*
+* Description - Makes a record of the counters since the load start: totals and
+*               not yet advanced to the totals delta counters of the leader. Writes
+*               it to the file and publishes to the metrics exporter.
+*
+* Input -       *bctx    - pointer to the batch context of the leader
+*               now_time - current time in msec
+* Return Code/Output - None
+****************************************************************************************/
+void stats_stream_record (batch_context* bctx, unsigned long now_time)
+{
+  stats_stream_compose (bctx, now_time, 1, 1);
+}
+
+/****************************************************************************************
+* Function name - stats_stream_close
+*
+* Description - Flushes and unmaps the binary statistics stream file and releases
+*               the records
+*
+* Input -       *bctx - pointer to the batch context of the leader
+* Return Code/Output - None
+****************************************************************************************/
+void stats_stream_close (batch_context* bctx)
+{
+  stats_stream* st = bctx->stream;
+
+  if (! st)
+    return;
+
+  if (st->map)
+    {
+      msync (st->map, st->map_size, MS_SYNC);
+      munmap (st->map, st->map_size);
+    }
+  if (st->fd != -1)
+    close (st->fd);
+
+  free (st->record);
+  free (st);
+
+  bctx->stream = 0;
+}
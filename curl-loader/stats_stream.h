@@ -0,0 +1,206 @@
+/*
+*     stats_stream.h
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef STATS_STREAM_H
+#define STATS_STREAM_H
+
+#include "statistics.h"
+
+/*
+  Binary statistics stream - file <batch-name>.sts, memory-mapped and
+  written by the leader thread without formatting.
+
+  The file is a header followed by a ring of fixed-size records, up to 
+  STATS_STREAM_RECORDS_NUM records and STATS_STREAM_SIZE_MAX bytes. A record
+  keeps the counters since the load start (cumulative), thus any record 
+  stands alone, and an interval is the difference of two records.
+
+  A record is copied to the ring at index <records_written> modulo 
+  <records_num>, and only then <records_written> is advanced.
+
+  The file is decoded to CSV or JSON by tools/sts_decode.
+*/
+
+#define STATS_STREAM_MAGIC "CLSTS\0\0\0"
+#define STATS_STREAM_MAGIC_SIZE 8
+#define STATS_STREAM_VERSION 1
+
+/* Number of records in the ring and the ring size limit */
+#define STATS_STREAM_RECORDS_NUM 16384
+#define STATS_STREAM_RECORDS_MIN 64
+#define STATS_STREAM_SIZE_MAX (256UL << 20)
+
+/* Minimal time between records, msec */
+#define STATS_STREAM_INTERVAL_MIN 100
+
+#define STATS_STREAM_NAME_SIZE 64
+#define STATS_STREAM_URL_NAME_SIZE 16
+
+typedef struct sts_header
+{
+  char magic[STATS_STREAM_MAGIC_SIZE];
+
+  /* Format of the records */
+  unsigned int version;
+  unsigned int phase_num;
+  unsigned int hist_sub_bits;
+  unsigned int hist_counts_num;
+
+  /* Size of the header with url names, where the ring starts */
+  unsigned int header_size;
+
+  /* Size of a record and number of records in the ring */
+  unsigned int record_size;
+  unsigned int records_num;
+
+  /* Number of urls in a record */
+  unsigned int url_num;
+
+  /* Time between records, msec */
+  unsigned long long interval;
+
+  /* Load start time, msec since the epoch */
+  unsigned long long start_time;
+
+  /* Number of records written; the latest one is at (records_written - 1) % records_num */
+  unsigned long long records_written;
+
+  char batch_name[STATS_STREAM_NAME_SIZE];
+
+  /* Followed by url_num short names of STATS_STREAM_URL_NAME_SIZE */
+
+} sts_header;
+
+/* Loading counters of HTTP/FTP or HTTPS/FTPS */
+typedef struct sts_proto
+{
+  unsigned long long requests;
+  unsigned long long resp_1xx;
+  unsigned long long resp_2xx;
+  unsigned long long resp_3xx;
+  unsigned long long resp_4xx;
+  unsigned long long resp_5xx;
+  unsigned long long other_errs;
+  unsigned long long url_timeout_errs;
+  unsigned long long data_in;
+  unsigned long long data_out;
+
+  unsigned long long appl_delay_points;
+  unsigned long long appl_delay_sum;
+  unsigned long long appl_delay_2xx_points;
+  unsigned long long appl_delay_2xx_sum;
+
+  unsigned long long phase_points;
+  unsigned long long phase_sum[PHASE_NUM];
+  unsigned long long phase_max[PHASE_NUM];
+
+  /* Application delays in usec, downsampled */
+  hdr_hist_small appl_delay;
+
+} sts_proto;
+
+/* Operational counters of a url */
+typedef struct sts_url
+{
+  unsigned long long ok;
+  unsigned long long failed;
+  unsigned long long timeouted;
+  unsigned long long resp_class[OP_STAT_RESP_CLASSES];
+
+  /* Total times in usec of successful fetches */
+  hdr_hist_small delay;
+
+} sts_url;
+
+typedef struct sts_record
+{
+  /* Time since the load start, msec */
+  unsigned long long time;
+
+  /* Number of clients */
+  unsigned long long clients;
+
+  /* Number of calls initiated, used for CAPS */
+  unsigned long long call_init_count;
+
+  sts_proto http;
+  sts_proto https;
+
+  /* Followed by url_num sts_url */
+
+} sts_record;
+
+#define STS_RECORD_SIZE(url_num) \
+  (sizeof (sts_record) + (url_num) * sizeof (sts_url))
+
+#define STS_RECORD_URL(rec, i) \
+  ((sts_url *) ((char *) (rec) + sizeof (sts_record)) + (i))
+
+/* Forward declaration */
+struct batch_context;
+
+/****************************************************************************************
+* Function name - stats_stream_open
+*
+* Description - Inits the records of the leader and, with stats_stream_interval, 
+*               creates and maps the binary statistics stream file <batch-name>.sts
+*
+* Input -       *bctx - pointer to the batch context of the leader
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int stats_stream_open (struct batch_context* bctx);
+
+/****************************************************************************************
+* Function name - stats_stream_tick
+*
+* Description - Called by the leader at its loop iterations. Writes a record, when
+*               stats_stream_interval has passed since the previous record to the 
+*               file or METRICS_SNAPSHOT_INTERVAL since the previous snapshot of
+*               the metrics exporter.
+*
+* Input -       *bctx    - pointer to the batch context of the leader
+*               now_time - current time in msec
+* Return Code/Output - None
+****************************************************************************************/
+void stats_stream_tick (struct batch_context* bctx, unsigned long now_time);
+
+/****************************************************************************************
+* Function name - stats_stream_record
+*
+* Description - Makes a record of the counters since the load start: totals and
+*               not yet advanced to the totals delta counters of the leader. Writes
+*               it to the file and publishes to the metrics exporter.
+*
+* Input -       *bctx    - pointer to the batch context of the leader
+*               now_time - current time in msec
+* Return Code/Output - None
+****************************************************************************************/
+void stats_stream_record (struct batch_context* bctx, unsigned long now_time);
+
+/****************************************************************************************
+* Function name - stats_stream_close
+*
+* Description - Flushes and unmaps the binary statistics stream file and releases
+*               the records
+*
+* Input -       *bctx - pointer to the batch context of the leader
+* Return Code/Output - None
+****************************************************************************************/
+void stats_stream_close (struct batch_context* bctx);
+
+#endif /* STATS_STREAM_H */
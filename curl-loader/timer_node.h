@@ -26,7 +26,10 @@
 /* forward declaration */
 struct timer_node;
 
-/* Prototype of the function to be called on timer expiration.*/
+/* 
+   Prototype of the function to be called on timer expiration. The last
+   argument is the current time in msec.
+*/
 typedef int (*handle_timer) (struct timer_node*, void*, unsigned long);
 
 /*
@@ -35,11 +38,11 @@ typedef int (*handle_timer) (struct timer_node*, void*, unsigned long);
  */
 typedef struct timer_node
 {
-  /* The next timer shot in msec since the epoch (Jan 1 1970) */
-  unsigned long next_timer;
+  /* The next timer shot in usec of the monotonic clock (see timer_tick.h) */
+  unsigned long long next_timer;
 
-  /* Interval in msec between periodic timer shots. Zero for non-periodic timer. */
-  unsigned long period;
+  /* Interval in usec between periodic timer shots. Zero for non-periodic timer. */
+  unsigned long long period;
   
   /* Function to be called on timer expiration. Trying to be Object Oriented ...*/
   handle_timer func_timer;
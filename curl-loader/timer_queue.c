@@ -28,10 +28,14 @@
 #include <limits.h>
 
 #include "timer_queue.h"
-#include "heap.h"
 #include "timer_node.h"
+#include "timer_tick.h"
 
-#define TQ_RESOLUTION 9 /* 9 msec */
+#define TQ_RESOLUTION 1000 /* 1 msec in usec, also the tick of a timing wheel */
+
+static int tq_dispatch_expired_wheel (timer_wheel*const w, 
+                                      void* vp_param, 
+                                      unsigned long long now_time);
 
 /* 	
    Prototype of the function to be used to compare heap-kept objects
@@ -49,7 +53,7 @@ int timer_node_comparator (hnode* const left, hnode* right)
 */
 void timer_node_dump (hnode* const h)
 {
-    fprintf (stderr, "n_timer=%ld ", ((timer_node *) h->ctx)->next_timer);
+    fprintf (stderr, "n_timer=%llu ", ((timer_node *) h->ctx)->next_timer);
 }
 
 /********************************************************************************
@@ -58,7 +62,8 @@ void timer_node_dump (hnode* const h)
 * Description - Performs initialization of an allocated timer queue. Inside sets 
 *               comparator and dump functions for a timer node objects.
 *
-* Input -       *tq                - pointer to an allocated timer queue, e.g. heap
+* Input -       *tq                - pointer to an allocated timer queue
+*               type               - TQ_TYPE_HEAP or TQ_TYPE_WHEEL
 *               tq_size            - size of the queue required
 *               tq_increase_step   - number of objects to be allocated by each 
 *                                    allocation operation
@@ -68,6 +73,7 @@ void timer_node_dump (hnode* const h)
 * Return Code/Output - On success - 0, on error -1
 *********************************************************************************/
 int tq_init (timer_queue*const tq,
+             int type,
              size_t tq_initial_size,
              size_t tq_increase_step,
              size_t nodes_num_prealloc)
@@ -78,7 +84,21 @@ int tq_init (timer_queue*const tq,
         return -1;
     }
 
-    return heap_init ((heap *const) tq,
+    tq->type = type;
+
+    if (tq->type == TQ_TYPE_WHEEL)
+      {
+        /* The wheel should not run ahead of "now" cached by the thread */
+        unsigned long long now_time = get_tick_count_cached_usec ();
+
+        return tw_init (&tq->u.w,
+                        tq_initial_size,
+                        nodes_num_prealloc,
+                        TQ_RESOLUTION,
+                        now_time ? now_time : get_tick_count_usec ());
+      }
+
+    return heap_init (&tq->u.h,
                       tq_initial_size,
                       tq_increase_step,
                       timer_node_comparator,
@@ -96,7 +116,10 @@ int tq_init (timer_queue*const tq,
 ****************************************************************************************/
 void tq_release (timer_queue*const tq)
 {
-    return heap_reset ((heap*const) tq);
+    if (tq->type == TQ_TYPE_WHEEL)
+      return tw_reset (&tq->u.w);
+
+    return heap_reset (&tq->u.h);
 }
 
 /****************************************************************************************
@@ -128,12 +151,15 @@ long tq_schedule_timer (timer_queue*const tq,
     if (tnode->period && tnode->period < TQ_RESOLUTION)
     {
         fprintf (stderr, 
-                 "%s - error: tnode fields outside of valid range: next_timer (%ld), period (%ld).\n",
+                 "%s - error: tnode fields outside of valid range: next_timer (%llu), period (%llu).\n",
                  __func__, tnode->next_timer, tnode->period);
         return -1;
     }
 
-    heap * h = (heap *) tq;
+    if (tq->type == TQ_TYPE_WHEEL)
+      return (tnode->timer_id = tw_schedule (&tq->u.w, tnode));
+
+    heap * h = &tq->u.h;
     hnode* new_hnode = (hnode *) mpool_take_obj (h->nodes_mpool);
 
     if (!new_hnode)
@@ -152,7 +178,7 @@ long tq_schedule_timer (timer_queue*const tq,
        Push the new timer node to the heap. Zero passed as an indication, 
        that it is a new timer rather than re-scheduling of a periodic timer.	
     */ 
-    return (tnode->timer_id = heap_push (tq, new_hnode, 0));
+    return (tnode->timer_id = heap_push (h, new_hnode, 0));
 }
 
 /****************************************************************************************
@@ -167,7 +193,10 @@ long tq_schedule_timer (timer_queue*const tq,
 ****************************************************************************************/
 int tq_cancel_timer (timer_queue*const tq, long timer_id)
 {
-    heap* h = (heap *) tq;
+    heap* h = &tq->u.h;
+
+    if (tq->type == TQ_TYPE_WHEEL)
+      return tw_cancel (&tq->u.w, timer_id);
 
     if (!tq || timer_id < 0 || (size_t) timer_id > h->max_heap_size)
     {
@@ -223,7 +252,7 @@ int tq_cancel_timers (timer_queue*const tq, struct timer_node* const tnode)
   hnode* node = 0;
   size_t index = 0;
   int counter = 0;
-  heap* h = (heap *) tq;
+  heap* h = &tq->u.h;
 
   if (!tq || !tnode)
     {
@@ -231,6 +260,19 @@ int tq_cancel_timers (timer_queue*const tq, struct timer_node* const tnode)
       return -1;
     }
 
+  /* A wheel finds the node by the timer-id without a scan */
+  if (tq->type == TQ_TYPE_WHEEL)
+    {
+      timer_wheel* w = &tq->u.w;
+
+      if (tnode->timer_id < 0 || (size_t) tnode->timer_id >= w->ids_size ||
+          ! w->ids_arr[tnode->timer_id] || 
+          w->ids_arr[tnode->timer_id]->ctx != tnode)
+        return 0;
+
+      return tw_cancel (w, tnode->timer_id) == -1 ? -1 : 1;
+    }
+
   for (index = 0; index < h->curr_heap_size;)
     {
       if (h->heap[index]->ctx == tnode)
@@ -266,21 +308,24 @@ int tq_cancel_timers (timer_queue*const tq, struct timer_node* const tnode)
 /****************************************************************************************
 * Function name - tq_time_to_nearest_timer
 *
-* Description - Returns time (msec) to the nearest timer in queue, or -1, when 
-*               no timers queued. Returned time is taked from timer-node field 
+* Description - Returns time (usec) of the nearest timer in queue, or ULLONG_MAX, 
+*               when no timers queued. Returned time is taked from timer-node field 
 *               next-timer. 
 *
 * Input -       *tq - pointer to a timer queue, e.g. heap
 *
-* Return Code/Output - Time in msec till the nearest timer or  ULONG_MAX, when 
+* Return Code/Output - Time in usec of the nearest timer or ULLONG_MAX, when 
 *                      there are no timers.
 ****************************************************************************************/
-unsigned long tq_time_to_nearest_timer (timer_queue*const tq)
+unsigned long long tq_time_to_nearest_timer (timer_queue*const tq)
 {
-    heap* h = (heap *) tq;
+    heap* h = &tq->u.h;
+
+    if (tq->type == TQ_TYPE_WHEEL)
+      return tw_nearest_time (&tq->u.w);
 
     if (! h->curr_heap_size)
-        return ULONG_MAX;
+        return ULLONG_MAX;
 
     return ((timer_node *) h->heap[0]->ctx)->next_timer;
 }
@@ -298,8 +343,28 @@ unsigned long tq_time_to_nearest_timer (timer_queue*const tq)
 ****************************************************************************************/
 int tq_remove_nearest_timer (timer_queue*const tq, timer_node** tnode)
 {
-  heap* h = (heap *) tq;
-  hnode* node = heap_pop ((heap *const) tq, 0);
+  if (tq->type == TQ_TYPE_WHEEL)
+    {
+      timer_wheel* w = &tq->u.w;
+      unsigned long long time_nearest = w->curr_tick * w->resolution;
+      wnode* wn = 0;
+
+      /* Moves the wheel time forward to the nearest timer */
+      while (! (wn = tw_expired_pop (w, time_nearest)))
+        {
+          if (! tw_size (w))
+            return -1;
+
+          time_nearest = tw_nearest_time (w);
+        }
+
+      *tnode = wn->ctx;
+      tw_release_node (w, wn);
+      return 0;
+    }
+
+  heap* h = &tq->u.h;
+  hnode* node = heap_pop (h, 0);
 
   if (!node)
     return -1;
@@ -326,22 +391,26 @@ int tq_remove_nearest_timer (timer_queue*const tq, timer_node** tnode)
 *
 * Input -       *tq       - pointer to a timer queue, e.g. heap
 *               *vp_param - void pointer passed parameter
-*               now_time  - current time since epoch in msec
+*               now_time  - current time of the monotonic clock in usec
 *
 * Return Code/Output - On success - 0, on error -1
 ****************************************************************************************/
 int tq_dispatch_nearest_timer (timer_queue*const tq, 
 			       void* vp_param, 
-			       unsigned long now_time)
+			       unsigned long long now_time)
 {
-  heap* h = (heap *) tq;
-  hnode* top_node = heap_top_node ((heap *const) tq);
+  if (tq->type == TQ_TYPE_WHEEL)
+    return tq_dispatch_expired_wheel (&tq->u.w, vp_param, now_time);
 
-  hnode* node = heap_pop ((heap *const) tq, 
+  heap* h = &tq->u.h;
+  hnode* top_node = heap_top_node (h);
+
+  hnode* node = heap_pop (h, 
                           ((timer_node *) top_node->ctx)->period ? 1 : 0);
   timer_node* tnode = (timer_node *) node->ctx;
 
-  int rval = tnode->func_timer (tnode, vp_param, now_time);
+  int rval = tnode->func_timer (tnode, vp_param, 
+                               (unsigned long) (now_time / TICK_USEC_PER_MSEC));
 
   if (rval)
     goto node_return;
@@ -350,7 +419,7 @@ int tq_dispatch_nearest_timer (timer_queue*const tq,
     {
       tnode->next_timer = now_time + tnode->period;
       
-      if (heap_push (tq, node, 1) == -1)
+      if (heap_push (h, node, 1) == -1)
         {
           fprintf (stderr, "%s - error: heap_push () failed.\n", __func__);
           rval = -1;
@@ -376,6 +445,54 @@ int tq_dispatch_nearest_timer (timer_queue*const tq,
   return rval;
 }
 
+/****************************************************************************************
+* Function name - tq_dispatch_expired_wheel
+*
+* Description - Takes the first expired timer from a timing wheel and calls for its 
+*               handle_timer (). A non-periodic timer-id is released before the call, 
+*               as the heap does, and a periodic timer is re-scheduled with the same id.
+*
+* Input -       *w        - pointer to a timing wheel
+*               *vp_param - void pointer passed parameter
+*               now_time  - current time of the monotonic clock in usec
+*
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+static int tq_dispatch_expired_wheel (timer_wheel*const w, 
+                                      void* vp_param, 
+                                      unsigned long long now_time)
+{
+  wnode* node = tw_expired_pop (w, now_time);
+  timer_node* tnode = 0;
+  int rval = 0;
+
+  /* Nearest time of a far timer is the start of its slot */
+  if (!node)
+    return 0;
+
+  tnode = node->ctx;
+
+  if (! tnode->period)
+    {
+      tw_release_node (w, node);
+
+      return tnode->func_timer (tnode, vp_param, 
+                                (unsigned long) (now_time / TICK_USEC_PER_MSEC));
+    }
+
+  rval = tnode->func_timer (tnode, vp_param, 
+                            (unsigned long) (now_time / TICK_USEC_PER_MSEC));
+  if (rval)
+    {
+      tw_release_node (w, node);
+      return rval;
+    }
+
+  tnode->next_timer = now_time + tnode->period;
+  tw_reschedule (w, node);
+
+  return 0;
+}
 
 /****************************************************************************************
 * Function name - tq_empty
@@ -387,7 +504,10 @@ int tq_dispatch_nearest_timer (timer_queue*const tq,
 ****************************************************************************************/
 int tq_empty (timer_queue*const tq)
 {
-  return heap_empty ((heap *const) tq);
+  if (tq->type == TQ_TYPE_WHEEL)
+    return ! tw_size (&tq->u.w);
+
+  return heap_empty (&tq->u.h);
 }
 
 /****************************************************************************************
@@ -400,12 +520,15 @@ int tq_empty (timer_queue*const tq)
 ****************************************************************************************/
 int tq_size (timer_queue*const tq)
 {
-  return heap_size ((heap *const) tq);
+  if (tq->type == TQ_TYPE_WHEEL)
+    return (int) tw_size (&tq->u.w);
+
+  return heap_size (&tq->u.h);
 }
 
 int release_kept_timer_id (timer_queue*const tq, long timer_id)
 {
-  heap* h = (heap *) tq;
+  heap* h = &tq->u.h;
 
   if (!tq || timer_id < 0 || (size_t) timer_id > h->max_heap_size)
     {
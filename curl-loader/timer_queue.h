@@ -25,11 +25,41 @@
 
 #include <stddef.h>
 
+#include "heap.h"
+#include "timer_wheel.h"
+
 /*
   Timer queue API.
 */
 
-typedef void timer_queue;
+/*
+  Implementations of a timer queue.
+*/
+enum tq_type
+  {
+    TQ_TYPE_HEAP = 0,  /* Binary heap, O(log n) schedule and cancel */
+    TQ_TYPE_WHEEL = 1, /* Hierarchical timing wheel, O(1) schedule and cancel */
+  };
+
+/* The default is set by the build: make timer_wheel=1 */
+#ifdef TIMER_QUEUE_WHEEL
+#define TQ_TYPE_DEFAULT TQ_TYPE_WHEEL
+#else
+#define TQ_TYPE_DEFAULT TQ_TYPE_HEAP
+#endif
+
+typedef struct timer_queue
+{
+  /* Implementation of the queue, TQ_TYPE_HEAP or TQ_TYPE_WHEEL */
+  int type;
+
+  union
+  {
+    heap h;
+    timer_wheel w;
+  } u;
+
+} timer_queue;
 
 struct timer_node;
 
@@ -39,7 +69,8 @@ struct timer_node;
 * Description - Performs initialization of an allocated timer queue. Inside sets 
 *               comparator and dump functions for the timer node objects.
 *
-* Input -       *tq -               pointer to an allocated timer queue, e.g. heap
+* Input -       *tq -               pointer to an allocated timer queue
+*               type -              TQ_TYPE_HEAP or TQ_TYPE_WHEEL
 *               tq_size -           size of the queue required
 *               tq_increase_step -  number of objects to be allocated by each 
 *                                   allocation operation
@@ -49,6 +80,7 @@ struct timer_node;
 * Return Code/Output - On success - 0, on error -1
 ****************************************************************************************/
 int tq_init (timer_queue*const tq,
+             int type,
              size_t tq_size,
              size_t tq_increase_step,
              size_t nodes_num_prealloc);
@@ -58,7 +90,7 @@ int tq_init (timer_queue*const tq,
 *
 * Description - De-allocates all allocated memory
 *
-* Input -       *tq - pointer to an allocated timer queue, e.g. heap
+* Input -       *tq - pointer to an allocated timer queue
 * Return Code/Output - None
 ****************************************************************************************/
 void tq_release (timer_queue*const tq);
@@ -69,7 +101,7 @@ void tq_release (timer_queue*const tq);
 *
 * Description - Schedules timer, using timer-node as the assisting structure
 *
-* Input -       *tq    -  pointer to an allocated timer queue, e.g. heap
+* Input -       *tq    -  pointer to an allocated timer queue
 *               *tnode -  pointer to the user-allocated timer node with filled next-timer and,
 *                         optionally, period as well as with a set timer-handling function, 
 *                         which is dispatched by tq_dispatch_nearest_timer ()
@@ -83,7 +115,7 @@ long tq_schedule_timer (timer_queue*const tq, struct timer_node* const tnode);
 *
 * Description - Cancels timer, using timer-id returned by tq_schedule_timer ()
 *
-* Input -       *tq - pointer to a timer queue, e.g. heap
+* Input -       *tq - pointer to a timer queue
 *               timer_id -  number returned by tq_schedule_timer ()
 * Return Code/Output - On success - 0, on error -1
 ****************************************************************************************/
@@ -92,9 +124,10 @@ int tq_cancel_timer (timer_queue*const tq, long timer_id);
 /****************************************************************************************
 * Function name - tq_cancel_timers
 *
-* Description - Cancels all timers in timer queue, scheduled for a timer node
+* Description - Cancels all timers in timer queue, scheduled for a timer node.
+*               The wheel cancels the timer of the last scheduling of the node.
 *
-* Input -       *tq - pointer to a timer queue, e.g. heap
+* Input -       *tq - pointer to a timer queue
 *               *tnode -  pointer to the timer-node (timer context) to be searched for
 * Return Code/Output - On success - zero or positive number of cancelled timers, 
 *                      on error -1
@@ -104,16 +137,18 @@ int tq_cancel_timers (timer_queue*const tq, struct timer_node* const tnode);
 /****************************************************************************************
 * Function name - tq_time_to_nearest_timer
 *
-* Description - Returns time (msec) to the nearest timer in queue
+* Description - Returns time (usec) of the nearest timer in queue
 *               The returned time is taked from the the timer-node of the 
-*               nearest timer (field next-timer). 
+*               nearest timer (field next-timer). The wheel returns the time 
+*               of the tick, when the timer is dispatched, or an earlier time 
+*               for timers, not cascaded yet to the lowest level.
 *
-* Input -       *tq - pointer to a timer queue, e.g. heap
+* Input -       *tq - pointer to a timer queue
 *
-* Return Code/Output - Time in msec till the nearest timer or  ULONG_MAX, when 
+* Return Code/Output - Time in usec of the nearest timer or ULLONG_MAX, when 
 *                      there are no timers in the timer queue.
 ****************************************************************************************/
-unsigned long tq_time_to_nearest_timer (timer_queue*const tq);
+unsigned long long tq_time_to_nearest_timer (timer_queue*const tq);
 
 
 /****************************************************************************************
@@ -123,7 +158,7 @@ unsigned long tq_time_to_nearest_timer (timer_queue*const tq);
 *               pointer to the timer context. Internally performs necessary 
 *               rearrangements of the queue.
 *
-* Input -       *tq - pointer to a timer queue, e.g. heap
+* Input -       *tq - pointer to a timer queue
 * Input/Output- **tnode - second pointer to a timer node to be filled 
 * Return Code/Output - On success - 0, on error -1
 ****************************************************************************************/
@@ -135,19 +170,21 @@ int tq_remove_nearest_timer (timer_queue*const tq, struct timer_node** tnode);
 * Function name - tq_dispatch_nearest_timer
 *
 * Description - Removes nearest timer from the queue, calls for func_timer () of the
-*               timer node kept as the timer context. Internally performs necessary 
+*               timer node kept as the timer context. The wheel dispatches the first
+*               timer expired by <now_time>, if any. Internally performs necessary 
 *               rearrangements of the queue, e.g. reschedules periodic timers and manages 
 *               memory agaist mpool, if required.
 *
-* Input -       *tq       - pointer to a timer queue, e.g. heap
+* Input -       *tq       - pointer to a timer queue
 *               *vp_param - void pointer passed parameter
-*               now_time  - current time since epoch in msec
+*               now_time  - current time of the monotonic clock in usec; 
+*                           passed to func_timer () in msec
 *
 * Return Code/Output - On success - 0, on error -1
 ****************************************************************************************/
 int tq_dispatch_nearest_timer (timer_queue*const tq, 
                                void* vp_param, 
-                               unsigned long now_time);
+                               unsigned long long now_time);
 
 
 /****************************************************************************************
@@ -155,7 +192,7 @@ int tq_dispatch_nearest_timer (timer_queue*const tq,
 *
 * Description - Evaluates, whether a timer queue is empty. 
 *
-* Input -       *tq - pointer to a timer queue, e.g. heap
+* Input -       *tq - pointer to a timer queue
 * Return Code/Output - If empty - positive value, if full - 0
 ****************************************************************************************/
 int tq_empty (timer_queue*const tq);
@@ -165,7 +202,7 @@ int tq_empty (timer_queue*const tq);
 *
 * Description -  Returns current size of timer-queue
 *
-* Input -        *tq - pointer to an initialized timer queue, e.g. heap
+* Input -        *tq - pointer to an initialized timer queue
 * Return Code/Output - On Success - zero or positive number, on error - (-1)
 ****************************************************************************************/
 int tq_size (timer_queue*const tq);
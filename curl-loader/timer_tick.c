@@ -0,0 +1,109 @@
+/*
+ *     timer_tick.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Clock service of the loader. Timestamps are taken from CLOCK_MONOTONIC,
+ * which is not stepped by NTP, with microsecond resolution. Each thread 
+ * keeps its cached "now", updated once per event loop iteration, to be 
+ * used by hot paths like libcurl tracing callbacks.
+ */
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "timer_tick.h"
+
+/* "now" of the thread in microseconds; zero, when never updated */
+static __thread unsigned long long tick_cached_usec = 0;
+
+/****************************************************************************************
+* Function name - get_tick_count_usec
+*
+* Description - Delivers timestamp of the monotonic clock in microseconds.
+*
+* Return Code/Output - timestamp in microseconds
+****************************************************************************************/
+unsigned long long get_tick_count_usec ()
+{
+  struct timespec ts;
+
+  if (clock_gettime (CLOCK_MONOTONIC, &ts) == -1)
+    {
+      fprintf(stderr, "%s - clock_gettime () failed with errno %d.\n", 
+              __func__, errno);
+      exit (1);
+    }
+  return (unsigned long long) ts.tv_sec * 1000000ULL + 
+    (unsigned long long) ts.tv_nsec / 1000ULL;
+}
+
+/****************************************************************************************
+* Function name - get_tick_count
+*
+* Description - Delivers timestamp of the monotonic clock in milliseconds.
+*
+* Return Code/Output - timestamp in milliseconds
+****************************************************************************************/
+unsigned long get_tick_count ()
+{
+  return (unsigned long) (get_tick_count_usec () / TICK_USEC_PER_MSEC);
+}
+
+/****************************************************************************************
+* Function name - update_tick_count_cached
+*
+* Description - Takes the monotonic clock to the "now" cached by the calling thread.
+*
+* Return Code/Output - the cached timestamp in milliseconds
+****************************************************************************************/
+unsigned long update_tick_count_cached ()
+{
+  tick_cached_usec = get_tick_count_usec ();
+
+  return (unsigned long) (tick_cached_usec / TICK_USEC_PER_MSEC);
+}
+
+/****************************************************************************************
+* Function name - get_tick_count_cached_usec
+*
+* Description - Delivers "now" cached by the calling thread in microseconds.
+*
+* Return Code/Output - timestamp in microseconds
+****************************************************************************************/
+unsigned long long get_tick_count_cached_usec ()
+{
+  if (! tick_cached_usec)
+    update_tick_count_cached ();
+
+  return tick_cached_usec;
+}
+
+/****************************************************************************************
+* Function name - get_tick_count_cached
+*
+* Description - Delivers "now" cached by the calling thread in milliseconds.
+*
+* Return Code/Output - timestamp in milliseconds
+****************************************************************************************/
+unsigned long get_tick_count_cached ()
+{
+  return (unsigned long) (get_tick_count_cached_usec () / TICK_USEC_PER_MSEC);
+}
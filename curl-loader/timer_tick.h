@@ -23,13 +23,53 @@
 #ifndef TIMER_TICK_H
 #define TIMER_TICK_H
 
+/* Microseconds in a millisecond */
+#define TICK_USEC_PER_MSEC 1000ULL
+
+/****************************************************************************************
+* Function name - get_tick_count_usec
+*
+* Description - Delivers timestamp of the monotonic clock in microseconds.
+*
+* Return Code/Output - timestamp in microseconds
+****************************************************************************************/
+unsigned long long get_tick_count_usec ();
+
 /****************************************************************************************
 * Function name - get_tick_count
 *
-* Description - Delivers timestamp in milliseconds.
+* Description - Delivers timestamp of the monotonic clock in milliseconds.
 *
-* Return Code/Output - timestamp in milliseconds or -1 on errors
+* Return Code/Output - timestamp in milliseconds
 ****************************************************************************************/
 unsigned long get_tick_count ();
 
+/****************************************************************************************
+* Function name - update_tick_count_cached
+*
+* Description - Takes the monotonic clock to the "now" cached by the calling thread.
+*               Called by the loading engines once per event loop iteration.
+*
+* Return Code/Output - the cached timestamp in milliseconds
+****************************************************************************************/
+unsigned long update_tick_count_cached ();
+
+/****************************************************************************************
+* Function name - get_tick_count_cached_usec
+*
+* Description - Delivers "now" cached by the calling thread in microseconds.
+*
+* Return Code/Output - timestamp in microseconds
+****************************************************************************************/
+unsigned long long get_tick_count_cached_usec ();
+
+/****************************************************************************************
+* Function name - get_tick_count_cached
+*
+* Description - Delivers "now" cached by the calling thread in milliseconds.
+*
+* Return Code/Output - timestamp in milliseconds
+****************************************************************************************/
+unsigned long get_tick_count_cached ();
+
 #endif /* TIMER_TICK_H */
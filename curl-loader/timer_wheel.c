@@ -0,0 +1,685 @@
+/*
+*     timer_wheel.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+* Hashed hierarchical timing wheel. Scheduling and cancelling a timer
+* are O(1) list operations, and all timers of a tick are moved to the
+* expired list at once. Timers are dispatched at tick resolution: a timer
+* is never fired before its next_timer, and timers of the same tick are
+* fired in the order of their scheduling.
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "timer_wheel.h"
+#include "timer_node.h"
+#include "cl_alloc.h"
+
+/* Appends node to the tail of a slot or of the expired list */
+static void tw_list_append (timer_wheel*const w, wnode* const node,
+                            int level, int slot);
+
+/* Removes node from the list, keeping it */
+static void tw_list_unlink (timer_wheel*const w, wnode* const node);
+
+/* Places node to the slot by its tick or to the expired list */
+static void tw_insert (timer_wheel*const w, wnode* const node);
+
+/* Moves the timers of a level 0 slot to the expired list */
+static void tw_expire_slot (timer_wheel*const w, int slot);
+
+/* Re-distributes timers of upper levels on entering their slot range */
+static void tw_cascade (timer_wheel*const w);
+
+/* Advances the wheel up to the tick */
+static void tw_advance (timer_wheel*const w, unsigned long long tick);
+
+/* Fetches a free node-id, increasing the ids array, when required */
+static long tw_get_node_id (timer_wheel*const w);
+
+/* Finds the first non-empty slot of a level starting from slot <from> */
+static int tw_slot_used_next (timer_wheel*const w, int level, int from);
+
+
+/****************************************************************************************
+* Function name - tw_init
+*
+* Description - Performs initialization of an allocated timer wheel.
+*
+* Input -       *w - pointer to an allocated wheel
+*               ids_size -  initial number of timer-ids, increased on demand
+*               nodes_prealloc -  number of wnodes to be pre-allocated at initialization
+*               resolution - tick duration in usec
+*               now_time - current time of the monotonic clock in usec
+*
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int tw_init (timer_wheel*const w,
+             size_t ids_size,
+             size_t nodes_prealloc,
+             unsigned long long resolution,
+             unsigned long long now_time)
+{
+  size_t i = 0;
+
+  if (!w || !ids_size || !resolution)
+    {
+      fprintf(stderr, "%s - error: wrong input\n", __func__);
+      return -1;
+    }
+
+  memset ((void*)w, 0, sizeof (*w));
+
+  w->resolution = resolution;
+  w->curr_tick = now_time / resolution;
+
+  if (! (w->ids_arr = calloc (ids_size, sizeof (wnode*))) ||
+      ! (w->ids_free = calloc (ids_size, sizeof (long))))
+    {
+      fprintf(stderr, "%s - error: alloc of nodes-ids arrays failed\n", __func__);
+      return -1;
+    }
+
+  /* Stack of free ids to provide the lowest ids first */
+  for (i = 0; i < ids_size; i++)
+    {
+      w->ids_free[i] = (long) (ids_size - 1 - i);
+    }
+  w->ids_size = w->ids_free_num = ids_size;
+
+  if (!(w->nodes_mpool = cl_calloc (1, sizeof (mpool))))
+    {
+      fprintf(stderr, "%s - error: mpool allocation failed\n", __func__);
+      return -1;
+    }
+
+  if (mpool_init (w->nodes_mpool, sizeof (wnode), nodes_prealloc) == -1)
+    {
+      fprintf(stderr, "%s - error: mpool_init () -  failed\n",  __func__);
+      return -1;
+    }
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - tw_reset
+*
+* Description - De-allocates memory of a wheel, but does not deallocate the wheel itself.
+*
+* Input -       *w - pointer to an initialized wheel
+* Return Code/Output - none
+****************************************************************************************/
+void tw_reset (timer_wheel*const w)
+{
+  if (w->ids_arr)
+    {
+      free (w->ids_arr);
+    }
+  if (w->ids_free)
+    {
+      free (w->ids_free);
+    }
+  if (w->nodes_mpool)
+    {
+      mpool_free (w->nodes_mpool);
+      free (w->nodes_mpool);
+    }
+  memset (w, 0, sizeof (*w));
+}
+
+/****************************************************************************************
+* Function name - tw_schedule
+*
+* Description - Adds a timer node to the wheel at its next_timer
+*
+* Input -       *w - pointer to an initialized wheel
+*               *tnode - pointer to the timer node
+* Return Code/Output - On success - timer-id, on error - (-1)
+****************************************************************************************/
+long tw_schedule (timer_wheel*const w, timer_node* const tnode)
+{
+  wnode* node = 0;
+  long node_id = -1;
+
+  if ((node_id = tw_get_node_id (w)) == -1)
+    {
+      fprintf(stderr, "%s - error: tw_get_node_id () failed\n", __func__);
+      return -1;
+    }
+
+  if (! (node = (wnode *) mpool_take_obj (w->nodes_mpool)))
+    {
+      fprintf (stderr, "%s - error: allocation of a new wnode from pool failed.\n",
+               __func__);
+      w->ids_free[w->ids_free_num++] = node_id;
+      return -1;
+    }
+
+  node->node_id = node_id;
+  node->ctx = tnode;
+
+  tw_reschedule (w, node);
+
+  return node_id;
+}
+
+/****************************************************************************************
+* Function name - tw_reschedule
+*
+* Description - Adds back a node, taken by tw_expired_pop (), keeping its timer-id
+*               (support for periodical timer). The new next_timer should be set.
+*
+* Input -       *w - pointer to an initialized wheel
+*               *node - pointer to the node
+* Return Code/Output - none
+****************************************************************************************/
+void tw_reschedule (timer_wheel*const w, wnode* const node)
+{
+  /* Round up to never fire a timer before its time */
+  node->tick = (node->ctx->next_timer + w->resolution - 1) / w->resolution;
+
+  w->ids_arr[node->node_id] = node;
+
+  tw_insert (w, node);
+}
+
+/****************************************************************************************
+* Function name - tw_cancel
+*
+* Description - Removes a timer from the wheel by its timer-id
+*
+* Input -       *w - pointer to an initialized wheel
+*               timer_id - timer-id returned by tw_schedule ()
+* Return Code/Output - On success - 0, when the timer-id is not scheduled - (-1)
+****************************************************************************************/
+int tw_cancel (timer_wheel*const w, long timer_id)
+{
+  wnode* node = 0;
+
+  if (timer_id < 0 || (size_t) timer_id >= w->ids_size)
+    {
+      fprintf (stderr, "%s - error: wrong input.\n", __func__);
+      return -1;
+    }
+
+  /* Cancelled, expired or being dispatched */
+  if (! (node = w->ids_arr[timer_id]))
+    return -1;
+
+  tw_list_unlink (w, node);
+  tw_release_node (w, node);
+
+  return 0;
+}
+
+/****************************************************************************************
+* Function name - tw_nearest_time
+*
+* Description - Returns the time of the nearest tick with timers to dispatch. For
+*               timers far away at upper levels returns the start of their slot,
+*               where they are cascaded, which may be earlier.
+*
+* Input -       *w - pointer to an initialized wheel
+* Return Code/Output - Time in usec or ULLONG_MAX, when the wheel is empty
+****************************************************************************************/
+unsigned long long tw_nearest_time (timer_wheel*const w)
+{
+  const unsigned long long curr = w->curr_tick;
+  unsigned long long nearest = ULLONG_MAX, tick = 0;
+  int level = 0, curr_slot = 0, slot = 0, distance = 0;
+
+  /* Expired timers are due by the time of the wheel */
+  if (w->expired.head)
+    {
+      tick = w->curr_tick * w->resolution;
+      return w->expired.head->ctx->next_timer < tick ? 
+        w->expired.head->ctx->next_timer : tick;
+    }
+
+  if (! w->slots_nodes_num)
+    return ULLONG_MAX;
+
+  /* Ticks till the end of the current level 0 range are exact */
+  curr_slot = (int) (curr & TW_SLOT_MASK);
+
+  if (curr_slot < TW_SLOT_MASK &&
+      (slot = tw_slot_used_next (w, 0, curr_slot + 1)) >= 0)
+    {
+      return ((curr & ~((unsigned long long) TW_SLOT_MASK)) + slot) * w->resolution;
+    }
+
+  /* Level 0 slots below the current keep the ticks of the next range */
+  if ((slot = tw_slot_used_next (w, 0, 0)) >= 0)
+    {
+      nearest = (curr & ~((unsigned long long) TW_SLOT_MASK)) + TW_SLOTS + slot;
+    }
+
+  for (level = 1; level < TW_LEVELS; level++)
+    {
+      const int shift = level * TW_SLOT_BITS;
+
+      curr_slot = (int) ((curr >> shift) & TW_SLOT_MASK);
+
+      /* Search the slots after the current one with a wrap-around */
+      slot = curr_slot < TW_SLOT_MASK ?
+        tw_slot_used_next (w, level, curr_slot + 1) : -1;
+
+      if (slot < 0 && (slot = tw_slot_used_next (w, level, 0)) < 0)
+        continue;
+
+      distance = (slot - curr_slot) & TW_SLOT_MASK;
+      if (!distance)
+        distance = TW_SLOTS;
+
+      tick = ((curr >> shift) + distance) << shift;
+
+      if (tick < nearest)
+        nearest = tick;
+    }
+
+  return nearest == ULLONG_MAX ? ULLONG_MAX : nearest * w->resolution;
+}
+
+/****************************************************************************************
+* Function name - tw_expired_pop
+*
+* Description - Advances the wheel to <now_time>, moving whole slots of the passed
+*               ticks to the expired list, and takes out the first expired node.
+*               Timer-id of the node remains reserved till tw_release_node () or
+*               tw_reschedule ().
+*
+* Input -       *w - pointer to an initialized wheel
+*               now_time - current time of the monotonic clock in usec
+* Return Code/Output - Pointer to the node or NULL, when nothing is expired
+****************************************************************************************/
+wnode* tw_expired_pop (timer_wheel*const w, unsigned long long now_time)
+{
+  wnode* node = 0;
+
+  tw_advance (w, now_time / w->resolution);
+
+  if (! (node = w->expired.head))
+    return 0;
+
+  tw_list_unlink (w, node);
+  w->ids_arr[node->node_id] = 0;
+
+  return node;
+}
+
+/****************************************************************************************
+* Function name - tw_release_node
+*
+* Description - Frees timer-id of a node taken out by tw_expired_pop () and
+*               returns the node to the pool
+*
+* Input -       *w - pointer to an initialized wheel
+*               *node - pointer to the node
+* Return Code/Output - none
+****************************************************************************************/
+void tw_release_node (timer_wheel*const w, wnode* const node)
+{
+  w->ids_arr[node->node_id] = 0;
+  w->ids_free[w->ids_free_num++] = node->node_id;
+
+  memset (&node->next, 0, sizeof (*node) - offsetof (wnode, next));
+  node->alloc.link.next = 0;
+
+  mpool_return_obj (w->nodes_mpool, (allocatable *) node);
+}
+
+/****************************************************************************************
+* Function name - tw_size
+*
+* Description -  Returns number of timers in a wheel
+*
+* Input -        *w - pointer to an initialized wheel
+* Return Code/Output - Number of timers
+****************************************************************************************/
+size_t tw_size (timer_wheel*const w)
+{
+  return w->slots_nodes_num + w->expired_nodes_num;
+}
+
+/****************************************************************************************
+* Function name - tw_insert
+*
+* Description - Places node to the slot by its tick or, when the tick has already
+*               passed, to the expired list. A level is chosen by the distance
+*               to the tick, and the slot - by the tick bits of the level.
+*
+* Input -       *w - pointer to an initialized wheel
+*               *node - pointer to the node with the tick set
+* Return Code/Output - none
+****************************************************************************************/
+static void tw_insert (timer_wheel*const w, wnode* const node)
+{
+  unsigned long long tick = node->tick;
+  unsigned long long delta = 0;
+  int level = 0;
+
+  if (tick <= w->curr_tick)
+    {
+      tw_list_append (w, node, -1, 0);
+      return;
+    }
+
+  delta = tick - w->curr_tick;
+
+  while (level < TW_LEVELS - 1 &&
+         delta >= (1ULL << ((level + 1) * TW_SLOT_BITS)))
+    {
+      level++;
+    }
+
+  /* Beyond the wheel range: park at the farthest slot to be cascaded again */
+  if (delta >= (1ULL << (TW_LEVELS * TW_SLOT_BITS)))
+    {
+      tick = w->curr_tick + (1ULL << (TW_LEVELS * TW_SLOT_BITS)) - 1;
+    }
+
+  tw_list_append (w, node, level,
+                  (int) ((tick >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK));
+}
+
+/****************************************************************************************
+* Function name - tw_advance
+*
+* Description - Advances the wheel up to the tick. Jumps over empty ticks, using the
+*               bitmaps of used slots, and stops at the range boundaries of level 0
+*               to cascade timers from the upper levels.
+*
+* Input -       *w - pointer to an initialized wheel
+*               tick - tick to advance to
+* Return Code/Output - none
+****************************************************************************************/
+static void tw_advance (timer_wheel*const w, unsigned long long tick)
+{
+  unsigned long long next = 0, target = 0;
+  int slot = 0;
+
+  while (w->curr_tick < tick)
+    {
+      if (! w->slots_nodes_num)
+        {
+          w->curr_tick = tick;
+          break;
+        }
+
+      next = w->curr_tick + 1;
+
+      if (! (next & TW_SLOT_MASK))
+        {
+          w->curr_tick = next;
+          tw_cascade (w);
+          tw_expire_slot (w, 0);
+          continue;
+        }
+
+      slot = tw_slot_used_next (w, 0, (int) (next & TW_SLOT_MASK));
+
+      target = slot < 0 ? (next | TW_SLOT_MASK) :
+        (next & ~((unsigned long long) TW_SLOT_MASK)) + slot;
+
+      if (target > tick)
+        {
+          w->curr_tick = tick;
+          break;
+        }
+
+      w->curr_tick = target;
+
+      if (slot >= 0)
+        tw_expire_slot (w, slot);
+    }
+}
+
+/****************************************************************************************
+* Function name - tw_cascade
+*
+* Description - On entering a new level 0 range re-distributes the timers of the
+*               upper level slots, which ranges start at the current tick.
+*
+* Input -       *w - pointer to an initialized wheel
+* Return Code/Output - none
+****************************************************************************************/
+static void tw_cascade (timer_wheel*const w)
+{
+  int level = 1, slot = 0;
+  wnode* node = 0, *next = 0;
+
+  /* Find the highest level, which slot range starts at the tick */
+  while (level < TW_LEVELS - 1 &&
+         ! (w->curr_tick & ((1ULL << ((level + 1) * TW_SLOT_BITS)) - 1)))
+    {
+      level++;
+    }
+
+  for (; level > 0; level--)
+    {
+      slot = (int) ((w->curr_tick >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK);
+
+      node = w->slots[level][slot].head;
+
+      w->slots[level][slot].head = w->slots[level][slot].tail = 0;
+      w->slots_used[level][slot / 64] &= ~(1ULL << (slot % 64));
+
+      for (; node; node = next)
+        {
+          next = node->next;
+          w->slots_nodes_num--;
+          tw_insert (w, node);
+        }
+    }
+}
+
+/****************************************************************************************
+* Function name - tw_expire_slot
+*
+* Description - Moves all timers of a level 0 slot to the tail of the expired list
+*
+* Input -       *w - pointer to an initialized wheel
+*               slot - index of the slot
+* Return Code/Output - none
+****************************************************************************************/
+static void tw_expire_slot (timer_wheel*const w, int slot)
+{
+  tw_list* list = &w->slots[0][slot];
+  wnode* node = 0;
+  size_t num = 0;
+
+  if (! list->head)
+    return;
+
+  for (node = list->head; node; node = node->next)
+    {
+      node->level = -1;
+      num++;
+    }
+
+  if (w->expired.tail)
+    {
+      w->expired.tail->next = list->head;
+      list->head->prev = w->expired.tail;
+    }
+  else
+    {
+      w->expired.head = list->head;
+    }
+  w->expired.tail = list->tail;
+
+  list->head = list->tail = 0;
+  w->slots_used[0][slot / 64] &= ~(1ULL << (slot % 64));
+
+  w->slots_nodes_num -= num;
+  w->expired_nodes_num += num;
+}
+
+/****************************************************************************************
+* Function name - tw_list_append
+*
+* Description - Appends node to the tail of a slot or of the expired list
+*
+* Input -       *w - pointer to an initialized wheel
+*               *node - pointer to the node
+*               level - level of the slot or -1 for the expired list
+*               slot - index of the slot
+* Return Code/Output - none
+****************************************************************************************/
+static void tw_list_append (timer_wheel*const w, wnode* const node,
+                            int level, int slot)
+{
+  tw_list* list = level < 0 ? &w->expired : &w->slots[level][slot];
+
+  node->level = (short) level;
+  node->slot = (short) slot;
+  node->next = 0;
+  node->prev = list->tail;
+
+  if (list->tail)
+    list->tail->next = node;
+  else
+    list->head = node;
+
+  list->tail = node;
+
+  if (level < 0)
+    {
+      w->expired_nodes_num++;
+    }
+  else
+    {
+      w->slots_used[level][slot / 64] |= 1ULL << (slot % 64);
+      w->slots_nodes_num++;
+    }
+}
+
+/****************************************************************************************
+* Function name - tw_list_unlink
+*
+* Description - Removes node from its slot or from the expired list
+*
+* Input -       *w - pointer to an initialized wheel
+*               *node - pointer to the node
+* Return Code/Output - none
+****************************************************************************************/
+static void tw_list_unlink (timer_wheel*const w, wnode* const node)
+{
+  tw_list* list = node->level < 0 ? &w->expired :
+    &w->slots[node->level][node->slot];
+
+  if (node->prev)
+    node->prev->next = node->next;
+  else
+    list->head = node->next;
+
+  if (node->next)
+    node->next->prev = node->prev;
+  else
+    list->tail = node->prev;
+
+  node->next = node->prev = 0;
+
+  if (node->level < 0)
+    {
+      w->expired_nodes_num--;
+    }
+  else
+    {
+      if (! list->head)
+        w->slots_used[node->level][node->slot / 64] &= ~(1ULL << (node->slot % 64));
+      w->slots_nodes_num--;
+    }
+}
+
+/****************************************************************************************
+* Function name - tw_get_node_id
+*
+* Description - Provides a free node-id. When all ids are in use, doubles the ids array.
+*
+* Input -       *w - pointer to an initialized wheel
+* Return Code/Output - On success - node-id, on error - (-1)
+****************************************************************************************/
+static long tw_get_node_id (timer_wheel*const w)
+{
+  size_t new_size = 0, i = 0;
+  wnode** new_ids = 0;
+  long* new_free = 0;
+
+  if (! w->ids_free_num)
+    {
+      new_size = 2 * w->ids_size;
+
+      if (! (new_ids = realloc (w->ids_arr, new_size * sizeof (wnode*))))
+        {
+          fprintf(stderr, "%s - error: realloc of the nodes-ids array failed\n", __func__);
+          return -1;
+        }
+      w->ids_arr = new_ids;
+      memset (w->ids_arr + w->ids_size, 0, (new_size - w->ids_size) * sizeof (wnode*));
+
+      if (! (new_free = realloc (w->ids_free, new_size * sizeof (long))))
+        {
+          fprintf(stderr, "%s - error: realloc of the free ids array failed\n", __func__);
+          return -1;
+        }
+      w->ids_free = new_free;
+
+      for (i = 0; i < new_size - w->ids_size; i++)
+        {
+          w->ids_free[i] = (long) (new_size - 1 - i);
+        }
+      w->ids_free_num = new_size - w->ids_size;
+      w->ids_size = new_size;
+    }
+
+  return w->ids_free[--w->ids_free_num];
+}
+
+/****************************************************************************************
+* Function name - tw_slot_used_next
+*
+* Description - Finds the first non-empty slot of a level starting from the slot
+*               <from> and up to the last slot, without a wrap-around.
+*
+* Input -       *w - pointer to an initialized wheel
+*               level - level of the wheel
+*               from - slot to start from
+* Return Code/Output - Index of the slot or -1, when all the slots are empty
+****************************************************************************************/
+static int tw_slot_used_next (timer_wheel*const w, int level, int from)
+{
+  int word = from / 64;
+  unsigned long long bits = w->slots_used[level][word] & (~0ULL << (from % 64));
+
+  for (;;)
+    {
+      if (bits)
+        return word * 64 + __builtin_ctzll (bits);
+
+      if (++word == TW_BITMAP_WORDS)
+        return -1;
+
+      bits = w->slots_used[level][word];
+    }
+}
@@ -0,0 +1,227 @@
+/*
+*     timer_wheel.h
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+
+#include "mpool.h"
+
+/*
+  Hashed hierarchical timing wheel. Level 0 keeps a slot per tick,
+  each slot of level N covers TW_SLOTS^N ticks. Timers of a level N slot
+  are cascaded to the lower levels, when the wheel enters the slot range.
+  With 4 levels of 256 slots and 1 msec ticks the wheel covers 49 days.
+*/
+#define TW_LEVELS 4
+#define TW_SLOT_BITS 8
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_SLOT_MASK (TW_SLOTS - 1)
+#define TW_BITMAP_WORDS (TW_SLOTS / 64)
+
+struct timer_node;
+
+/*
+  wnode - is the housekeeping node of the wheel, linked to a wheel slot
+  or to the list of expired timers.
+*/
+typedef struct wnode
+{
+  /* Base for the "allocatable" property. */
+  allocatable alloc;
+
+  struct wnode* next;
+  struct wnode* prev;
+
+  /* Tick of the expiration: next_timer of the timer node rounded up */
+  unsigned long long tick;
+
+  /* The unique id of the node, the timer-id */
+  long node_id;
+
+  /* Level and slot of the list keeping the node; level -1 - expired list */
+  short level;
+  short slot;
+
+  /* Timer node of the user */
+  struct timer_node* ctx;
+
+} wnode;
+
+typedef struct tw_list
+{
+  wnode* head;
+  wnode* tail;
+} tw_list;
+
+typedef struct timer_wheel
+{
+  /* Tick duration in usec */
+  unsigned long long resolution;
+
+  /* The last tick, up to which the wheel has been advanced */
+  unsigned long long curr_tick;
+
+  /* Slots of the levels */
+  tw_list slots[TW_LEVELS][TW_SLOTS];
+
+  /* Bitmaps of non-empty slots, to skip empty ticks fast */
+  unsigned long long slots_used[TW_LEVELS][TW_BITMAP_WORDS];
+
+  /* Expired timers, waiting to be dispatched */
+  tw_list expired;
+
+  /* Number of timers in the slots, not counting the expired */
+  size_t slots_nodes_num;
+
+  /* Number of the expired timers */
+  size_t expired_nodes_num;
+
+  /*
+     Mapping of node-ids to the nodes. NULL for a free id and for an id,
+     reserved by a node taken out for dispatching.
+  */
+  wnode** ids_arr;
+
+  /* Size of the <ids_arr> */
+  size_t ids_size;
+
+  /* Stack of free node-ids */
+  long* ids_free;
+  size_t ids_free_num;
+
+  /* Memory pool of wnodes */
+  struct mpool* nodes_mpool;
+
+} timer_wheel;
+
+
+/****************************************************************************************
+* Function name - tw_init
+*
+* Description - Performs initialization of an allocated timer wheel.
+*
+* Input -       *w - pointer to an allocated wheel
+*               ids_size -  initial number of timer-ids, increased on demand
+*               nodes_prealloc -  number of wnodes to be pre-allocated at initialization
+*               resolution - tick duration in usec
+*               now_time - current time of the monotonic clock in usec
+*
+* Return Code/Output - On success - 0, on error -1
+****************************************************************************************/
+int tw_init (timer_wheel*const w,
+             size_t ids_size,
+             size_t nodes_prealloc,
+             unsigned long long resolution,
+             unsigned long long now_time);
+
+/****************************************************************************************
+* Function name - tw_reset
+*
+* Description - De-allocates memory of a wheel, but does not deallocate the wheel itself.
+*
+* Input -       *w - pointer to an initialized wheel
+* Return Code/Output - none
+****************************************************************************************/
+void tw_reset (timer_wheel*const w);
+
+/****************************************************************************************
+* Function name - tw_schedule
+*
+* Description - Adds a timer node to the wheel at its next_timer
+*
+* Input -       *w - pointer to an initialized wheel
+*               *tnode - pointer to the timer node
+* Return Code/Output - On success - timer-id, on error - (-1)
+****************************************************************************************/
+long tw_schedule (timer_wheel*const w, struct timer_node* const tnode);
+
+/****************************************************************************************
+* Function name - tw_reschedule
+*
+* Description - Adds back a node, taken by tw_expired_pop (), keeping its timer-id
+*               (support for periodical timer). The new next_timer should be set.
+*
+* Input -       *w - pointer to an initialized wheel
+*               *node - pointer to the node
+* Return Code/Output - none
+****************************************************************************************/
+void tw_reschedule (timer_wheel*const w, wnode* const node);
+
+/****************************************************************************************
+* Function name - tw_cancel
+*
+* Description - Removes a timer from the wheel by its timer-id
+*
+* Input -       *w - pointer to an initialized wheel
+*               timer_id - timer-id returned by tw_schedule ()
+* Return Code/Output - On success - 0, when the timer-id is not scheduled - (-1)
+****************************************************************************************/
+int tw_cancel (timer_wheel*const w, long timer_id);
+
+/****************************************************************************************
+* Function name - tw_nearest_time
+*
+* Description - Returns the time of the nearest tick with timers to dispatch, or
+*               "now" of the wheel, when there are expired timers. For
+*               timers far away at upper levels returns the start of their slot,
+*               where they are cascaded, which may be earlier.
+*
+* Input -       *w - pointer to an initialized wheel
+* Return Code/Output - Time in usec or ULLONG_MAX, when the wheel is empty
+****************************************************************************************/
+unsigned long long tw_nearest_time (timer_wheel*const w);
+
+/****************************************************************************************
+* Function name - tw_expired_pop
+*
+* Description - Advances the wheel to <now_time>, moving whole slots of the passed
+*               ticks to the expired list, and takes out the first expired node.
+*               Timer-id of the node remains reserved till tw_release_node () or
+*               tw_reschedule ().
+*
+* Input -       *w - pointer to an initialized wheel
+*               now_time - current time of the monotonic clock in usec
+* Return Code/Output - Pointer to the node or NULL, when nothing is expired
+****************************************************************************************/
+wnode* tw_expired_pop (timer_wheel*const w, unsigned long long now_time);
+
+/****************************************************************************************
+* Function name - tw_release_node
+*
+* Description - Frees timer-id of a node taken out by tw_expired_pop () and
+*               returns the node to the pool
+*
+* Input -       *w - pointer to an initialized wheel
+*               *node - pointer to the node
+* Return Code/Output - none
+****************************************************************************************/
+void tw_release_node (timer_wheel*const w, wnode* const node);
+
+/****************************************************************************************
+* Function name - tw_size
+*
+* Description -  Returns number of timers in a wheel
+*
+* Input -        *w - pointer to an initialized wheel
+* Return Code/Output - Number of timers
+****************************************************************************************/
+size_t tw_size (timer_wheel*const w);
+
+#endif /* TIMER_WHEEL_H */
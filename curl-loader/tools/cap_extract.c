@@ -0,0 +1,387 @@
+/*
+*     cap_extract.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+* Extractor of the responses, captured by curl-loader to the segment files
+* <batch-name>.<segment-num>.cap with the index <batch-name>.cidx, when
+* LOG_RESP_SEGMENT_SIZE tag is configured. The segments are looked for
+* in the directory of the index. A response is the concatenation of the
+* pieces of the same client, cycle, url and kind in the index order.
+*
+* Build: make cap_extract
+* Usage: tools/cap_extract [-c client] [-y cycle] [-u url] [-k h|b]
+*                          [-p | -x dir] <batch-name>.cidx
+*        without -p and -x lists the responses: client, cycle, url, kind,
+*        bytes and pieces
+*        -c, -y, -u, -k - select responses of a client, cycle, url and
+*                         headers or bodies
+*        -p - prints the selected responses to stdout
+*        -x - extracts the selected responses to the files
+*             dir/url<url>/cl-<client>-cycle-<cycle>.hdr|body, as they are
+*             logged without segmented capture
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "resp_capture.h"
+
+#define CAP_EXTRACT_USAGE \
+  "usage: %s [-c client] [-y cycle] [-u url] [-k h|b] [-p | -x dir] <batch-name>.cidx\n"
+
+typedef struct extract_context
+{
+  const rcap_header* header;
+  const rcap_entry* entries;
+  size_t entries_num;
+
+  /* Directory of the index with the segments */
+  char dir[1024];
+
+  /* The mapped segments, mapped on demand */
+  const char** segments;
+  size_t* segment_sizes;
+  unsigned int segments_num;
+
+  /* Selection, -1 - any */
+  long client;
+  long cycle;
+  long url;
+  int kind;
+
+  int print;
+  const char* extract_dir;
+} extract_context;
+
+/* Entries sorted by the response and then by the index order */
+static const rcap_entry* sort_entries;
+
+static int entry_cmp (const void* a, const void* b)
+{
+  const rcap_entry* l = &sort_entries[*(const size_t *) a];
+  const rcap_entry* r = &sort_entries[*(const size_t *) b];
+
+  if (l->url != r->url)
+    return l->url < r->url ? -1 : 1;
+  if (l->client != r->client)
+    return l->client < r->client ? -1 : 1;
+  if (l->cycle != r->cycle)
+    return l->cycle < r->cycle ? -1 : 1;
+  if (l->kind != r->kind)
+    return l->kind < r->kind ? -1 : 1;
+
+  return *(const size_t *) a < *(const size_t *) b ? -1 : 1;
+}
+
+static int same_response (const rcap_entry* l, const rcap_entry* r)
+{
+  return l->url == r->url && l->client == r->client &&
+    l->cycle == r->cycle && l->kind == r->kind;
+}
+
+static int selected (const extract_context* ec, const rcap_entry* e)
+{
+  return (ec->client < 0 || (unsigned long) ec->client == e->client) &&
+    (ec->cycle < 0 || (unsigned long) ec->cycle == e->cycle) &&
+    (ec->url < 0 || (unsigned long) ec->url == e->url) &&
+    (! ec->kind || ec->kind == e->kind);
+}
+
+/* Returns the data of an entry, mapping its segment, when first used */
+static const char* entry_data (extract_context* ec, const rcap_entry* e)
+{
+  char path[2048];
+  struct stat st;
+  void* map;
+  int fd;
+
+  if (e->segment >= ec->segments_num)
+    {
+      const unsigned int num = e->segment + 1;
+      const char** segments = realloc (ec->segments, num * sizeof (*segments));
+      size_t* sizes = realloc (ec->segment_sizes, num * sizeof (*sizes));
+
+      if (segments)
+        ec->segments = segments;
+      if (sizes)
+        ec->segment_sizes = sizes;
+      if (! segments || ! sizes)
+        return NULL;
+
+      memset (ec->segments + ec->segments_num, 0,
+              (num - ec->segments_num) * sizeof (*segments));
+      memset (ec->segment_sizes + ec->segments_num, 0,
+              (num - ec->segments_num) * sizeof (*sizes));
+      ec->segments_num = num;
+    }
+
+  if (! ec->segments[e->segment])
+    {
+      snprintf (path, sizeof (path), "%s%s.%04u.cap", ec->dir,
+                ec->header->batch_name, e->segment);
+
+      if ((fd = open (path, O_RDONLY)) == -1 || fstat (fd, &st) == -1)
+        {
+          fprintf (stderr, "%s - error: failed to open %s, errno %d.\n",
+                   __func__, path, errno);
+          if (fd != -1)
+            close (fd);
+          return NULL;
+        }
+
+      map = st.st_size ?
+        mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+      close (fd);
+
+      if (map == MAP_FAILED)
+        {
+          fprintf (stderr, "%s - error: failed to map %s.\n", __func__, path);
+          return NULL;
+        }
+
+      ec->segments[e->segment] = map;
+      ec->segment_sizes[e->segment] = st.st_size;
+    }
+
+  if (e->offset + e->length > ec->segment_sizes[e->segment])
+    {
+      fprintf (stderr, "%s - error: segment %u is truncated.\n", __func__, e->segment);
+      return NULL;
+    }
+
+  return ec->segments[e->segment] + e->offset;
+}
+
+static int mkdir_url (const char* dir, unsigned int url)
+{
+  char path[2048];
+
+  if (mkdir (dir, 0755) == -1 && errno != EEXIST)
+    return -1;
+
+  snprintf (path, sizeof (path), "%s/url%u", dir, url);
+
+  if (mkdir (path, 0755) == -1 && errno != EEXIST)
+    return -1;
+
+  return 0;
+}
+
+/* Lists, prints or extracts a response of the sorted entries from first to last */
+static int response_output (extract_context* ec,
+                            const size_t* order,
+                            size_t first,
+                            size_t last)
+{
+  const rcap_entry* e = &ec->entries[order[first]];
+  unsigned long long bytes = 0;
+  FILE* out = stdout;
+  char path[2048];
+  size_t i;
+
+  if (! ec->print && ! ec->extract_dir)
+    {
+      for (i = first; i <= last; i++)
+        bytes += ec->entries[order[i]].length;
+
+      printf ("%u,%u,%u,%s,%llu,%lu\n", e->client, e->cycle, e->url,
+              e->kind == RESP_CAPTURE_HEADERS ? "hdr" : "body", bytes,
+              (unsigned long) (last - first + 1));
+      return 0;
+    }
+
+  if (ec->extract_dir)
+    {
+      snprintf (path, sizeof (path), "%s/url%u/cl-%u-cycle-%u.%s",
+                ec->extract_dir, e->url, e->client, e->cycle,
+                e->kind == RESP_CAPTURE_HEADERS ? "hdr" : "body");
+
+      if (mkdir_url (ec->extract_dir, e->url) == -1 || ! (out = fopen (path, "w")))
+        {
+          fprintf (stderr, "%s - error: failed to create %s, errno %d.\n",
+                   __func__, path, errno);
+          return -1;
+        }
+    }
+
+  for (i = first; i <= last; i++)
+    {
+      const rcap_entry* p = &ec->entries[order[i]];
+      const char* data = entry_data (ec, p);
+
+      if (! data)
+        {
+          if (out != stdout)
+            fclose (out);
+          return -1;
+        }
+
+      fwrite (data, 1, p->length, out);
+    }
+
+  if (out != stdout)
+    fclose (out);
+
+  return 0;
+}
+
+static int header_check (const rcap_header* h, size_t file_size)
+{
+  if (file_size < sizeof (rcap_header) ||
+      memcmp (h->magic, RESP_CAPTURE_MAGIC, RESP_CAPTURE_MAGIC_SIZE))
+    {
+      fprintf (stderr, "%s - error: not a capture index file.\n", __func__);
+      return -1;
+    }
+
+  if (h->version != RESP_CAPTURE_VERSION || h->entry_size != sizeof (rcap_entry))
+    {
+      fprintf (stderr, "%s - error: unsupported version %u of the index.\n",
+               __func__, h->version);
+      return -1;
+    }
+
+  return 0;
+}
+
+int main (int argc, char *argv [])
+{
+  extract_context ec;
+  struct stat st;
+  void* map = 0;
+  size_t* order = 0;
+  size_t i, n, first;
+  const char* slash;
+  int rget_opt = 0, fd = -1, rval = 1;
+
+  memset (&ec, 0, sizeof (ec));
+  ec.client = ec.cycle = ec.url = -1;
+
+  while ((rget_opt = getopt (argc, argv, "c:y:u:k:px:")) != EOF)
+    {
+      switch (rget_opt)
+        {
+        case 'c':
+          ec.client = atol (optarg);
+          break;
+        case 'y':
+          ec.cycle = atol (optarg);
+          break;
+        case 'u':
+          ec.url = atol (optarg);
+          break;
+        case 'k':
+          ec.kind = optarg[0] == 'h' ? RESP_CAPTURE_HEADERS : RESP_CAPTURE_BODY;
+          break;
+        case 'p':
+          ec.print = 1;
+          break;
+        case 'x':
+          ec.extract_dir = optarg;
+          break;
+        default:
+          fprintf (stderr, CAP_EXTRACT_USAGE, argv[0]);
+          return 1;
+        }
+    }
+
+  if (optind != argc - 1 || (ec.print && ec.extract_dir))
+    {
+      fprintf (stderr, CAP_EXTRACT_USAGE, argv[0]);
+      return 1;
+    }
+
+  if ((slash = strrchr (argv[optind], '/')))
+    snprintf (ec.dir, sizeof (ec.dir), "%.*s/", (int) (slash - argv[optind]),
+              argv[optind]);
+
+  if ((fd = open (argv[optind], O_RDONLY)) == -1 || fstat (fd, &st) == -1)
+    {
+      fprintf (stderr, "%s - error: failed to open %s, errno %d.\n",
+               __func__, argv[optind], errno);
+      return 1;
+    }
+
+  if (! st.st_size ||
+      (map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+      fprintf (stderr, "%s - error: failed to map %s.\n", __func__, argv[optind]);
+      close (fd);
+      return 1;
+    }
+
+  ec.header = (const rcap_header *) map;
+
+  if (header_check (ec.header, st.st_size) == -1)
+    goto cleanup;
+
+  ec.entries = (const rcap_entry *) ((const char *) map + sizeof (rcap_header));
+  ec.entries_num = (st.st_size - sizeof (rcap_header)) / sizeof (rcap_entry);
+
+  if (! (order = calloc (ec.entries_num + 1, sizeof (*order))))
+    {
+      fprintf (stderr, "%s - error: calloc () failed.\n", __func__);
+      goto cleanup;
+    }
+
+  for (i = 0, n = 0; i < ec.entries_num; i++)
+    {
+      if (selected (&ec, &ec.entries[i]))
+        order[n++] = i;
+    }
+
+  sort_entries = ec.entries;
+  qsort (order, n, sizeof (*order), entry_cmp);
+
+  if (! ec.print && ! ec.extract_dir)
+    printf ("client,cycle,url,kind,bytes,pieces\n");
+
+  for (i = 0, first = 0; i < n; i++)
+    {
+      if (i + 1 < n &&
+          same_response (&ec.entries[order[i]], &ec.entries[order[i + 1]]))
+        continue;
+
+      if (response_output (&ec, order, first, i) == -1)
+        goto cleanup;
+
+      first = i + 1;
+    }
+
+  rval = 0;
+
+ cleanup:
+  for (i = 0; i < ec.segments_num; i++)
+    {
+      if (ec.segments[i])
+        munmap ((void *) ec.segments[i], ec.segment_sizes[i]);
+    }
+  free (ec.segments);
+  free (ec.segment_sizes);
+  free (order);
+  munmap (map, st.st_size);
+  close (fd);
+  return rval;
+}
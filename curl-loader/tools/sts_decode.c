@@ -0,0 +1,453 @@
+/*
+*     sts_decode.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+* Decoder of the binary statistics stream <batch-name>.sts, written by
+* curl-loader with the command-line option -b. Outputs to stdout the
+* records of the ring from the oldest to the latest as intervals - the
+* differences of adjacent records - or, with -c, as counters since the
+* load start. When the ring has wrapped, the oldest record is used only
+* as the base of the next interval. The stream may be decoded, while
+* curl-loader is still writing it.
+*
+* Build: make sts_decode
+* Usage: tools/sts_decode [-c] [-j] [-u] <batch-name>.sts
+*        -c - counters since the load start instead of intervals
+*        -j - JSON, an object per record in a line, instead of CSV
+*        -u - CSV of the urls operational statistics instead of the loading one
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stats_stream.h"
+
+static const char* phase_names[PHASE_NUM] =
+  {"dns", "conn", "tls", "ttfb", "xfer", "redir", "total"};
+
+static const char* class_names[OP_STAT_RESP_CLASSES] =
+  {"1xx", "2xx", "3xx", "4xx", "5xx"};
+
+/* Delay percentiles, the last is the maximum */
+static const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 100.0};
+static const char* percentile_names[] = {"p50", "p90", "p99", "p999", "max"};
+#define PERCENTILES_NUM (sizeof (percentiles) / sizeof (percentiles[0]))
+
+typedef struct decode_context
+{
+  const sts_header* header;
+  const char* ring;
+
+  int cumulative;
+  int json;
+  int urls;
+} decode_context;
+
+static double usec_to_msec (unsigned long long usec)
+{
+  return usec / 1000.0;
+}
+
+static double avg_msec (unsigned long long sum, unsigned long long points)
+{
+  return points ? usec_to_msec (sum / points) : 0.0;
+}
+
+static const char* url_name (const decode_context* dc, unsigned int i)
+{
+  return (const char *) dc->header + sizeof (sts_header) +
+    i * STATS_STREAM_URL_NAME_SIZE;
+}
+
+static const sts_record* record_get (const decode_context* dc, unsigned long long n)
+{
+  return (const sts_record *) (dc->ring +
+    (n % dc->header->records_num) * dc->header->record_size);
+}
+
+/* Counters of a record less counters of an earlier record, if any */
+static void proto_interval (sts_proto* p, const sts_proto* prev)
+{
+  int i;
+
+  if (! prev)
+    return;
+
+  p->requests -= prev->requests;
+  p->resp_1xx -= prev->resp_1xx;
+  p->resp_2xx -= prev->resp_2xx;
+  p->resp_3xx -= prev->resp_3xx;
+  p->resp_4xx -= prev->resp_4xx;
+  p->resp_5xx -= prev->resp_5xx;
+  p->other_errs -= prev->other_errs;
+  p->url_timeout_errs -= prev->url_timeout_errs;
+  p->data_in -= prev->data_in;
+  p->data_out -= prev->data_out;
+  p->appl_delay_points -= prev->appl_delay_points;
+  p->appl_delay_sum -= prev->appl_delay_sum;
+  p->appl_delay_2xx_points -= prev->appl_delay_2xx_points;
+  p->appl_delay_2xx_sum -= prev->appl_delay_2xx_sum;
+  p->phase_points -= prev->phase_points;
+
+  for (i = 0; i < PHASE_NUM; i++)
+    {
+      p->phase_sum[i] -= prev->phase_sum[i];
+    }
+
+  hdr_hist_small_sub (&p->appl_delay, &prev->appl_delay);
+}
+
+static void url_interval (sts_url* u, const sts_url* prev)
+{
+  int i;
+
+  if (! prev)
+    return;
+
+  u->ok -= prev->ok;
+  u->failed -= prev->failed;
+  u->timeouted -= prev->timeouted;
+
+  for (i = 0; i < OP_STAT_RESP_CLASSES; i++)
+    {
+      u->resp_class[i] -= prev->resp_class[i];
+    }
+
+  hdr_hist_small_sub (&u->delay, &prev->delay);
+}
+
+static void print_csv_header (const decode_context* dc)
+{
+  size_t i;
+
+  if (dc->urls)
+    {
+      fprintf (stdout, "time_ms,interval_ms,url,name,ok,failed,timeouted");
+      for (i = 0; i < OP_STAT_RESP_CLASSES; i++)
+        fprintf (stdout, ",%s", class_names[i]);
+      for (i = 0; i < PERCENTILES_NUM; i++)
+        fprintf (stdout, ",t_%s_ms", percentile_names[i]);
+      fprintf (stdout, "\n");
+      return;
+    }
+
+  fprintf (stdout, "time_ms,interval_ms,clients,calls,appl,requests,"
+           "1xx,2xx,3xx,4xx,5xx,errs,t_errs,data_in,data_out,d_avg_ms,d_2xx_avg_ms");
+  for (i = 0; i < PERCENTILES_NUM; i++)
+    fprintf (stdout, ",d_%s_ms", percentile_names[i]);
+  for (i = 0; i < PHASE_NUM; i++)
+    fprintf (stdout, ",%s_ms", phase_names[i]);
+  fprintf (stdout, "\n");
+}
+
+static void print_proto (const decode_context* dc,
+                         const sts_record* rec,
+                         unsigned long long interval,
+                         unsigned long long calls,
+                         const char* appl,
+                         const sts_proto* p)
+{
+  size_t i;
+
+  if (dc->json)
+    {
+      fprintf (stdout, "\"%s\":{\"requests\":%llu", appl, p->requests);
+      fprintf (stdout, ",\"1xx\":%llu,\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,\"5xx\":%llu",
+               p->resp_1xx, p->resp_2xx, p->resp_3xx, p->resp_4xx, p->resp_5xx);
+      fprintf (stdout, ",\"errs\":%llu,\"t_errs\":%llu,\"data_in\":%llu,\"data_out\":%llu",
+               p->other_errs, p->url_timeout_errs, p->data_in, p->data_out);
+      fprintf (stdout, ",\"d_avg_ms\":%.3f,\"d_2xx_avg_ms\":%.3f",
+               avg_msec (p->appl_delay_sum, p->appl_delay_points),
+               avg_msec (p->appl_delay_2xx_sum, p->appl_delay_2xx_points));
+      for (i = 0; i < PERCENTILES_NUM; i++)
+        fprintf (stdout, ",\"d_%s_ms\":%.3f", percentile_names[i],
+                 usec_to_msec (hdr_hist_small_percentile (&p->appl_delay,
+                                                          percentiles[i])));
+      for (i = 0; i < PHASE_NUM; i++)
+        fprintf (stdout, ",\"%s_ms\":%.3f", phase_names[i],
+                 avg_msec (p->phase_sum[i], p->phase_points));
+      fprintf (stdout, "}");
+      return;
+    }
+
+  fprintf (stdout, "%llu,%llu,%llu,%llu,%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu",
+           rec->time, interval, rec->clients, calls, appl, p->requests,
+           p->resp_1xx, p->resp_2xx, p->resp_3xx, p->resp_4xx, p->resp_5xx,
+           p->other_errs, p->url_timeout_errs, p->data_in, p->data_out);
+  fprintf (stdout, ",%.3f,%.3f",
+           avg_msec (p->appl_delay_sum, p->appl_delay_points),
+           avg_msec (p->appl_delay_2xx_sum, p->appl_delay_2xx_points));
+  for (i = 0; i < PERCENTILES_NUM; i++)
+    fprintf (stdout, ",%.3f",
+             usec_to_msec (hdr_hist_small_percentile (&p->appl_delay, percentiles[i])));
+  for (i = 0; i < PHASE_NUM; i++)
+    fprintf (stdout, ",%.3f", avg_msec (p->phase_sum[i], p->phase_points));
+  fprintf (stdout, "\n");
+}
+
+static void print_json_string (const char* str)
+{
+  fputc ('"', stdout);
+  for (; *str; str++)
+    {
+      if (*str == '"' || *str == '\\')
+        fputc ('\\', stdout);
+      if ((unsigned char) *str >= ' ')
+        fputc (*str, stdout);
+    }
+  fputc ('"', stdout);
+}
+
+static void print_url (const decode_context* dc,
+                       const sts_record* rec,
+                       unsigned long long interval,
+                       unsigned int index,
+                       const sts_url* u)
+{
+  size_t i;
+
+  if (dc->json)
+    {
+      fprintf (stdout, "%s{\"url\":%u,\"name\":", index ? "," : "", index);
+      print_json_string (url_name (dc, index));
+      fprintf (stdout, ",\"ok\":%llu,\"failed\":%llu,\"timeouted\":%llu",
+               u->ok, u->failed, u->timeouted);
+      for (i = 0; i < OP_STAT_RESP_CLASSES; i++)
+        fprintf (stdout, ",\"%s\":%llu", class_names[i], u->resp_class[i]);
+      for (i = 0; i < PERCENTILES_NUM; i++)
+        fprintf (stdout, ",\"t_%s_ms\":%.3f", percentile_names[i],
+                 usec_to_msec (hdr_hist_small_percentile (&u->delay, percentiles[i])));
+      fprintf (stdout, "}");
+      return;
+    }
+
+  fprintf (stdout, "%llu,%llu,%u,\"%s\",%llu,%llu,%llu",
+           rec->time, interval, index, url_name (dc, index),
+           u->ok, u->failed, u->timeouted);
+  for (i = 0; i < OP_STAT_RESP_CLASSES; i++)
+    fprintf (stdout, ",%llu", u->resp_class[i]);
+  for (i = 0; i < PERCENTILES_NUM; i++)
+    fprintf (stdout, ",%.3f",
+             usec_to_msec (hdr_hist_small_percentile (&u->delay, percentiles[i])));
+  fprintf (stdout, "\n");
+}
+
+static int print_record (const decode_context* dc,
+                         const sts_record* rec,
+                         const sts_record* prev)
+{
+  const sts_header* h = dc->header;
+  unsigned long long interval, calls;
+  sts_record* r = 0;
+  sts_url* u = 0;
+  unsigned int i;
+
+  /* The copy is taken to make the differences */
+  if (! (r = malloc (h->record_size)))
+    {
+      fprintf (stderr, "%s - error: malloc () failed.\n", __func__);
+      return -1;
+    }
+  memcpy (r, rec, h->record_size);
+
+  if (dc->cumulative)
+    prev = 0;
+
+  interval = prev ? r->time - prev->time : r->time;
+  calls = prev ? r->call_init_count - prev->call_init_count : r->call_init_count;
+
+  proto_interval (&r->http, prev ? &prev->http : 0);
+  proto_interval (&r->https, prev ? &prev->https : 0);
+
+  for (i = 0; i < h->url_num; i++)
+    {
+      url_interval (STS_RECORD_URL (r, i), prev ? STS_RECORD_URL (prev, i) : 0);
+    }
+
+  if (dc->json)
+    {
+      fprintf (stdout, "{\"time_ms\":%llu,\"interval_ms\":%llu,\"clients\":%llu,"
+               "\"calls\":%llu,", r->time, interval, r->clients, calls);
+      print_proto (dc, r, interval, calls, "http", &r->http);
+      fprintf (stdout, ",");
+      print_proto (dc, r, interval, calls, "https", &r->https);
+      fprintf (stdout, ",\"urls\":[");
+      for (i = 0; i < h->url_num; i++)
+        {
+          print_url (dc, r, interval, i, STS_RECORD_URL (r, i));
+        }
+      fprintf (stdout, "]}\n");
+    }
+  else if (dc->urls)
+    {
+      for (i = 0; i < h->url_num; i++)
+        {
+          u = STS_RECORD_URL (r, i);
+          print_url (dc, r, interval, i, u);
+        }
+    }
+  else
+    {
+      print_proto (dc, r, interval, calls, "H/F", &r->http);
+      print_proto (dc, r, interval, calls, "H/F/S", &r->https);
+    }
+
+  free (r);
+  return 0;
+}
+
+static int header_check (const sts_header* h, size_t file_size)
+{
+  unsigned int i;
+
+  if (file_size < sizeof (sts_header) ||
+      memcmp (h->magic, STATS_STREAM_MAGIC, STATS_STREAM_MAGIC_SIZE))
+    {
+      fprintf (stderr, "%s - error: not a statistics stream file.\n", __func__);
+      return -1;
+    }
+
+  if (h->version != STATS_STREAM_VERSION ||
+      h->phase_num != PHASE_NUM ||
+      h->hist_sub_bits != HDR_HIST_SMALL_SUB_BITS ||
+      h->hist_counts_num != HDR_HIST_SMALL_COUNTS_NUM ||
+      h->record_size != sizeof (sts_record) + h->url_num * sizeof (sts_url))
+    {
+      fprintf (stderr, "%s - error: unsupported version %u of the stream.\n",
+               __func__, h->version);
+      return -1;
+    }
+
+  /* The url names are read from the header */
+  if (h->url_num > (file_size - sizeof (sts_header)) / STATS_STREAM_URL_NAME_SIZE ||
+      h->header_size < sizeof (sts_header) +
+      (size_t) h->url_num * STATS_STREAM_URL_NAME_SIZE)
+    {
+      fprintf (stderr, "%s - error: wrong number of urls %u in the stream header.\n",
+               __func__, h->url_num);
+      return -1;
+    }
+
+  if (! h->records_num ||
+      file_size < h->header_size + (size_t) h->record_size * h->records_num)
+    {
+      fprintf (stderr, "%s - error: the stream file is truncated.\n", __func__);
+      return -1;
+    }
+
+  for (i = 0; i < h->url_num; i++)
+    {
+      if (! memchr ((const char *) h + sizeof (sts_header) +
+                    i * STATS_STREAM_URL_NAME_SIZE, 0, STATS_STREAM_URL_NAME_SIZE))
+        {
+          fprintf (stderr, "%s - error: url name %u is not terminated.\n",
+                   __func__, i);
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+int main (int argc, char *argv [])
+{
+  decode_context dc;
+  struct stat st;
+  void* map = 0;
+  unsigned long long written, first, n;
+  int rget_opt = 0, fd = -1, rval = 1;
+
+  memset (&dc, 0, sizeof (dc));
+
+  while ((rget_opt = getopt (argc, argv, "cju")) != EOF)
+    {
+      switch (rget_opt)
+        {
+        case 'c':
+          dc.cumulative = 1;
+          break;
+        case 'j':
+          dc.json = 1;
+          break;
+        case 'u':
+          dc.urls = 1;
+          break;
+        default:
+          fprintf (stderr, "usage: %s [-c] [-j] [-u] <batch-name>.sts\n", argv[0]);
+          return 1;
+        }
+    }
+
+  if (optind != argc - 1)
+    {
+      fprintf (stderr, "usage: %s [-c] [-j] [-u] <batch-name>.sts\n", argv[0]);
+      return 1;
+    }
+
+  if ((fd = open (argv[optind], O_RDONLY)) == -1 || fstat (fd, &st) == -1)
+    {
+      fprintf (stderr, "%s - error: failed to open %s, errno %d.\n",
+               __func__, argv[optind], errno);
+      return 1;
+    }
+
+  if (! st.st_size ||
+      (map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+      fprintf (stderr, "%s - error: failed to map %s.\n", __func__, argv[optind]);
+      close (fd);
+      return 1;
+    }
+
+  dc.header = (const sts_header *) map;
+
+  if (header_check (dc.header, st.st_size) == -1)
+    goto cleanup;
+
+  dc.ring = (const char *) map + dc.header->header_size;
+
+  written = __atomic_load_n (&dc.header->records_written, __ATOMIC_ACQUIRE);
+  first = written > dc.header->records_num ? written - dc.header->records_num : 0;
+
+  if (! dc.json)
+    print_csv_header (&dc);
+
+  for (n = first; n < written; n++)
+    {
+      /* The oldest record of a wrapped ring is the base of the next interval */
+      if (n == first && first && ! dc.cumulative)
+        continue;
+
+      if (print_record (&dc, record_get (&dc, n), n ? record_get (&dc, n - 1) : 0) == -1)
+        goto cleanup;
+    }
+
+  rval = 0;
+
+ cleanup:
+  munmap (map, st.st_size);
+  close (fd);
+  return rval;
+}
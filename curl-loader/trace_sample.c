@@ -0,0 +1,225 @@
+/*
+*     trace_sample.c
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// must be first include
+#include "fdsetsize.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "batch.h"
+#include "client.h"
+#include "conf.h"
+#include "log_ring.h"
+#include "timer_tick.h"
+#include "trace_sample.h"
+
+/*
+  Grows the trace buffer of a client to fit the needed size, up to the max
+  size. Returns the size available.
+*/
+static size_t trace_sample_reserve (client_context* cctx, size_t needed, size_t max)
+{
+  size_t size = cctx->trace_size ? cctx->trace_size : TRACE_SAMPLE_BUF_INIT;
+  char* buf;
+
+  if (needed <= cctx->trace_size)
+    return cctx->trace_size;
+
+  while (size < needed && size < max)
+    size *= 2;
+
+  if (size > max)
+    size = max;
+
+  if (size <= cctx->trace_size || ! (buf = realloc (cctx->trace_buf, size)))
+    return cctx->trace_size;
+
+  cctx->trace_buf = buf;
+  cctx->trace_size = size;
+  return size;
+}
+
+/****************************************************************************************
+* Function name - trace_sample_printf
+*
+* Description - Formats a log record of a client into its trace buffer, when the
+*               traces are sampled, or into the log otherwise
+*
+* Input -       *cctx - pointer to the client context
+*               *fmt  - format of the record, as for printf ()
+* Return Code/Output - None
+****************************************************************************************/
+void trace_sample_printf (client_context* cctx, const char* fmt, ...)
+{
+  va_list ap;
+  size_t size;
+  int len;
+
+  va_start (ap, fmt);
+
+  if (! trace_sampling)
+    {
+      log_ring_vprintf (cctx->bctx->log_ring, cctx->file_output, fmt, ap);
+      va_end (ap);
+      return;
+    }
+
+  if (cctx->trace_truncated)
+    {
+      va_end (ap);
+      return;
+    }
+
+  size = trace_sample_reserve (cctx, cctx->trace_len + TRACE_SAMPLE_BUF_INIT,
+                               TRACE_SAMPLE_BUF_MAX);
+
+  len = vsnprintf (cctx->trace_buf + cctx->trace_len, size - cctx->trace_len, fmt, ap);
+  va_end (ap);
+
+  if (len < 0)
+    return;
+
+  if (cctx->trace_len + len >= size)
+    {
+      /* Longer than reserved, formatted once more into the grown buffer */
+      size = trace_sample_reserve (cctx, cctx->trace_len + len + 1,
+                                   TRACE_SAMPLE_BUF_MAX);
+
+      if (cctx->trace_len + len >= size)
+        {
+          /* The trace is cut at the last whole record */
+          cctx->trace_truncated = 1;
+          return;
+        }
+
+      va_start (ap, fmt);
+      (void) vsnprintf (cctx->trace_buf + cctx->trace_len, size - cctx->trace_len,
+                        fmt, ap);
+      va_end (ap);
+    }
+
+  cctx->trace_len += len;
+}
+
+/****************************************************************************************
+* Function name - trace_sample_complete
+*
+* Description - On a url fetch completion logs the trace of the client, when the
+*               fetch was slow, failed or is sampled, and empties the trace
+*
+* Input -       *cctx      - pointer to the client context
+*               failed     - whether the fetch failed
+*               *error     - description of the failure or NULL
+*               time_usec  - total time of the fetch, usec
+* Return Code/Output - None
+****************************************************************************************/
+void trace_sample_complete (client_context* cctx,
+                            int failed,
+                            const char* error,
+                            unsigned long time_usec)
+{
+  batch_context* bctx = cctx->bctx;
+  const char* reason = NULL;
+
+  if (! trace_sampling)
+    return;
+
+  /* Each fetch is counted, thus the sampling doesn't depend on the outliers */
+  const int sampled = trace_sample_rate &&
+    ! (++bctx->trace_sample_count % (unsigned long) trace_sample_rate);
+
+  if (failed)
+    reason = "failed";
+  else if (trace_sample_slow && time_usec > (unsigned long) trace_sample_slow * 1000)
+    reason = "slow";
+  else if (sampled)
+    reason = "sampled";
+
+  if (reason)
+    {
+      char head[LOG_RING_RECORD_MAX];
+      size_t head_len;
+      int len;
+
+      len = snprintf (head, sizeof (head),
+                      "%ld %ld %ld %s## TRACE %s %lu.%03lu msec%s%s%s\n",
+                      get_tick_count_cached () - bctx->start_time,
+                      cctx->cycle_num, (long) cctx->url_curr_index, cctx->client_name,
+                      reason, time_usec / 1000, time_usec % 1000,
+                      error ? ": " : "", error ? error : "",
+                      cctx->trace_truncated ? " (trace cut)" : "");
+
+      if (len < 0)
+        len = 0;
+
+      head_len = (size_t) len;
+      if (head_len >= sizeof (head))
+        {
+          /* Too long error description is cut, the record still ends a line */
+          head_len = sizeof (head) - 1;
+          head[head_len - 1] = '\n';
+        }
+
+      /*
+        The header is put in front of the trace in its buffer, thus the
+        header and the trace are logged by a single write and records of
+        other clients never come in between.
+      */
+      if (trace_sample_reserve (cctx, cctx->trace_len + head_len,
+                                TRACE_SAMPLE_BUF_MAX + sizeof (head)) >=
+          cctx->trace_len + head_len)
+        {
+          memmove (cctx->trace_buf + head_len, cctx->trace_buf, cctx->trace_len);
+          memcpy (cctx->trace_buf, head, head_len);
+
+          log_ring_write (bctx->log_ring, cctx->file_output,
+                          cctx->trace_buf, cctx->trace_len + head_len);
+        }
+      else
+        {
+          /* No memory to grow the buffer, the header is logged apart */
+          log_ring_write (bctx->log_ring, cctx->file_output, head, head_len);
+
+          if (cctx->trace_len)
+            log_ring_write (bctx->log_ring, cctx->file_output,
+                            cctx->trace_buf, cctx->trace_len);
+        }
+    }
+
+  cctx->trace_len = 0;
+  cctx->trace_truncated = 0;
+}
+
+/****************************************************************************************
+* Function name - trace_sample_release
+*
+* Description - Releases the trace buffer of a client
+*
+* Input -       *cctx - pointer to the client context
+* Return Code/Output - None
+****************************************************************************************/
+void trace_sample_release (client_context* cctx)
+{
+  free (cctx->trace_buf);
+
+  cctx->trace_buf = NULL;
+  cctx->trace_len = cctx->trace_size = 0;
+  cctx->trace_truncated = 0;
+}
@@ -0,0 +1,83 @@
+/*
+*     trace_sample.h
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef TRACE_SAMPLE_H
+#define TRACE_SAMPLE_H
+
+#include <stddef.h>
+
+/*
+  Tail-based sampling of the client traces, -j <slow-msec>[,<N>] option.
+  The records of the verbose logging of a url fetch are kept in the trace
+  buffer of the client instead of the log. On the fetch completion the trace
+  is logged, headed by a "## TRACE" record with the reason, only when the
+  fetch is slower than <slow-msec>, failed or is each <N>-th fetch of the
+  batch, and is discarded otherwise. The header and the trace are logged
+  by a single write.
+*/
+
+/* Initial size of the trace buffer of a client */
+#define TRACE_SAMPLE_BUF_INIT 1024
+
+/* Maximal size of the trace buffer of a client; longer traces are cut */
+#define TRACE_SAMPLE_BUF_MAX (64 * 1024)
+
+/* Forward declaration */
+struct client_context;
+
+/****************************************************************************************
+* Function name - trace_sample_printf
+*
+* Description - Formats a log record of a client into its trace buffer, when the
+*               traces are sampled, or into the log otherwise
+*
+* Input -       *cctx - pointer to the client context
+*               *fmt  - format of the record, as for printf ()
+* Return Code/Output - None
+****************************************************************************************/
+void trace_sample_printf (struct client_context* cctx, const char* fmt, ...)
+  __attribute__ ((format (printf, 2, 3)));
+
+/****************************************************************************************
+* Function name - trace_sample_complete
+*
+* Description - On a url fetch completion logs the trace of the client, when the
+*               fetch was slow, failed or is sampled, and empties the trace
+*
+* Input -       *cctx      - pointer to the client context
+*               failed     - whether the fetch failed
+*               *error     - description of the failure or NULL
+*               time_usec  - total time of the fetch, usec
+* Return Code/Output - None
+****************************************************************************************/
+void trace_sample_complete (struct client_context* cctx,
+                            int failed,
+                            const char* error,
+                            unsigned long time_usec);
+
+/****************************************************************************************
+* Function name - trace_sample_release
+*
+* Description - Releases the trace buffer of a client
+*
+* Input -       *cctx - pointer to the client context
+* Return Code/Output - None
+****************************************************************************************/
+void trace_sample_release (struct client_context* cctx);
+
+#endif /* TRACE_SAMPLE_H */
@@ -34,6 +34,15 @@
 
 #define URL_RESPONSE_STATUS_ERRORS_TABLE_SIZE 600
 
+/*
+  Data shared by clients of a thread via curl share objects,
+  bits of the url <share_data> mask.
+*/
+#define URL_SHARE_TLS_SESSIONS 0x1
+#define URL_SHARE_DNS 0x2
+#define URL_SHARE_CONNECTIONS 0x4
+#define URL_SHARE_MASK 0x7
+
 
 /*
   Application types of URLs.
@@ -286,6 +295,12 @@ typedef struct url_context
     */
   long fresh_connect; 
 
+    /*
+      Mask of URL_SHARE_* bits: TLS sessions, DNS cache and connections 
+      shared with other clients of the thread, when fetching the url.
+    */
+  int share_data;
+
     /*
      Maximum time to establish TCP connection with a server (including resolving).
      If zero, the global connect_timeout default is taken.